@@ -2947,6 +2947,202 @@ Point2D Rbc_Map2D(Graph *graphPtr, double x, double y, Axis2D *axesPtr) {
     return point;
 }
 
+/*
+ * Values are mapped in blocks of MAP_BLOCK_VALUES, so the logarithms
+ * for a log-scale axis can be staged on the stack.
+ */
+#define MAP_BLOCK_VALUES 256
+
+/*
+ * The mapping of one axis with every per-axis decision hoisted out of
+ * the loop.  A value maps to
+ *
+ *      ((norm * flip + flipBase) * orient + orientBase) * range + offset
+ *
+ * where norm = (value - min) * scale.  Multiplying by 1.0 or -1.0 and
+ * adding 0.0 or 1.0 is exact, so this reproduces Rbc_HMap() and
+ * Rbc_VMap() bit for bit.
+ */
+typedef struct {
+    double min, scale;         /* Normalizes a value to [0..1]. */
+    double flip, flipBase;     /* Reverses a descending axis. */
+    double orient, orientBase; /* Reverses a vertical axis. */
+    double range, offset;      /* Scales to screen coordinates. */
+    int logScale;
+} AxisTransform;
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * GetAxisTransform --
+ *
+ *      Fills in the hoisted mapping of an axis.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Axis *axisPtr
+ *      int vertical - Whether the axis runs vertically on the screen.
+ *      AxisTransform *transPtr - Receives the mapping.
+ *
+ * Results:
+ *      Returns FALSE if the axis range overflows.  Such an axis needs
+ *      the careful normalization of NormalizeAxisValue().
+ *
+ * ----------------------------------------------------------------------
+ */
+static int GetAxisTransform(Graph *graphPtr, Axis *axisPtr, int vertical, AxisTransform *transPtr) {
+    transPtr->min = axisPtr->axisRange.min;
+    transPtr->scale = axisPtr->axisRange.scale;
+    transPtr->flip = (axisPtr->descending) ? -1.0 : 1.0;
+    transPtr->flipBase = (axisPtr->descending) ? 1.0 : 0.0;
+    transPtr->orient = (vertical) ? -1.0 : 1.0;
+    transPtr->orientBase = (vertical) ? 1.0 : 0.0;
+    transPtr->range = (vertical) ? graphPtr->vRange : graphPtr->hRange;
+    transPtr->offset = (vertical) ? graphPtr->vOffset : graphPtr->hOffset;
+    transPtr->logScale = axisPtr->logScale;
+    return FINITE(axisPtr->axisRange.range);
+}
+
+static void LogValues(const double *valueArr, double *logArr, Tcl_Size nValues) {
+    Tcl_Size i;
+
+    for (i = 0; i < nValues; i++) {
+        logArr[i] = (valueArr[i] > 0.0) ? log10(valueArr[i]) : NAN;
+    }
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * MapBlock --
+ *
+ *      Maps a block of values with no branches in the loop body, so
+ *      the compiler can vectorize it.  A point is kept when both its
+ *      values and both its screen coordinates are finite.
+ *
+ * Parameters:
+ *      const AxisTransform *hPtr - Mapping of the horizontal axis.
+ *      const AxisTransform *vPtr - Mapping of the vertical axis.
+ *      const double *hArr - Values on the horizontal axis.
+ *      const double *vArr - Values on the vertical axis.
+ *      Tcl_Size nValues
+ *      Point2D *screenPts - Receives the screen coordinates.
+ *      unsigned char *keep - Receives whether each point is kept.
+ *
+ * Results:
+ *      Returns the number of points kept.
+ *
+ * ----------------------------------------------------------------------
+ */
+static Tcl_Size MapBlock(const AxisTransform *hPtr, const AxisTransform *vPtr, const double *hArr, const double *vArr,
+                         Tcl_Size nValues, Point2D *screenPts, unsigned char *keep) {
+    double hMin = hPtr->min, hScale = hPtr->scale, hFlip = hPtr->flip, hFlipBase = hPtr->flipBase;
+    double hOrient = hPtr->orient, hOrientBase = hPtr->orientBase, hRange = hPtr->range, hOffset = hPtr->offset;
+    double vMin = vPtr->min, vScale = vPtr->scale, vFlip = vPtr->flip, vFlipBase = vPtr->flipBase;
+    double vOrient = vPtr->orient, vOrientBase = vPtr->orientBase, vRange = vPtr->range, vOffset = vPtr->offset;
+    Tcl_Size count;
+    Tcl_Size i;
+
+    count = 0;
+    for (i = 0; i < nValues; i++) {
+        double sx, sy;
+        int kept;
+
+        sx = ((((hArr[i] - hMin) * hScale) * hFlip + hFlipBase) * hOrient + hOrientBase) * hRange + hOffset;
+        sy = ((((vArr[i] - vMin) * vScale) * vFlip + vFlipBase) * vOrient + vOrientBase) * vRange + vOffset;
+        kept = (fabs(hArr[i]) <= DBL_MAX) & (fabs(vArr[i]) <= DBL_MAX) & (fabs(sx) <= DBL_MAX) & (fabs(sy) <= DBL_MAX);
+        screenPts[i].x = sx;
+        screenPts[i].y = sy;
+        keep[i] = (unsigned char)kept;
+        count += kept;
+    }
+    return count;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * Rbc_MapArray2D --
+ *
+ *      Maps arrays of graph x,y coordinate values to window positions.
+ *      This gives the same coordinates as calling Rbc_Map2D() on each
+ *      point, but decides the scale, inversion and orientation of
+ *      the axes once for the whole array.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Axis2D *axesPtr - Specifies which axes to use
+ *      const double *x - Graph x coordinates
+ *      const double *y - Graph y coordinates
+ *      Tcl_Size nPoints
+ *      Point2D *screenPts - Receives the window coordinates
+ *      unsigned char *keep - Receives TRUE for each point with kept
+ *                            data and window coordinates.
+ *
+ * Results:
+ *      Returns the number of points kept.  The window coordinates of
+ *      points not kept are undefined.
+ *
+ * ----------------------------------------------------------------------
+ */
+Tcl_Size Rbc_MapArray2D(Graph *graphPtr, Axis2D *axesPtr, const double *x, const double *y, Tcl_Size nPoints,
+                        Point2D *screenPts, unsigned char *keep) {
+    AxisTransform h, v;
+    const double *hArr, *vArr;
+    double hStage[MAP_BLOCK_VALUES], vStage[MAP_BLOCK_VALUES];
+    Tcl_Size count;
+    Tcl_Size start;
+    int linear;
+
+    if (graphPtr->inverted) {
+        linear = GetAxisTransform(graphPtr, axesPtr->y, FALSE, &h);
+        linear &= GetAxisTransform(graphPtr, axesPtr->x, TRUE, &v);
+        hArr = y, vArr = x;
+    } else {
+        linear = GetAxisTransform(graphPtr, axesPtr->x, FALSE, &h);
+        linear &= GetAxisTransform(graphPtr, axesPtr->y, TRUE, &v);
+        hArr = x, vArr = y;
+    }
+    count = 0;
+    if (!linear) {
+        Tcl_Size i;
+
+        for (i = 0; i < nPoints; i++) {
+            Point2D point;
+            int kept;
+
+            point = Rbc_Map2D(graphPtr, x[i], y[i], axesPtr);
+            kept = FINITE(x[i]) && FINITE(y[i]) && FINITE(point.x) && FINITE(point.y);
+            screenPts[i] = point;
+            keep[i] = (unsigned char)kept;
+            count += kept;
+        }
+        return count;
+    }
+    for (start = 0; start < nPoints; start += MAP_BLOCK_VALUES) {
+        const double *hBlock, *vBlock;
+        Tcl_Size nValues;
+
+        nValues = MIN(nPoints - start, MAP_BLOCK_VALUES);
+        hBlock = hArr + start;
+        vBlock = vArr + start;
+        /*
+         * The logarithm of a non-kept or non-positive value is not
+         * kept, so those points are still dropped by MapBlock().
+         */
+        if (h.logScale) {
+            LogValues(hBlock, hStage, nValues);
+            hBlock = hStage;
+        }
+        if (v.logScale) {
+            LogValues(vBlock, vStage, nValues);
+            vBlock = vStage;
+        }
+        count += MapBlock(&h, &v, hBlock, vBlock, nValues, screenPts + start, keep + start);
+    }
+    return count;
+}
+
 /*
  * ----------------------------------------------------------------------
  *
@@ -173,6 +173,7 @@ _Static_assert(offsetof(Bar, core) == 0, "Element core must be the first Bar mem
 #define BAR_ELEM_STYLES_MASK (1 << 5)
 #define BAR_ELEM_BUILTIN_PEN_MASK (1 << 6)
 #define BAR_ELEM_MAP_ITEM_MASK (1 << 7)
+#define BAR_ELEM_MAP_STYLE_MASK (1 << 8)
 
 static const Tk_OptionSpec barElemOptionSpecs[] = {
     {TK_OPTION_STRING, "-activepen", "activePen", "ActivePen", DEF_BAR_ACTIVE_PEN, BAR_CORE_OFFSET(activePenObjPtr), -1,
@@ -192,7 +193,7 @@ static const Tk_OptionSpec barElemOptionSpecs[] = {
     {TK_OPTION_PIXELS, "-errorbarwidth", "errorBarWidth", "ErrorBarWidth", DEF_BAR_ERRORBAR_LINE_WIDTH,
      BAR_BUILTIN_PEN_OFFSET(errorBarWidthObjPtr), -1, 0, NULL, BAR_ELEM_BUILTIN_PEN_MASK},
     {TK_OPTION_PIXELS, "-errorbarcap", "errorBarCap", "ErrorBarCap", DEF_BAR_ERRORBAR_CAP_WIDTH,
-     BAR_BUILTIN_PEN_OFFSET(errorBarCapObjPtr), -1, 0, NULL, BAR_ELEM_BUILTIN_PEN_MASK | BAR_ELEM_MAP_ITEM_MASK},
+     BAR_BUILTIN_PEN_OFFSET(errorBarCapObjPtr), -1, 0, NULL, BAR_ELEM_BUILTIN_PEN_MASK | BAR_ELEM_MAP_STYLE_MASK},
     {TK_OPTION_STRING, "-data", "data", "Data", NULL, BAR_CORE_OFFSET(dataObjPtr), -1, TK_OPTION_NULL_OK, NULL,
      BAR_ELEM_DATA_MASK | BAR_ELEM_MAP_ITEM_MASK},
     {TK_OPTION_SYNONYM, "-fg", NULL, NULL, NULL, -1, -1, 0, "-foreground", 0},
@@ -209,7 +210,7 @@ static const Tk_OptionSpec barElemOptionSpecs[] = {
     {TK_OPTION_STRING, "-mapy", "mapY", "MapY", DEF_BAR_AXIS_Y, BAR_CORE_OFFSET(mapYObjPtr), -1, 0, NULL,
      BAR_ELEM_AXES_MASK | BAR_ELEM_MAP_ITEM_MASK},
     {TK_OPTION_STRING, "-pen", "pen", "Pen", NULL, BAR_CORE_OFFSET(normalPenObjPtr), -1, TK_OPTION_NULL_OK, NULL,
-     BAR_ELEM_PEN_MASK | BAR_ELEM_MAP_ITEM_MASK},
+     BAR_ELEM_PEN_MASK | BAR_ELEM_MAP_STYLE_MASK},
     {TK_OPTION_RELIEF, "-relief", "relief", "Relief", DEF_BAR_RELIEF, -1, BAR_BUILTIN_PEN_OFFSET(relief), 0, NULL,
      BAR_ELEM_BUILTIN_PEN_MASK},
     {TK_OPTION_STRING, "-showerrorbars", "showErrorBars", "ShowErrorBars", DEF_BAR_SHOW_ERRORBARS,
@@ -221,7 +222,7 @@ static const Tk_OptionSpec barElemOptionSpecs[] = {
     {TK_OPTION_BITMAP, "-stipple", "stipple", "Stipple", DEF_BAR_NORMAL_STIPPLE, -1, BAR_BUILTIN_PEN_OFFSET(stipple),
      TK_OPTION_NULL_OK, NULL, BAR_ELEM_BUILTIN_PEN_MASK},
     {TK_OPTION_STRING, "-styles", "styles", "Styles", DEF_BAR_STYLES, BAR_CORE_OFFSET(stylesObjPtr), -1,
-     TK_OPTION_NULL_OK, NULL, BAR_ELEM_STYLES_MASK | BAR_ELEM_MAP_ITEM_MASK},
+     TK_OPTION_NULL_OK, NULL, BAR_ELEM_STYLES_MASK | BAR_ELEM_MAP_STYLE_MASK},
     {TK_OPTION_ANCHOR, "-valueanchor", "valueAnchor", "ValueAnchor", DEF_PEN_VALUE_ANCHOR, -1,
      BAR_BUILTIN_PEN_OFFSET(valueStyle.anchor), 0, NULL, BAR_ELEM_BUILTIN_PEN_MASK},
     {TK_OPTION_COLOR, "-valuecolor", "valueColor", "ValueColor", DEF_PEN_VALUE_COLOR, -1,
@@ -235,7 +236,7 @@ static const Tk_OptionSpec barElemOptionSpecs[] = {
     {TK_OPTION_STRING, "-valueshadow", "valueShadow", "ValueShadow", DEF_PEN_VALUE_SHADOW,
      BAR_BUILTIN_PEN_OFFSET(valueShadowObjPtr), -1, TK_OPTION_NULL_OK, NULL, BAR_ELEM_BUILTIN_PEN_MASK},
     {TK_OPTION_STRING, "-weights", "weights", "Weights", NULL, BAR_CORE_OFFSET(weightsObjPtr), -1, TK_OPTION_NULL_OK,
-     NULL, BAR_ELEM_DATA_MASK | BAR_ELEM_MAP_ITEM_MASK},
+     NULL, BAR_ELEM_DATA_MASK | BAR_ELEM_MAP_STYLE_MASK},
     {TK_OPTION_STRING, "-x", "xdata", "Xdata", DEF_BAR_DATA, BAR_CORE_OFFSET(xObjPtr), -1, TK_OPTION_NULL_OK, NULL,
      BAR_ELEM_DATA_MASK | BAR_ELEM_MAP_ITEM_MASK},
     {TK_OPTION_SYNONYM, "-xdata", NULL, NULL, NULL, -1, -1, 0, "-x", 0},
@@ -479,9 +480,11 @@ static int Round(register double x);
 static void ClearPalette(Rbc_Chain *palette);
 static void InitPen(BarPen *penPtr, const Tk_OptionSpec *optionSpecs, unsigned int flags);
 static void CheckStacks(Graph *graphPtr, Axis2D *pairPtr, double *minPtr, double *maxPtr);
-static void MergePens(Bar *barPtr, PenStyle **dataToStyle);
+static void MergePens(Bar *barPtr, StyleMap *mapPtr);
 static void MapActiveBars(Bar *barPtr);
+static void ResetBarStyles(Bar *barPtr);
 static void ResetBar(Bar *barPtr);
+static void MapBarStyles(Graph *graphPtr, Bar *barPtr);
 
 static void DrawBarSegments(Graph *graphPtr, Drawable drawable, BarPen *penPtr, BarRectangle *rectangles,
                             Tcl_Size nRects);
@@ -1191,6 +1194,10 @@ static int ConfigureBar(Graph *graphPtr, Element *elemPtr) {
         Rbc_SyncElemDataOptionObjects(elemPtr);
     }
 
+    if (elemPtr->optionMask & BAR_ELEM_MAP_STYLE_MASK) {
+        elemPtr->flags |= MAP_STYLE;
+    }
+
     if ((!elemPtr->optionsConfigured) || (elemPtr->optionMask & BAR_ELEM_MAP_ITEM_MASK)) {
         elemPtr->flags |= MAP_ITEM;
     }
@@ -1368,10 +1375,12 @@ static void ClosestBar(Graph *graphPtr, Element *elemPtr, ClosestSearch *searchP
  * MergePens --
  *
  *      Reorders the both arrays of points and errorbars to merge pens.
+ *      The bars and error bars of each style keep their order.
  *
  * Parameters:
  *      Bar *barPtr
- *      PenStyle **dataToStyle
+ *      StyleMap *mapPtr - Style of each data point, or NULL if the
+ *                         element has a single style
  *
  * Results:
  *      None.
@@ -1382,9 +1391,12 @@ static void ClosestBar(Graph *graphPtr, Element *elemPtr, ClosestSearch *searchP
  *
  *----------------------------------------------------------------------
  */
-static void MergePens(Bar *barPtr, PenStyle **dataToStyle) {
+static void MergePens(Bar *barPtr, StyleMap *mapPtr) {
     BarPenStyle *stylePtr;
     Rbc_ChainLink *linkPtr;
+    Tcl_Size *counts;
+    Tcl_Size i;
+    int k;
     size_t rectanglesBytes = 0;
     size_t rectToDataBytes = 0;
     size_t xErrorBarsBytes = 0;
@@ -1425,30 +1437,27 @@ static void MergePens(Bar *barPtr, PenStyle **dataToStyle) {
     }
     /* We have more than one style. Group bar segments of like pen
      * styles together.  */
+    counts = ckalloc(mapPtr->nStyles * sizeof(*counts));
     if (barPtr->nRects > 0) {
         BarRectangle *rectangles;
-        BarRectangle *rectPtr;
         Tcl_Size *rectToData;
-        Tcl_Size *indexPtr;
-        Tcl_Size dataIndex;
-        Tcl_Size i;
+        Tcl_Size *order;
 
         rectangles = ckalloc(rectanglesBytes);
         rectToData = ckalloc(rectToDataBytes);
-        rectPtr = rectangles;
-        indexPtr = rectToData;
-        for (linkPtr = Rbc_ChainFirstLink(barPtr->core.palette); linkPtr != NULL;
-             linkPtr = Rbc_ChainNextLink(linkPtr)) {
+        order = Rbc_StyleMapOrder(mapPtr, barPtr->rectToData, barPtr->nRects, counts);
+        for (i = 0; i < barPtr->nRects; i++) {
+            rectangles[i] = barPtr->rectangles[order[i]];
+            rectToData[i] = barPtr->rectToData[order[i]];
+        }
+        ckfree(order);
+        i = 0;
+        for (k = 0, linkPtr = Rbc_ChainFirstLink(barPtr->core.palette); linkPtr != NULL;
+             k++, linkPtr = Rbc_ChainNextLink(linkPtr)) {
             stylePtr = Rbc_ChainGetValue(linkPtr);
-            stylePtr->rectangles = rectPtr;
-            for (i = 0; i < barPtr->nRects; i++) {
-                dataIndex = barPtr->rectToData[i];
-                if (dataToStyle[dataIndex] == (PenStyle *)stylePtr) {
-                    *rectPtr++ = barPtr->rectangles[i];
-                    *indexPtr++ = dataIndex;
-                }
-            }
-            stylePtr->nRects = (Tcl_Size)(rectPtr - stylePtr->rectangles);
+            stylePtr->rectangles = rectangles + i;
+            stylePtr->nRects = counts[k];
+            i += counts[k];
         }
         ckfree(barPtr->rectangles);
         barPtr->rectangles = rectangles;
@@ -1457,28 +1466,24 @@ static void MergePens(Bar *barPtr, PenStyle **dataToStyle) {
     }
     if (barPtr->core.xErrorBarCnt > 0) {
         Segment2D *errorBars;
-        Segment2D *segPtr;
         Tcl_Size *errorToData;
-        Tcl_Size *indexPtr;
-        Tcl_Size dataIndex;
-        Tcl_Size i;
+        Tcl_Size *order;
 
         errorBars = ckalloc(xErrorBarsBytes);
         errorToData = ckalloc(xErrorToDataBytes);
-        segPtr = errorBars;
-        indexPtr = errorToData;
-        for (linkPtr = Rbc_ChainFirstLink(barPtr->core.palette); linkPtr != NULL;
-             linkPtr = Rbc_ChainNextLink(linkPtr)) {
+        order = Rbc_StyleMapOrder(mapPtr, barPtr->core.xErrorToData, barPtr->core.xErrorBarCnt, counts);
+        for (i = 0; i < barPtr->core.xErrorBarCnt; i++) {
+            errorBars[i] = barPtr->core.xErrorBars[order[i]];
+            errorToData[i] = barPtr->core.xErrorToData[order[i]];
+        }
+        ckfree(order);
+        i = 0;
+        for (k = 0, linkPtr = Rbc_ChainFirstLink(barPtr->core.palette); linkPtr != NULL;
+             k++, linkPtr = Rbc_ChainNextLink(linkPtr)) {
             stylePtr = Rbc_ChainGetValue(linkPtr);
-            stylePtr->xErrorBars = segPtr;
-            for (i = 0; i < barPtr->core.xErrorBarCnt; i++) {
-                dataIndex = barPtr->core.xErrorToData[i];
-                if (dataToStyle[dataIndex] == (PenStyle *)stylePtr) {
-                    *segPtr++ = barPtr->core.xErrorBars[i];
-                    *indexPtr++ = dataIndex;
-                }
-            }
-            stylePtr->xErrorBarCnt = (Tcl_Size)(segPtr - stylePtr->xErrorBars);
+            stylePtr->xErrorBars = errorBars + i;
+            stylePtr->xErrorBarCnt = counts[k];
+            i += counts[k];
         }
         ckfree(barPtr->core.xErrorBars);
         barPtr->core.xErrorBars = errorBars;
@@ -1487,34 +1492,31 @@ static void MergePens(Bar *barPtr, PenStyle **dataToStyle) {
     }
     if (barPtr->core.yErrorBarCnt > 0) {
         Segment2D *errorBars;
-        Segment2D *segPtr;
         Tcl_Size *errorToData;
-        Tcl_Size *indexPtr;
-        Tcl_Size dataIndex;
-        Tcl_Size i;
+        Tcl_Size *order;
 
         errorBars = ckalloc(yErrorBarsBytes);
         errorToData = ckalloc(yErrorToDataBytes);
-        segPtr = errorBars;
-        indexPtr = errorToData;
-        for (linkPtr = Rbc_ChainFirstLink(barPtr->core.palette); linkPtr != NULL;
-             linkPtr = Rbc_ChainNextLink(linkPtr)) {
+        order = Rbc_StyleMapOrder(mapPtr, barPtr->core.yErrorToData, barPtr->core.yErrorBarCnt, counts);
+        for (i = 0; i < barPtr->core.yErrorBarCnt; i++) {
+            errorBars[i] = barPtr->core.yErrorBars[order[i]];
+            errorToData[i] = barPtr->core.yErrorToData[order[i]];
+        }
+        ckfree(order);
+        i = 0;
+        for (k = 0, linkPtr = Rbc_ChainFirstLink(barPtr->core.palette); linkPtr != NULL;
+             k++, linkPtr = Rbc_ChainNextLink(linkPtr)) {
             stylePtr = Rbc_ChainGetValue(linkPtr);
-            stylePtr->yErrorBars = segPtr;
-            for (i = 0; i < barPtr->core.yErrorBarCnt; i++) {
-                dataIndex = barPtr->core.yErrorToData[i];
-                if (dataToStyle[dataIndex] == (PenStyle *)stylePtr) {
-                    *segPtr++ = barPtr->core.yErrorBars[i];
-                    *indexPtr++ = dataIndex;
-                }
-            }
-            stylePtr->yErrorBarCnt = (Tcl_Size)(segPtr - stylePtr->yErrorBars);
+            stylePtr->yErrorBars = errorBars + i;
+            stylePtr->yErrorBarCnt = counts[k];
+            i += counts[k];
         }
         ckfree(barPtr->core.yErrorBars);
         barPtr->core.yErrorBars = errorBars;
         ckfree(barPtr->core.yErrorToData);
         barPtr->core.yErrorToData = errorToData;
     }
+    ckfree(counts);
 }
 
 /*
@@ -1611,13 +1613,48 @@ static void MapActiveBars(Bar *barPtr) {
  */
 static void ResetBar(Bar *barPtr) {
     /* Release any storage associated with the display of the bar */
-    ClearPalette(barPtr->core.palette);
+    ResetBarStyles(barPtr);
     if (barPtr->activeRects != NULL) {
         ckfree((char *)barPtr->activeRects);
     }
     if (barPtr->activeToData != NULL) {
         ckfree((char *)barPtr->activeToData);
     }
+    if (barPtr->rectangles != NULL) {
+        ckfree((char *)barPtr->rectangles);
+    }
+    if (barPtr->rectToData != NULL) {
+        ckfree((char *)barPtr->rectToData);
+    }
+    barPtr->activeToData = NULL;
+    barPtr->rectToData = NULL;
+    barPtr->activeRects = barPtr->rectangles = NULL;
+    barPtr->nActive = 0;
+    barPtr->nRects = 0;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * ResetBarStyles --
+ *
+ *      Releases the per-style slices of the bar rectangles and the
+ *      error bars, whose caps are sized by the styles.  The
+ *      rectangles themselves are kept.
+ *
+ * Parameters:
+ *      Bar *barPtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      The error bar arrays are freed.
+ *
+ * ----------------------------------------------------------------------
+ */
+static void ResetBarStyles(Bar *barPtr) {
+    ClearPalette(barPtr->core.palette);
     if (barPtr->core.xErrorBars != NULL) {
         ckfree((char *)barPtr->core.xErrorBars);
     }
@@ -1630,20 +1667,9 @@ static void ResetBar(Bar *barPtr) {
     if (barPtr->core.yErrorToData != NULL) {
         ckfree((char *)barPtr->core.yErrorToData);
     }
-    if (barPtr->rectangles != NULL) {
-        ckfree((char *)barPtr->rectangles);
-    }
-    if (barPtr->rectToData != NULL) {
-        ckfree((char *)barPtr->rectToData);
-    }
-    barPtr->activeToData = NULL;
-    barPtr->rectToData = NULL;
     barPtr->core.xErrorToData = NULL;
     barPtr->core.yErrorToData = NULL;
-    barPtr->activeRects = barPtr->rectangles = NULL;
     barPtr->core.xErrorBars = barPtr->core.yErrorBars = NULL;
-    barPtr->nActive = 0;
-    barPtr->nRects = 0;
     barPtr->core.xErrorBarCnt = 0;
     barPtr->core.yErrorBarCnt = 0;
 }
@@ -1665,6 +1691,9 @@ static void ResetBar(Bar *barPtr) {
  *      coordinates.  Otherwise, the range will represent the number
  *      of values.
  *
+ *      If only the pen styles of the bar changed, the rectangles are
+ *      kept and only regrouped by style.
+ *
  * Parameters:
  *      Graph *graphPtr
  *      Element *elemPtr
@@ -1680,7 +1709,6 @@ static void ResetBar(Bar *barPtr) {
 static void MapBar(Graph *graphPtr, Element *elemPtr) {
     Bar *barPtr = BAR_FROM_CORE(elemPtr);
     FreqKey key;
-    PenStyle **dataToStyle;
     Point2D c1, c2; /* Two opposite corners of the rectangle
                      * in graph coordinates. */
     const double *x;
@@ -1689,44 +1717,103 @@ static void MapBar(Graph *graphPtr, Element *elemPtr) {
     double baseline;
     double dx, dy;
     Tcl_Size *rectToData; /* Maps rectangles to data point indices */
+    double *cornerX;      /* Graph coordinates of both corners of */
+    double *cornerY;      /* each bar, before mapping. */
+    Point2D *cornerPts;   /* Window coordinates of the corners. */
+    unsigned char *keep;
+    unsigned char *inverted;
     int height;
     int invertBar;
     Tcl_Size nPoints;
+    Tcl_Size first, last;
+    Tcl_Size nBars;
     Tcl_Size count;
     BarRectangle *rectPtr;
     BarRectangle *rectangles;
     Tcl_Size i;
-    int size;
-    Rbc_ChainLink *linkPtr;
-    BarPenStyle *stylePtr;
     size_t rectanglesBytes;
     size_t rectToDataBytes;
+    size_t cornerBytes;
+    size_t cornerPtsBytes;
+    size_t keepBytes;
 
+    if (!(elemPtr->flags & MAP_ITEM)) {
+        ResetBarStyles(barPtr);
+        MapBarStyles(graphPtr, barPtr);
+        return;
+    }
     ResetBar(barPtr);
     nPoints = NumberOfPoints(elemPtr);
     if (nPoints < 1) {
         return; /* No data points */
     }
-    if ((GetBarArrayByteCount(nPoints, sizeof(*rectangles), &rectanglesBytes) != TCL_OK) ||
-        (GetBarArrayByteCount(nPoints, sizeof(*rectToData), &rectToDataBytes) != TCL_OK)) {
-        return;
-    }
     barWidth = graphPtr->barWidth;
     if (barPtr->barWidth > 0.0) {
         barWidth = barPtr->barWidth;
     }
+    /*
+     * Bars more than a bar width outside the x-axis limits are
+     * skipped.  If the x values are ordered, don't even look at them.
+     */
+    if ((barPtr->core.axes.x->logScale) || (!Rbc_GetElemVisibleRange(elemPtr, barWidth, &first, &last))) {
+        first = 0;
+        last = nPoints - 1;
+    }
+    nPoints = last - first + 1;
+    if ((GetBarArrayByteCount(nPoints, sizeof(*rectangles), &rectanglesBytes) != TCL_OK) ||
+        (GetBarArrayByteCount(nPoints, sizeof(*rectToData), &rectToDataBytes) != TCL_OK) ||
+        (GetBarArrayByteCount(nPoints, 2 * sizeof(*cornerX), &cornerBytes) != TCL_OK) ||
+        (GetBarArrayByteCount(nPoints, 2 * sizeof(*cornerPts), &cornerPtsBytes) != TCL_OK) ||
+        (GetBarArrayByteCount(nPoints, 2 * sizeof(*keep), &keepBytes) != TCL_OK)) {
+        return;
+    }
     baseline = (barPtr->core.axes.y->logScale) ? 1.0 : graphPtr->baseline;
     barOffset = barWidth * 0.5;
     /*
      * Create an array of rectangles representing the screen coordinates
      * of all the segments in the bar.
      */
-    rectangles = ckalloc(rectanglesBytes);
-    rectToData = ckalloc(rectToDataBytes);
-    rectPtr = rectangles;
+    rectangles = Tcl_AttemptAlloc(rectanglesBytes);
+    rectToData = Tcl_AttemptAlloc(rectToDataBytes);
+    cornerX = Tcl_AttemptAlloc(cornerBytes);
+    cornerY = Tcl_AttemptAlloc(cornerBytes);
+    cornerPts = Tcl_AttemptAlloc(cornerPtsBytes);
+    keep = Tcl_AttemptAlloc(keepBytes);
+    inverted = Tcl_AttemptAlloc((size_t)nPoints * sizeof(*inverted));
+    if ((rectangles == NULL) || (rectToData == NULL) || (cornerX == NULL) || (cornerY == NULL) ||
+        (cornerPts == NULL) || (keep == NULL) || (inverted == NULL)) {
+        /* The element isn't drawn rather than the application aborted. */
+        if (rectangles != NULL) {
+            ckfree(rectangles);
+        }
+        if (rectToData != NULL) {
+            ckfree(rectToData);
+        }
+        if (cornerX != NULL) {
+            ckfree(cornerX);
+        }
+        if (cornerY != NULL) {
+            ckfree(cornerY);
+        }
+        if (cornerPts != NULL) {
+            ckfree(cornerPts);
+        }
+        if (keep != NULL) {
+            ckfree(keep);
+        }
+        if (inverted != NULL) {
+            ckfree(inverted);
+        }
+        return;
+    }
     x = barPtr->core.x.valueArr, y = barPtr->core.y.valueArr;
-    count = 0;
-    for (i = 0; i < nPoints; i++) {
+    /*
+     * First collect the corners of every bar in graph coordinates.
+     * Stacking makes each bar depend on the ones before it, so this
+     * pass stays sequential.  The corners are then mapped in one batch.
+     */
+    nBars = 0;
+    for (i = first; i <= last; i++) {
         if ((!FINITE(x[i])) || (!FINITE(y[i]))) {
             continue;
         }
@@ -1816,19 +1903,34 @@ static void MapBar(Graph *graphPtr, Element *elemPtr) {
             temp = c1.y, c1.y = c2.y, c2.y = temp;
             invertBar = TRUE;
         }
-        /*
-         * Get the two corners of the bar segment and compute the rectangle
-         */
-        c1 = Rbc_Map2D(graphPtr, c1.x, c1.y, &barPtr->core.axes);
-        c2 = Rbc_Map2D(graphPtr, c2.x, c2.y, &barPtr->core.axes);
+        cornerX[2 * nBars] = c1.x;
+        cornerY[2 * nBars] = c1.y;
+        cornerX[2 * nBars + 1] = c2.x;
+        cornerY[2 * nBars + 1] = c2.y;
+        inverted[nBars] = (unsigned char)invertBar;
+        rectToData[nBars] = i;
+        nBars++;
+    }
+    Rbc_MapArray2D(graphPtr, &barPtr->core.axes, cornerX, cornerY, 2 * nBars, cornerPts, keep);
+    ckfree(cornerX);
+    ckfree(cornerY);
+    /*
+     * Get the two corners of each bar segment and compute the rectangle.
+     */
+    rectPtr = rectangles;
+    count = 0;
+    for (i = 0; i < nBars; i++) {
         /*
          * Mapping should normally produce finite screen coordinates.
          * Ignore a bar if arithmetic overflow or an invalid transform did
          * not.
          */
-        if ((!FINITE(c1.x)) || (!FINITE(c1.y)) || (!FINITE(c2.x)) || (!FINITE(c2.y))) {
+        if ((!keep[2 * i]) || (!keep[2 * i + 1])) {
             continue;
         }
+        c1 = cornerPts[2 * i];
+        c2 = cornerPts[2 * i + 1];
+        invertBar = inverted[i];
         /*
          * Bound horizontal coordinates by the graph window before converting
          * them to int, just as the vertical coordinates are bounded below.
@@ -1870,21 +1972,57 @@ static void MapBar(Graph *graphPtr, Element *elemPtr) {
         if (rectPtr->height < 1) {
             rectPtr->height = 1;
         }
-        rectToData[count] = i; /* Save the data index corresponding to the
-                                * rectangle */
+        rectToData[count] = rectToData[i]; /* Save the data index corresponding
+                                            * to the rectangle */
         rectPtr++;
         count++;
     }
+    ckfree(cornerPts);
+    ckfree(keep);
+    ckfree(inverted);
     barPtr->nRects = count;
     barPtr->rectangles = rectangles;
     barPtr->rectToData = rectToData;
     if (barPtr->core.nActiveIndices > 0) {
         MapActiveBars(barPtr);
     }
+    MapBarStyles(graphPtr, barPtr);
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * MapBarStyles --
+ *
+ *      Sizes the symbols of each pen style, assigns the bars to their
+ *      styles, maps the error bars and groups the rectangles by
+ *      style.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Bar *barPtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      The rectangles are reordered by style.
+ *
+ * ----------------------------------------------------------------------
+ */
+static void MapBarStyles(Graph *graphPtr, Bar *barPtr) {
+    StyleMap *mapPtr;
+    Rbc_ChainLink *linkPtr;
+    BarPenStyle *stylePtr;
+    int size;
+    int errorBars;
 
+    if (NumberOfPoints(&barPtr->core) < 1) {
+        return;
+    }
     size = 20;
-    if (count > 0) {
-        size = rectangles->width;
+    if (barPtr->nRects > 0) {
+        size = barPtr->rectangles->width;
     }
     /* Set the symbol size of all the pen styles. */
     for (linkPtr = Rbc_ChainFirstLink(barPtr->core.palette); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
@@ -1894,14 +2032,19 @@ static void MapBar(Graph *graphPtr, Element *elemPtr) {
             (stylePtr->penPtr->errorBarCapWidth > 0) ? stylePtr->penPtr->errorBarCapWidth : (int)(size * 0.6666666);
         stylePtr->errorBarCapWidth /= 2;
     }
-    dataToStyle = Rbc_StyleMap(&barPtr->core);
-    if (((barPtr->core.yHigh.nValues > 0) && (barPtr->core.yLow.nValues > 0)) ||
-        ((barPtr->core.xHigh.nValues > 0) && (barPtr->core.xLow.nValues > 0)) || (barPtr->core.xError.nValues > 0) ||
-        (barPtr->core.yError.nValues > 0)) {
-        Rbc_MapErrorBars(graphPtr, &barPtr->core, dataToStyle);
+    errorBars = (((barPtr->core.yHigh.nValues > 0) && (barPtr->core.yLow.nValues > 0)) ||
+                 ((barPtr->core.xHigh.nValues > 0) && (barPtr->core.xLow.nValues > 0)) ||
+                 (barPtr->core.xError.nValues > 0) || (barPtr->core.yError.nValues > 0));
+    if ((Rbc_ChainGetLength(barPtr->core.palette) < 2) && (!errorBars)) {
+        /* Every point has the normal style, so no style map is needed. */
+        MergePens(barPtr, NULL);
+        return;
+    }
+    mapPtr = Rbc_StyleMap(&barPtr->core);
+    if (errorBars) {
+        Rbc_MapErrorBars(graphPtr, &barPtr->core, mapPtr);
     }
-    MergePens(barPtr, dataToStyle);
-    ckfree((char *)dataToStyle);
+    MergePens(barPtr, mapPtr);
 }
 
 /*
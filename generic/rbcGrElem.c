@@ -35,6 +35,45 @@ static int ConfigureElementOptions(Graph *graphPtr, Element *elemPtr, Tcl_Size o
                                    int *maskPtr);
 static void ReleaseElementResources(Graph *graphPtr, Element *elemPtr);
 
+/*
+ * Elements are mapped on several threads only when there is enough work
+ * to pay for starting them.
+ */
+#define MAP_PARALLEL_MIN_POINTS (1 << 18)
+#define MAP_MAX_THREADS 16
+
+/*
+ * MapQueue --
+ *
+ *      Elements waiting to be mapped.  Each thread repeatedly takes
+ *      the next element until the queue is empty.
+ */
+typedef struct {
+    Graph *graphPtr;
+    Element **elements; /* Elements to map, largest first. */
+    Tcl_Size nElements;
+    Tcl_Size next; /* Index of the next element to map. */
+    Tcl_Mutex mutex; /* Protects next. */
+} MapQueue;
+
+static int CompareElementSizes(const void *a, const void *b);
+static void MapQueuedElements(MapQueue *queuePtr);
+static Tcl_ThreadCreateType MapElementsThread(ClientData clientData);
+static void MapElementsInParallel(Graph *graphPtr, Tcl_Size nElements);
+
+/*
+ * Sign bit of a double, as an unsigned integer of the same size.
+ */
+#define WEIGHT_KEY_SIGN ((Tcl_WideUInt)1 << 63)
+
+static int WeightInStyle(const PenStyle *stylePtr, double w);
+static Tcl_WideUInt DoubleToKey(double d);
+static double KeyToDouble(Tcl_WideUInt key);
+static double GetStyleEdge(const PenStyle *stylePtr, double in, double out);
+static int CompareWeights(const void *a, const void *b);
+static StyleInterval *GetStyleIntervals(const StyleMap *mapPtr, int *nIntervalsPtr);
+static int GetWeightStyle(const StyleMap *mapPtr, double w);
+
 typedef int RbcGrElementOp(Graph *graphPtr, Tcl_Interp *interp, Rbc_Uid type, Tcl_Size objc, Tcl_Obj *const objv[]);
 
 typedef struct {
@@ -48,6 +87,7 @@ static RbcGrElementOp ConfigureOp;
 static RbcGrElementOp DeactivateOp;
 static RbcGrElementOp DeleteOp;
 static RbcGrElementOp ExistsOp;
+static RbcGrElementOp FindOp;
 static RbcGrElementOp GetOp;
 static RbcGrElementOp NamesOp;
 static RbcGrElementOp ShowOp;
@@ -64,7 +104,9 @@ typedef enum {
     ELEM_DATA_OPTION_X_LOW,
     ELEM_DATA_OPTION_Y_ERROR,
     ELEM_DATA_OPTION_Y_HIGH,
-    ELEM_DATA_OPTION_Y_LOW
+    ELEM_DATA_OPTION_Y_LOW,
+    ELEM_DATA_OPTION_COLORS,
+    ELEM_DATA_OPTION_SIZES
 } ElemDataOption;
 
 #define ELEM_DATA_OPTION_MASK(option) (1u << ((unsigned int)(option) - 1u))
@@ -478,6 +520,139 @@ double Rbc_FindElemVectorMinimum(ElemVector *vPtr, double minLimit) {
     return min;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * InvalidateXOrder --
+ *
+ *      Forgets the cached order of the x values from the given index
+ *      on.
+ *
+ * Parameters:
+ *      Element *elemPtr
+ *      Tcl_Size first - Lowest changed index
+ *
+ * Results:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static void InvalidateXOrder(Element *elemPtr, Tcl_Size first) {
+    elemPtr->xOrdered = MIN(elemPtr->xOrdered, first);
+    elemPtr->xChecked = MIN(elemPtr->xChecked, first);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Rbc_ElemXOrdered --
+ *
+ *      Determines if the x values of the element's data points are
+ *      finite and non-decreasing.  The answer is cached, and only the
+ *      values changed or appended since the last call are checked.
+ *
+ * Parameters:
+ *      Element *elemPtr
+ *
+ * Results:
+ *      Returns TRUE if the x values are ordered.
+ *
+ *----------------------------------------------------------------------
+ */
+int Rbc_ElemXOrdered(Element *elemPtr) {
+    Tcl_Size nPoints;
+
+    nPoints = NumberOfPoints(elemPtr);
+    if ((elemPtr->xOrdered == elemPtr->xChecked) && (elemPtr->xChecked < nPoints)) {
+        const double *x;
+        Tcl_Size i;
+
+        x = elemPtr->x.valueArr;
+        for (i = elemPtr->xChecked; i < nPoints; i++) {
+            if ((!FINITE(x[i])) || ((i > 0) && (x[i] < x[i - 1]))) {
+                break;
+            }
+        }
+        elemPtr->xOrdered = i;
+        elemPtr->xChecked = MIN(i + 1, nPoints);
+    }
+    return (elemPtr->xOrdered >= nPoints);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Rbc_GetElemVisibleRange --
+ *
+ *      Finds the data points of an element with ordered x values
+ *      that fall within the limits of its x-axis, so that only they
+ *      need to be mapped.  The range includes one point on either
+ *      side, so a trace still runs off the edges of the plotting
+ *      area.
+ *
+ * Parameters:
+ *      Element *elemPtr
+ *      double margin - Distance the limits are widened by, in axis
+ *                      units (decades for a logarithmic axis)
+ *      Tcl_Size *firstPtr - (out) Index of the first point
+ *      Tcl_Size *lastPtr - (out) Index of the last point
+ *
+ * Results:
+ *      Returns TRUE if the range was found.  FALSE means that the x
+ *      values aren't ordered, and every point must be considered.
+ *
+ *----------------------------------------------------------------------
+ */
+int Rbc_GetElemVisibleRange(Element *elemPtr, double margin, Tcl_Size *firstPtr, Tcl_Size *lastPtr) {
+    Axis *axisPtr;
+    const double *x;
+    double min, max;
+    Tcl_Size nPoints;
+    Tcl_Size low, high, mid;
+
+    nPoints = NumberOfPoints(elemPtr);
+    if ((nPoints < 1) || (!Rbc_ElemXOrdered(elemPtr))) {
+        return FALSE;
+    }
+    axisPtr = elemPtr->axes.x;
+    x = elemPtr->x.valueArr;
+    if ((axisPtr->logScale) && (x[0] <= 0.0)) {
+        return FALSE;
+    }
+    min = axisPtr->axisRange.min - margin;
+    max = axisPtr->axisRange.max + margin;
+    /*
+     * Find the first point at or right of the minimum and the first
+     * point right of the maximum.  The limits of a logarithmic axis
+     * are compared with the logarithms of the values, as they are
+     * when mapped.
+     */
+#define AXIS_VALUE(i) ((axisPtr->logScale) ? log10(x[i]) : x[i])
+    low = 0;
+    high = nPoints;
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (AXIS_VALUE(mid) < min) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *firstPtr = MAX(low - 1, 0);
+    high = nPoints;
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (AXIS_VALUE(mid) <= max) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *lastPtr = MIN(low, nPoints - 1);
+#undef AXIS_VALUE
+    return TRUE;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -513,7 +688,12 @@ void Rbc_FreeElemVector(ElemVector *vPtr) {
  *
  * VectorChangedProc --
  *
- *      TODO: Description
+ *      Called when a vector used by the element is updated or
+ *      destroyed.  Records the lowest changed index, resynchronizes
+ *      the element's view of the values and remaps the element.
+ *      The weights only select the pen styles, and the color and size
+ *      vectors only the look of the symbols, so a change to them keeps
+ *      the mapped points.
  *
  * Parameters:
  *      Tcl_Interp *interp
@@ -532,22 +712,39 @@ static void VectorChangedProc(Tcl_Interp *interp, ClientData clientData, Rbc_Vec
     ElemVector *vPtr = clientData;
     Element *elemPtr = vPtr->elemPtr;
     Graph *graphPtr = elemPtr->graphPtr;
+    Tcl_Size first;
 
     switch (notify) {
     case RBC_VECTOR_NOTIFY_DESTROY:
         vPtr->clientId = NULL;
         vPtr->valueArr = NULL;
         vPtr->nValues = 0;
+        first = 0;
         break;
 
     case RBC_VECTOR_NOTIFY_UPDATE:
     default:
+        first = Rbc_VectorChangedFirst(vPtr->clientId);
         Rbc_GetVectorById(interp, vPtr->clientId, &vPtr->vecPtr);
         SyncElemVector(vPtr);
         break;
     }
-    graphPtr->flags |= RESET_AXES;
-    elemPtr->flags |= MAP_ITEM;
+    vPtr->changedFirst = MIN(vPtr->changedFirst, first);
+    if (vPtr == &elemPtr->x) {
+        InvalidateXOrder(elemPtr, first);
+    }
+    if ((vPtr == &elemPtr->x) || (vPtr == &elemPtr->y)) {
+        elemPtr->dataStamp++;
+    }
+    if (vPtr == &elemPtr->w) {
+        elemPtr->weightStamp++;
+        elemPtr->flags |= MAP_STYLE;
+    } else if ((vPtr == &elemPtr->colorData) || (vPtr == &elemPtr->sizeData)) {
+        elemPtr->flags |= MAP_STYLE;
+    } else {
+        graphPtr->flags |= RESET_AXES;
+        elemPtr->flags |= MAP_ITEM;
+    }
     if (!elemPtr->hidden) {
         graphPtr->flags |= REDRAW_BACKING_STORE;
         Rbc_EventuallyRedrawGraph(graphPtr);
@@ -800,6 +997,15 @@ void Rbc_CommitElemVector(Element *elemPtr, ElemVector *destPtr, ElemVector *can
     memset(candidatePtr, 0, sizeof(*candidatePtr));
 
     destPtr->elemPtr = elemPtr;
+    if (destPtr == &elemPtr->x) {
+        InvalidateXOrder(elemPtr, 0);
+    }
+    if ((destPtr == &elemPtr->x) || (destPtr == &elemPtr->y)) {
+        elemPtr->dataStamp++;
+    }
+    if (destPtr == &elemPtr->w) {
+        elemPtr->weightStamp++;
+    }
 
     if (destPtr->clientId != NULL) {
         /*
@@ -871,6 +1077,12 @@ static ElemDataOption GetElemDataOption(Element *elemPtr, Tcl_Obj *objPtr) {
     if (strcmp(name, "-ylow") == 0) {
         return ELEM_DATA_OPTION_Y_LOW;
     }
+    if (strcmp(name, "-colorvector") == 0) {
+        return ELEM_DATA_OPTION_COLORS;
+    }
+    if (strcmp(name, "-sizevector") == 0) {
+        return ELEM_DATA_OPTION_SIZES;
+    }
 
     return ELEM_DATA_OPTION_NONE;
 }
@@ -1738,6 +1950,9 @@ void Rbc_FreeElemDataTransaction(ElemDataTransaction *transactionPtr) {
     Rbc_FreeElemVector(&transactionPtr->yHigh);
     Rbc_FreeElemVector(&transactionPtr->yLow);
 
+    Rbc_FreeElemVector(&transactionPtr->colorData);
+    Rbc_FreeElemVector(&transactionPtr->sizeData);
+
     transactionPtr->stagedMask = 0;
 }
 
@@ -1974,6 +2189,20 @@ int Rbc_PrepareElemDataTransaction(Graph *graphPtr, Element *elemPtr, ElemDataTr
                 goto error;
             }
         }
+
+        if (!(explicitMask & ELEM_DATA_OPTION_MASK(ELEM_DATA_OPTION_COLORS)) && (elemPtr->colorVectorObjPtr != NULL)) {
+            if (StageElemDataVector(interp, elemPtr, elemPtr->colorVectorObjPtr, transactionPtr,
+                                   &transactionPtr->colorData, ELEM_DATA_OPTION_COLORS) != TCL_OK) {
+                goto error;
+            }
+        }
+
+        if (!(explicitMask & ELEM_DATA_OPTION_MASK(ELEM_DATA_OPTION_SIZES)) && (elemPtr->sizeVectorObjPtr != NULL)) {
+            if (StageElemDataVector(interp, elemPtr, elemPtr->sizeVectorObjPtr, transactionPtr,
+                                   &transactionPtr->sizeData, ELEM_DATA_OPTION_SIZES) != TCL_OK) {
+                goto error;
+            }
+        }
     }
 
     /*
@@ -2058,6 +2287,20 @@ int Rbc_PrepareElemDataTransaction(Graph *graphPtr, Element *elemPtr, ElemDataTr
             }
             break;
 
+        case ELEM_DATA_OPTION_COLORS:
+            if (StageElemDataVector(interp, elemPtr, valueObjPtr, transactionPtr, &transactionPtr->colorData,
+                                   option) != TCL_OK) {
+                goto error;
+            }
+            break;
+
+        case ELEM_DATA_OPTION_SIZES:
+            if (StageElemDataVector(interp, elemPtr, valueObjPtr, transactionPtr, &transactionPtr->sizeData,
+                                   option) != TCL_OK) {
+                goto error;
+            }
+            break;
+
         case ELEM_DATA_OPTION_NONE:
             break;
         }
@@ -2127,6 +2370,14 @@ void Rbc_CommitElemDataTransaction(Element *elemPtr, ElemDataTransaction *transa
         Rbc_CommitElemVector(elemPtr, &elemPtr->yLow, &transactionPtr->yLow);
     }
 
+    if (transactionPtr->stagedMask & ELEM_DATA_OPTION_MASK(ELEM_DATA_OPTION_COLORS)) {
+        Rbc_CommitElemVector(elemPtr, &elemPtr->colorData, &transactionPtr->colorData);
+    }
+
+    if (transactionPtr->stagedMask & ELEM_DATA_OPTION_MASK(ELEM_DATA_OPTION_SIZES)) {
+        Rbc_CommitElemVector(elemPtr, &elemPtr->sizeData, &transactionPtr->sizeData);
+    }
+
     transactionPtr->stagedMask = 0;
 }
 
@@ -2375,6 +2626,8 @@ void Rbc_SyncElemDataOptionObjects(Element *elemPtr) {
         case ELEM_DATA_OPTION_Y_ERROR:
         case ELEM_DATA_OPTION_Y_HIGH:
         case ELEM_DATA_OPTION_Y_LOW:
+        case ELEM_DATA_OPTION_COLORS:
+        case ELEM_DATA_OPTION_SIZES:
             break;
         }
     }
@@ -2617,6 +2870,224 @@ static int ParseClosestOptions(Graph *graphPtr, Tcl_Interp *interp, Tcl_Size obj
     return TCL_OK;
 }
 
+/*
+ * Data points are mapped and tested against the region of a "find"
+ * operation this many at a time.
+ */
+#define FIND_BLOCK_POINTS 16384
+
+/*
+ * FindRegion --
+ *
+ *      Region of the window searched by the "find" operation.
+ */
+typedef struct {
+    int isPolygon;       /* If TRUE, the region is the polygon below.
+                          * Otherwise it's the rectangle exts. */
+    Point2D *points;     /* Vertices of the polygon. */
+    Tcl_Size nPoints;
+    Extents2D exts;      /* Bounding box of the region. */
+    Tcl_Obj *vecNameObj; /* If non-NULL, name of the vector to
+                          * receive the indices. */
+} FindRegion;
+
+typedef enum { FIND_OPTION_POLYGON, FIND_OPTION_RECTANGLE, FIND_OPTION_VECTOR } FindOption;
+
+static const char *const findOptionNames[] = {"-polygon", "-rectangle", "-vector", NULL};
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ParseFindOptions --
+ *
+ *      Parses the region and options of the "find" operation.  The
+ *      region is either "-rectangle x1 y1 x2 y2" or "-polygon coords",
+ *      where coords is a list of at least three x y pairs.  All are
+ *      window coordinates.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Tcl_Interp *interp
+ *      Tcl_Size objc
+ *      Tcl_Obj *const objv[]
+ *      FindRegion *regionPtr - (out) Receives the region.  The caller
+ *                              must free the polygon's vertices.
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ *----------------------------------------------------------------------
+ */
+static int ParseFindOptions(Graph *graphPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[],
+                            FindRegion *regionPtr) {
+    Tcl_Size i;
+    int haveRegion;
+
+    memset(regionPtr, 0, sizeof(FindRegion));
+    haveRegion = FALSE;
+    for (i = 4; i < objc;) {
+        int optionIndex;
+        Tcl_Size nArgs;
+
+        if (Tcl_GetIndexFromObj(interp, objv[i], findOptionNames, "option", 0, &optionIndex) != TCL_OK) {
+            return TCL_ERROR;
+        }
+        nArgs = (optionIndex == FIND_OPTION_RECTANGLE) ? 4 : 1;
+        if ((objc - i - 1) < nArgs) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("value for \"%s\" missing", Tcl_GetString(objv[i])));
+            return TCL_ERROR;
+        }
+        if ((optionIndex != FIND_OPTION_VECTOR) && (haveRegion)) {
+            Tcl_SetObjResult(interp, Tcl_NewStringObj("only one of -rectangle or -polygon may be given", -1));
+            return TCL_ERROR;
+        }
+        switch ((FindOption)optionIndex) {
+        case FIND_OPTION_POLYGON: {
+            Tcl_Obj **elemObjv;
+            Tcl_Size nElem, j;
+
+            if (Tcl_ListObjGetElements(interp, objv[i + 1], &nElem, &elemObjv) != TCL_OK) {
+                return TCL_ERROR;
+            }
+            if ((nElem < 6) || (nElem & 1)) {
+                Tcl_SetObjResult(interp, Tcl_NewStringObj("polygon needs at least three x y coordinate pairs", -1));
+                return TCL_ERROR;
+            }
+            regionPtr->points = ckalloc((nElem / 2) * sizeof(Point2D));
+            regionPtr->nPoints = nElem / 2;
+            for (j = 0; j < nElem; j += 2) {
+                int x, y;
+
+                if ((Tk_GetPixelsFromObj(interp, graphPtr->tkwin, elemObjv[j], &x) != TCL_OK) ||
+                    (Tk_GetPixelsFromObj(interp, graphPtr->tkwin, elemObjv[j + 1], &y) != TCL_OK)) {
+                    return TCL_ERROR;
+                }
+                regionPtr->points[j / 2].x = (double)x;
+                regionPtr->points[j / 2].y = (double)y;
+                if (j == 0) {
+                    regionPtr->exts.left = regionPtr->exts.right = (double)x;
+                    regionPtr->exts.top = regionPtr->exts.bottom = (double)y;
+                } else {
+                    regionPtr->exts.left = MIN(regionPtr->exts.left, (double)x);
+                    regionPtr->exts.right = MAX(regionPtr->exts.right, (double)x);
+                    regionPtr->exts.top = MIN(regionPtr->exts.top, (double)y);
+                    regionPtr->exts.bottom = MAX(regionPtr->exts.bottom, (double)y);
+                }
+            }
+            regionPtr->isPolygon = TRUE;
+            haveRegion = TRUE;
+            break;
+        }
+        case FIND_OPTION_RECTANGLE: {
+            int x1, y1, x2, y2;
+
+            if ((Tk_GetPixelsFromObj(interp, graphPtr->tkwin, objv[i + 1], &x1) != TCL_OK) ||
+                (Tk_GetPixelsFromObj(interp, graphPtr->tkwin, objv[i + 2], &y1) != TCL_OK) ||
+                (Tk_GetPixelsFromObj(interp, graphPtr->tkwin, objv[i + 3], &x2) != TCL_OK) ||
+                (Tk_GetPixelsFromObj(interp, graphPtr->tkwin, objv[i + 4], &y2) != TCL_OK)) {
+                return TCL_ERROR;
+            }
+            regionPtr->exts.left = (double)MIN(x1, x2);
+            regionPtr->exts.right = (double)MAX(x1, x2);
+            regionPtr->exts.top = (double)MIN(y1, y2);
+            regionPtr->exts.bottom = (double)MAX(y1, y2);
+            haveRegion = TRUE;
+            break;
+        }
+        case FIND_OPTION_VECTOR:
+            regionPtr->vecNameObj = objv[i + 1];
+            break;
+        }
+        i += nArgs + 1;
+    }
+    if (!haveRegion) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("missing region: must give -rectangle or -polygon", -1));
+        return TCL_ERROR;
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetFindRange --
+ *
+ *      Finds the data points of an element with ordered x values
+ *      that can lie within the given window coordinates along the
+ *      screen axis of its x-axis.  Only these points need to be
+ *      mapped and tested by the "find" operation.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Element *elemPtr
+ *      double min - Least window coordinate
+ *      double max - Greatest window coordinate
+ *      Tcl_Size *firstPtr - (out) Index of the first point
+ *      Tcl_Size *endPtr - (out) Index after the last point
+ *
+ * Results:
+ *      Returns TRUE if the range was found.  FALSE means that the x
+ *      values aren't ordered, and every point must be tested.
+ *
+ *----------------------------------------------------------------------
+ */
+static int GetFindRange(Graph *graphPtr, Element *elemPtr, double min, double max, Tcl_Size *firstPtr,
+                        Tcl_Size *endPtr) {
+    Axis *axisPtr;
+    const double *x;
+    double sign;
+    Tcl_Size nPoints;
+    Tcl_Size low, high, mid;
+
+    nPoints = NumberOfPoints(elemPtr);
+    if ((nPoints < 1) || (!Rbc_ElemXOrdered(elemPtr))) {
+        return FALSE;
+    }
+    axisPtr = elemPtr->axes.x;
+    x = elemPtr->x.valueArr;
+    if ((axisPtr->logScale) && (x[0] <= 0.0)) {
+        return FALSE;
+    }
+    /*
+     * Window coordinates are the same as those given by
+     * Rbc_MapArray2D, and never decrease (or never increase) with
+     * the index.  Flip the sign of decreasing ones, so the range can
+     * be found by a binary search.
+     */
+#define SCREEN_VALUE(i)                                                                                                \
+    (sign * ((graphPtr->inverted) ? Rbc_VMap(graphPtr, axisPtr, x[i]) : Rbc_HMap(graphPtr, axisPtr, x[i])))
+    sign = 1.0;
+    if (SCREEN_VALUE(0) > SCREEN_VALUE(nPoints - 1)) {
+        double temp;
+
+        sign = -1.0;
+        temp = -min, min = -max, max = temp;
+    }
+    low = 0;
+    high = nPoints;
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (!(SCREEN_VALUE(mid) >= min)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *firstPtr = low;
+    high = nPoints;
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (SCREEN_VALUE(mid) <= max) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *endPtr = low;
+#undef SCREEN_VALUE
+    return TRUE;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -2782,114 +3253,450 @@ int Rbc_ParseStylesObj(Graph *graphPtr, Element *elemPtr, Tcl_Obj *objPtr, size_
 /*
  *----------------------------------------------------------------------
  *
- * Rbc_StyleMap --
+ * WeightInStyle --
  *
- *      Creates an array of style indices and fills it based on the weight
- *      of each data point.
+ *      Tells if a weight falls in the range of a pen style.
  *
  * Parameters:
- *      Element *elemPtr
+ *      const PenStyle *stylePtr
+ *      double w - Weight of a data point
  *
  * Results:
- *      None.
+ *      Returns 1 if the weight is in the range, 0 otherwise.
  *
- * Side effects:
- *      Memory is freed and allocated for the index array.
+ *----------------------------------------------------------------------
+ */
+static int WeightInStyle(const PenStyle *stylePtr, double w) {
+    double norm;
+
+    norm = (w - stylePtr->weight.min) / stylePtr->weight.range;
+    return (((norm - 1.0) <= DBL_EPSILON) && (((1.0 - norm) - 1.0) <= DBL_EPSILON));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DoubleToKey, KeyToDouble --
+ *
+ *      Convert between doubles and unsigned integers of the same
+ *      order, so that the doubles between two others can be counted
+ *      and halved.  Ordered keys of NaNs lie outside those of the
+ *      infinities.
  *
  *----------------------------------------------------------------------
  */
-PenStyle **Rbc_StyleMap(Element *elemPtr) {
-    Tcl_Size i;
-    Tcl_Size nWeights;
-    PenStyle **dataToStyle;
-    Rbc_ChainLink *linkPtr;
-    PenStyle *stylePtr;
-    const double *w;
-    Tcl_Size nPoints;
-    size_t byteCount;
+static Tcl_WideUInt DoubleToKey(double d) {
+    Tcl_WideUInt bits;
 
-    nPoints = NumberOfPoints(elemPtr);
-    nWeights = MIN(elemPtr->w.nValues, nPoints);
-    w = elemPtr->w.valueArr;
-    linkPtr = Rbc_ChainFirstLink(elemPtr->palette);
-    stylePtr = Rbc_ChainGetValue(linkPtr);
-    /*
-     * A style-map entry is required for every data point.  Preserve
-     * the allocator's fatal-overflow semantics, but validate the
-     * Tcl_Size value before converting it to size_t.
-     */
-    if ((Tcl_WideUInt)nPoints > (Tcl_WideUInt)(SIZE_MAX / sizeof(*dataToStyle))) {
-        Tcl_Panic("Rbc_StyleMap: allocation size overflow");
-    }
-    byteCount = (size_t)nPoints * sizeof(*dataToStyle);
-    /*
-     * Keep an allocation for the empty case because callers
-     * unconditionally release the returned pointer.
-     */
-    if (byteCount == 0) {
-        byteCount = 1;
-    }
-    dataToStyle = ckalloc(byteCount);
-    /*
-     * Initialize every data point to the normal style.
-     */
-    for (i = 0; i < nPoints; i++) {
-        dataToStyle[i] = stylePtr;
-    }
-    /*
-     * Replace the normal style for points whose weights fall inside
-     * one of the configured style ranges.
-     */
-    for (i = 0; i < nWeights; i++) {
-        for (linkPtr = Rbc_ChainLastLink(elemPtr->palette); linkPtr != NULL; linkPtr = Rbc_ChainPrevLink(linkPtr)) {
-            double norm;
+    memcpy(&bits, &d, sizeof(bits));
+    return (bits & WEIGHT_KEY_SIGN) ? ~bits : (bits | WEIGHT_KEY_SIGN);
+}
 
-            stylePtr = Rbc_ChainGetValue(linkPtr);
-            if (stylePtr->weight.range <= 0.0) {
-                continue;
-            }
-            norm = (w[i] - stylePtr->weight.min) / stylePtr->weight.range;
-            if (((norm - 1.0) <= DBL_EPSILON) && (((1.0 - norm) - 1.0) <= DBL_EPSILON)) {
-                dataToStyle[i] = stylePtr;
-                break;
-            }
-        }
-    }
-    return dataToStyle;
+static double KeyToDouble(Tcl_WideUInt key) {
+    Tcl_WideUInt bits;
+    double d;
+
+    bits = (key & WEIGHT_KEY_SIGN) ? (key & ~WEIGHT_KEY_SIGN) : ~key;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * Rbc_ExpandErrorBarExtents --
+ * GetStyleEdge --
  *
- *      Expands element extents to include error-bar coordinates.
- *      Only error values that correspond to actual element data points
- *      and can therefore be mapped by Rbc_MapErrorBars are considered.
+ *      Finds the edge of the weights taking a pen style on one side.
+ *      Since WeightInStyle rounds, its edges aren't exactly the ends of
+ *      the style's range.  But the weights it takes do form one run of
+ *      doubles, so the edge is found by halving the doubles between
+ *      one taken and one not.
  *
  * Parameters:
- *      Element *elemPtr    - Element containing data and error vectors.
- *      Extents2D *extsPtr  - Extents to expand.
+ *      const PenStyle *stylePtr
+ *      double in - Weight in the style
+ *      double out - Weight not in the style
  *
  * Results:
- *      None.
- *
- * Side Effects:
- *      May expand the supplied extents.
+ *      Returns the weight in the style closest to out.
  *
  *----------------------------------------------------------------------
  */
-void Rbc_ExpandErrorBarExtents(Element *elemPtr, Extents2D *extsPtr) {
-    Tcl_Size nPoints;
-    Tcl_Size n;
-    Tcl_Size i;
+static double GetStyleEdge(const PenStyle *stylePtr, double in, double out) {
+    Tcl_WideUInt inKey, outKey, midKey;
 
-    if ((elemPtr == NULL) || (extsPtr == NULL)) {
-        return;
+    inKey = DoubleToKey(in);
+    outKey = DoubleToKey(out);
+    while (((inKey > outKey) ? (inKey - outKey) : (outKey - inKey)) > 1) {
+        midKey = (inKey > outKey) ? (outKey + (inKey - outKey) / 2) : (inKey + (outKey - inKey) / 2);
+        if (WeightInStyle(stylePtr, KeyToDouble(midKey))) {
+            inKey = midKey;
+        } else {
+            outKey = midKey;
+        }
     }
-    nPoints = NumberOfPoints(elemPtr);
-    if (nPoints <= 0) {
-        return;
+    return KeyToDouble(inKey);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompareWeights --
+ *
+ *      Orders weights for qsort.
+ *
+ *----------------------------------------------------------------------
+ */
+static int CompareWeights(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetStyleIntervals --
+ *
+ *      Builds the table of weight intervals of the styles of a style
+ *      map.  Where the ranges of styles overlap, the style last in the
+ *      palette wins.  Weights in no range take the first style, the
+ *      element's normal pen.
+ *
+ * Parameters:
+ *      const StyleMap *mapPtr - Map whose styles are set
+ *      int *nIntervalsPtr - (out) Number of intervals
+ *
+ * Results:
+ *      Returns a new array of intervals.  The first starts at -Inf.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static StyleInterval *GetStyleIntervals(const StyleMap *mapPtr, int *nIntervalsPtr) {
+    StyleInterval *intervals;
+    double *lows, *highs, *bounds;
+    int nBounds, nIntervals;
+    int i, k;
+
+    /* Each style adds at most two bounds to the one at -Inf. */
+    lows = ckalloc(MAX(mapPtr->nStyles, 1) * sizeof(double));
+    highs = ckalloc(MAX(mapPtr->nStyles, 1) * sizeof(double));
+    bounds = ckalloc((2 * (size_t)mapPtr->nStyles + 1) * sizeof(double));
+    nBounds = 0;
+    bounds[nBounds++] = -HUGE_VAL;
+    for (k = 1; k < mapPtr->nStyles; k++) {
+        const PenStyle *stylePtr = mapPtr->styles[k];
+
+        /* A style whose own minimum isn't in range takes no weight. */
+        if ((!(stylePtr->weight.range > 0.0)) || (!WeightInStyle(stylePtr, stylePtr->weight.min))) {
+            lows[k] = highs[k] = HUGE_VAL;
+            continue;
+        }
+        lows[k] = GetStyleEdge(stylePtr, stylePtr->weight.min, -HUGE_VAL);
+        /* The interval ends at the double after the last one taken. */
+        highs[k] = KeyToDouble(DoubleToKey(GetStyleEdge(stylePtr, stylePtr->weight.min, HUGE_VAL)) + 1);
+        bounds[nBounds++] = lows[k];
+        bounds[nBounds++] = highs[k];
+    }
+    qsort(bounds, (size_t)nBounds, sizeof(double), CompareWeights);
+
+    intervals = ckalloc((size_t)nBounds * sizeof(StyleInterval));
+    nIntervals = 0;
+    for (i = 0; i < nBounds; i++) {
+        int style;
+
+        if ((i > 0) && (bounds[i] == bounds[i - 1])) {
+            continue;
+        }
+        style = 0;
+        for (k = mapPtr->nStyles - 1; k > 0; k--) {
+            if ((lows[k] <= bounds[i]) && (bounds[i] < highs[k])) {
+                style = k;
+                break;
+            }
+        }
+        if ((nIntervals > 0) && (intervals[nIntervals - 1].style == style)) {
+            continue;
+        }
+        intervals[nIntervals].min = bounds[i];
+        intervals[nIntervals].style = style;
+        nIntervals++;
+    }
+    ckfree(bounds);
+    ckfree(highs);
+    ckfree(lows);
+    *nIntervalsPtr = nIntervals;
+    return intervals;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetWeightStyle --
+ *
+ *      Looks up the style of a weight in the intervals of a style map.
+ *
+ * Parameters:
+ *      const StyleMap *mapPtr
+ *      double w - Weight of a data point
+ *
+ * Results:
+ *      Returns the position of the style in the palette.
+ *
+ *----------------------------------------------------------------------
+ */
+static int GetWeightStyle(const StyleMap *mapPtr, double w) {
+    int low, high;
+
+    if (w != w) {
+        /* NaN is in no range. */
+        return 0;
+    }
+    /* Find the last interval starting at or below the weight. */
+    low = 0;
+    high = mapPtr->nIntervals;
+    while (high - low > 1) {
+        int mid;
+
+        mid = low + (high - low) / 2;
+        if (mapPtr->intervals[mid].min <= w) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return mapPtr->intervals[low].style;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Rbc_StyleMap --
+ *
+ *      Finds the pen style of each data point of the element from its
+ *      weight.  The positions found are kept, and found again only if
+ *      the weights, the number of points or the styles' ranges changed
+ *      since the last time.
+ *
+ * Parameters:
+ *      Element *elemPtr
+ *
+ * Results:
+ *      Returns the element's style map.
+ *
+ * Side effects:
+ *      Memory is freed and allocated for the style map.
+ *
+ *----------------------------------------------------------------------
+ */
+StyleMap *Rbc_StyleMap(Element *elemPtr) {
+    StyleMap *mapPtr = &elemPtr->styleMap;
+    StyleInterval *intervals;
+    Rbc_ChainLink *linkPtr;
+    const double *w;
+    Tcl_Size nPoints, nWeights;
+    Tcl_Size i;
+    int nStyles, nIntervals, indexSize;
+    int same;
+
+    nPoints = NumberOfPoints(elemPtr);
+    nWeights = MIN(elemPtr->w.nValues, nPoints);
+    w = elemPtr->w.valueArr;
+
+    /* The styles themselves may be new, even if their ranges aren't. */
+    nStyles = (int)Rbc_ChainGetLength(elemPtr->palette);
+    if (nStyles != mapPtr->nStyles) {
+        if (mapPtr->styles != NULL) {
+            ckfree(mapPtr->styles);
+        }
+        mapPtr->styles = ckalloc(MAX(nStyles, 1) * sizeof(PenStyle *));
+        mapPtr->nStyles = nStyles;
+    }
+    nStyles = 0;
+    for (linkPtr = Rbc_ChainFirstLink(elemPtr->palette); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
+        mapPtr->styles[nStyles++] = Rbc_ChainGetValue(linkPtr);
+    }
+    intervals = GetStyleIntervals(mapPtr, &nIntervals);
+    indexSize = (nStyles <= (1 << 8)) ? 1 : (nStyles <= (1 << 16)) ? 2 : 4;
+
+    same = ((mapPtr->indices != NULL) && (mapPtr->nPoints == nPoints) && (mapPtr->weights == w) &&
+            (mapPtr->nWeights == nWeights) && (mapPtr->weightStamp == elemPtr->weightStamp) &&
+            (mapPtr->indexSize == indexSize) && (mapPtr->nIntervals == nIntervals));
+    for (i = 0; (same) && (i < nIntervals); i++) {
+        same = ((mapPtr->intervals[i].min == intervals[i].min) && (mapPtr->intervals[i].style == intervals[i].style));
+    }
+    if (mapPtr->intervals != NULL) {
+        ckfree(mapPtr->intervals);
+    }
+    mapPtr->intervals = intervals;
+    mapPtr->nIntervals = nIntervals;
+    if (same) {
+        return mapPtr;
+    }
+
+    if (mapPtr->indices != NULL) {
+        ckfree(mapPtr->indices);
+    }
+    /*
+     * A style-map entry is required for every data point.  Preserve
+     * the allocator's fatal-overflow semantics, but validate the
+     * Tcl_Size value before converting it to size_t.  Keep an
+     * allocation for the empty case, which marks the map as found.
+     */
+    if ((Tcl_WideUInt)nPoints > (Tcl_WideUInt)(SIZE_MAX / indexSize)) {
+        Tcl_Panic("Rbc_StyleMap: allocation size overflow");
+    }
+    mapPtr->indices = ckalloc(MAX((size_t)nPoints * indexSize, 1));
+    mapPtr->indexSize = indexSize;
+    mapPtr->nPoints = nPoints;
+    mapPtr->weights = w;
+    mapPtr->nWeights = nWeights;
+    mapPtr->weightStamp = elemPtr->weightStamp;
+
+    /* Every data point starts with the normal style. */
+    memset(mapPtr->indices, 0, (size_t)nPoints * indexSize);
+    if (nIntervals < 2) {
+        return mapPtr;
+    }
+    for (i = 0; i < nWeights; i++) {
+        int style;
+
+        /* Runs of equal weights are common. */
+        if ((i > 0) && (w[i] == w[i - 1])) {
+            style = Rbc_StyleMapIndex(mapPtr, i - 1);
+        } else {
+            style = GetWeightStyle(mapPtr, w[i]);
+        }
+        switch (indexSize) {
+        case 1:
+            ((unsigned char *)mapPtr->indices)[i] = (unsigned char)style;
+            break;
+        case 2:
+            ((unsigned short *)mapPtr->indices)[i] = (unsigned short)style;
+            break;
+        default:
+            ((unsigned int *)mapPtr->indices)[i] = (unsigned int)style;
+            break;
+        }
+    }
+    return mapPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Rbc_StyleMapOrder --
+ *
+ *      Sorts mapped items, such as symbol points or error bars, by the
+ *      style of their data points.  The items of each style keep their
+ *      order.
+ *
+ * Parameters:
+ *      const StyleMap *mapPtr
+ *      const Tcl_Size *toData - Data point of each item
+ *      Tcl_Size nItems - Number of items
+ *      Tcl_Size *counts - (out) Number of items of each style
+ *
+ * Results:
+ *      Returns a new array of the items' indices, in style order.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+Tcl_Size *Rbc_StyleMapOrder(const StyleMap *mapPtr, const Tcl_Size *toData, Tcl_Size nItems, Tcl_Size *counts) {
+    Tcl_Size *order, *next;
+    Tcl_Size i;
+    int k;
+
+    if ((Tcl_WideUInt)nItems > (Tcl_WideUInt)(SIZE_MAX / sizeof(*order))) {
+        Tcl_Panic("Rbc_StyleMapOrder: allocation size overflow");
+    }
+    order = ckalloc(MAX((size_t)nItems * sizeof(*order), 1));
+    next = ckalloc(MAX(mapPtr->nStyles, 1) * sizeof(*next));
+    memset(counts, 0, mapPtr->nStyles * sizeof(*counts));
+    for (i = 0; i < nItems; i++) {
+        counts[Rbc_StyleMapIndex(mapPtr, toData[i])]++;
+    }
+    next[0] = 0;
+    for (k = 1; k < mapPtr->nStyles; k++) {
+        next[k] = next[k - 1] + counts[k - 1];
+    }
+    for (i = 0; i < nItems; i++) {
+        order[next[Rbc_StyleMapIndex(mapPtr, toData[i])]++] = i;
+    }
+    ckfree(next);
+    return order;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Rbc_FreeStyleMap --
+ *
+ *      Releases the memory of a style map.
+ *
+ * Parameters:
+ *      StyleMap *mapPtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+void Rbc_FreeStyleMap(StyleMap *mapPtr) {
+    if (mapPtr->styles != NULL) {
+        ckfree(mapPtr->styles);
+    }
+    if (mapPtr->intervals != NULL) {
+        ckfree(mapPtr->intervals);
+    }
+    if (mapPtr->indices != NULL) {
+        ckfree(mapPtr->indices);
+    }
+    memset(mapPtr, 0, sizeof(StyleMap));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Rbc_ExpandErrorBarExtents --
+ *
+ *      Expands element extents to include error-bar coordinates.
+ *      Only error values that correspond to actual element data points
+ *      and can therefore be mapped by Rbc_MapErrorBars are considered.
+ *
+ * Parameters:
+ *      Element *elemPtr    - Element containing data and error vectors.
+ *      Extents2D *extsPtr  - Extents to expand.
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      May expand the supplied extents.
+ *
+ *----------------------------------------------------------------------
+ */
+void Rbc_ExpandErrorBarExtents(Element *elemPtr, Extents2D *extsPtr) {
+    Tcl_Size nPoints;
+    Tcl_Size n;
+    Tcl_Size i;
+
+    if ((elemPtr == NULL) || (extsPtr == NULL)) {
+        return;
+    }
+    nPoints = NumberOfPoints(elemPtr);
+    if (nPoints <= 0) {
+        return;
     }
     /*
      * X error bars.
@@ -3068,6 +3875,11 @@ static int AllocateErrorBarArrays(Tcl_Size nPoints, Segment2D **segmentsPtr, Tcl
     return TCL_OK;
 }
 
+/*
+ * Error bars are mapped in blocks of ERRORBAR_BLOCK_POINTS data points.
+ */
+#define ERRORBAR_BLOCK_POINTS 128
+
 /*
  *----------------------------------------------------------------------
  *
@@ -3079,7 +3891,7 @@ static int AllocateErrorBarArrays(Tcl_Size nPoints, Segment2D **segmentsPtr, Tcl
  * Parameters:
  *      Graph *graphPtr
  *      Element *elemPtr
- *      PenStyle **dataToStyle
+ *      StyleMap *mapPtr
  *
  * Results:
  *      None.
@@ -3089,8 +3901,12 @@ static int AllocateErrorBarArrays(Tcl_Size nPoints, Segment2D **segmentsPtr, Tcl
  *
  *----------------------------------------------------------------------
  */
-void Rbc_MapErrorBars(Graph *graphPtr, Element *elemPtr, PenStyle **dataToStyle) {
+void Rbc_MapErrorBars(Graph *graphPtr, Element *elemPtr, StyleMap *mapPtr) {
     Extents2D exts;
+    double endX[2 * ERRORBAR_BLOCK_POINTS]; /* Graph coordinates of the */
+    double endY[2 * ERRORBAR_BLOCK_POINTS]; /* ends of each error bar. */
+    Point2D endPts[2 * ERRORBAR_BLOCK_POINTS];
+    unsigned char keep[2 * ERRORBAR_BLOCK_POINTS];
     Tcl_Size n;
     Tcl_Size nPoints;
 
@@ -3110,50 +3926,65 @@ void Rbc_MapErrorBars(Graph *graphPtr, Element *elemPtr, PenStyle **dataToStyle)
         Tcl_Size *errorToData;
         Tcl_Size *indexPtr;
         Tcl_Size i;
+        Tcl_Size start;
         if (AllocateErrorBarArrays(n, &errorBars, &errorToData) != TCL_OK) {
             return;
         }
         segPtr = errorBars;
         indexPtr = errorToData;
-        for (i = 0; i < n; i++) {
-            PenStyle *stylePtr;
-            double high;
-            double low;
-            double x;
-            double y;
-            x = elemPtr->x.valueArr[i];
-            y = elemPtr->y.valueArr[i];
-            stylePtr = dataToStyle[i];
-            if (!FINITE(x) || !FINITE(y)) {
-                continue;
-            }
-            if (elemPtr->xError.nValues > 0) {
-                high = x + elemPtr->xError.valueArr[i];
-                low = x - elemPtr->xError.valueArr[i];
-            } else {
-                high = elemPtr->xHigh.valueArr[i];
-                low = elemPtr->xLow.valueArr[i];
-            }
-            if (!FINITE(high) || !FINITE(low)) {
-                continue;
+        for (start = 0; start < n; start += ERRORBAR_BLOCK_POINTS) {
+            Segment2D *blockSegs;
+            Tcl_Size *blockIndices;
+            Tcl_Size nBlock;
+            Tcl_Size nClipped;
+            Tcl_Size j;
+
+            /*
+             * Collect the ends of a block of error bars and map them
+             * together.  A non-finite x leaves both ends non-finite, so
+             * the whole bar is dropped.
+             */
+            nBlock = MIN(n - start, ERRORBAR_BLOCK_POINTS);
+            for (j = 0; j < nBlock; j++) {
+                double high;
+                double low;
+                double x;
+
+                i = start + j;
+                x = elemPtr->x.valueArr[i];
+                if (elemPtr->xError.nValues > 0) {
+                    high = x + elemPtr->xError.valueArr[i];
+                    low = x - elemPtr->xError.valueArr[i];
+                } else {
+                    high = (FINITE(x)) ? elemPtr->xHigh.valueArr[i] : x;
+                    low = elemPtr->xLow.valueArr[i];
+                }
+                endX[2 * j] = high;
+                endX[2 * j + 1] = low;
+                endY[2 * j] = endY[2 * j + 1] = elemPtr->y.valueArr[i];
             }
-            {
+            Rbc_MapArray2D(graphPtr, &elemPtr->axes, endX, endY, 2 * nBlock, endPts, keep);
+            blockSegs = segPtr;
+            blockIndices = indexPtr;
+            for (j = 0; j < nBlock; j++) {
+                PenStyle *stylePtr;
                 Point2D p;
                 Point2D q;
-                p = Rbc_Map2D(graphPtr, high, y, &elemPtr->axes);
-                q = Rbc_Map2D(graphPtr, low, y, &elemPtr->axes);
-                if ((!FINITE(p.x)) || (!FINITE(p.y)) || (!FINITE(q.x)) || (!FINITE(q.y))) {
+
+                if ((!keep[2 * j]) || (!keep[2 * j + 1])) {
                     continue;
                 }
+                i = start + j;
+                stylePtr = Rbc_StyleMapStyle(mapPtr, i);
+                p = endPts[2 * j];
+                q = endPts[2 * j + 1];
                 /*
                  * Main horizontal error-bar segment.
                  */
                 segPtr->p = p;
                 segPtr->q = q;
-                if (Rbc_LineRectClip(&exts, &p, &q, segPtr)) {
-                    segPtr++;
-                    *indexPtr++ = i;
-                }
+                segPtr++;
+                *indexPtr++ = i;
                 /*
                  * First cap.
                  */
@@ -3164,11 +3995,10 @@ void Rbc_MapErrorBars(Graph *graphPtr, Element *elemPtr, PenStyle **dataToStyle)
                 capP.y = p.y - stylePtr->errorBarCapWidth;
                 capQ.x = p.x;
                 capQ.y = p.y + stylePtr->errorBarCapWidth;
-                if (Rbc_LineRectClip(&exts, &capP, &capQ, segPtr)) {
-
-                    segPtr++;
-                    *indexPtr++ = i;
-                }
+                segPtr->p = capP;
+                segPtr->q = capQ;
+                segPtr++;
+                *indexPtr++ = i;
                 /*
                  * Second cap.
                  */
@@ -3176,11 +4006,17 @@ void Rbc_MapErrorBars(Graph *graphPtr, Element *elemPtr, PenStyle **dataToStyle)
                 capP.y = q.y - stylePtr->errorBarCapWidth;
                 capQ.x = q.x;
                 capQ.y = q.y + stylePtr->errorBarCapWidth;
-                if (Rbc_LineRectClip(&exts, &capP, &capQ, segPtr)) {
-                    segPtr++;
-                    *indexPtr++ = i;
-                }
+                segPtr->p = capP;
+                segPtr->q = capQ;
+                segPtr++;
+                *indexPtr++ = i;
             }
+            /*
+             * Clip the error bars and caps of the block together.
+             */
+            nClipped = Rbc_ClipSegments(&exts, blockSegs, (Tcl_Size)(segPtr - blockSegs), blockIndices);
+            segPtr = blockSegs + nClipped;
+            indexPtr = blockIndices + nClipped;
         }
         elemPtr->xErrorBars = errorBars;
         elemPtr->xErrorBarCnt = (Tcl_Size)(segPtr - errorBars);
@@ -3200,52 +4036,62 @@ void Rbc_MapErrorBars(Graph *graphPtr, Element *elemPtr, PenStyle **dataToStyle)
         Tcl_Size *errorToData;
         Tcl_Size *indexPtr;
         Tcl_Size i;
+        Tcl_Size start;
         if (AllocateErrorBarArrays(n, &errorBars, &errorToData) != TCL_OK) {
             return;
         }
         segPtr = errorBars;
         indexPtr = errorToData;
-        for (i = 0; i < n; i++) {
-            PenStyle *stylePtr;
-            double high;
-            double low;
-            double x;
-            double y;
-            x = elemPtr->x.valueArr[i];
-            y = elemPtr->y.valueArr[i];
-            stylePtr = dataToStyle[i];
-            if (!FINITE(x) || !FINITE(y)) {
-                continue;
-            }
-            if (elemPtr->yError.nValues > 0) {
-                high = y + elemPtr->yError.valueArr[i];
-                low = y - elemPtr->yError.valueArr[i];
-            } else {
-                high = elemPtr->yHigh.valueArr[i];
-                low = elemPtr->yLow.valueArr[i];
-            }
-            if (!FINITE(high) || !FINITE(low)) {
-                continue;
+        for (start = 0; start < n; start += ERRORBAR_BLOCK_POINTS) {
+            Segment2D *blockSegs;
+            Tcl_Size *blockIndices;
+            Tcl_Size nBlock;
+            Tcl_Size nClipped;
+            Tcl_Size j;
+
+            nBlock = MIN(n - start, ERRORBAR_BLOCK_POINTS);
+            for (j = 0; j < nBlock; j++) {
+                double high;
+                double low;
+                double y;
+
+                i = start + j;
+                y = elemPtr->y.valueArr[i];
+                if (elemPtr->yError.nValues > 0) {
+                    high = y + elemPtr->yError.valueArr[i];
+                    low = y - elemPtr->yError.valueArr[i];
+                } else {
+                    high = (FINITE(y)) ? elemPtr->yHigh.valueArr[i] : y;
+                    low = elemPtr->yLow.valueArr[i];
+                }
+                endX[2 * j] = endX[2 * j + 1] = elemPtr->x.valueArr[i];
+                endY[2 * j] = high;
+                endY[2 * j + 1] = low;
             }
-            {
+            Rbc_MapArray2D(graphPtr, &elemPtr->axes, endX, endY, 2 * nBlock, endPts, keep);
+            blockSegs = segPtr;
+            blockIndices = indexPtr;
+            for (j = 0; j < nBlock; j++) {
+                PenStyle *stylePtr;
                 Point2D p;
                 Point2D q;
                 Point2D capP;
                 Point2D capQ;
-                p = Rbc_Map2D(graphPtr, x, high, &elemPtr->axes);
-                q = Rbc_Map2D(graphPtr, x, low, &elemPtr->axes);
-                if ((!FINITE(p.x)) || (!FINITE(p.y)) || (!FINITE(q.x)) || (!FINITE(q.y))) {
+
+                if ((!keep[2 * j]) || (!keep[2 * j + 1])) {
                     continue;
                 }
+                i = start + j;
+                stylePtr = Rbc_StyleMapStyle(mapPtr, i);
+                p = endPts[2 * j];
+                q = endPts[2 * j + 1];
                 /*
                  * Main vertical error-bar segment.
                  */
                 segPtr->p = p;
                 segPtr->q = q;
-                if (Rbc_LineRectClip(&exts, &p, &q, segPtr)) {
-                    segPtr++;
-                    *indexPtr++ = i;
-                }
+                segPtr++;
+                *indexPtr++ = i;
                 /*
                  * First cap.
                  */
@@ -3253,10 +4099,10 @@ void Rbc_MapErrorBars(Graph *graphPtr, Element *elemPtr, PenStyle **dataToStyle)
                 capP.y = p.y;
                 capQ.x = p.x + stylePtr->errorBarCapWidth;
                 capQ.y = p.y;
-                if (Rbc_LineRectClip(&exts, &capP, &capQ, segPtr)) {
-                    segPtr++;
-                    *indexPtr++ = i;
-                }
+                segPtr->p = capP;
+                segPtr->q = capQ;
+                segPtr++;
+                *indexPtr++ = i;
                 /*
                  * Second cap.
                  */
@@ -3264,11 +4110,17 @@ void Rbc_MapErrorBars(Graph *graphPtr, Element *elemPtr, PenStyle **dataToStyle)
                 capP.y = q.y;
                 capQ.x = q.x + stylePtr->errorBarCapWidth;
                 capQ.y = q.y;
-                if (Rbc_LineRectClip(&exts, &capP, &capQ, segPtr)) {
-                    segPtr++;
-                    *indexPtr++ = i;
-                }
+                segPtr->p = capP;
+                segPtr->q = capQ;
+                segPtr++;
+                *indexPtr++ = i;
             }
+            /*
+             * Clip the error bars and caps of the block together.
+             */
+            nClipped = Rbc_ClipSegments(&exts, blockSegs, (Tcl_Size)(segPtr - blockSegs), blockIndices);
+            segPtr = blockSegs + nClipped;
+            indexPtr = blockIndices + nClipped;
         }
         elemPtr->yErrorBars = errorBars;
         elemPtr->yErrorBarCnt = (Tcl_Size)(segPtr - errorBars);
@@ -3483,6 +4335,7 @@ static void ReleaseElementResources(Graph *graphPtr, Element *elemPtr) {
      * or an embedded pen.
      */
     (*elemPtr->procsPtr->destroyProc)(graphPtr, elemPtr);
+    Rbc_FreeStyleMap(&elemPtr->styleMap);
     if (elemPtr->optionsInitialized) {
         Tk_FreeConfigOptions((char *)elemPtr, elemPtr->optionTable, graphPtr->tkwin);
         elemPtr->optionsInitialized = FALSE;
@@ -3714,39 +4567,240 @@ void Rbc_DestroyElements(Graph *graphPtr) {
  *
  * Rbc_MapElements --
  *
- *      TODO: Description
+ *      Maps the visible elements that need it.  An element is fully
+ *      remapped when its geometry or the whole graph layout changed
+ *      (MAP_ITEM or MAP_ALL).  When only its pen styles changed
+ *      (MAP_STYLE), MAP_ITEM is left clear so that the element's map
+ *      procedure can keep the screen coordinates it already has.
+ *
+ *      When there are several elements and enough points to map, the
+ *      elements are mapped on several threads (see
+ *      MapElementsInParallel).
  *
  * Parameters:
  *      Graph *graphPtr
  *
  * Results:
- *      TODO: Results
+ *      None.
  *
  * Side Effects:
- *      TODO: Side Effects
+ *      The elements' screen coordinates and pen styles are updated.
  *
  *----------------------------------------------------------------------
  */
 void Rbc_MapElements(Graph *graphPtr) {
     Element *elemPtr;
     Rbc_ChainLink *linkPtr;
+    Tcl_Size nElements;
+    Tcl_WideInt nPoints;
 
     if (graphPtr->mode != MODE_INFRONT) {
         Rbc_ResetStacks(graphPtr);
     }
+    nElements = 0;
+    nPoints = 0;
     for (linkPtr = Rbc_ChainFirstLink(graphPtr->elements.displayList); linkPtr != NULL;
          linkPtr = Rbc_ChainNextLink(linkPtr)) {
         elemPtr = Rbc_ChainGetValue(linkPtr);
-        if (elemPtr->hidden) {
-            continue;
+        if (graphPtr->flags & MAP_ALL) {
+            elemPtr->flags |= MAP_ITEM;
+        }
+        if ((!elemPtr->hidden) && (elemPtr->flags & (MAP_ITEM | MAP_STYLE))) {
+            nElements++;
+            nPoints += NumberOfPoints(elemPtr);
         }
-        if ((graphPtr->flags & MAP_ALL) || (elemPtr->flags & MAP_ITEM)) {
-            (*elemPtr->procsPtr->mapProc)(graphPtr, elemPtr);
-            elemPtr->flags &= ~MAP_ITEM;
+    }
+    /*
+     * Stacked, aligned and overlapping bars are placed relative to
+     * the bars mapped before them, so they are mapped in order.
+     */
+    if ((nElements > 1) && (nPoints >= MAP_PARALLEL_MIN_POINTS) &&
+        ((graphPtr->nStacks == 0) || (graphPtr->mode == MODE_INFRONT)) && (Rbc_GetProcessorCount() > 1)) {
+        MapElementsInParallel(graphPtr, nElements);
+    } else {
+        for (linkPtr = Rbc_ChainFirstLink(graphPtr->elements.displayList); linkPtr != NULL;
+             linkPtr = Rbc_ChainNextLink(linkPtr)) {
+            elemPtr = Rbc_ChainGetValue(linkPtr);
+            if ((!elemPtr->hidden) && (elemPtr->flags & (MAP_ITEM | MAP_STYLE))) {
+                (*elemPtr->procsPtr->mapProc)(graphPtr, elemPtr);
+            }
+        }
+    }
+    for (linkPtr = Rbc_ChainFirstLink(graphPtr->elements.displayList); linkPtr != NULL;
+         linkPtr = Rbc_ChainNextLink(linkPtr)) {
+        elemPtr = Rbc_ChainGetValue(linkPtr);
+        if (!elemPtr->hidden) {
+            elemPtr->flags &= ~(MAP_ITEM | MAP_STYLE);
         }
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompareElementSizes --
+ *
+ *      qsort comparison procedure ordering elements by decreasing
+ *      number of data points, so that the longest maps start first.
+ *
+ * Parameters:
+ *      const void *a
+ *      const void *b
+ *
+ * Results:
+ *      Returns a negative, zero or positive value.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static int CompareElementSizes(const void *a, const void *b) {
+    Tcl_Size n1, n2;
+
+    n1 = NumberOfPoints(*(Element *const *)a);
+    n2 = NumberOfPoints(*(Element *const *)b);
+    return (n1 < n2) - (n1 > n2);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MapQueuedElements --
+ *
+ *      Maps elements from the queue until it is empty.
+ *
+ *      A map procedure only reads the graph geometry, the axes, the
+ *      element's vectors and pens, and only writes to its own element.
+ *      It allocates with ckalloc, which keeps a separate cache for
+ *      each thread, and never calls Tk or Xlib: GCs and fonts belong
+ *      to the configure and draw procedures.  Different elements can
+ *      therefore be mapped at the same time.
+ *
+ * Parameters:
+ *      MapQueue *queuePtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      The elements are mapped.
+ *
+ *----------------------------------------------------------------------
+ */
+static void MapQueuedElements(MapQueue *queuePtr) {
+    Element *elemPtr;
+
+    for (;;) {
+        Tcl_MutexLock(&queuePtr->mutex);
+        elemPtr = NULL;
+        if (queuePtr->next < queuePtr->nElements) {
+            elemPtr = queuePtr->elements[queuePtr->next++];
+        }
+        Tcl_MutexUnlock(&queuePtr->mutex);
+        if (elemPtr == NULL) {
+            break;
+        }
+        (*elemPtr->procsPtr->mapProc)(queuePtr->graphPtr, elemPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MapElementsThread --
+ *
+ *      Body of the threads started by MapElementsInParallel.
+ *
+ * Parameters:
+ *      ClientData clientData - Queue of elements to map.
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      The thread exits once the queue is empty.
+ *
+ *----------------------------------------------------------------------
+ */
+static Tcl_ThreadCreateType MapElementsThread(ClientData clientData) {
+    MapQueuedElements(clientData);
+    Tcl_ExitThread(TCL_OK);
+    TCL_THREAD_CREATE_RETURN;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MapElementsInParallel --
+ *
+ *      Maps the visible elements that need it on up to one thread per
+ *      processor.  The calling thread maps elements too, and returns
+ *      only when all of them are mapped, so drawing always sees
+ *      complete element geometry.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Tcl_Size nElements - Number of elements to map.
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      The elements are mapped.  If a thread can't be started, its
+ *      share of the work is done by the others.
+ *
+ *----------------------------------------------------------------------
+ */
+static void MapElementsInParallel(Graph *graphPtr, Tcl_Size nElements) {
+    MapQueue queue;
+    Tcl_ThreadId threadIds[MAP_MAX_THREADS];
+    Rbc_ChainLink *linkPtr;
+    Element *elemPtr;
+    int nThreads, nStarted;
+    int i, result;
+
+    queue.graphPtr = graphPtr;
+    queue.elements = ckalloc((size_t)nElements * sizeof(*queue.elements));
+    queue.nElements = 0;
+    queue.next = 0;
+    queue.mutex = NULL;
+    for (linkPtr = Rbc_ChainFirstLink(graphPtr->elements.displayList); linkPtr != NULL;
+         linkPtr = Rbc_ChainNextLink(linkPtr)) {
+        elemPtr = Rbc_ChainGetValue(linkPtr);
+        if ((!elemPtr->hidden) && (elemPtr->flags & (MAP_ITEM | MAP_STYLE))) {
+            queue.elements[queue.nElements++] = elemPtr;
+        }
+    }
+    qsort(queue.elements, (size_t)queue.nElements, sizeof(*queue.elements), CompareElementSizes);
+
+    nThreads = MIN(Rbc_GetProcessorCount(), MAP_MAX_THREADS);
+    if ((Tcl_Size)nThreads > queue.nElements) {
+        nThreads = (int)queue.nElements;
+    }
+    /*
+     * Tcl creates a mutex when it is first locked.  Do that here,
+     * before the threads race to lock it.
+     */
+    Tcl_MutexLock(&queue.mutex);
+    Tcl_MutexUnlock(&queue.mutex);
+
+    /* The calling thread is one of the mapping threads. */
+    nStarted = 0;
+    for (i = 1; i < nThreads; i++) {
+        if (Tcl_CreateThread(&threadIds[nStarted], MapElementsThread, &queue, TCL_THREAD_STACK_DEFAULT,
+                             TCL_THREAD_JOINABLE) == TCL_OK) {
+            nStarted++;
+        }
+    }
+    MapQueuedElements(&queue);
+    for (i = 0; i < nStarted; i++) {
+        Tcl_JoinThread(threadIds[i], &result);
+    }
+    Tcl_MutexFinalize(&queue.mutex);
+    ckfree(queue.elements);
+}
+
 /*
  * -----------------------------------------------------------------
  *
@@ -4442,11 +5496,18 @@ static int ConfigureOp(Graph *graphPtr, Tcl_Interp *interp, Rbc_Uid type, Tcl_Si
             }
         }
 
-        graphPtr->flags |= RESET_AXES;
-        graphPtr->flags |= RESET_WORLD;
-        graphPtr->flags |= MAP_WORLD | REDRAW_WORLD;
-
-        elemPtr->flags |= MAP_ITEM;
+        /*
+         * The element's configure procedure sets MAP_ITEM for options
+         * that move its points or change the legend layout.  Anything
+         * else only restyles the element and redraws it.
+         */
+        if (elemPtr->flags & MAP_ITEM) {
+            graphPtr->flags |= RESET_AXES;
+            graphPtr->flags |= RESET_WORLD;
+            graphPtr->flags |= MAP_WORLD | REDRAW_WORLD;
+        } else {
+            graphPtr->flags |= REDRAW_WORLD;
+        }
     }
 
     graphPtr->flags |= REDRAW_BACKING_STORE | DRAW_MARGINS;
@@ -4567,6 +5628,158 @@ static int ExistsOp(Graph *graphPtr, Tcl_Interp *interp, Rbc_Uid type, Tcl_Size
     return TCL_OK;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * FindOp --
+ *
+ *      Finds the data points of an element inside of a rectangle or
+ *      polygon, given in window coordinates.
+ *
+ *      .g element find elemName -rectangle x1 y1 x2 y2 ?-vector vecName?
+ *      .g element find elemName -polygon coords ?-vector vecName?
+ *
+ *      The points are mapped and tested a block at a time, so the
+ *      element's data is never copied.  If the x values are ordered,
+ *      only the points that can lie within the region's horizontal
+ *      extent (vertical if the graph is inverted) are tested.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Tcl_Interp *interp
+ *      Rbc_Uid type
+ *      int objc
+ *      Tcl_Obj *const objv[]
+ *
+ * Results:
+ *      A standard Tcl result.  The interpreter result is a list of the
+ *      indices of the points found, in increasing order.  If a vector
+ *      is named, the indices are stored in it instead, and the result
+ *      is the number of points found.
+ *
+ * Side Effects:
+ *      The vector is created if it doesn't already exist.
+ *
+ *----------------------------------------------------------------------
+ */
+static int FindOp(Graph *graphPtr, Tcl_Interp *interp, Rbc_Uid type, Tcl_Size objc, Tcl_Obj *const objv[]) {
+    Element *elemPtr;
+    FindRegion region;
+    Point2D *screenPts;
+    unsigned char *keep, *inside;
+    double *indexArr;
+    double min, max;
+    Tcl_Size nIndices, indexSize;
+    Tcl_Size first, end, start;
+
+    if (NameToElement(graphPtr, objv[3], &elemPtr) != TCL_OK) {
+        return TCL_ERROR; /* Can't find named element */
+    }
+    if (ParseFindOptions(graphPtr, interp, objc, objv, &region) != TCL_OK) {
+        if (region.points != NULL) {
+            ckfree(region.points);
+        }
+        return TCL_ERROR;
+    }
+    if (graphPtr->flags & RESET_AXES) {
+        Rbc_ResetAxes(graphPtr);
+    }
+    first = 0;
+    end = NumberOfPoints(elemPtr);
+    /* Skip the element if the X or Y vectors have notifications pending */
+    if ((Rbc_VectorNotifyPending(elemPtr->x.clientId)) || (Rbc_VectorNotifyPending(elemPtr->y.clientId))) {
+        end = 0;
+    }
+    if (graphPtr->inverted) {
+        min = region.exts.top, max = region.exts.bottom;
+    } else {
+        min = region.exts.left, max = region.exts.right;
+    }
+    /*
+     * Widen the range by a pixel, since the crossing of a polygon's
+     * edge may be rounded just outside of its bounding box.
+     */
+    if ((end > 0) && (!GetFindRange(graphPtr, elemPtr, min - 1.0, max + 1.0, &first, &end))) {
+        first = 0;
+    }
+    indexArr = NULL;
+    nIndices = indexSize = 0;
+    screenPts = ckalloc(FIND_BLOCK_POINTS * sizeof(Point2D));
+    keep = ckalloc(FIND_BLOCK_POINTS * 2);
+    inside = keep + FIND_BLOCK_POINTS;
+    for (start = first; start < end; start += FIND_BLOCK_POINTS) {
+        Tcl_Size n, i;
+
+        n = MIN(end - start, FIND_BLOCK_POINTS);
+        if (Rbc_MapArray2D(graphPtr, &elemPtr->axes, elemPtr->x.valueArr + start, elemPtr->y.valueArr + start, n,
+                           screenPts, keep) == 0) {
+            continue;
+        }
+        if (region.isPolygon) {
+            if (Rbc_PointsInPolygon(screenPts, n, region.points, region.nPoints, inside) == 0) {
+                continue;
+            }
+        } else {
+            for (i = 0; i < n; i++) {
+                inside[i] = (screenPts[i].x >= region.exts.left) & (screenPts[i].x <= region.exts.right) &
+                            (screenPts[i].y >= region.exts.top) & (screenPts[i].y <= region.exts.bottom);
+            }
+        }
+        for (i = 0; i < n; i++) {
+            if (!(keep[i] & inside[i])) {
+                continue;
+            }
+            if (nIndices == indexSize) {
+                indexSize = (indexSize == 0) ? 256 : indexSize * 2;
+                indexArr = ckrealloc(indexArr, indexSize * sizeof(double));
+            }
+            indexArr[nIndices++] = (double)(start + i);
+        }
+    }
+    ckfree(keep);
+    ckfree(screenPts);
+    if (region.points != NULL) {
+        ckfree(region.points);
+    }
+    if (region.vecNameObj != NULL) {
+        Rbc_Vector *vecPtr;
+        const char *vecName;
+
+        vecName = Tcl_GetString(region.vecNameObj);
+        if (Rbc_GetVector(interp, vecName, &vecPtr) != TCL_OK) {
+            Tcl_ResetResult(interp);
+            if (Rbc_CreateVector(interp, vecName, 0, &vecPtr) != TCL_OK) {
+                goto error;
+            }
+        }
+        /* The vector takes over the array of indices. */
+        if (Rbc_ResetVector(vecPtr, indexArr, nIndices, indexSize, (indexArr == NULL) ? TCL_STATIC : TCL_DYNAMIC) !=
+            TCL_OK) {
+            goto error;
+        }
+        Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt)nIndices));
+    } else {
+        Tcl_Obj *listObjPtr;
+        Tcl_Size i;
+
+        listObjPtr = Tcl_NewListObj(0, NULL);
+        for (i = 0; i < nIndices; i++) {
+            Tcl_ListObjAppendElement(interp, listObjPtr, Tcl_NewWideIntObj((Tcl_WideInt)indexArr[i]));
+        }
+        if (indexArr != NULL) {
+            ckfree(indexArr);
+        }
+        Tcl_SetObjResult(interp, listObjPtr);
+    }
+    return TCL_OK;
+
+error:
+    if (indexArr != NULL) {
+        ckfree(indexArr);
+    }
+    return TCL_ERROR;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -4749,6 +5962,7 @@ static const ElementOpSpec elemOps[] = {
     {{"deactivate", 3, 0, "?elemName?..."}, DeactivateOp},
     {{"delete", 3, 0, "?elemName?..."}, DeleteOp},
     {{"exists", 4, 4, "elemName"}, ExistsOp},
+    {{"find", 5, 0, "elemName -rectangle x1 y1 x2 y2|-polygon coords ?-vector vecName?"}, FindOp},
     {{"get", 4, 4, "name"}, GetOp},
     {{"names", 3, 0, "?pattern?..."}, NamesOp},
     {{"show", 3, 4, "?elemList?"}, ShowOp},
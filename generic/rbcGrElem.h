@@ -56,6 +56,11 @@
               * colors. */
 #define SCALE_SYMBOL (1 << 10)
 
+#define MAP_STYLE                                                                                                      \
+    (1 << 11) /* Only the pen styles of the element                                                                    \
+               * changed.  Its mapped points are kept                                                                  \
+               * and only the pens are reassigned. */
+
 #define NumberOfPoints(e) MIN((e)->x.nValues, (e)->y.nValues)
 
 /*
@@ -102,6 +107,50 @@ typedef struct {
                      * the current graph size. */
 } PenStyle;
 
+/*
+ * -------------------------------------------------------------------
+ *
+ * StyleMap --
+ *
+ *    Pen style of each data point of an element, kept as the position
+ *    of the style in the element's palette.  Positions are one, two or
+ *    four bytes each, the fewest that hold the number of styles.
+ *
+ *    The weights are looked up in a table of intervals, sorted by their
+ *    lowest weight, each giving the style of the weights from there up
+ *    to the next interval.  The positions are kept from one map of the
+ *    element to the next, until the weights or the table change.
+ *
+ * -------------------------------------------------------------------
+ */
+typedef struct {
+    double min; /* Lowest weight of the interval. */
+    int style;  /* Position of its style. */
+} StyleInterval;
+
+typedef struct {
+    PenStyle **styles; /* Styles of the palette, in order. */
+    int nStyles;
+
+    StyleInterval *intervals;
+    int nIntervals;
+
+    int indexSize;  /* Bytes per position: 1, 2 or 4. */
+    void *indices;  /* Position of the style of each point. */
+    Tcl_Size nPoints;
+
+    /* What the positions were found from. */
+    const double *weights;
+    Tcl_Size nWeights;
+    unsigned long weightStamp;
+} StyleMap;
+
+#define Rbc_StyleMapIndex(m, i)                                                                                        \
+    (((m)->indexSize == 1)   ? (int)((unsigned char *)(m)->indices)[i]                                                 \
+     : ((m)->indexSize == 2) ? (int)((unsigned short *)(m)->indices)[i]                                                \
+                             : (int)((unsigned int *)(m)->indices)[i])
+#define Rbc_StyleMapStyle(m, i) ((m)->styles[Rbc_StyleMapIndex(m, i)])
+
 typedef struct {
     XColor *color; /* Color of error bar */
     int lineWidth; /* Width of the error bar segments. */
@@ -184,6 +233,10 @@ typedef struct {
 
     Element *elemPtr; /* Element associated with vector. */
 
+    Tcl_Size changedFirst; /* Lowest index changed since the element
+                            * last summarized the values.  Zero when
+                            * the vector is replaced. */
+
 } ElemVector;
 
 typedef struct {
@@ -200,6 +253,9 @@ typedef struct {
     ElemVector yError;
     ElemVector yHigh;
     ElemVector yLow;
+
+    ElemVector colorData;
+    ElemVector sizeData;
 } ElemDataTransaction;
 
 typedef struct {
@@ -268,6 +324,10 @@ struct ElementStruct {
     ElemVector yHigh, yLow; /* Absolute/asymmetric Y-coordinate high/low
                 error values. */
 
+    ElemVector colorData; /* Per-point values mapped through the
+                           * colormap to color the symbols. */
+    ElemVector sizeData;  /* Per-point symbol sizes in pixels. */
+
     Tcl_Size *activeIndices; /* Array of indices (malloc-ed) which
                          * indicate which data points are
                          * active (drawn with "active"
@@ -328,6 +388,8 @@ struct ElementStruct {
     Tcl_Obj *yErrorObjPtr;
     Tcl_Obj *yHighObjPtr;
     Tcl_Obj *yLowObjPtr;
+    Tcl_Obj *colorVectorObjPtr;
+    Tcl_Obj *sizeVectorObjPtr;
 
     int optionsInitialized;
     int tkResourcesReleased;
@@ -361,6 +423,27 @@ struct ElementStruct {
                             * used to scale the size of element's
                             * symbol. */
     int state;
+
+    /*
+     * Cached order of the x values.  Of the first xChecked values,
+     * the first xOrdered are finite and non-decreasing.  Both are
+     * lowered when the x values change.
+     */
+    Tcl_Size xOrdered;
+    Tcl_Size xChecked;
+
+    /*
+     * Counts the changes of the x or y values, so that what's derived
+     * from them can tell if it is out of date.
+     */
+    unsigned long dataStamp;
+
+    /*
+     * Counts the changes of the weights, and the style of each point
+     * found from them.
+     */
+    unsigned long weightStamp;
+    StyleMap styleMap;
 };
 
 Element *Rbc_BarElement(Graph *, const char *, Rbc_Uid);
@@ -372,6 +455,8 @@ int Rbc_ParseElemVectorPairsObj(Tcl_Interp *interp, Element *elemPtr, Tcl_Obj *o
                                 ElemVector *yCandidatePtr);
 void Rbc_CommitElemVector(Element *elemPtr, ElemVector *destPtr, ElemVector *candidatePtr);
 double Rbc_FindElemVectorMinimum(ElemVector *vecPtr, double minLimit);
+int Rbc_ElemXOrdered(Element *elemPtr);
+int Rbc_GetElemVisibleRange(Element *elemPtr, double margin, Tcl_Size *firstPtr, Tcl_Size *lastPtr);
 int Rbc_PrepareElemDataTransaction(Graph *graphPtr, Element *elemPtr, ElemDataTransaction *transactionPtr);
 void Rbc_CommitElemDataTransaction(Element *elemPtr, ElemDataTransaction *transactionPtr);
 void Rbc_FreeElemDataTransaction(ElemDataTransaction *transactionPtr);
@@ -396,8 +481,10 @@ void Rbc_FreeElemStylesTransaction(Graph *graphPtr, ElemStylesTransaction *trans
 void Rbc_FreePalette(Graph *graphPtr, Rbc_Chain *palette);
 void Rbc_DestroyPalette(Graph *graphPtr, Rbc_Chain *palette);
 int Rbc_ParseStylesObj(Graph *graphPtr, Element *elemPtr, Tcl_Obj *objPtr, size_t styleSize, Rbc_Chain **palettePtrPtr);
-PenStyle **Rbc_StyleMap(Element *elemPtr);
-void Rbc_MapErrorBars(Graph *graphPtr, Element *elemPtr, PenStyle **dataToStyle);
+StyleMap *Rbc_StyleMap(Element *elemPtr);
+Tcl_Size *Rbc_StyleMapOrder(const StyleMap *mapPtr, const Tcl_Size *toData, Tcl_Size nItems, Tcl_Size *counts);
+void Rbc_FreeStyleMap(StyleMap *mapPtr);
+void Rbc_MapErrorBars(Graph *graphPtr, Element *elemPtr, StyleMap *mapPtr);
 void Rbc_ExpandErrorBarExtents(Element *elemPtr, Extents2D *extsPtr);
 int Rbc_ValidateValueFormat(Tcl_Interp *interp, const char *format);
 void Rbc_FormatValueLabel(char *buffer, size_t bufferSize, const char *format, int show, double x, double y);
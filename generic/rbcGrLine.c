@@ -58,6 +58,218 @@ static SmoothingInfo smoothingInfo[] = {{"linear", PEN_SMOOTH_NONE},         {"s
                                         {"quadratic", PEN_SMOOTH_QUADRATIC}, {"catrom", PEN_SMOOTH_CATROM},
                                         {(char *)NULL, PEN_SMOOTH_LAST}};
 
+typedef enum {
+    LINE_DECIMATE_AUTO, /* Decimate only when the picture can't change */
+    LINE_DECIMATE_OFF,  /* Never decimate */
+    LINE_DECIMATE_M4    /* Decimate whenever the x data is monotone */
+} Decimation;
+
+typedef struct {
+    char *name;
+    Decimation value;
+} DecimationInfo;
+
+static DecimationInfo decimationInfo[] = {
+    {"auto", LINE_DECIMATE_AUTO}, {"off", LINE_DECIMATE_OFF}, {"m4", LINE_DECIMATE_M4}, {(char *)NULL, 0}};
+
+typedef enum {
+    LINE_SYMBOL_CULL_OFF,  /* Draw every symbol */
+    LINE_SYMBOL_CULL_PIXEL /* Draw only the topmost symbol of each
+                            * pen at each pixel */
+} SymbolCulling;
+
+typedef struct {
+    char *name;
+    SymbolCulling value;
+} SymbolCullingInfo;
+
+static SymbolCullingInfo symbolCullingInfo[] = {
+    {"off", LINE_SYMBOL_CULL_OFF}, {"pixel", LINE_SYMBOL_CULL_PIXEL}, {(char *)NULL, 0}};
+
+typedef enum {
+    LINE_RENDER_NORMAL, /* Draw the traces and symbols */
+    LINE_RENDER_DENSITY /* Draw an image of the number of points
+                         * at each pixel */
+} Rendering;
+
+typedef struct {
+    char *name;
+    Rendering value;
+} RenderingInfo;
+
+static RenderingInfo renderingInfo[] = {
+    {"normal", LINE_RENDER_NORMAL}, {"density", LINE_RENDER_DENSITY}, {(char *)NULL, 0}};
+
+typedef enum {
+    DENSITY_SCALE_LINEAR, /* Colors are proportional to the counts */
+    DENSITY_SCALE_LOG,    /* ... to the logarithm of the counts */
+    DENSITY_SCALE_EQHIST  /* ... to the rank of the counts, so that
+                           * each color is used about as often */
+} DensityScale;
+
+typedef struct {
+    char *name;
+    DensityScale value;
+} DensityScaleInfo;
+
+static DensityScaleInfo densityScaleInfo[] = {{"linear", DENSITY_SCALE_LINEAR},
+                                              {"log", DENSITY_SCALE_LOG},
+                                              {"eqhist", DENSITY_SCALE_EQHIST},
+                                              {(char *)NULL, 0}};
+
+/*
+ * Colormaps run from the color of the lowest value to that of the
+ * highest through evenly spaced stops.
+ */
+typedef struct {
+    unsigned char red, green, blue;
+} ColormapStop;
+
+typedef struct {
+    char *name;
+    const ColormapStop *stops;
+    int nStops;
+} ColormapInfo;
+
+static const ColormapStop bluesStops[] = {{222, 235, 247}, {158, 202, 225}, {66, 146, 198}, {8, 48, 107}};
+static const ColormapStop greyStops[] = {{224, 224, 224}, {0, 0, 0}};
+static const ColormapStop hotStops[] = {{128, 0, 0}, {255, 0, 0}, {255, 128, 0}, {255, 255, 0}, {255, 255, 192}};
+static const ColormapStop viridisStops[] = {{68, 1, 84},    {72, 40, 120},  {62, 74, 137},  {49, 104, 142},
+                                            {38, 130, 142}, {31, 158, 137}, {53, 183, 121}, {109, 205, 89},
+                                            {180, 222, 44}, {253, 231, 37}};
+
+static ColormapInfo colormapInfo[] = {{"blues", bluesStops, sizeof(bluesStops) / sizeof(bluesStops[0])},
+                                      {"grey", greyStops, sizeof(greyStops) / sizeof(greyStops[0])},
+                                      {"hot", hotStops, sizeof(hotStops) / sizeof(hotStops[0])},
+                                      {"viridis", viridisStops, sizeof(viridisStops) / sizeof(viridisStops[0])},
+                                      {(char *)NULL, NULL, 0}};
+
+/*
+ * A trace is only decimated when it has more than DECIMATE_MIN_RATIO
+ * points per pixel column.  Below that, M4 keeps nearly every point.
+ */
+#define DECIMATE_MIN_RATIO 4
+
+/*
+ * Long traces keep a pyramid of level-of-detail summaries, so that
+ * zooming and panning only read the points in view.  A block of
+ * level 0 summarizes LOD_BRANCH data points, and a block of each
+ * following level summarizes LOD_BRANCH blocks of the level below.
+ * It's built for traces of at least LOD_MIN_POINTS points whose x
+ * values are finite and never decrease.  Fifteen levels are enough
+ * for any Tcl_Size.
+ */
+#define LOD_BRANCH 16
+#define LOD_MIN_POINTS 65536
+#define LOD_MAX_LEVELS 15
+
+/*
+ * Pen attributes that the mapped points depend upon (see
+ * GetMappedStyles).
+ */
+#define MAPPED_TRACES (1 << 0)
+#define MAPPED_DECIMATE (1 << 1)
+
+/*
+ * When the graph's -asyncmap option is set, elements of at least
+ * ASYNC_MAP_MIN_POINTS data points are mapped on a worker thread.
+ */
+#define ASYNC_MAP_MIN_POINTS (1 << 20)
+
+/*
+ * Density images of elements with at least DENSITY_PARALLEL_MIN_POINTS
+ * data points are counted on up to DENSITY_MAX_THREADS threads, each
+ * with its own grid.  The points are mapped DENSITY_BLOCK_POINTS at a
+ * time.
+ */
+#define DENSITY_PARALLEL_MIN_POINTS (1 << 20)
+#define DENSITY_MAX_THREADS 16
+#define DENSITY_BLOCK_POINTS 4096
+
+/*
+ * The out codes of the points of traces are computed
+ * TRACE_BLOCK_POINTS at a time, before their segments are clipped.
+ */
+#define TRACE_BLOCK_POINTS 256
+
+/*
+ * Closest searches of elements with at least CLOSEST_GRID_MIN_ITEMS
+ * mapped points or segments use a grid of square cells, so that only
+ * the cells within the search distance are examined.  The cells are
+ * sized for about CLOSEST_GRID_CELL_ITEMS items each.  A segment whose
+ * bounding box covers more than CLOSEST_GRID_MAX_SPAN cells is kept
+ * out of the cells and always examined.
+ */
+#define CLOSEST_GRID_MIN_ITEMS 512
+#define CLOSEST_GRID_CELL_ITEMS 2
+#define CLOSEST_GRID_MAX_SPAN 16
+
+typedef struct {
+    Tcl_Size minIndex; /* Index of the smallest y value of the block,
+                        * or -1 if one of its y values isn't
+                        * finite. */
+    Tcl_Size maxIndex; /* Index of the largest y value of the
+                        * block. */
+} LodBlock;
+
+typedef struct {
+    LodBlock *levels[LOD_MAX_LEVELS]; /* Blocks of each level, finest
+                                       * first. */
+    Tcl_Size nBlocks[LOD_MAX_LEVELS]; /* Number of blocks in use. */
+    Tcl_Size sizes[LOD_MAX_LEVELS];   /* Number of blocks allocated. */
+    int nLevels;
+    Tcl_Size nPoints; /* Number of data points summarized. */
+} LodPyramid;
+
+typedef struct {
+    float x1, y1;       /* End points of the segment, in the */
+    float x2, y2;       /* precision of the traces. */
+    Tcl_Size dataIndex; /* Index of the data point starting the
+                         * segment. */
+} ClosestSegment;
+
+/*
+ * A uniform grid over the mapped points, or the trace segments, of a
+ * line element.  It's built by the first closest search that needs it
+ * and freed whenever the mapped points change.  Items are numbered in
+ * the order a plain scan would examine them: indices of the symbol
+ * points, or of the segments array.
+ */
+typedef struct {
+    double left, top;         /* Screen coordinates of the corner of
+                               * the first cell. */
+    double cellSize;          /* Width and height of a cell. */
+    int nColumns, nRows;
+    Tcl_Size *cellStart;      /* Start of the items of each cell in
+                               * cellItems, followed by the number of
+                               * items in cellItems. */
+    Tcl_Size *cellItems;      /* Items in each cell, in order. */
+    Tcl_Size *wideItems;      /* Segments too long to be kept in the
+                               * cells, in order. */
+    Tcl_Size nWideItems;
+    ClosestSegment *segments; /* Segments of the grid, or NULL if the
+                               * items are symbol points. */
+    Tcl_Size nSegments;
+} ClosestGrid;
+
+/*
+ * The natural or quadratic spline through the data points of a line,
+ * fitted in axis coordinates: the data values, or their logarithms on
+ * a logarithmic axis.  Screen coordinates are an affine function of
+ * axis coordinates, so the spline holds for any range of the axes and
+ * any size of the graph.  It's only fit again when the data, the
+ * smoothing or the scale of an axis changes.
+ */
+typedef struct {
+    Rbc_Spline *fitPtr;      /* Fitted spline, or NULL if the data
+                              * points can't be fit. */
+    Smoothing smooth;        /* Smoothing it was fit for, or
+                              * PEN_SMOOTH_NONE if there's no fit. */
+    int logScales;           /* Log scales of the axes it was fit for:
+                              * bit 0 is the x axis, bit 1 the y axis. */
+    unsigned long dataStamp; /* Data stamp of the element when fit. */
+} LineSpline;
+
 typedef struct {
     Point2D *screenPts;  /* Array of transformed coordinates */
     Tcl_Size nScreenPts; /* Number of coordinates */
@@ -70,6 +282,7 @@ typedef struct {
      * NULL means that the entire mapped point array is continuous.
      */
     unsigned char *breakBefore;
+    int decimated; /* Indicates that decimation dropped points. */
 } MapInfo;
 
 /*
@@ -111,19 +324,153 @@ typedef struct {
     Pixmap mask;
 } ParsedSymbol;
 
+/*
+ * Screen coordinates of a point of a trace, in single precision.
+ * Traces are clipped to the plotting area, where a float still
+ * resolves a small fraction of a pixel, and TraceCoord keeps each
+ * point on the pixel it was drawn at in double precision.  Drawing,
+ * PostScript output and trace searches use these points; only the
+ * symbol points keep double precision.
+ */
+typedef struct {
+    float x, y;
+} TracePoint;
+
 typedef struct {
-    Tcl_Size start;         /* Index into the X-Y coordinate
-                             * arrays indicating where trace
-                             * starts. */
+    Tcl_Size first;         /* Index of the trace's first point in
+                             * the points of the element's
+                             * traces. */
     Tcl_Size nScreenPts;    /* Number of points in the continuous
                              * trace */
-    Point2D *screenPts;     /* Array of screen coordinates
-                             * (malloc-ed) representing the
-                             * trace. */
+    Tcl_Size firstIndex;    /* Index of the trace's first entry in
+                             * the data indices of the traces, or
+                             * -1 if its points map to consecutive
+                             * data points. */
+    Tcl_Size dataIndex;     /* Index of the data point of the
+                             * trace's first point. */
+    Tcl_Size firstDraw;     /* Index of the trace's first entry in
+                             * the drawn points of the traces, or
+                             * -1 if every point is drawn. */
+    Tcl_Size nDrawPts;      /* Number of points drawn for the
+                             * trace on the screen. */
+} LineTrace;
+
+/*
+ * LineTraces --
+ *
+ *      The traces of a line element.  The points of all traces are
+ *      stored one after the other in the same arrays, and each trace
+ *      is a slice of them.  The arrays are kept, and only grown, from
+ *      one map of the element to the next.
+ */
+typedef struct {
+    LineTrace *runs;        /* Traces, in the order they're mapped. */
+    Tcl_Size nRuns, runSpace;
+    TracePoint *screenPts;  /* Screen coordinates of the points of
+                             * the traces. */
+    Tcl_Size nScreenPts, pointSpace;
     Tcl_Size *symbolToData; /* Reverse mapping of screen
                              * coordinate indices back to their
-                             * data coordinates */
-} LineTrace;
+                             * data coordinates, for the traces
+                             * whose firstIndex isn't -1. */
+    Tcl_Size nIndices, indexSpace;
+    Tcl_Size *drawPts;      /* For each trace whose firstDraw isn't
+                             * -1, the indices in the trace of the
+                             * screen points that change the
+                             * rasterized trace. */
+    Tcl_Size nDrawPts, drawSpace;
+} LineTraces;
+
+/*
+ * Return the screen points of a trace, the data index of its i-th
+ * point, and the i-th point drawn for it on the screen.
+ */
+#define TRACE_POINTS(l, t) ((l)->traces.screenPts + (t)->first)
+#define TRACE_DATA_INDEX(l, t, i)                                                                                      \
+    (((t)->firstIndex >= 0) ? (l)->traces.symbolToData[(t)->firstIndex + (i)] : (t)->dataIndex + (i))
+#define TRACE_DRAW_POINT(l, t, i)                                                                                      \
+    (TRACE_POINTS(l, t) + (((t)->firstDraw >= 0) ? (l)->traces.drawPts[(t)->firstDraw + (i)] : (i)))
+
+/*
+ * SpriteRun --
+ *
+ *      A row of adjacent pixels of a symbol sprite.
+ */
+typedef struct {
+    int x, y;       /* Position of the first pixel, relative to
+                     * the center of the symbol. */
+    int length;     /* Number of pixels in the run. */
+    Tcl_Size first; /* Index of the first pixel's value in the
+                     * sprite's array of pixels. */
+} SpriteRun;
+
+/*
+ * SymbolSprite --
+ *
+ *      The pixels of one symbol of a pen, as the X server draws it.
+ *      Large numbers of symbols are stamped from the sprite into an
+ *      image of the drawable, instead of being drawn one by one.
+ */
+typedef struct SymbolSpriteStruct {
+    int size;                  /* Size of the symbol. */
+    int colorKey;              /* Color the symbol is drawn in, or 0
+                                * for the pen's colors (see
+                                * SetSymbolColor). */
+    int left, right;           /* Horizontal extent of the pixels,
+                                * relative to the symbol's center. */
+    int top, bottom;           /* Vertical extent of the pixels. */
+    Tcl_Size nRuns;
+    SpriteRun *runs;           /* Rows of pixels covered by the
+                                * symbol. */
+    unsigned long *pixels;     /* Pixel values of the runs. */
+    struct SymbolSpriteStruct *nextPtr;
+} SymbolSprite;
+
+/*
+ * SpriteBatch --
+ *
+ *      Symbols stamped from the same sprite.
+ */
+typedef struct {
+    SymbolSprite *spritePtr;
+    Tcl_Size nSymbolPts;
+    Point2D *symbolPts;
+} SpriteBatch;
+
+/*
+ * The symbols of an element with a -colorvector or -sizevector are
+ * keyed by the index of their color in the colormap and their size in
+ * pixels.  SYMBOL_COLOR_PEN and SYMBOL_SIZE_STYLE are the keys of the
+ * symbols drawn in the colors and size of their pen style.
+ */
+#define SYMBOL_COLORS 256
+#define SYMBOL_COLOR_PEN SYMBOL_COLORS
+#define SYMBOL_SIZE_STYLE 255
+
+/*
+ * SymbolRun --
+ *
+ *      Consecutive symbols of a pen style with the same color and
+ *      size keys.
+ */
+typedef struct {
+    Tcl_Size first;            /* Index of the first symbol point. */
+    Tcl_Size nSymbolPts;
+    int color;                 /* Color key of the symbols. */
+    int size;                  /* Size of the symbols in pixels. */
+} SymbolRun;
+
+/*
+ * SymbolSort --
+ *
+ *      Scratch arrays of GroupSymbolColors.
+ */
+typedef struct {
+    Point2D *points;
+    Tcl_Size *toData;
+    unsigned short *colors;
+    unsigned char *sizes;
+} SymbolSort;
 
 typedef struct {
     /*
@@ -151,6 +498,9 @@ typedef struct {
     Tcl_Obj *valueShadowObjPtr;
     
     Symbol symbol;
+    SymbolSprite *sprites; /* Sprites of the symbol, one for each
+                            * size drawn.  They are freed whenever
+                            * the pen is configured. */
 
     int traceWidth;
     Rbc_Dashes traceDashes;
@@ -207,6 +557,28 @@ typedef struct {
 
 } LinePenStyle;
 
+/*
+ * Number of data points at each pixel of the plotting area, drawn as
+ * a single image when the element's -render option is density.
+ */
+typedef struct {
+    uint32_t *counts;          /* Hits of each pixel, row by row, or
+                                * NULL if the element isn't mapped as
+                                * a density image.  Counts are exact
+                                * integers, converted to fractions
+                                * only when colored. */
+    int x, y;                  /* Screen position of the first pixel. */
+    int width, height;         /* Dimensions of the grid. */
+    unsigned int stamp;        /* Changes whenever the counts do. */
+    Pixmap pixmap;             /* Image of the counts, or None. */
+    Pixmap mask;               /* Pixels with no points clear, or None
+                                * if every pixel has some. */
+    ColorTable colorTable;     /* Colors allocated for the image. */
+    unsigned int pixmapStamp;  /* Stamp of the counts in the image. */
+} DensityGrid;
+
+typedef struct AsyncMapStruct AsyncMap;
+
 typedef struct {
     Element core;
     /*
@@ -221,8 +593,13 @@ typedef struct {
      */
     Tcl_Obj *areaPatternObjPtr;
     Tcl_Obj *areaTileObjPtr;
+    Tcl_Obj *colormapObjPtr;
+    Tcl_Obj *decimateObjPtr;
+    Tcl_Obj *densityScaleObjPtr;
     Tcl_Obj *maxSymbolsObjPtr;
+    Tcl_Obj *renderObjPtr;
     Tcl_Obj *smoothObjPtr;
+    Tcl_Obj *symbolCullObjPtr;
     Tcl_Obj *traceObjPtr;
     
     /* Line smoothing */
@@ -231,8 +608,50 @@ typedef struct {
 
     Smoothing smooth; /* Smoothing function used. */
 
+    Decimation decimate; /* Reduces the trace to the first, last,
+                          * minimum and maximum point of each
+                          * pixel column. */
+
+    SymbolCulling symbolCull; /* Drops the symbols hidden under a
+                               * symbol of the same pen drawn at the
+                               * same pixel. */
+
+    Rendering render;          /* Draws the traces and symbols, or the
+                                * density of the points. */
+    int colormap;              /* Index in colormapInfo of the colors
+                                * of the density image. */
+    DensityScale densityScale; /* Maps the counts to colors. */
+    DensityGrid density;       /* Counts of the density image. */
+
+    double splineTolerance; /* Largest distance in pixels between a
+                             * Catmull-Rom spline and the segments
+                             * drawn for it. */
+
     double rTolerance; /* Tolerance to reduce the number of
                         * points displayed. */
+
+    LodPyramid lod; /* Level-of-detail summaries of long
+                     * traces. */
+
+    LineSpline spline; /* Spline through the data points, for
+                        * natural and quadratic smoothing. */
+
+    int mappedStyles; /* Pen attributes that the mapped points
+                       * depend upon (see GetMappedStyles). */
+
+    Tcl_Size mappedPoints; /* Number of data points when the element
+                            * was last mapped.  No mapped point
+                            * refers to a data point past it. */
+
+    int decimated; /* Indicates that the mapped points were
+                    * decimated.  Closest searches then look at
+                    * the data points instead. */
+
+    AsyncMap *asyncPtr; /* Map of the element in progress on a
+                         * worker thread, or NULL. */
+    int asyncPending;   /* Indicates that another map was asked for
+                         * after asyncPtr was canceled.  It's
+                         * started once asyncPtr finishes. */
     /*
      * Drawing related data structures.
      */
@@ -278,6 +697,20 @@ typedef struct {
     Tcl_Size symbolInterval;
     Tcl_Size symbolCounter;
 
+    /* Per-point symbol colors and sizes */
+    unsigned short *symbolColors; /* Color key of each symbol point,
+                                   * or NULL without a color vector. */
+    unsigned char *symbolSizes;   /* Size key of each symbol point,
+                                   * or NULL without a size vector. */
+    XColor **colorTable;          /* Colors of the colormap allocated
+                                   * for the symbols, as they're
+                                   * drawn.  */
+    int colorTableMap;            /* Colormap of the colorTable. */
+    GC colorGC;                   /* Draws the symbols of a color in
+                                   * place of the pen's symbol GCs. */
+    int symbolColorKey;           /* Color the symbols are currently
+                                   * drawn in (see SetSymbolColor). */
+
     /* X-Y graph-specific fields */
 
     int penDir; /* Indicates if a change in the pen
@@ -285,8 +718,8 @@ typedef struct {
                  * retrace (line segment is not
                  * drawn). */
 
-    Rbc_Chain *traces; /* List of traces (a trace is a series
-                        * of contiguous line segments).  New
+    LineTraces traces; /* Traces (a trace is a series of
+                        * contiguous line segments).  New
                         * traces are generated when either
                         * the next segment changes the pen
                         * direction, or the end point is
@@ -300,6 +733,11 @@ typedef struct {
     Tcl_Size nStrips;       /* Number of line segments to be drawn. */
     Tcl_Size *stripToData;  /* Pen to visible line segment mapping. */
 
+    ClosestGrid *pointGrid;   /* Grids for closest searches of the
+                               * symbol points and of the traces or
+                               * strips, or NULL if not built. */
+    ClosestGrid *segmentGrid;
+
 } Line;
 
 _Static_assert(offsetof(Line, core) == 0, "Element core must be the first Line member");
@@ -309,11 +747,55 @@ _Static_assert(offsetof(Line, core) == 0, "Element core must be the first Line m
 #define LINE_CORE_OFFSET(member) (offsetof(Line, core) + offsetof(Element, member))
 #define LINE_BUILTIN_PEN_OFFSET(member) (offsetof(Line, builtinPen) + offsetof(LinePen, member))
 
+/*
+ * A map of a line element on a worker thread.  The worker maps a copy
+ * of the element whose data values, axes and graph geometry are
+ * snapshots taken when the map started, so nothing it reads changes
+ * while it runs.  The copy has no pen styles: the mapped points are
+ * assigned to the styles of the element when they are swapped in.
+ */
+struct AsyncMapStruct {
+    Line *linePtr;         /* Element being mapped, or NULL if it was
+                            * destroyed.  Only used by the thread of
+                            * the graph. */
+    Line line;             /* Copy of the element that is mapped. */
+    Graph graph;           /* Snapshot of the graph. */
+    Axis xAxis, yAxis;     /* Snapshots of the element's axes. */
+    double *values;        /* Snapshot of the x values, followed by
+                            * the y values. */
+    Tcl_Size nPoints;      /* Number of data points in the snapshot. */
+    Tcl_ThreadId threadId; /* Thread of the graph. */
+    Tcl_Mutex mutex;       /* Protects canceled. */
+    int canceled;          /* Indicates that the result is no longer
+                            * wanted. */
+};
+
+typedef struct {
+    Tcl_Event header;
+    AsyncMap *asyncPtr;
+} AsyncMapEvent;
+
+/*
+ * Share of the data points of a density image counted by one thread.
+ */
+typedef struct {
+    Graph *graphPtr;
+    Axis2D *axesPtr;         /* Axes mapping the data points. */
+    const double *x, *y;     /* Data values of the element. */
+    Tcl_Size first, last;    /* Range of data points counted.  The
+                              * last point is excluded. */
+    const DensityGrid *gridPtr; /* Position and size of the grid. */
+    uint32_t *counts;        /* Grid receiving the counts. */
+} DensityTask;
+
 #define DEF_LINE_ACTIVE_PEN "activeLine"
 #define DEF_LINE_AXIS_X "x"
 #define DEF_LINE_AXIS_Y "y"
+#define DEF_LINE_COLORMAP "viridis"
 #define DEF_LINE_DASHES (char *)NULL
 #define DEF_LINE_DATA (char *)NULL
+#define DEF_LINE_DECIMATE "auto"
+#define DEF_LINE_DENSITY_SCALE "linear"
 #define DEF_LINE_FILL_COLOR "defcolor"
 #define DEF_LINE_FILL_MONO "defcolor"
 #define DEF_LINE_HIDE "no"
@@ -334,13 +816,16 @@ _Static_assert(offsetof(Line, core) == 0, "Element core must be the first Line m
 #define DEF_LINE_PEN_MONO RGB_BLACK
 #define DEF_LINE_PEN_WIDTH "1"
 #define DEF_LINE_PIXELS "0.125i"
+#define DEF_LINE_RENDER "normal"
 #define DEF_LINE_REDUCE "0.0"
 #define DEF_LINE_SCALE_SYMBOLS "yes"
 #define DEF_LINE_SMOOTH "linear"
+#define DEF_LINE_SPLINE_TOLERANCE "0.25"
 #define DEF_LINE_STATE "normal"
 #define DEF_LINE_STIPPLE (char *)NULL
 #define DEF_LINE_STYLES ""
 #define DEF_LINE_SYMBOL "circle"
+#define DEF_LINE_SYMBOL_CULL "off"
 #define DEF_LINE_TAGS "all"
 #define DEF_LINE_X_DATA (char *)NULL
 #define DEF_LINE_Y_DATA (char *)NULL
@@ -393,14 +878,25 @@ _Static_assert(offsetof(Line, core) == 0, "Element core must be the first Line m
 #define LINE_ELEM_MAP_ITEM_MASK (1 << 10)
 #define LINE_ELEM_SCALE_SYMBOL_MASK (1 << 11)
 #define LINE_ELEM_MAX_SYMBOLS_MASK (1 << 12)
+#define LINE_ELEM_DECIMATE_MASK (1 << 13)
+#define LINE_ELEM_MAP_STYLE_MASK (1 << 14)
+#define LINE_ELEM_SYMBOL_CULL_MASK (1 << 15)
+#define LINE_ELEM_DENSITY_MASK (1 << 16)
 
-#define LINE_ELEM_SCALAR_MASK (LINE_ELEM_MAX_SYMBOLS_MASK | LINE_ELEM_SMOOTH_MASK | LINE_ELEM_TRACE_MASK)
+#define LINE_ELEM_SCALAR_MASK                                                                                          \
+    (LINE_ELEM_MAX_SYMBOLS_MASK | LINE_ELEM_SMOOTH_MASK | LINE_ELEM_TRACE_MASK | LINE_ELEM_DECIMATE_MASK |           \
+     LINE_ELEM_SYMBOL_CULL_MASK | LINE_ELEM_DENSITY_MASK)
 
 typedef enum {
     LINE_SCALAR_OPTION_NONE,
     LINE_SCALAR_OPTION_MAX_SYMBOLS,
     LINE_SCALAR_OPTION_SMOOTH,
-    LINE_SCALAR_OPTION_TRACE
+    LINE_SCALAR_OPTION_TRACE,
+    LINE_SCALAR_OPTION_DECIMATE,
+    LINE_SCALAR_OPTION_SYMBOL_CULL,
+    LINE_SCALAR_OPTION_RENDER,
+    LINE_SCALAR_OPTION_COLORMAP,
+    LINE_SCALAR_OPTION_DENSITY_SCALE
 } LineScalarOption;
 
 #define LINE_SCALAR_OPTION_MASK(option) (1u << ((unsigned int)(option) - 1u))
@@ -411,6 +907,11 @@ typedef struct {
     int maxSymbols;
     Smoothing smooth;
     int penDir;
+    Decimation decimate;
+    SymbolCulling symbolCull;
+    Rendering render;
+    int colormap;
+    DensityScale densityScale;
 } LineScalarTransaction;
 
 typedef enum {
@@ -545,6 +1046,26 @@ typedef struct {
         NULL,                                                                 \
         LINE_ELEM_BUILTIN_PEN_MASK                                            \
     },                                                                        \
+    {                                                                         \
+        TK_OPTION_STRING,                                                     \
+        "-colormap", "colormap", "Colormap",                                  \
+        DEF_LINE_COLORMAP,                                                    \
+        offsetof(Line, colormapObjPtr),                                       \
+        -1,                                                                   \
+        0,                                                                    \
+        NULL,                                                                 \
+        LINE_ELEM_DENSITY_MASK                                                \
+    },                                                                        \
+    {                                                                         \
+        TK_OPTION_STRING,                                                     \
+        "-colorvector", "colorVector", "ColorVector",                         \
+        NULL,                                                                 \
+        LINE_CORE_OFFSET(colorVectorObjPtr),                                  \
+        -1,                                                                   \
+        TK_OPTION_NULL_OK,                                                    \
+        NULL,                                                                 \
+        LINE_ELEM_DATA_MASK | LINE_ELEM_MAP_STYLE_MASK                        \
+    },                                                                        \
     {                                                                         \
         TK_OPTION_STRING,                                                     \
         "-dashes", "dashes", "Dashes",                                        \
@@ -565,6 +1086,26 @@ typedef struct {
         NULL,                                                                 \
         LINE_ELEM_DATA_MASK | LINE_ELEM_MAP_ITEM_MASK                         \
     },                                                                        \
+    {                                                                         \
+        TK_OPTION_STRING,                                                     \
+        "-decimate", "decimate", "Decimate",                                  \
+        DEF_LINE_DECIMATE,                                                    \
+        offsetof(Line, decimateObjPtr),                                       \
+        -1,                                                                   \
+        0,                                                                    \
+        NULL,                                                                 \
+        LINE_ELEM_DECIMATE_MASK | LINE_ELEM_MAP_ITEM_MASK                     \
+    },                                                                        \
+    {                                                                         \
+        TK_OPTION_STRING,                                                     \
+        "-densityscale", "densityScale", "DensityScale",                      \
+        DEF_LINE_DENSITY_SCALE,                                               \
+        offsetof(Line, densityScaleObjPtr),                                   \
+        -1,                                                                   \
+        0,                                                                    \
+        NULL,                                                                 \
+        LINE_ELEM_DENSITY_MASK                                                \
+    },                                                                        \
     {                                                                         \
         TK_OPTION_STRING,                                                     \
         "-errorbarcolor", "errorBarColor", "ErrorBarColor",                   \
@@ -593,7 +1134,7 @@ typedef struct {
         -1,                                                                   \
         0,                                                                    \
         NULL,                                                                 \
-        LINE_ELEM_BUILTIN_PEN_MASK | LINE_ELEM_MAP_ITEM_MASK                  \
+        LINE_ELEM_BUILTIN_PEN_MASK                                            \
     },                                                                        \
     {                                                                         \
         TK_OPTION_STRING,                                                     \
@@ -673,7 +1214,7 @@ typedef struct {
         -1,                                                                   \
         0,                                                                    \
         NULL,                                                                 \
-        LINE_ELEM_MAX_SYMBOLS_MASK | LINE_ELEM_MAP_ITEM_MASK                  \
+        LINE_ELEM_MAX_SYMBOLS_MASK                                            \
     },                                                                        \
     {                                                                         \
         TK_OPTION_STRING,                                                     \
@@ -713,7 +1254,7 @@ typedef struct {
         -1,                                                                   \
         TK_OPTION_NULL_OK,                                                    \
         NULL,                                                                 \
-        LINE_ELEM_PEN_MASK | LINE_ELEM_MAP_ITEM_MASK                          \
+        LINE_ELEM_PEN_MASK | LINE_ELEM_MAP_STYLE_MASK                         \
     },                                                                        \
     {                                                                         \
         TK_OPTION_STRING,                                                     \
@@ -723,9 +1264,19 @@ typedef struct {
         -1,                                                                   \
         0,                                                                    \
         NULL,                                                                 \
-        LINE_ELEM_BUILTIN_PEN_MASK | LINE_ELEM_MAP_ITEM_MASK                  \
+        LINE_ELEM_BUILTIN_PEN_MASK                                            \
     },                                                                        \
     REDUCE_ENTRY                                                              \
+    {                                                                         \
+        TK_OPTION_STRING,                                                     \
+        "-render", "render", "Render",                                        \
+        DEF_LINE_RENDER,                                                      \
+        offsetof(Line, renderObjPtr),                                         \
+        -1,                                                                   \
+        0,                                                                    \
+        NULL,                                                                 \
+        LINE_ELEM_DENSITY_MASK | LINE_ELEM_MAP_ITEM_MASK                      \
+    },                                                                        \
     {                                                                         \
         TK_OPTION_BOOLEAN,                                                    \
         "-scalesymbols", "scaleSymbols", "ScaleSymbols",                      \
@@ -756,6 +1307,16 @@ typedef struct {
         NULL,                                                                 \
         LINE_ELEM_BUILTIN_PEN_MASK                                            \
     },                                                                        \
+    {                                                                         \
+        TK_OPTION_STRING,                                                     \
+        "-sizevector", "sizeVector", "SizeVector",                            \
+        NULL,                                                                 \
+        LINE_CORE_OFFSET(sizeVectorObjPtr),                                   \
+        -1,                                                                   \
+        TK_OPTION_NULL_OK,                                                    \
+        NULL,                                                                 \
+        LINE_ELEM_DATA_MASK | LINE_ELEM_MAP_STYLE_MASK                        \
+    },                                                                        \
     {                                                                         \
         TK_OPTION_STRING,                                                     \
         "-smooth", "smooth", "Smooth",                                        \
@@ -766,6 +1327,16 @@ typedef struct {
         NULL,                                                                 \
         LINE_ELEM_SMOOTH_MASK | LINE_ELEM_MAP_ITEM_MASK                       \
     },                                                                        \
+    {                                                                         \
+        TK_OPTION_DOUBLE,                                                     \
+        "-splinetolerance", "splineTolerance", "SplineTolerance",             \
+        DEF_LINE_SPLINE_TOLERANCE,                                            \
+        -1,                                                                   \
+        offsetof(Line, splineTolerance),                                      \
+        0,                                                                    \
+        NULL,                                                                 \
+        LINE_ELEM_MAP_ITEM_MASK                                               \
+    },                                                                        \
     STATE_ENTRY                                                               \
     {                                                                         \
         TK_OPTION_STRING,                                                     \
@@ -775,7 +1346,7 @@ typedef struct {
         -1,                                                                   \
         TK_OPTION_NULL_OK,                                                    \
         NULL,                                                                 \
-        LINE_ELEM_STYLES_MASK | LINE_ELEM_MAP_ITEM_MASK                       \
+        LINE_ELEM_STYLES_MASK | LINE_ELEM_MAP_STYLE_MASK                      \
     },                                                                        \
     {                                                                         \
         TK_OPTION_STRING,                                                     \
@@ -787,6 +1358,16 @@ typedef struct {
         NULL,                                                                 \
         LINE_ELEM_BUILTIN_PEN_MASK                                            \
     },                                                                        \
+    {                                                                         \
+        TK_OPTION_STRING,                                                     \
+        "-symbolcull", "symbolCull", "SymbolCull",                            \
+        DEF_LINE_SYMBOL_CULL,                                                 \
+        offsetof(Line, symbolCullObjPtr),                                     \
+        -1,                                                                   \
+        0,                                                                    \
+        NULL,                                                                 \
+        LINE_ELEM_SYMBOL_CULL_MASK | LINE_ELEM_MAP_ITEM_MASK                  \
+    },                                                                        \
     TRACE_ENTRY                                                               \
     {                                                                         \
         TK_OPTION_ANCHOR,                                                     \
@@ -856,7 +1437,7 @@ typedef struct {
         -1,                                                                   \
         TK_OPTION_NULL_OK,                                                    \
         NULL,                                                                 \
-        LINE_ELEM_DATA_MASK | LINE_ELEM_MAP_ITEM_MASK                         \
+        LINE_ELEM_DATA_MASK | LINE_ELEM_MAP_STYLE_MASK                        \
     },                                                                        \
     {                                                                         \
         TK_OPTION_STRING,                                                     \
@@ -1233,38 +1814,117 @@ INLINE static int Round(register double x);
 static void ClearPalette(Rbc_Chain *palette);
 static void InitPen(LinePen *penPtr, const Tk_OptionSpec *optionSpecs, unsigned int flags);
 static int ScaleSymbol(Element *elemPtr, int normalSize);
+static double GetVisibleMargin(Graph *graphPtr, Line *linePtr);
 static void GetScreenPoints(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr);
 static void ReducePoints(MapInfo *mapPtr, double tolerance);
+static int PensAllowDecimation(Line *linePtr);
+static int PenAllowsDecimation(const LinePen *penPtr);
+static int CanDecimate(Graph *graphPtr, Line *linePtr, Tcl_Size nPoints);
+static void FreeLod(LodPyramid *lodPtr);
+static int UpdateLod(Line *linePtr, Tcl_Size nPoints);
+static int GetLodIndices(Graph *graphPtr, Line *linePtr, Tcl_Size nPoints, Tcl_Size **indicesPtr,
+                         Tcl_Size *countPtr);
+static void DecimatePoints(Graph *graphPtr, MapInfo *mapPtr);
 static void GenerateSteps(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr);
 static void GenerateSpline(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr);
+static int GenerateFittedSpline(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr);
+static Rbc_Spline *GetLineSpline(Line *linePtr);
+static void FreeLineSpline(LineSpline *splinePtr);
 static void GenerateParametricSpline(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr);
+static int StepParametricSpline(MapInfo *mapPtr, Extents2D *extsPtr, Point2D **intpPtsPtr, Tcl_Size **indicesPtr,
+                                Tcl_Size *nIntpPtsPtr);
+static int SubdivideParametricSpline(MapInfo *mapPtr, Extents2D *extsPtr, double tolerance, Point2D **intpPtsPtr,
+                                     Tcl_Size **indicesPtr, Tcl_Size *nIntpPtsPtr);
 static void MapSymbols(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr);
 static void MapActiveSymbols(Graph *graphPtr, Line *linePtr);
 static void MapStrip(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr);
-static void MergePens(Line *linePtr, PenStyle **dataToStyle);
+static void MergePens(Line *linePtr, StyleMap *mapPtr);
+static void CullSymbols(Graph *graphPtr, Line *linePtr);
+static void GroupSymbolColors(Line *linePtr);
+static void SortSymbolKeys(Line *linePtr, Tcl_Size first, Tcl_Size n, int bySize, SymbolSort *sortPtr);
+static void MapDensity(Graph *graphPtr, Line *linePtr);
+static void CountDensity(DensityTask *taskPtr);
+static Tcl_ThreadCreateType DensityThread(ClientData clientData);
+static void FreeDensityCounts(DensityGrid *gridPtr);
+static void FreeDensityPixmap(Graph *graphPtr, Line *linePtr);
+static void GetColormapColors(int colormap, Pix32 *colors);
+static int CompareCounts(const void *a, const void *b);
+static Rbc_ColorImage GetDensityImage(Line *linePtr, XColor *bgColorPtr);
+static void DrawDensity(Graph *graphPtr, Drawable drawable, Line *linePtr);
+static void DensityToPostScript(Graph *graphPtr, PsToken psToken, Line *linePtr);
 INLINE static int OutCode(Extents2D *extsPtr, Point2D *p);
 static int ClipSegment(Extents2D *extsPtr, register int code1, register int code2, register Point2D *p,
                        register Point2D *q);
+INLINE static float TraceCoord(double value);
 static void SaveTrace(Line *linePtr, Tcl_Size start, Tcl_Size length, MapInfo *mapPtr);
+static Tcl_Size CollapseTrace(const TracePoint *screenPts, Tcl_Size nScreenPts, Tcl_Size *drawPts);
+static void ClearTraces(Line *linePtr);
 static void FreeTraces(Line *linePtr);
 static void MapTraces(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr);
 static void MapFillArea(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr);
+static void ResetLineStyles(Line *linePtr);
 static void ResetLine(Line *linePtr);
+static int GetMappedStyles(Graph *graphPtr, Line *linePtr);
+static void MapLineGeometry(Graph *graphPtr, Line *linePtr, AsyncMap *asyncPtr);
+static void MapLineStyles(Graph *graphPtr, Line *linePtr);
+static int StartAsyncMap(Graph *graphPtr, Line *linePtr, int mappedStyles);
+static void CancelAsyncMap(Line *linePtr);
+static int AsyncMapCanceled(AsyncMap *asyncPtr);
+static Tcl_ThreadCreateType AsyncMapThread(ClientData clientData);
+static int AsyncMapEventProc(Tcl_Event *eventPtr, int flags);
+static void SwapAsyncMap(Graph *graphPtr, Line *linePtr, AsyncMap *asyncPtr);
+static void FreeAsyncMap(AsyncMap *asyncPtr);
 static int ClosestTrace(Graph *graphPtr, Line *linePtr, ClosestSearch *searchPtr, DistanceProc *distProc);
 static int ClosestStrip(Graph *graphPtr, Line *linePtr, ClosestSearch *searchPtr, DistanceProc *distProc);
 static void ClosestPoint(Line *linePtr, ClosestSearch *searchPtr);
+static void ClosestDataPoint(Graph *graphPtr, Line *linePtr, ClosestSearch *searchPtr);
+static int ClosestDataTrace(Graph *graphPtr, Line *linePtr, ClosestSearch *searchPtr, DistanceProc *distProc);
+static double PointDistance(ClosestSearch *searchPtr, Point2D *pointPtr);
+static void GetGridCell(ClosestGrid *gridPtr, double x, double y, int *columnPtr, int *rowPtr);
+static void GetSegmentEnds(const ClosestSegment *segPtr, Point2D *p, Point2D *q);
+static ClosestGrid *NewClosestGrid(Point2D *points, Tcl_Size nPoints, ClosestSegment *segments,
+                                   Tcl_Size nSegments);
+static void FreeClosestGrid(ClosestGrid *gridPtr);
+static void FreeClosestGrids(Line *linePtr);
+static ClosestGrid *GetPointGrid(Line *linePtr);
+static ClosestGrid *GetSegmentGrid(Line *linePtr, int strips);
+static int GetSearchCells(ClosestGrid *gridPtr, ClosestSearch *searchPtr, double dist, int alongX, int alongY,
+                          int *cellsPtr);
+static Tcl_Size SearchPointGrid(Line *linePtr, ClosestGrid *gridPtr, ClosestSearch *searchPtr,
+                                double *minDistPtr);
+static int SearchSegmentGrid(Graph *graphPtr, Line *linePtr, ClosestGrid *gridPtr, ClosestSearch *searchPtr,
+                             DistanceProc *distProc);
 static void DrawCircles(Display *display, Drawable drawable, Line *linePtr, LinePen *penPtr, Tcl_Size nSymbolPts,
                         Point2D *symbolPts, int radius);
 static void DrawSquares(Display *display, Drawable drawable, Line *linePtr, LinePen *penPtr, Tcl_Size nSymbolPts,
                         register Point2D *symbolPts, int r);
 static void DrawSymbols(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePen *penPtr, int size,
                         Tcl_Size nSymbolPts, Point2D *symbolPts);
+static void FreeSymbolSprites(LinePen *penPtr);
+static void FreeSymbolKeys(Line *linePtr);
+static void FreeSymbolColorTable(Graph *graphPtr, Line *linePtr);
+static SymbolRun *GetSymbolRuns(Line *linePtr, Tcl_Size first, Tcl_Size nSymbolPts, int size, Tcl_Size *nRunsPtr);
+static void SetSymbolColor(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePen *penPtr, int color);
+static void DrawSymbolRuns(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePenStyle *stylePtr,
+                           Tcl_Size first);
+#ifndef WIN32
+static SymbolSprite *GetSymbolSprite(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePen *penPtr, int size);
+static Tk_ErrorProc StampErrorProc;
+static int StampSprites(Graph *graphPtr, Drawable drawable, Line *linePtr, SpriteBatch *batches,
+                        Tcl_Size nBatches);
+static int StampSymbols(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePen *penPtr, int size,
+                        Tcl_Size nSymbolPts, Point2D *symbolPts);
+static int StampSymbolRuns(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePen *penPtr, SymbolRun *runs,
+                           Tcl_Size nRuns);
+#endif
 static void DrawTraces(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePen *penPtr);
 static void DrawValues(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePen *penPtr, Tcl_Size nSymbolPts,
                        Point2D *symbolPts, const Tcl_Size *pointToData);
 static void GetSymbolPostScriptInfo(Graph *graphPtr, PsToken psToken, LinePen *penPtr, int size);
 static void SymbolsToPostScript(Graph *graphPtr, PsToken psToken, LinePen *penPtr, int size, Tcl_Size nSymbolPts,
                                 Point2D *symbolPts);
+static void SymbolRunsToPostScript(Graph *graphPtr, PsToken psToken, Line *linePtr, LinePenStyle *stylePtr,
+                                   Tcl_Size first);
 static void SetLineAttributes(PsToken psToken, LinePen *penPtr);
 static void TracesToPostScript(PsToken psToken, Line *linePtr, LinePen *penPtr);
 static void ValuesToPostScript(PsToken psToken, Line *linePtr, LinePen *penPtr, Tcl_Size nSymbolPts, Point2D *symbolPts,
@@ -1375,6 +2035,21 @@ static LineScalarOption GetLineScalarOption(Element *elemPtr, Tcl_Obj *objPtr) {
     if (strcmp(name, "-trace") == 0) {
         return LINE_SCALAR_OPTION_TRACE;
     }
+    if (strcmp(name, "-decimate") == 0) {
+        return LINE_SCALAR_OPTION_DECIMATE;
+    }
+    if (strcmp(name, "-symbolcull") == 0) {
+        return LINE_SCALAR_OPTION_SYMBOL_CULL;
+    }
+    if (strcmp(name, "-render") == 0) {
+        return LINE_SCALAR_OPTION_RENDER;
+    }
+    if (strcmp(name, "-colormap") == 0) {
+        return LINE_SCALAR_OPTION_COLORMAP;
+    }
+    if (strcmp(name, "-densityscale") == 0) {
+        return LINE_SCALAR_OPTION_DENSITY_SCALE;
+    }
     return LINE_SCALAR_OPTION_NONE;
 }
 
@@ -1906,66 +2581,205 @@ static int GetSmoothFromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, Smoothing *valu
 /*
  *----------------------------------------------------------------------
  *
- * GetPenDirFromString --
+ * GetDecimateFromObj --
  *
- *      Parses a trace-direction value without modifying a widget
+ *      Parses a trace decimation mode without modifying a widget
  *      record.
  *
  *----------------------------------------------------------------------
  */
-static int GetPenDirFromString(Tcl_Interp *interp, const char *string, int *penDirPtr) {
-    size_t length;
-    char c;
+static int GetDecimateFromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, Decimation *valuePtr) {
+    DecimationInfo *diPtr;
+    const char *string;
 
-    c = string[0];
-    length = strlen(string);
+    string = Tcl_GetString(objPtr);
+    for (diPtr = decimationInfo; diPtr->name != NULL; diPtr++) {
+        if (strcmp(string, diPtr->name) == 0) {
+            *valuePtr = diPtr->value;
+            return TCL_OK;
+        }
+    }
 
-    if ((c == 'i') && (length <= strlen("increasing")) && (strncmp(string, "increasing", length) == 0)) {
-        *penDirPtr = PEN_INCREASING;
-    } else if ((c == 'd') && (length <= strlen("decreasing")) && (strncmp(string, "decreasing", length) == 0)) {
-        *penDirPtr = PEN_DECREASING;
-    } else if ((c == 'b') && (length <= strlen("both")) && (strncmp(string, "both", length) == 0)) {
-        *penDirPtr = PEN_BOTH_DIRECTIONS;
-    } else {
-        Rbc_AppendResultStrings(interp, "bad trace value \"", string,
-                         "\" : should be \"increasing\", \"decreasing\", or \"both\"", (char *)NULL);
+    Rbc_AppendResultStrings(interp, "bad decimate value \"", string, "\": should be auto, off, or m4", (char *)NULL);
 
-        return TCL_ERROR;
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetSymbolCullFromObj --
+ *
+ *      Parses a symbol culling mode without modifying a widget
+ *      record.
+ *
+ *----------------------------------------------------------------------
+ */
+static int GetSymbolCullFromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, SymbolCulling *valuePtr) {
+    SymbolCullingInfo *ciPtr;
+    const char *string;
+
+    string = Tcl_GetString(objPtr);
+    for (ciPtr = symbolCullingInfo; ciPtr->name != NULL; ciPtr++) {
+        if (strcmp(string, ciPtr->name) == 0) {
+            *valuePtr = ciPtr->value;
+            return TCL_OK;
+        }
     }
 
-    return TCL_OK;
-}
+    Rbc_AppendResultStrings(interp, "bad symbolcull value \"", string, "\": should be pixel or off", (char *)NULL);
 
-static int GetPenDirFromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, int *penDirPtr) {
-    return GetPenDirFromString(interp, Tcl_GetString(objPtr), penDirPtr);
+    return TCL_ERROR;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * StageLineScalarOption --
+ * GetRenderFromObj --
  *
- *      Parses one line-specific scalar option into temporary
- *      transaction storage without modifying the live line element.
+ *      Parses a rendering mode without modifying a widget record.
  *
  *----------------------------------------------------------------------
  */
-static int StageLineScalarOption(Graph *graphPtr, Tcl_Obj *objPtr, LineScalarOption option,
-                                 LineScalarTransaction *transactionPtr) {
-    int intValue;
-    Smoothing smoothValue;
+static int GetRenderFromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, Rendering *valuePtr) {
+    RenderingInfo *riPtr;
+    const char *string;
 
-    switch (option) {
-    case LINE_SCALAR_OPTION_MAX_SYMBOLS:
-        if (Rbc_GetPixelsFromObj(graphPtr->interp, graphPtr->tkwin, objPtr, PIXELS_NONNEGATIVE, &intValue) != TCL_OK) {
-            return TCL_ERROR;
+    string = Tcl_GetString(objPtr);
+    for (riPtr = renderingInfo; riPtr->name != NULL; riPtr++) {
+        if (strcmp(string, riPtr->name) == 0) {
+            *valuePtr = riPtr->value;
+            return TCL_OK;
         }
+    }
 
-        transactionPtr->maxSymbols = intValue;
-        break;
+    Rbc_AppendResultStrings(interp, "bad render value \"", string, "\": should be normal or density", (char *)NULL);
 
-    case LINE_SCALAR_OPTION_SMOOTH:
-        if (GetSmoothFromObj(graphPtr->interp, objPtr, &smoothValue) != TCL_OK) {
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetColormapFromObj --
+ *
+ *      Parses a colormap name into its index in colormapInfo without
+ *      modifying a widget record.
+ *
+ *----------------------------------------------------------------------
+ */
+static int GetColormapFromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, int *indexPtr) {
+    const char *string;
+    int i;
+
+    string = Tcl_GetString(objPtr);
+    for (i = 0; colormapInfo[i].name != NULL; i++) {
+        if (strcmp(string, colormapInfo[i].name) == 0) {
+            *indexPtr = i;
+            return TCL_OK;
+        }
+    }
+
+    Rbc_AppendResultStrings(interp, "bad colormap \"", string, "\": should be blues, grey, hot, or viridis",
+                            (char *)NULL);
+
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetDensityScaleFromObj --
+ *
+ *      Parses a density scale without modifying a widget record.
+ *
+ *----------------------------------------------------------------------
+ */
+static int GetDensityScaleFromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, DensityScale *valuePtr) {
+    DensityScaleInfo *diPtr;
+    const char *string;
+
+    string = Tcl_GetString(objPtr);
+    for (diPtr = densityScaleInfo; diPtr->name != NULL; diPtr++) {
+        if (strcmp(string, diPtr->name) == 0) {
+            *valuePtr = diPtr->value;
+            return TCL_OK;
+        }
+    }
+
+    Rbc_AppendResultStrings(interp, "bad densityscale value \"", string, "\": should be linear, log, or eqhist",
+                            (char *)NULL);
+
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetPenDirFromString --
+ *
+ *      Parses a trace-direction value without modifying a widget
+ *      record.
+ *
+ *----------------------------------------------------------------------
+ */
+static int GetPenDirFromString(Tcl_Interp *interp, const char *string, int *penDirPtr) {
+    size_t length;
+    char c;
+
+    c = string[0];
+    length = strlen(string);
+
+    if ((c == 'i') && (length <= strlen("increasing")) && (strncmp(string, "increasing", length) == 0)) {
+        *penDirPtr = PEN_INCREASING;
+    } else if ((c == 'd') && (length <= strlen("decreasing")) && (strncmp(string, "decreasing", length) == 0)) {
+        *penDirPtr = PEN_DECREASING;
+    } else if ((c == 'b') && (length <= strlen("both")) && (strncmp(string, "both", length) == 0)) {
+        *penDirPtr = PEN_BOTH_DIRECTIONS;
+    } else {
+        Rbc_AppendResultStrings(interp, "bad trace value \"", string,
+                         "\" : should be \"increasing\", \"decreasing\", or \"both\"", (char *)NULL);
+
+        return TCL_ERROR;
+    }
+
+    return TCL_OK;
+}
+
+static int GetPenDirFromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, int *penDirPtr) {
+    return GetPenDirFromString(interp, Tcl_GetString(objPtr), penDirPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StageLineScalarOption --
+ *
+ *      Parses one line-specific scalar option into temporary
+ *      transaction storage without modifying the live line element.
+ *
+ *----------------------------------------------------------------------
+ */
+static int StageLineScalarOption(Graph *graphPtr, Tcl_Obj *objPtr, LineScalarOption option,
+                                 LineScalarTransaction *transactionPtr) {
+    int intValue;
+    Smoothing smoothValue;
+    Decimation decimateValue;
+    SymbolCulling cullValue;
+    Rendering renderValue;
+    DensityScale scaleValue;
+
+    switch (option) {
+    case LINE_SCALAR_OPTION_MAX_SYMBOLS:
+        if (Rbc_GetPixelsFromObj(graphPtr->interp, graphPtr->tkwin, objPtr, PIXELS_NONNEGATIVE, &intValue) != TCL_OK) {
+            return TCL_ERROR;
+        }
+
+        transactionPtr->maxSymbols = intValue;
+        break;
+
+    case LINE_SCALAR_OPTION_SMOOTH:
+        if (GetSmoothFromObj(graphPtr->interp, objPtr, &smoothValue) != TCL_OK) {
             return TCL_ERROR;
         }
 
@@ -1980,6 +2794,46 @@ static int StageLineScalarOption(Graph *graphPtr, Tcl_Obj *objPtr, LineScalarOpt
         transactionPtr->penDir = intValue;
         break;
 
+    case LINE_SCALAR_OPTION_DECIMATE:
+        if (GetDecimateFromObj(graphPtr->interp, objPtr, &decimateValue) != TCL_OK) {
+            return TCL_ERROR;
+        }
+
+        transactionPtr->decimate = decimateValue;
+        break;
+
+    case LINE_SCALAR_OPTION_SYMBOL_CULL:
+        if (GetSymbolCullFromObj(graphPtr->interp, objPtr, &cullValue) != TCL_OK) {
+            return TCL_ERROR;
+        }
+
+        transactionPtr->symbolCull = cullValue;
+        break;
+
+    case LINE_SCALAR_OPTION_RENDER:
+        if (GetRenderFromObj(graphPtr->interp, objPtr, &renderValue) != TCL_OK) {
+            return TCL_ERROR;
+        }
+
+        transactionPtr->render = renderValue;
+        break;
+
+    case LINE_SCALAR_OPTION_COLORMAP:
+        if (GetColormapFromObj(graphPtr->interp, objPtr, &intValue) != TCL_OK) {
+            return TCL_ERROR;
+        }
+
+        transactionPtr->colormap = intValue;
+        break;
+
+    case LINE_SCALAR_OPTION_DENSITY_SCALE:
+        if (GetDensityScaleFromObj(graphPtr->interp, objPtr, &scaleValue) != TCL_OK) {
+            return TCL_ERROR;
+        }
+
+        transactionPtr->densityScale = scaleValue;
+        break;
+
     case LINE_SCALAR_OPTION_NONE:
     default:
         Tcl_Panic("StageLineScalarOption called with invalid option");
@@ -2060,6 +2914,45 @@ static int PrepareLineScalarTransaction(Graph *graphPtr, Element *elemPtr, Line
                 return TCL_ERROR;
             }
         }
+
+        if (!(explicitMask & LINE_SCALAR_OPTION_MASK(LINE_SCALAR_OPTION_DECIMATE)) &&
+            (linePtr->decimateObjPtr != NULL)) {
+            if (StageLineScalarOption(graphPtr, linePtr->decimateObjPtr, LINE_SCALAR_OPTION_DECIMATE,
+                                      transactionPtr) != TCL_OK) {
+                return TCL_ERROR;
+            }
+        }
+
+        if (!(explicitMask & LINE_SCALAR_OPTION_MASK(LINE_SCALAR_OPTION_SYMBOL_CULL)) &&
+            (linePtr->symbolCullObjPtr != NULL)) {
+            if (StageLineScalarOption(graphPtr, linePtr->symbolCullObjPtr, LINE_SCALAR_OPTION_SYMBOL_CULL,
+                                      transactionPtr) != TCL_OK) {
+                return TCL_ERROR;
+            }
+        }
+
+        if (!(explicitMask & LINE_SCALAR_OPTION_MASK(LINE_SCALAR_OPTION_RENDER)) && (linePtr->renderObjPtr != NULL)) {
+            if (StageLineScalarOption(graphPtr, linePtr->renderObjPtr, LINE_SCALAR_OPTION_RENDER, transactionPtr) !=
+                TCL_OK) {
+                return TCL_ERROR;
+            }
+        }
+
+        if (!(explicitMask & LINE_SCALAR_OPTION_MASK(LINE_SCALAR_OPTION_COLORMAP)) &&
+            (linePtr->colormapObjPtr != NULL)) {
+            if (StageLineScalarOption(graphPtr, linePtr->colormapObjPtr, LINE_SCALAR_OPTION_COLORMAP,
+                                      transactionPtr) != TCL_OK) {
+                return TCL_ERROR;
+            }
+        }
+
+        if (!(explicitMask & LINE_SCALAR_OPTION_MASK(LINE_SCALAR_OPTION_DENSITY_SCALE)) &&
+            (linePtr->densityScaleObjPtr != NULL)) {
+            if (StageLineScalarOption(graphPtr, linePtr->densityScaleObjPtr, LINE_SCALAR_OPTION_DENSITY_SCALE,
+                                      transactionPtr) != TCL_OK) {
+                return TCL_ERROR;
+            }
+        }
     }
 
     /*
@@ -2104,6 +2997,32 @@ static void CommitLineScalarTransaction(Line *linePtr, LineScalarTransaction *tr
         linePtr->penDir = transactionPtr->penDir;
     }
 
+    if (transactionPtr->stagedMask & LINE_SCALAR_OPTION_MASK(LINE_SCALAR_OPTION_DECIMATE)) {
+        linePtr->decimate = transactionPtr->decimate;
+    }
+
+    if (transactionPtr->stagedMask & LINE_SCALAR_OPTION_MASK(LINE_SCALAR_OPTION_SYMBOL_CULL)) {
+        linePtr->symbolCull = transactionPtr->symbolCull;
+    }
+
+    if (transactionPtr->stagedMask & LINE_SCALAR_OPTION_MASK(LINE_SCALAR_OPTION_RENDER)) {
+        linePtr->render = transactionPtr->render;
+    }
+
+    /*
+     * The colors of the density image don't change its counts.  Only
+     * the image is redrawn.
+     */
+    if (transactionPtr->stagedMask & LINE_SCALAR_OPTION_MASK(LINE_SCALAR_OPTION_COLORMAP)) {
+        linePtr->colormap = transactionPtr->colormap;
+        linePtr->density.stamp++;
+    }
+
+    if (transactionPtr->stagedMask & LINE_SCALAR_OPTION_MASK(LINE_SCALAR_OPTION_DENSITY_SCALE)) {
+        linePtr->densityScale = transactionPtr->densityScale;
+        linePtr->density.stamp++;
+    }
+
     transactionPtr->stagedMask = 0;
 }
 
@@ -2413,6 +3332,7 @@ static int ConfigurePen(Graph *graphPtr, Pen *penPtr) {
     lpPtr->symbol.fillGC = newFillGC;
     lpPtr->traceGC = newTraceGC;
     lpPtr->errorBarGC = newErrorBarGC;
+    FreeSymbolSprites(lpPtr);
     return TCL_OK;
 
 error:
@@ -2452,6 +3372,7 @@ static void DestroyPen(Graph *graphPtr, Pen *penPtr) {
     lpPtr = LINE_PEN_FROM_CORE(penPtr);
 
     Rbc_FreeTextStyle(graphPtr->display, &lpPtr->valueStyle);
+    FreeSymbolSprites(lpPtr);
 
     lpPtr->valueStyle.gc = NULL;
 
@@ -2727,13 +3648,52 @@ static int ScaleSymbol(Element *elemPtr, int normalSize) {
     return newSize;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetVisibleMargin --
+ *
+ *      Converts the padding of the plotting area along the x-axis to
+ *      axis units.  Traces and symbols are clipped to the padded area,
+ *      so points culled by Rbc_GetElemVisibleRange must lie beyond it.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Line *linePtr
+ *
+ * Results:
+ *      Returns the margin in axis units (decades for a logarithmic
+ *      axis).
+ *
+ *----------------------------------------------------------------------
+ */
+static double GetVisibleMargin(Graph *graphPtr, Line *linePtr) {
+    double pad;
+    int span;
+
+    if (graphPtr->inverted) {
+        pad = (double)MAX(graphPtr->padY.side1, graphPtr->padY.side2);
+        span = graphPtr->vRange;
+    } else {
+        pad = (double)MAX(graphPtr->padX.side1, graphPtr->padX.side2);
+        span = graphPtr->hRange;
+    }
+    if (span < 1) {
+        return 0.0;
+    }
+    return pad * linePtr->core.axes.x->axisRange.range / (double)span;
+}
+
 /*
  *----------------------------------------------------------------------
  *
  * GetScreenPoints --
  *
  *      Generates a coordinate array of transformed screen coordinates
- *      from the data points.
+ *      from the data points.  If the x values are ordered, only the
+ *      points in view are mapped.  Long traces that will be decimated
+ *      only map the points picked from their level-of-detail
+ *      summaries.
  *
  * Parameters:
  *      Graph *graphPtr
@@ -2751,15 +3711,20 @@ static int ScaleSymbol(Element *elemPtr, int normalSize) {
 static void GetScreenPoints(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
     const double *x;
     const double *y;
+    double *lodValues;
     Point2D *screenPts;
     Tcl_Size *indices;
-    unsigned char *breakBefore;
+    unsigned char *keep;
     Tcl_Size nDataPoints;
-    Tcl_Size nScreenPoints;
+    Tcl_Size nPoints;
+    Tcl_Size first, last;
     Tcl_Size i;
     Tcl_Size count;
     size_t pointBytes;
     size_t indexBytes;
+    size_t keepBytes;
+    int picked;
+    int dropped;
     int hasBreaks;
 
     mapPtr->screenPts = NULL;
@@ -2767,831 +3732,987 @@ static void GetScreenPoints(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
     mapPtr->breakBefore = NULL;
     mapPtr->nScreenPts = 0;
     nDataPoints = NumberOfPoints(&linePtr->core);
+    if (nDataPoints <= 0) {
+        return;
+    }
     x = linePtr->core.x.valueArr;
     y = linePtr->core.y.valueArr;
-    /*
-     * This is only an allocation upper bound.  Some finite raw data
-     * may still be outside the domain of a logarithmic axis.
-     */
-    nScreenPoints = 0;
-    for (i = 0; i < nDataPoints; i++) {
-        if (FINITE(x[i]) && FINITE(y[i])) {
-            nScreenPoints++;
+    nPoints = nDataPoints;
+    first = 0;
+    indices = NULL;
+    lodValues = NULL;
+    if (GetLodIndices(graphPtr, linePtr, nDataPoints, &indices, &nPoints) == TCL_OK) {
+        size_t valueBytes;
+
+        /*
+         * Gather the values of the picked points, so they can be
+         * mapped like any others.
+         */
+        if ((GetLineArrayByteCount(nPoints, 2 * sizeof(double), &valueBytes) == TCL_OK) &&
+            ((lodValues = Tcl_AttemptAlloc(valueBytes)) != NULL)) {
+            for (i = 0; i < nPoints; i++) {
+                lodValues[i] = x[indices[i]];
+                lodValues[nPoints + i] = y[indices[i]];
+            }
+            x = lodValues;
+            y = lodValues + nPoints;
+            mapPtr->decimated = TRUE;
+        } else {
+            ckfree(indices);
+            indices = NULL;
+            nPoints = nDataPoints;
         }
+    } else if (((linePtr->reqSmooth == PEN_SMOOTH_NONE) || (linePtr->reqSmooth == PEN_SMOOTH_STEP)) &&
+               (Rbc_GetElemVisibleRange(&linePtr->core, GetVisibleMargin(graphPtr, linePtr), &first, &last))) {
+        /*
+         * A spline through the points depends on all of them, so
+         * only unsmoothed traces are cut to the points in view.
+         */
+        x += first;
+        y += first;
+        nPoints = last - first + 1;
     }
-    if (nScreenPoints == 0) {
-        return;
-    }
-    if ((GetLineArrayByteCount(nScreenPoints, sizeof(*screenPts), &pointBytes) != TCL_OK) ||
-        (GetLineArrayByteCount(nScreenPoints, sizeof(*indices), &indexBytes) != TCL_OK)) {
-        return;
+    if ((GetLineArrayByteCount(nPoints, sizeof(*screenPts), &pointBytes) != TCL_OK) ||
+        (GetLineArrayByteCount(nPoints, sizeof(*keep), &keepBytes) != TCL_OK)) {
+        goto error;
     }
     screenPts = Tcl_AttemptAlloc(pointBytes);
     if (screenPts == NULL) {
-        return;
+        goto error;
     }
-    indices = Tcl_AttemptAlloc(indexBytes);
-    if (indices == NULL) {
+    keep = Tcl_AttemptAlloc(keepBytes);
+    if (keep == NULL) {
         ckfree(screenPts);
-        return;
+        goto error;
     }
-    count = 0;
-    for (i = 0; i < nDataPoints; i++) {
-        Point2D point;
-
-        if ((!FINITE(x[i])) || (!FINITE(y[i]))) {
-            continue;
-        }
-        point = Rbc_Map2D(graphPtr, x[i], y[i], &linePtr->core.axes);
-        /*
-         * Non-positive data on a logarithmic axis intentionally maps
-         * to a non-finite coordinate.  It represents a break in the
-         * data rather than a point to draw.
-         */
-        if ((!FINITE(point.x)) || (!FINITE(point.y))) {
-            continue;
-        }
-        screenPts[count] = point;
-        indices[count] = i;
-        count++;
+    /*
+     * Non-finite data, and non-positive data on a logarithmic axis,
+     * map to non-finite coordinates and are not kept.  They represent
+     * a break in the data rather than a point to draw.
+     */
+    count = Rbc_MapArray2D(graphPtr, &linePtr->core.axes, x, y, nPoints, screenPts, keep);
+    if (lodValues != NULL) {
+        ckfree(lodValues);
+        lodValues = NULL;
     }
     if (count == 0) {
         ckfree(screenPts);
-        ckfree(indices);
-        return;
+        ckfree(keep);
+        goto error;
+    }
+    picked = (indices != NULL);
+    if (!picked) {
+        if ((GetLineArrayByteCount(count, sizeof(*indices), &indexBytes) != TCL_OK) ||
+            ((indices = Tcl_AttemptAlloc(indexBytes)) == NULL)) {
+            ckfree(screenPts);
+            ckfree(keep);
+            return;
+        }
     }
     /*
-     * Detect discontinuities while indices still refer directly to
-     * the original data array.  Later smoothing and reduction destroy
-     * that simple relationship.
+     * Compact the kept points.  Detect discontinuities on the way: a
+     * point follows a break if a point mapped before it was dropped.
+     * Later smoothing and reduction lose track of the dropped points.
+     *
+     * The break flags are stored in the keep array, whose entries
+     * aren't needed any more once the point is moved.
      */
+    count = 0;
+    dropped = FALSE;
     hasBreaks = FALSE;
-    for (i = 1; i < count; i++) {
-        if (indices[i] != indices[i - 1] + 1) {
-            hasBreaks = TRUE;
-            break;
+    for (i = 0; i < nPoints; i++) {
+        if (!keep[i]) {
+            dropped = (count > 0);
+            continue;
         }
+        screenPts[count] = screenPts[i];
+        indices[count] = (picked) ? indices[i] : first + i;
+        keep[count] = dropped;
+        hasBreaks |= dropped;
+        dropped = FALSE;
+        count++;
     }
-    breakBefore = NULL;
-    if (hasBreaks) {
-        size_t breakBytes;
-
-        if (GetLineArrayByteCount(count, sizeof(*breakBefore), &breakBytes) != TCL_OK) {
-            ckfree(screenPts);
-            ckfree(indices);
-            return;
-        }
-        breakBefore = Tcl_AttemptAlloc(breakBytes);
-        if (breakBefore == NULL) {
-            ckfree(screenPts);
-            ckfree(indices);
-            return;
-        }
-        breakBefore[0] = FALSE;
-        for (i = 1; i < count; i++) {
-            breakBefore[i] = (indices[i] != indices[i - 1] + 1);
-        }
+    if (!hasBreaks) {
+        ckfree(keep);
+        keep = NULL;
     }
     mapPtr->screenPts = screenPts;
     mapPtr->indices = indices;
-    mapPtr->breakBefore = breakBefore;
+    mapPtr->breakBefore = keep;
     mapPtr->nScreenPts = count;
-}
+    return;
+
+error:
+    if (lodValues != NULL) {
+        ckfree(lodValues);
+    }
+    if (indices != NULL) {
+        ckfree(indices);
+    }
+}
 
 /*
  *----------------------------------------------------------------------
  *
- * ReducePoints --
+ * CanDecimate --
  *
- *      Generates a coordinate array of transformed screen coordinates
- *      from the data points.
+ *      Determines whether the mapped points of a line element should
+ *      be decimated.  Decimation only pays off when there are several
+ *      points per pixel column.  In "auto" mode it is also restricted
+ *      to plain one-pixel traces without symbols, values, dashes, fill
+ *      or smoothing, where it can't change the picture.  The pens are
+ *      not read here but through the mapped styles of the element, so
+ *      a copy mapped on a worker thread needs none.
  *
  * Parameters:
- *      MapInfo *mapPtr
- *      double tolerance
+ *      Graph *graphPtr
+ *      Line *linePtr
+ *      Tcl_Size nPoints - Number of mapped points
  *
  * Results:
- *      The transformed screen coordinates are returned.
- *
- * Side effects:
- *      Memory is allocated for the coordinate array.
+ *      Returns TRUE if the points should be decimated.
  *
  *----------------------------------------------------------------------
  */
-static void ReducePoints(MapInfo *mapPtr, double tolerance) {
-    Point2D *screenPts;
-    Tcl_Size *indices;
-    unsigned char *breakBefore;
-    Tcl_Size *simple;
-    Tcl_Size nPoints;
-    Tcl_Size n;
-    Tcl_Size i;
-    Tcl_Size runStart;
-    size_t simpleBytes;
-    size_t pointBytes;
-    size_t indexBytes;
-
-    if ((mapPtr == NULL) || (mapPtr->screenPts == NULL) || (mapPtr->indices == NULL) || (mapPtr->nScreenPts < 2)) {
-        return;
-    }
-    nPoints = mapPtr->nScreenPts;
-    if (GetLineArrayByteCount(nPoints, sizeof(*simple), &simpleBytes) != TCL_OK) {
-        return;
-    }
-    simple = Tcl_AttemptAlloc(simpleBytes);
-    if (simple == NULL) {
-        return;
-    }
-    n = 0;
-    runStart = 0;
-    for (i = 1; i <= nPoints; i++) {
-        if ((i == nPoints) || ((mapPtr->breakBefore != NULL) && mapPtr->breakBefore[i])) {
-            Tcl_Size runCount;
+static int CanDecimate(Graph *graphPtr, Line *linePtr, Tcl_Size nPoints) {
+    double nColumns;
 
-            runCount = Rbc_SimplifyLine(mapPtr->screenPts, runStart, i - 1, tolerance, simple + n);
-            if ((runCount <= 0) || (runCount > nPoints - n)) {
-                ckfree(simple);
-                return;
-            }
-            n += runCount;
-            runStart = i;
-        }
-    }
-    if (n == nPoints) {
-        ckfree(simple);
-        return;
+    if (linePtr->decimate == LINE_DECIMATE_OFF) {
+        return FALSE;
     }
-    if ((n <= 0) || (GetLineArrayByteCount(n, sizeof(*screenPts), &pointBytes) != TCL_OK) ||
-        (GetLineArrayByteCount(n, sizeof(*indices), &indexBytes) != TCL_OK)) {
-        ckfree(simple);
-        return;
+    nColumns = (graphPtr->inverted) ? graphPtr->vRange : graphPtr->hRange;
+    if ((double)nPoints <= (nColumns + 1.0) * DECIMATE_MIN_RATIO) {
+        return FALSE;
     }
-    screenPts = Tcl_AttemptAlloc(pointBytes);
-    if (screenPts == NULL) {
-        ckfree(simple);
-        return;
+    if (linePtr->decimate == LINE_DECIMATE_M4) {
+        return TRUE;
     }
-    indices = Tcl_AttemptAlloc(indexBytes);
-    if (indices == NULL) {
-        ckfree(screenPts);
-        ckfree(simple);
-        return;
+    if ((linePtr->reqSmooth != PEN_SMOOTH_NONE) || (linePtr->fillTile != NULL) || (linePtr->fillStipple != None)) {
+        return FALSE;
     }
-    breakBefore = NULL;
-    if (mapPtr->breakBefore != NULL) {
-        size_t breakBytes;
+    return (linePtr->mappedStyles & MAPPED_DECIMATE) != 0;
+}
 
-        if (GetLineArrayByteCount(n, sizeof(*breakBefore), &breakBytes) != TCL_OK) {
-            ckfree(screenPts);
-            ckfree(indices);
-            ckfree(simple);
-            return;
-        }
-        breakBefore = Tcl_AttemptAlloc(breakBytes);
-        if (breakBefore == NULL) {
-            ckfree(screenPts);
-            ckfree(indices);
-            ckfree(simple);
-            return;
-        }
-    }
-    for (i = 0; i < n; i++) {
-        Tcl_Size k;
+/*
+ *----------------------------------------------------------------------
+ *
+ * PensAllowDecimation --
+ *
+ *      Indicates if none of the element's pens draws anything that
+ *      would show the points dropped by automatic decimation:
+ *      symbols, values, wide or dashed traces.  The active pen isn't
+ *      considered, since active points are mapped from the data.
+ *
+ * Parameters:
+ *      Line *linePtr
+ *
+ * Results:
+ *      Returns TRUE if the pens allow decimation.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static int PensAllowDecimation(Line *linePtr) {
+    Rbc_ChainLink *linkPtr;
 
-        k = simple[i];
-        screenPts[i] = mapPtr->screenPts[k];
-        indices[i] = mapPtr->indices[k];
-        if (breakBefore != NULL) {
-            breakBefore[i] = mapPtr->breakBefore[k];
+    for (linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
+        LinePenStyle *stylePtr;
+
+        stylePtr = Rbc_ChainGetValue(linkPtr);
+        if (!PenAllowsDecimation(stylePtr->penPtr)) {
+            return FALSE;
         }
     }
-    ckfree(simple);
-    ckfree(mapPtr->screenPts);
-    ckfree(mapPtr->indices);
-    if (mapPtr->breakBefore != NULL) {
-        ckfree(mapPtr->breakBefore);
-    }
-    mapPtr->screenPts = screenPts;
-    mapPtr->indices = indices;
-    mapPtr->breakBefore = breakBefore;
-    mapPtr->nScreenPts = n;
+    return TRUE;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * GenerateSteps --
+ * PenAllowsDecimation --
  *
- *      Resets the coordinate and pen index arrays adding new points
- *      for step-and-hold type smoothing.
+ *      Indicates if a pen draws only a plain one-pixel trace.
+ *
+ * Parameters:
+ *      const LinePen *penPtr
+ *
+ * Results:
+ *      Returns TRUE if the pen allows decimation.
+ *
+ *----------------------------------------------------------------------
+ */
+static int PenAllowsDecimation(const LinePen *penPtr) {
+    return (penPtr->symbol.type == SYMBOL_NONE) && (penPtr->valueShow == SHOW_NONE) && (penPtr->traceWidth <= 1) &&
+           (!LineIsDashed(penPtr->traceDashes));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DecimatePoints --
+ *
+ *      Reduces the mapped points to the first, last, minimum and
+ *      maximum point of each pixel column (M4 decimation), keeping
+ *      their original order.  All the segments between points of one
+ *      column are drawn in that column, so they cover exactly the
+ *      pixels between its minimum and maximum, and the segments
+ *      between columns are kept.  A one-pixel trace of the decimated
+ *      points therefore draws the same pixels as the full trace.
+ *
+ *      This requires the points of a column to be contiguous, so
+ *      nothing is done unless the columns are monotone.  A break in
+ *      the data also ends a column.
  *
  * Parameters:
+ *      Graph *graphPtr
  *      MapInfo *mapPtr
  *
  * Results:
  *      None.
  *
- * Side Effects:
- *      The temporary arrays for screen coordinates and pen indices
- *      are updated.
+ * Side effects:
+ *      The point, index and break arrays of mapPtr are compacted in
+ *      place.
  *
  *----------------------------------------------------------------------
  */
-static void GenerateSteps(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
+static void DecimatePoints(Graph *graphPtr, MapInfo *mapPtr) {
     Point2D *screenPts;
     Tcl_Size *indices;
     unsigned char *breakBefore;
-    Tcl_Size i;
+    Tcl_Size nPoints;
+    Tcl_Size start;
     Tcl_Size count;
-    Tcl_Size newSize;
-    size_t pointBytes;
-    size_t indexBytes;
+    Tcl_Size i;
+    int inverted;
+    int direction;
+    double column;
 
-    if (mapPtr->nScreenPts < 2) {
-        return;
-    }
-    if (mapPtr->nScreenPts > (TCL_SIZE_MAX / 2) + 1) {
-        linePtr->smooth = PEN_SMOOTH_NONE;
-        return;
-    }
-    newSize = (mapPtr->nScreenPts - 1) * 2 + 1;
-    if ((GetLineArrayByteCount(newSize, sizeof(*screenPts), &pointBytes) != TCL_OK) ||
-        (GetLineArrayByteCount(newSize, sizeof(*indices), &indexBytes) != TCL_OK)) {
-        linePtr->smooth = PEN_SMOOTH_NONE;
-        return;
-    }
-    screenPts = Tcl_AttemptAlloc(pointBytes);
-    if (screenPts == NULL) {
-        linePtr->smooth = PEN_SMOOTH_NONE;
-        return;
-    }
-    indices = Tcl_AttemptAlloc(indexBytes);
-    if (indices == NULL) {
-        ckfree(screenPts);
-        linePtr->smooth = PEN_SMOOTH_NONE;
-        return;
-    }
-    breakBefore = NULL;
-    if (mapPtr->breakBefore != NULL) {
-        size_t breakBytes;
-        if (GetLineArrayByteCount(newSize, sizeof(*breakBefore), &breakBytes) != TCL_OK) {
-            ckfree(screenPts);
-            ckfree(indices);
-            linePtr->smooth = PEN_SMOOTH_NONE;
-            return;
-        }
-        breakBefore = Tcl_AttemptAlloc(breakBytes);
-        if (breakBefore == NULL) {
-            ckfree(screenPts);
-            ckfree(indices);
-            linePtr->smooth = PEN_SMOOTH_NONE;
-            return;
+#define COLUMN(p) floor((inverted) ? (p).y : (p).x)
+#define ROW(p) ((inverted) ? (p).x : (p).y)
+
+    screenPts = mapPtr->screenPts;
+    indices = mapPtr->indices;
+    breakBefore = mapPtr->breakBefore;
+    nPoints = mapPtr->nScreenPts;
+    inverted = graphPtr->inverted;
+    /*
+     * Make sure the columns never change direction.
+     */
+    direction = 0;
+    column = COLUMN(screenPts[0]);
+    for (i = 1; i < nPoints; i++) {
+        double next;
+
+        next = COLUMN(screenPts[i]);
+        if (next != column) {
+            int sign;
+
+            sign = (next > column) ? 1 : -1;
+            if (direction == 0) {
+                direction = sign;
+            } else if (sign != direction) {
+                return;
+            }
+            column = next;
         }
     }
-    screenPts[0] = mapPtr->screenPts[0];
-    indices[0] = mapPtr->indices[0];
-    if (breakBefore != NULL) {
-        breakBefore[0] = FALSE;
-    }
-    count = 1;
-    for (i = 1; i < mapPtr->nScreenPts; i++) {
-        /*
-         * Do not manufacture a step segment across a missing-data
-         * boundary.
-         */
-        if ((mapPtr->breakBefore != NULL) && mapPtr->breakBefore[i]) {
-            screenPts[count] = mapPtr->screenPts[i];
-            indices[count] = mapPtr->indices[i];
-            breakBefore[count] = TRUE;
-            count++;
-            continue;
+    /*
+     * A column never keeps more points than it has, so the points can
+     * be compacted in place.
+     */
+    count = 0;
+    for (start = 0; start < nPoints; /*empty*/) {
+        Tcl_Size end;
+        Tcl_Size minIndex, maxIndex;
+        Tcl_Size keep[4];
+        Tcl_Size nKeep;
+        Tcl_Size j;
+
+        column = COLUMN(screenPts[start]);
+        minIndex = maxIndex = start;
+        for (end = start + 1; end < nPoints; end++) {
+            if ((COLUMN(screenPts[end]) != column) || ((breakBefore != NULL) && breakBefore[end])) {
+                break;
+            }
+            if (ROW(screenPts[end]) < ROW(screenPts[minIndex])) {
+                minIndex = end;
+            }
+            if (ROW(screenPts[end]) > ROW(screenPts[maxIndex])) {
+                maxIndex = end;
+            }
         }
         /*
-         * Step-and-hold changes data X first while holding data Y
-         * constant, then changes data Y.
-         *
-         * Normally data X maps to screen X, so the intermediate
-         * point is:
-         *
-         *     (next.x, previous.y)
-         *
-         * With -invertxy, data X maps to screen Y instead, so it is:
-         *
-         *     (previous.x, next.y)
+         * Keep the first, extreme and last points in their original
+         * order, once each.
          */
-        screenPts[count] = screenPts[count - 1];
-        if (graphPtr->inverted) {
-            screenPts[count].y = mapPtr->screenPts[i].y;
-        } else {
-            screenPts[count].x = mapPtr->screenPts[i].x;
+        keep[0] = start;
+        keep[1] = MIN(minIndex, maxIndex);
+        keep[2] = MAX(minIndex, maxIndex);
+        keep[3] = end - 1;
+        nKeep = 0;
+        for (j = 0; j < 4; j++) {
+            Tcl_Size k;
+
+            k = keep[j];
+            if ((nKeep > 0) && (k == keep[nKeep - 1])) {
+                continue;
+            }
+            keep[nKeep++] = k;
         }
-        screenPts[count + 1] = mapPtr->screenPts[i];
-        indices[count] = mapPtr->indices[i];
-        indices[count + 1] = mapPtr->indices[i];
-        if (breakBefore != NULL) {
-            breakBefore[count] = FALSE;
-            breakBefore[count + 1] = FALSE;
+        for (j = 0; j < nKeep; j++) {
+            screenPts[count] = screenPts[keep[j]];
+            indices[count] = indices[keep[j]];
+            if (breakBefore != NULL) {
+                breakBefore[count] = (j == 0) ? breakBefore[start] : FALSE;
+            }
+            count++;
         }
-        count += 2;
+        start = end;
     }
-    ckfree(mapPtr->screenPts);
-    ckfree(mapPtr->indices);
-    if (mapPtr->breakBefore != NULL) {
-        ckfree(mapPtr->breakBefore);
+    if (count < nPoints) {
+        mapPtr->decimated = TRUE;
     }
-    mapPtr->screenPts = screenPts;
-    mapPtr->indices = indices;
-    mapPtr->breakBefore = breakBefore;
     mapPtr->nScreenPts = count;
+
+#undef COLUMN
+#undef ROW
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * GenerateSpline --
+ * FreeLod --
  *
- *      Computes a spline based upon the data points, returning a new
- *      (larger) coordinate array or points.
+ *      Releases the level-of-detail summaries of a trace.
  *
  * Parameters:
- *      Graph *graphPtr;
- *      Line *linePtr
- *      MapInfo *mapPtr
+ *      LodPyramid *lodPtr
  *
  * Results:
  *      None.
  *
- * Side Effects:
- *      The temporary arrays for screen coordinates and data indices
- *      are updated based upon spline.
+ *----------------------------------------------------------------------
+ */
+static void FreeLod(LodPyramid *lodPtr) {
+    int level;
+
+    for (level = 0; level < LOD_MAX_LEVELS; level++) {
+        if (lodPtr->levels[level] != NULL) {
+            ckfree(lodPtr->levels[level]);
+        }
+    }
+    memset(lodPtr, 0, sizeof(*lodPtr));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UpdateLod --
+ *
+ *      Brings the level-of-detail summaries of the trace up to date.
+ *      Only the blocks from the lowest y index changed since the last
+ *      update are recomputed, so appending data to a vector only
+ *      summarizes the new points.
+ *
+ *      Each block records the indices of its smallest and largest y
+ *      values.  Its first and last points are implied by its place
+ *      in the level, so the x values don't matter as long as they
+ *      are ordered.
+ *
+ * Parameters:
+ *      Line *linePtr
+ *      Tcl_Size nPoints - Number of data points
+ *
+ * Results:
+ *      Returns TRUE if the summaries can be used, FALSE if memory
+ *      couldn't be allocated.
+ *
+ * Side effects:
+ *      The summaries are (re)allocated.  The changed index of the y
+ *      vector is reset.
  *
  *----------------------------------------------------------------------
  */
-static void GenerateSpline(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
-    Tcl_Size extra;
-    Tcl_WideInt span;
-    Point2D *origPts;
-    Point2D *splinePts;
-    Point2D *intpPts;
-    Tcl_Size *indices;
-    Tcl_Size capacity;
+static int UpdateLod(Line *linePtr, Tcl_Size nPoints) {
+    LodPyramid *lodPtr = &linePtr->lod;
+    const double *y;
+    Tcl_Size nBlocks[LOD_MAX_LEVELS];
+    Tcl_Size valid;
+    Tcl_Size start;
     Tcl_Size count;
     Tcl_Size i;
-    Tcl_Size j;
-    Tcl_Size nOrigPts;
-    Tcl_Size nIntpPts;
-    size_t splineBytes;
-    double plotMin;
-    double plotMax;
-    double firstU;
-    double nextU;
-    int reversed;
-    int result;
-    int sample;
+    int nLevels;
+    int level;
 
-    nOrigPts = mapPtr->nScreenPts;
-    origPts = mapPtr->screenPts;
-    assert(nOrigPts > 0);
-    if (nOrigPts < 3) {
-        return;
-    }
-    /*
-     * Natural and quadratic splines are functions of data X.
-     *
-     * Normally data X maps to screen X.  For an inverted graph it
-     * maps to screen Y instead.  Select that screen coordinate as the
-     * spline abscissa.
-     */
-    if (graphPtr->inverted) {
-        plotMin = (double)graphPtr->top;
-        plotMax = (double)graphPtr->bottom;
-        span = (Tcl_WideInt)graphPtr->bottom - (Tcl_WideInt)graphPtr->top + 1;
-        firstU = origPts[0].y;
-        nextU = origPts[1].y;
-    } else {
-        plotMin = (double)graphPtr->left;
-        plotMax = (double)graphPtr->right;
-        span = (Tcl_WideInt)graphPtr->right - (Tcl_WideInt)graphPtr->left + 1;
-        firstU = origPts[0].x;
-        nextU = origPts[1].x;
-    }
-    /*
-     * The spline routines require strictly increasing abscissas.
-     * Screen coordinates may instead decrease when the corresponding
-     * axis is descending, or simply because data X is mapped to the
-     * vertical screen direction.  Reflect the spline coordinate when
-     * necessary rather than reversing the point array.  This preserves
-     * data and index order.
-     */
-    if (nextU > firstU) {
-        reversed = FALSE;
-    } else if (nextU < firstU) {
-        reversed = TRUE;
-    } else {
-        return;
+    y = linePtr->core.y.valueArr;
+    valid = MIN(lodPtr->nPoints, nPoints);
+    valid = MIN(valid, linePtr->core.y.changedFirst);
+    linePtr->core.y.changedFirst = linePtr->core.y.nValues;
+    if (lodPtr->nLevels == 0) {
+        valid = 0;
+    }
+
+    nLevels = 0;
+    count = nPoints;
+    do {
+        count = (count + LOD_BRANCH - 1) / LOD_BRANCH;
+        nBlocks[nLevels++] = count;
+    } while ((count > LOD_BRANCH) && (nLevels < LOD_MAX_LEVELS));
+
+    for (level = 0; level < nLevels; level++) {
+        if (lodPtr->sizes[level] < nBlocks[level]) {
+            LodBlock *blocks;
+            Tcl_Size newSize;
+            size_t blockBytes;
+
+            newSize = MAX(nBlocks[level], lodPtr->sizes[level] * 2);
+            if ((GetLineArrayByteCount(newSize, sizeof(LodBlock), &blockBytes) != TCL_OK) ||
+                ((blocks = Tcl_AttemptRealloc(lodPtr->levels[level], blockBytes)) == NULL)) {
+                FreeLod(lodPtr);
+                return FALSE;
+            }
+            lodPtr->levels[level] = blocks;
+            lodPtr->sizes[level] = newSize;
+        }
     }
-    for (i = 0, j = 1; j < nOrigPts; i++, j++) {
-        double u;
-        double v;
 
-        if (graphPtr->inverted) {
-            u = origPts[i].y;
-            v = origPts[j].y;
-        } else {
-            u = origPts[i].x;
-            v = origPts[j].x;
+    start = valid / LOD_BRANCH;
+    for (level = 0; level < nLevels; level++) {
+        LodBlock *blockPtr;
+        Tcl_Size block;
+
+        if (level >= lodPtr->nLevels) {
+            start = 0;
         }
-        if ((!reversed && (v <= u)) || (reversed && (v >= u))) {
-            return;
+        for (block = start; block < nBlocks[level]; block++) {
+            Tcl_Size minIndex, maxIndex;
+
+            if (level == 0) {
+                Tcl_Size last;
+
+                minIndex = maxIndex = block * LOD_BRANCH;
+                last = MIN(minIndex + LOD_BRANCH, nPoints);
+                for (i = minIndex; i < last; i++) {
+                    if (!FINITE(y[i])) {
+                        minIndex = -1;
+                        break;
+                    }
+                    if (y[i] < y[minIndex]) {
+                        minIndex = i;
+                    }
+                    if (y[i] > y[maxIndex]) {
+                        maxIndex = i;
+                    }
+                }
+            } else {
+                LodBlock *childPtr, *endPtr;
+
+                childPtr = lodPtr->levels[level - 1] + block * LOD_BRANCH;
+                endPtr = lodPtr->levels[level - 1] + MIN((block + 1) * LOD_BRANCH, nBlocks[level - 1]);
+                minIndex = childPtr->minIndex;
+                maxIndex = childPtr->maxIndex;
+                for (/*empty*/; (childPtr < endPtr) && (minIndex >= 0); childPtr++) {
+                    if (childPtr->minIndex < 0) {
+                        minIndex = -1;
+                    } else {
+                        if (y[childPtr->minIndex] < y[minIndex]) {
+                            minIndex = childPtr->minIndex;
+                        }
+                        if (y[childPtr->maxIndex] > y[maxIndex]) {
+                            maxIndex = childPtr->maxIndex;
+                        }
+                    }
+                }
+            }
+            blockPtr = lodPtr->levels[level] + block;
+            blockPtr->minIndex = minIndex;
+            blockPtr->maxIndex = maxIndex;
         }
+        lodPtr->nBlocks[level] = nBlocks[level];
+        start /= LOD_BRANCH;
     }
-    /*
-     * Reflect the visible spline-coordinate interval too, so that both
-     * source and interpolation coordinates use the same increasing
-     * canonical coordinate system.
-     */
-    if (reversed) {
-        double tmp;
+    lodPtr->nLevels = nLevels;
+    lodPtr->nPoints = nPoints;
+    return TRUE;
+}
 
-        tmp = plotMin;
-        plotMin = -plotMax;
-        plotMax = -tmp;
-        firstU = -firstU;
-        if (graphPtr->inverted) {
-            nextU = -origPts[nOrigPts - 1].y;
-        } else {
-            nextU = -origPts[nOrigPts - 1].x;
-        }
-    } else {
-        if (graphPtr->inverted) {
-            nextU = origPts[nOrigPts - 1].y;
-        } else {
-            nextU = origPts[nOrigPts - 1].x;
+/*
+ * State of a walk over the level-of-detail summaries, collecting the
+ * indices of the points to draw.
+ */
+typedef struct {
+    Graph *graphPtr;
+    Axis *xAxisPtr;
+    int logY;           /* The y-axis is logarithmic. */
+    const double *x, *y;
+    LodPyramid *lodPtr;
+    Tcl_Size nPoints;
+    Tcl_Size lo, hi;    /* Range of points in view, including the
+                         * points just outside. */
+    Tcl_Size *indices;  /* Collected indices (malloc-ed). */
+    Tcl_Size nIndices;
+    Tcl_Size size;      /* Number of indices allocated. */
+} LodWalk;
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddLodIndex --
+ *
+ *      Appends a point index to the collected indices.
+ *
+ * Parameters:
+ *      LodWalk *walkPtr
+ *      Tcl_Size index
+ *
+ * Results:
+ *      A standard Tcl result.  TCL_ERROR if memory couldn't be
+ *      allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+static int AddLodIndex(LodWalk *walkPtr, Tcl_Size index) {
+    if (walkPtr->nIndices == walkPtr->size) {
+        Tcl_Size *indices;
+        Tcl_Size newSize;
+        size_t indexBytes;
+
+        newSize = (walkPtr->size > 0) ? walkPtr->size * 2 : 1024;
+        if ((GetLineArrayByteCount(newSize, sizeof(Tcl_Size), &indexBytes) != TCL_OK) ||
+            ((indices = Tcl_AttemptRealloc(walkPtr->indices, indexBytes)) == NULL)) {
+            return TCL_ERROR;
         }
+        walkPtr->indices = indices;
+        walkPtr->size = newSize;
     }
-    /*
-     * The canonical source abscissas are increasing, so this test also
-     * covers either screen direction.
-     */
-    if ((firstU > plotMax) || (nextU < plotMin)) {
-        return;
+    walkPtr->indices[walkPtr->nIndices++] = index;
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LodColumn --
+ *
+ *      Returns the pixel column of an x value, the same way
+ *      DecimatePoints determines it from the mapped point.
+ *
+ *----------------------------------------------------------------------
+ */
+static double LodColumn(LodWalk *walkPtr, double x) {
+    if (walkPtr->graphPtr->inverted) {
+        return floor(Rbc_VMap(walkPtr->graphPtr, walkPtr->xAxisPtr, x));
     }
-    if (span < 1) {
-        return;
+    return floor(Rbc_HMap(walkPtr->graphPtr, walkPtr->xAxisPtr, x));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WalkLodBlock --
+ *
+ *      Collects the indices of the points of a block that are needed
+ *      to draw it.  A block whose points all fall in one pixel column
+ *      and draw without a break contributes its first, smallest,
+ *      largest and last point, which is what decimation would keep of
+ *      them.  Other blocks are split into the blocks of the level
+ *      below, down to the individual points.  So the walk stops at
+ *      the coarsest level with at least one block per pixel column.
+ *
+ * Parameters:
+ *      LodWalk *walkPtr
+ *      int level - Level of the block
+ *      Tcl_Size block - Index of the block in its level
+ *      Tcl_Size span - Number of points summarized by a block of
+ *                      the level
+ *
+ * Results:
+ *      A standard Tcl result.  TCL_ERROR if memory couldn't be
+ *      allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+static int WalkLodBlock(LodWalk *walkPtr, int level, Tcl_Size block, Tcl_Size span) {
+    LodBlock *blockPtr;
+    const double *y;
+    Tcl_Size first, last;
+    Tcl_Size i;
+
+    first = block * span;
+    last = MIN(first + span, walkPtr->nPoints) - 1;
+    if ((last < walkPtr->lo) || (first > walkPtr->hi)) {
+        return TCL_OK;
     }
-    if ((Tcl_WideUInt)span > (Tcl_WideUInt)TCL_SIZE_MAX) {
-        linePtr->smooth = PEN_SMOOTH_NONE;
-        return;
+    y = walkPtr->y;
+    blockPtr = walkPtr->lodPtr->levels[level] + block;
+    if ((blockPtr->minIndex >= 0) && ((!walkPtr->logY) || (y[blockPtr->minIndex] > 0.0)) &&
+        (LodColumn(walkPtr, walkPtr->x[first]) == LodColumn(walkPtr, walkPtr->x[last]))) {
+        Tcl_Size keep[4];
+        Tcl_Size j;
+
+        keep[0] = first;
+        keep[1] = MIN(blockPtr->minIndex, blockPtr->maxIndex);
+        keep[2] = MAX(blockPtr->minIndex, blockPtr->maxIndex);
+        keep[3] = last;
+        for (j = 0; j < 4; j++) {
+            if (((j == 0) || (keep[j] != keep[j - 1])) && (AddLodIndex(walkPtr, keep[j]) != TCL_OK)) {
+                return TCL_ERROR;
+            }
+        }
+        return TCL_OK;
     }
-    extra = (Tcl_Size)span;
-    if (nOrigPts > TCL_SIZE_MAX - extra - 1) {
-        linePtr->smooth = PEN_SMOOTH_NONE;
-        return;
+    if (level == 0) {
+        last = MIN(last, walkPtr->hi);
+        for (i = MAX(first, walkPtr->lo); i <= last; i++) {
+            if (AddLodIndex(walkPtr, i) != TCL_OK) {
+                return TCL_ERROR;
+            }
+        }
+        return TCL_OK;
     }
-    capacity = nOrigPts + extra + 1;
-    if (((Tcl_WideUInt)capacity > (Tcl_WideUInt)(SIZE_MAX / sizeof(*intpPts))) ||
-        ((Tcl_WideUInt)capacity > (Tcl_WideUInt)(SIZE_MAX / sizeof(*indices)))) {
-        linePtr->smooth = PEN_SMOOTH_NONE;
-        return;
+    last = MIN((block + 1) * LOD_BRANCH, walkPtr->lodPtr->nBlocks[level - 1]);
+    for (i = block * LOD_BRANCH; i < last; i++) {
+        if (WalkLodBlock(walkPtr, level - 1, i, span / LOD_BRANCH) != TCL_OK) {
+            return TCL_ERROR;
+        }
     }
-    if (GetLineArrayByteCount(nOrigPts, sizeof(*splinePts), &splineBytes) != TCL_OK) {
-        linePtr->smooth = PEN_SMOOTH_NONE;
-        return;
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetLodIndices --
+ *
+ *      Picks the points of a long trace to map from its level-of-
+ *      detail summaries.  Only the points in view are considered,
+ *      plus one on either side so the trace still runs off the edges
+ *      of the plotting area.  Decimating the picked points gives the
+ *      same result as decimating all of them.
+ *
+ *      The summaries are used only if the trace would be decimated
+ *      and its x values are ordered.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Line *linePtr
+ *      Tcl_Size nPoints - Number of data points
+ *      Tcl_Size **indicesPtr - (out) Indices of the picked points
+ *      Tcl_Size *countPtr - (out) Number of picked points
+ *
+ * Results:
+ *      Returns TCL_OK if points were picked.  TCL_ERROR means that
+ *      all the points must be mapped.
+ *
+ * Side effects:
+ *      The summaries are updated.  The index array is allocated and
+ *      must be freed by the caller.
+ *
+ *----------------------------------------------------------------------
+ */
+static int GetLodIndices(Graph *graphPtr, Line *linePtr, Tcl_Size nPoints, Tcl_Size **indicesPtr,
+                         Tcl_Size *countPtr) {
+    LodWalk walk;
+    Tcl_Size span;
+    Tcl_Size block, lastBlock;
+    int top;
+    int level;
+
+    if ((nPoints < LOD_MIN_POINTS) || (!CanDecimate(graphPtr, linePtr, nPoints))) {
+        return TCL_ERROR;
     }
-    splinePts = Tcl_AttemptAlloc(splineBytes);
-    if (splinePts == NULL) {
-        linePtr->smooth = PEN_SMOOTH_NONE;
-        return;
+    if (!Rbc_GetElemVisibleRange(&linePtr->core, GetVisibleMargin(graphPtr, linePtr), &walk.lo, &walk.hi)) {
+        return TCL_ERROR;
     }
-    /*
-     * Convert screen coordinates into the canonical spline coordinate
-     * system:
-     *
-     *     spline x = mapped data-X direction
-     *     spline y = mapped data-Y direction
-     *
-     * The spline x coordinate is reflected when necessary so that it
-     * is always strictly increasing.
-     */
-    for (i = 0; i < nOrigPts; i++) {
-        if (graphPtr->inverted) {
-            splinePts[i].x = origPts[i].y;
-            splinePts[i].y = origPts[i].x;
-        } else {
-            splinePts[i] = origPts[i];
-        }
-        if (reversed) {
-            splinePts[i].x = -splinePts[i].x;
+    if (!UpdateLod(linePtr, nPoints)) {
+        return TCL_ERROR;
+    }
+    walk.graphPtr = graphPtr;
+    walk.xAxisPtr = linePtr->core.axes.x;
+    walk.logY = linePtr->core.axes.y->logScale;
+    walk.x = linePtr->core.x.valueArr;
+    walk.y = linePtr->core.y.valueArr;
+    walk.lodPtr = &linePtr->lod;
+    walk.nPoints = nPoints;
+    walk.indices = NULL;
+    walk.nIndices = walk.size = 0;
+
+    top = linePtr->lod.nLevels - 1;
+    span = LOD_BRANCH;
+    for (level = 0; level < top; level++) {
+        span *= LOD_BRANCH;
+    }
+    lastBlock = walk.hi / span;
+    for (block = walk.lo / span; block <= lastBlock; block++) {
+        if (WalkLodBlock(&walk, top, block, span) != TCL_OK) {
+            if (walk.indices != NULL) {
+                ckfree(walk.indices);
+            }
+            return TCL_ERROR;
         }
     }
-    intpPts = Tcl_AttemptAlloc((size_t)capacity * sizeof(*intpPts));
-    if (intpPts == NULL) {
-        ckfree(splinePts);
-        linePtr->smooth = PEN_SMOOTH_NONE;
+    *indicesPtr = walk.indices;
+    *countPtr = walk.nIndices;
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReducePoints --
+ *
+ *      Generates a coordinate array of transformed screen coordinates
+ *      from the data points.
+ *
+ * Parameters:
+ *      MapInfo *mapPtr
+ *      double tolerance
+ *
+ * Results:
+ *      The transformed screen coordinates are returned.
+ *
+ * Side effects:
+ *      Memory is allocated for the coordinate array.
+ *
+ *----------------------------------------------------------------------
+ */
+static void ReducePoints(MapInfo *mapPtr, double tolerance) {
+    Point2D *screenPts;
+    Tcl_Size *indices;
+    unsigned char *breakBefore;
+    Tcl_Size *simple;
+    Tcl_Size nPoints;
+    Tcl_Size n;
+    Tcl_Size i;
+    Tcl_Size runStart;
+    size_t simpleBytes;
+    size_t pointBytes;
+    size_t indexBytes;
+
+    if ((mapPtr == NULL) || (mapPtr->screenPts == NULL) || (mapPtr->indices == NULL) || (mapPtr->nScreenPts < 2)) {
         return;
     }
-    indices = Tcl_AttemptAlloc((size_t)capacity * sizeof(*indices));
-    if (indices == NULL) {
-        ckfree(intpPts);
-        ckfree(splinePts);
-        linePtr->smooth = PEN_SMOOTH_NONE;
+    nPoints = mapPtr->nScreenPts;
+    if (GetLineArrayByteCount(nPoints, sizeof(*simple), &simpleBytes) != TCL_OK) {
         return;
     }
-    /*
-     * Populate the interpolation abscissas with every original knot
-     * plus one sample for each intervening visible screen pixel along
-     * the mapped data-X direction.
-     */
-    count = 0;
-    for (i = 0, j = 1; j < nOrigPts; i++, j++) {
-        intpPts[count].x = splinePts[i].x;
-        indices[count] = mapPtr->indices[i];
-        count++;
-        /*
-         * Does any part of this interval intersect the plotting area
-         * along the spline coordinate?
-         */
-        if ((splinePts[j].x >= plotMin) && (splinePts[i].x <= plotMax)) {
-
-            double first;
-            double limit;
-            int last;
+    simple = Tcl_AttemptAlloc(simpleBytes);
+    if (simple == NULL) {
+        return;
+    }
+    n = 0;
+    runStart = 0;
+    for (i = 1; i <= nPoints; i++) {
+        if ((i == nPoints) || ((mapPtr->breakBefore != NULL) && mapPtr->breakBefore[i])) {
+            Tcl_Size runCount;
 
-            /*
-             * Clip in floating point before converting to int.
-             */
-            first = splinePts[i].x + 1.0;
-            if (first < plotMin) {
-                first = plotMin;
-            } else if (first > plotMax) {
-                first = plotMax;
-            }
-            limit = splinePts[j].x;
-            if (limit < plotMin) {
-                limit = plotMin;
-            } else if (limit > plotMax) {
-                limit = plotMax;
-            }
-            sample = (int)first;
-            last = (int)limit;
-            while (sample < last) {
-                indices[count] = mapPtr->indices[i];
-                intpPts[count].x = (double)sample;
-                count++;
-                sample++;
+            runCount = Rbc_SimplifyLine(mapPtr->screenPts, runStart, i - 1, tolerance, simple + n);
+            if ((runCount <= 0) || (runCount > nPoints - n)) {
+                ckfree(simple);
+                return;
             }
+            n += runCount;
+            runStart = i;
         }
     }
-    /*
-     * The interval loop retains each interval's first knot.  Append the
-     * final original knot explicitly.
-     */
-    if (count >= capacity) {
-        linePtr->smooth = PEN_SMOOTH_NONE;
-        ckfree(intpPts);
-        ckfree(indices);
-        ckfree(splinePts);
+    if (n == nPoints) {
+        ckfree(simple);
         return;
     }
-    intpPts[count].x = splinePts[nOrigPts - 1].x;
-    indices[count] = mapPtr->indices[nOrigPts - 1];
-    count++;
-    nIntpPts = count;
-    result = FALSE;
-    if (linePtr->smooth == PEN_SMOOTH_NATURAL) {
-        result = Rbc_NaturalSpline(splinePts, nOrigPts, intpPts, nIntpPts);
-    } else if (linePtr->smooth == PEN_SMOOTH_QUADRATIC) {
-        result = Rbc_QuadraticSpline(splinePts, nOrigPts, intpPts, nIntpPts);
+    if ((n <= 0) || (GetLineArrayByteCount(n, sizeof(*screenPts), &pointBytes) != TCL_OK) ||
+        (GetLineArrayByteCount(n, sizeof(*indices), &indexBytes) != TCL_OK)) {
+        ckfree(simple);
+        return;
     }
-    ckfree(splinePts);
-    if (!result) {
-        /*
-         * The spline interpolation failed.  Fall back to the original
-         * coordinates and ordinary line segments.
-         */
-        linePtr->smooth = PEN_SMOOTH_NONE;
-        ckfree(intpPts);
-        ckfree(indices);
+    screenPts = Tcl_AttemptAlloc(pointBytes);
+    if (screenPts == NULL) {
+        ckfree(simple);
         return;
     }
-    /*
-     * Transform the generated canonical spline coordinates back into
-     * actual screen coordinates.
-     */
-    for (i = 0; i < nIntpPts; i++) {
-        double u;
-        double v;
+    indices = Tcl_AttemptAlloc(indexBytes);
+    if (indices == NULL) {
+        ckfree(screenPts);
+        ckfree(simple);
+        return;
+    }
+    breakBefore = NULL;
+    if (mapPtr->breakBefore != NULL) {
+        size_t breakBytes;
 
-        u = intpPts[i].x;
-        v = intpPts[i].y;
-        if (reversed) {
-            u = -u;
+        if (GetLineArrayByteCount(n, sizeof(*breakBefore), &breakBytes) != TCL_OK) {
+            ckfree(screenPts);
+            ckfree(indices);
+            ckfree(simple);
+            return;
         }
-        if (graphPtr->inverted) {
-            intpPts[i].x = v;
-            intpPts[i].y = u;
-        } else {
-            intpPts[i].x = u;
-            intpPts[i].y = v;
+        breakBefore = Tcl_AttemptAlloc(breakBytes);
+        if (breakBefore == NULL) {
+            ckfree(screenPts);
+            ckfree(indices);
+            ckfree(simple);
+            return;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        Tcl_Size k;
+
+        k = simple[i];
+        screenPts[i] = mapPtr->screenPts[k];
+        indices[i] = mapPtr->indices[k];
+        if (breakBefore != NULL) {
+            breakBefore[i] = mapPtr->breakBefore[k];
         }
     }
+    ckfree(simple);
     ckfree(mapPtr->screenPts);
     ckfree(mapPtr->indices);
+    if (mapPtr->breakBefore != NULL) {
+        ckfree(mapPtr->breakBefore);
+    }
+    mapPtr->screenPts = screenPts;
     mapPtr->indices = indices;
-    mapPtr->screenPts = intpPts;
-    mapPtr->nScreenPts = nIntpPts;
+    mapPtr->breakBefore = breakBefore;
+    mapPtr->nScreenPts = n;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * GenerateParametricSpline --
+ * GenerateSteps --
  *
- *      Computes a spline based upon the data points, returning a new
- *      (larger) coordinate array or points.
+ *      Resets the coordinate and pen index arrays adding new points
+ *      for step-and-hold type smoothing.
  *
  * Parameters:
- *      Graph *graphPtr;
- *      Line *linePtr
  *      MapInfo *mapPtr
  *
  * Results:
  *      None.
  *
  * Side Effects:
- *      The temporary arrays for screen coordinates and data indices
- *      are updated based upon spline.
+ *      The temporary arrays for screen coordinates and pen indices
+ *      are updated.
  *
  *----------------------------------------------------------------------
  */
-static void GenerateParametricSpline(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
-    Extents2D exts;
-    Point2D *origPts;
-    Point2D *intpPts;
+static void GenerateSteps(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
+    Point2D *screenPts;
     Tcl_Size *indices;
-    Tcl_Size nOrigPts;
-    Tcl_Size nIntpPts;
-    Tcl_Size capacity;
-    Tcl_Size count;
+    unsigned char *breakBefore;
     Tcl_Size i;
-    Tcl_Size j;
-    int result;
-
-    assert(mapPtr->nScreenPts > 0);
-    origPts = mapPtr->screenPts;
-    nOrigPts = mapPtr->nScreenPts;
-    intpPts = NULL;
-    indices = NULL;
-    Rbc_GraphExtents(graphPtr, &exts);
-
-    /*
-     * Every original point is retained. Additional points are generated
-     * at approximately two-pixel intervals along the visible portion of
-     * each segment.
-     */
-    capacity = nOrigPts;
-    for (i = 0, j = 1; j < nOrigPts; i++, j++) {
-        Segment2D clipped;
-
-        if (Rbc_LineRectClip(&exts, &origPts[i], &origPts[j], &clipped)) {
-            double distP;
-            double distQ;
+    Tcl_Size count;
+    Tcl_Size newSize;
+    size_t pointBytes;
+    size_t indexBytes;
 
-            distP = hypot(clipped.p.x - origPts[i].x, clipped.p.y - origPts[i].y);
-            distQ = hypot(clipped.q.x - origPts[i].x, clipped.q.y - origPts[i].y);
-            /*
-             * The first additional sample is two pixels from the clipped
-             * starting point.
-             */
-            distP += 2.0;
-            if (distP <= distQ) {
-                double extraValue;
-                Tcl_Size extra;
-                extraValue = floor((distQ - distP) / 2.0) + 1.0;
-                if (!FINITE(extraValue) || (extraValue > (double)(TCL_SIZE_MAX - capacity))) {
-                    goto fallback;
-                }
-                extra = (Tcl_Size)extraValue;
-                capacity += extra;
-            }
-        }
+    if (mapPtr->nScreenPts < 2) {
+        return;
     }
-    if (((size_t)capacity > (SIZE_MAX / sizeof(*intpPts))) || ((size_t)capacity > (SIZE_MAX / sizeof(*indices)))) {
-        goto fallback;
+    if (mapPtr->nScreenPts > (TCL_SIZE_MAX / 2) + 1) {
+        linePtr->smooth = PEN_SMOOTH_NONE;
+        return;
     }
-    intpPts = Tcl_AttemptAlloc((size_t)capacity * sizeof(*intpPts));
-    if (intpPts == NULL) {
-        goto fallback;
+    newSize = (mapPtr->nScreenPts - 1) * 2 + 1;
+    if ((GetLineArrayByteCount(newSize, sizeof(*screenPts), &pointBytes) != TCL_OK) ||
+        (GetLineArrayByteCount(newSize, sizeof(*indices), &indexBytes) != TCL_OK)) {
+        linePtr->smooth = PEN_SMOOTH_NONE;
+        return;
     }
-    indices = Tcl_AttemptAlloc((size_t)capacity * sizeof(*indices));
+    screenPts = Tcl_AttemptAlloc(pointBytes);
+    if (screenPts == NULL) {
+        linePtr->smooth = PEN_SMOOTH_NONE;
+        return;
+    }
+    indices = Tcl_AttemptAlloc(indexBytes);
     if (indices == NULL) {
-        goto fallback;
+        ckfree(screenPts);
+        linePtr->smooth = PEN_SMOOTH_NONE;
+        return;
     }
-    /*
-     * Store Catmull-Rom evaluation parameters in intpPts:
-     *
-     *     x = source interval
-     *     y = parameter t within that interval
-     *
-     * Rbc_CatromParametricSpline() replaces these parameters with the
-     * corresponding interpolated screen coordinates.
-     */
-    count = 0;
-    for (i = 0, j = 1; j < nOrigPts; i++, j++) {
-        Segment2D clipped;
-        double dist;
-
-        if (count >= capacity) {
-            goto fallback;
+    breakBefore = NULL;
+    if (mapPtr->breakBefore != NULL) {
+        size_t breakBytes;
+        if (GetLineArrayByteCount(newSize, sizeof(*breakBefore), &breakBytes) != TCL_OK) {
+            ckfree(screenPts);
+            ckfree(indices);
+            linePtr->smooth = PEN_SMOOTH_NONE;
+            return;
+        }
+        breakBefore = Tcl_AttemptAlloc(breakBytes);
+        if (breakBefore == NULL) {
+            ckfree(screenPts);
+            ckfree(indices);
+            linePtr->smooth = PEN_SMOOTH_NONE;
+            return;
         }
+    }
+    screenPts[0] = mapPtr->screenPts[0];
+    indices[0] = mapPtr->indices[0];
+    if (breakBefore != NULL) {
+        breakBefore[0] = FALSE;
+    }
+    count = 1;
+    for (i = 1; i < mapPtr->nScreenPts; i++) {
         /*
-         * Retain the original point at the beginning of this interval.
+         * Do not manufacture a step segment across a missing-data
+         * boundary.
          */
-        intpPts[count].x = (double)i;
-        intpPts[count].y = 0.0;
-        indices[count] = mapPtr->indices[i];
-        count++;
-        dist = hypot(origPts[j].x - origPts[i].x, origPts[j].y - origPts[i].y);
-        if ((!FINITE(dist)) || (dist <= DBL_EPSILON)) {
+        if ((mapPtr->breakBefore != NULL) && mapPtr->breakBefore[i]) {
+            screenPts[count] = mapPtr->screenPts[i];
+            indices[count] = mapPtr->indices[i];
+            breakBefore[count] = TRUE;
+            count++;
             continue;
         }
-        if (Rbc_LineRectClip(&exts, &origPts[i], &origPts[j], &clipped)) {
-            double distP;
-            double distQ;
-
-            distP = hypot(clipped.p.x - origPts[i].x, clipped.p.y - origPts[i].y);
-            distQ = hypot(clipped.q.x - origPts[i].x, clipped.q.y - origPts[i].y);
-            /*
-             * Insert interpolated points every two screen pixels over
-             * the visible portion of the source interval.
-             */
-            distP += 2.0;
-            while (distP <= distQ) {
-                if (count >= capacity) {
-                    goto fallback;
-                }
-                /*
-                 * Identify the point by its source interval and its
-                 * normalized position within that interval.
-                 */
-                intpPts[count].x = (double)i;
-                intpPts[count].y = distP / dist;
-                /*
-                 * Interpolated points map to the source point beginning
-                 * the interval.
-                 */
-                indices[count] = mapPtr->indices[i];
-                count++;
-                distP += 2.0;
-            }
+        /*
+         * Step-and-hold changes data X first while holding data Y
+         * constant, then changes data Y.
+         *
+         * Normally data X maps to screen X, so the intermediate
+         * point is:
+         *
+         *     (next.x, previous.y)
+         *
+         * With -invertxy, data X maps to screen Y instead, so it is:
+         *
+         *     (previous.x, next.y)
+         */
+        screenPts[count] = screenPts[count - 1];
+        if (graphPtr->inverted) {
+            screenPts[count].y = mapPtr->screenPts[i].y;
+        } else {
+            screenPts[count].x = mapPtr->screenPts[i].x;
         }
+        screenPts[count + 1] = mapPtr->screenPts[i];
+        indices[count] = mapPtr->indices[i];
+        indices[count + 1] = mapPtr->indices[i];
+        if (breakBefore != NULL) {
+            breakBefore[count] = FALSE;
+            breakBefore[count + 1] = FALSE;
+        }
+        count += 2;
     }
-    /*
-     * Append the final original point.
-     */
-    if (count >= capacity) {
-        goto fallback;
-    }
-    intpPts[count].x = (double)(nOrigPts - 1);
-    intpPts[count].y = 0.0;
-    indices[count] = mapPtr->indices[nOrigPts - 1];
-    count++;
-    nIntpPts = count;
-    result = Rbc_CatromParametricSpline(origPts, nOrigPts, intpPts, nIntpPts);
-    if (!result) {
-        goto fallback;
-    }
-    /*
-     * Commit only after spline generation succeeds.
-     */
     ckfree(mapPtr->screenPts);
     ckfree(mapPtr->indices);
-    mapPtr->screenPts = intpPts;
-    mapPtr->indices = indices;
-    mapPtr->nScreenPts = nIntpPts;
-    return;
-
-fallback:
-    if (intpPts != NULL) {
-        ckfree(intpPts);
-    }
-    if (indices != NULL) {
-        ckfree(indices);
+    if (mapPtr->breakBefore != NULL) {
+        ckfree(mapPtr->breakBefore);
     }
-    /*
-     * Preserve the original MapInfo arrays and fall back to straight
-     * line segments.
-     */
-    linePtr->smooth = PEN_SMOOTH_NONE;
+    mapPtr->screenPts = screenPts;
+    mapPtr->indices = indices;
+    mapPtr->breakBefore = breakBefore;
+    mapPtr->nScreenPts = count;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * MapSymbols --
+ * GenerateSpline --
  *
- *      Creates two arrays of points and pen indices, filled with
- *      the screen coordinates of the visible
+ *      Computes a spline based upon the data points, returning a new
+ *      (larger) coordinate array or points.
  *
  * Parameters:
  *      Graph *graphPtr;
@@ -3601,161 +4722,584 @@ fallback:
  * Results:
  *      None.
  *
- * Side effects:
- *      Memory is freed and allocated for the index array.
+ * Side Effects:
+ *      The temporary arrays for screen coordinates and data indices
+ *      are updated based upon spline.
  *
  *----------------------------------------------------------------------
  */
-static void MapSymbols(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
-    Extents2D exts;
-    Point2D *symbolPts;
+static void GenerateSpline(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
+    Tcl_Size extra;
+    Tcl_WideInt span;
+    Point2D *origPts;
+    Point2D *splinePts;
+    Point2D *intpPts;
     Tcl_Size *indices;
-    Tcl_Size i;
+    Tcl_Size capacity;
     Tcl_Size count;
-    size_t pointBytes;
-    size_t indexBytes;
+    Tcl_Size i;
+    Tcl_Size j;
+    Tcl_Size nOrigPts;
+    Tcl_Size nIntpPts;
+    size_t splineBytes;
+    double plotMin;
+    double plotMax;
+    double firstU;
+    double nextU;
+    int reversed;
+    int result;
+    int sample;
 
-    if (mapPtr->nScreenPts <= 0) {
+    nOrigPts = mapPtr->nScreenPts;
+    origPts = mapPtr->screenPts;
+    assert(nOrigPts > 0);
+    if (nOrigPts < 3) {
         return;
     }
-    if ((GetLineArrayByteCount(mapPtr->nScreenPts, sizeof(*symbolPts), &pointBytes) != TCL_OK) ||
-        (GetLineArrayByteCount(mapPtr->nScreenPts, sizeof(*indices), &indexBytes) != TCL_OK)) {
+    if (GenerateFittedSpline(graphPtr, linePtr, mapPtr)) {
         return;
     }
-    symbolPts = Tcl_AttemptAlloc(pointBytes);
-    if (symbolPts == NULL) {
-        return;
+    /*
+     * Natural and quadratic splines are functions of data X.
+     *
+     * Normally data X maps to screen X.  For an inverted graph it
+     * maps to screen Y instead.  Select that screen coordinate as the
+     * spline abscissa.
+     */
+    if (graphPtr->inverted) {
+        plotMin = (double)graphPtr->top;
+        plotMax = (double)graphPtr->bottom;
+        span = (Tcl_WideInt)graphPtr->bottom - (Tcl_WideInt)graphPtr->top + 1;
+        firstU = origPts[0].y;
+        nextU = origPts[1].y;
+    } else {
+        plotMin = (double)graphPtr->left;
+        plotMax = (double)graphPtr->right;
+        span = (Tcl_WideInt)graphPtr->right - (Tcl_WideInt)graphPtr->left + 1;
+        firstU = origPts[0].x;
+        nextU = origPts[1].x;
     }
-    indices = Tcl_AttemptAlloc(indexBytes);
-    if (indices == NULL) {
-        ckfree(symbolPts);
+    /*
+     * The spline routines require strictly increasing abscissas.
+     * Screen coordinates may instead decrease when the corresponding
+     * axis is descending, or simply because data X is mapped to the
+     * vertical screen direction.  Reflect the spline coordinate when
+     * necessary rather than reversing the point array.  This preserves
+     * data and index order.
+     */
+    if (nextU > firstU) {
+        reversed = FALSE;
+    } else if (nextU < firstU) {
+        reversed = TRUE;
+    } else {
         return;
     }
-    Rbc_GraphExtents(graphPtr, &exts);
-    count = 0;
-    for (i = 0; i < mapPtr->nScreenPts; i++) {
-        if (PointInRegion(&exts, mapPtr->screenPts[i].x, mapPtr->screenPts[i].y)) {
-            symbolPts[count] = mapPtr->screenPts[i];
-            indices[count] = mapPtr->indices[i];
-            count++;
+    for (i = 0, j = 1; j < nOrigPts; i++, j++) {
+        double u;
+        double v;
+
+        if (graphPtr->inverted) {
+            u = origPts[i].y;
+            v = origPts[j].y;
+        } else {
+            u = origPts[i].x;
+            v = origPts[j].x;
+        }
+        if ((!reversed && (v <= u)) || (reversed && (v >= u))) {
+            return;
         }
     }
-    if (count > 0) {
-        linePtr->symbolPts = symbolPts;
-        linePtr->symbolToData = indices;
-        linePtr->nSymbolPts = count;
+    /*
+     * Reflect the visible spline-coordinate interval too, so that both
+     * source and interpolation coordinates use the same increasing
+     * canonical coordinate system.
+     */
+    if (reversed) {
+        double tmp;
+
+        tmp = plotMin;
+        plotMin = -plotMax;
+        plotMax = -tmp;
+        firstU = -firstU;
+        if (graphPtr->inverted) {
+            nextU = -origPts[nOrigPts - 1].y;
+        } else {
+            nextU = -origPts[nOrigPts - 1].x;
+        }
     } else {
-        ckfree(symbolPts);
+        if (graphPtr->inverted) {
+            nextU = origPts[nOrigPts - 1].y;
+        } else {
+            nextU = origPts[nOrigPts - 1].x;
+        }
+    }
+    /*
+     * The canonical source abscissas are increasing, so this test also
+     * covers either screen direction.
+     */
+    if ((firstU > plotMax) || (nextU < plotMin)) {
+        return;
+    }
+    if (span < 1) {
+        return;
+    }
+    if ((Tcl_WideUInt)span > (Tcl_WideUInt)TCL_SIZE_MAX) {
+        linePtr->smooth = PEN_SMOOTH_NONE;
+        return;
+    }
+    extra = (Tcl_Size)span;
+    if (nOrigPts > TCL_SIZE_MAX - extra - 1) {
+        linePtr->smooth = PEN_SMOOTH_NONE;
+        return;
+    }
+    capacity = nOrigPts + extra + 1;
+    if (((Tcl_WideUInt)capacity > (Tcl_WideUInt)(SIZE_MAX / sizeof(*intpPts))) ||
+        ((Tcl_WideUInt)capacity > (Tcl_WideUInt)(SIZE_MAX / sizeof(*indices)))) {
+        linePtr->smooth = PEN_SMOOTH_NONE;
+        return;
+    }
+    if (GetLineArrayByteCount(nOrigPts, sizeof(*splinePts), &splineBytes) != TCL_OK) {
+        linePtr->smooth = PEN_SMOOTH_NONE;
+        return;
+    }
+    splinePts = Tcl_AttemptAlloc(splineBytes);
+    if (splinePts == NULL) {
+        linePtr->smooth = PEN_SMOOTH_NONE;
+        return;
+    }
+    /*
+     * Convert screen coordinates into the canonical spline coordinate
+     * system:
+     *
+     *     spline x = mapped data-X direction
+     *     spline y = mapped data-Y direction
+     *
+     * The spline x coordinate is reflected when necessary so that it
+     * is always strictly increasing.
+     */
+    for (i = 0; i < nOrigPts; i++) {
+        if (graphPtr->inverted) {
+            splinePts[i].x = origPts[i].y;
+            splinePts[i].y = origPts[i].x;
+        } else {
+            splinePts[i] = origPts[i];
+        }
+        if (reversed) {
+            splinePts[i].x = -splinePts[i].x;
+        }
+    }
+    intpPts = Tcl_AttemptAlloc((size_t)capacity * sizeof(*intpPts));
+    if (intpPts == NULL) {
+        ckfree(splinePts);
+        linePtr->smooth = PEN_SMOOTH_NONE;
+        return;
+    }
+    indices = Tcl_AttemptAlloc((size_t)capacity * sizeof(*indices));
+    if (indices == NULL) {
+        ckfree(intpPts);
+        ckfree(splinePts);
+        linePtr->smooth = PEN_SMOOTH_NONE;
+        return;
+    }
+    /*
+     * Populate the interpolation abscissas with every original knot
+     * plus one sample for each intervening visible screen pixel along
+     * the mapped data-X direction.
+     */
+    count = 0;
+    for (i = 0, j = 1; j < nOrigPts; i++, j++) {
+        intpPts[count].x = splinePts[i].x;
+        indices[count] = mapPtr->indices[i];
+        count++;
+        /*
+         * Does any part of this interval intersect the plotting area
+         * along the spline coordinate?
+         */
+        if ((splinePts[j].x >= plotMin) && (splinePts[i].x <= plotMax)) {
+
+            double first;
+            double limit;
+            int last;
+
+            /*
+             * Clip in floating point before converting to int.
+             */
+            first = splinePts[i].x + 1.0;
+            if (first < plotMin) {
+                first = plotMin;
+            } else if (first > plotMax) {
+                first = plotMax;
+            }
+            limit = splinePts[j].x;
+            if (limit < plotMin) {
+                limit = plotMin;
+            } else if (limit > plotMax) {
+                limit = plotMax;
+            }
+            sample = (int)first;
+            last = (int)limit;
+            while (sample < last) {
+                indices[count] = mapPtr->indices[i];
+                intpPts[count].x = (double)sample;
+                count++;
+                sample++;
+            }
+        }
+    }
+    /*
+     * The interval loop retains each interval's first knot.  Append the
+     * final original knot explicitly.
+     */
+    if (count >= capacity) {
+        linePtr->smooth = PEN_SMOOTH_NONE;
+        ckfree(intpPts);
+        ckfree(indices);
+        ckfree(splinePts);
+        return;
+    }
+    intpPts[count].x = splinePts[nOrigPts - 1].x;
+    indices[count] = mapPtr->indices[nOrigPts - 1];
+    count++;
+    nIntpPts = count;
+    result = FALSE;
+    if (linePtr->smooth == PEN_SMOOTH_NATURAL) {
+        result = Rbc_NaturalSpline(splinePts, nOrigPts, intpPts, nIntpPts);
+    } else if (linePtr->smooth == PEN_SMOOTH_QUADRATIC) {
+        result = Rbc_QuadraticSpline(splinePts, nOrigPts, intpPts, nIntpPts);
+    }
+    ckfree(splinePts);
+    if (!result) {
+        /*
+         * The spline interpolation failed.  Fall back to the original
+         * coordinates and ordinary line segments.
+         */
+        linePtr->smooth = PEN_SMOOTH_NONE;
+        ckfree(intpPts);
         ckfree(indices);
+        return;
+    }
+    /*
+     * Transform the generated canonical spline coordinates back into
+     * actual screen coordinates.
+     */
+    for (i = 0; i < nIntpPts; i++) {
+        double u;
+        double v;
+
+        u = intpPts[i].x;
+        v = intpPts[i].y;
+        if (reversed) {
+            u = -u;
+        }
+        if (graphPtr->inverted) {
+            intpPts[i].x = v;
+            intpPts[i].y = u;
+        } else {
+            intpPts[i].x = u;
+            intpPts[i].y = v;
+        }
     }
+    ckfree(mapPtr->screenPts);
+    ckfree(mapPtr->indices);
+    mapPtr->indices = indices;
+    mapPtr->screenPts = intpPts;
+    mapPtr->nScreenPts = nIntpPts;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * MapActiveSymbols --
+ * GenerateFittedSpline --
  *
- *      Creates an array of points of the active graph coordinates.
+ *      Computes a natural or quadratic spline from the spline fitted
+ *      through the data points of the element (see GetLineSpline).
+ *      Only the intervals in view are evaluated: the first one is
+ *      found by binary search, and each is sampled at the pixels it
+ *      covers.  The results match those of GenerateSpline, which
+ *      fits the spline to the screen points instead.
+ *
+ *      This only applies when every data point is mapped, in order.
  *
  * Parameters:
  *      Graph *graphPtr;
  *      Line *linePtr
+ *      MapInfo *mapPtr
  *
  * Results:
- *      None.
+ *      Returns TRUE if the spline was generated, FALSE if it's left
+ *      to GenerateSpline.
  *
- * Side effects:
- *      Memory is freed and allocated for the active point array.
+ * Side Effects:
+ *      The temporary arrays for screen coordinates and data indices
+ *      are replaced.  The spline of the element may be fit again.
  *
  *----------------------------------------------------------------------
  */
-static void MapActiveSymbols(Graph *graphPtr, Line *linePtr) {
-    Extents2D exts;
-    Point2D *activePts;
-    Tcl_Size *activeToData;
+static int GenerateFittedSpline(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
+    Rbc_Spline *fitPtr;
+    Axis *xAxisPtr;
+    Axis *yAxisPtr;
+    Point2D *origPts;
+    Point2D *intpPts;
+    Tcl_Size *indices;
     Tcl_Size nPoints;
-    Tcl_Size pointIndex;
-    Tcl_Size i;
+    Tcl_Size first;
+    Tcl_Size last;
+    Tcl_Size capacity;
     Tcl_Size count;
+    Tcl_Size i;
+    Tcl_WideInt span;
+    size_t pointBytes;
+    size_t indexBytes;
+    double plotMin;
+    double plotMax;
+    double t1, t2;
+    int reversed;
 
-    if (linePtr->activePts != NULL) {
-        ckfree(linePtr->activePts);
-        linePtr->activePts = NULL;
-    }
-    if (linePtr->activeToData != NULL) {
-        ckfree(linePtr->activeToData);
-        linePtr->activeToData = NULL;
+    nPoints = NumberOfPoints(&linePtr->core);
+    origPts = mapPtr->screenPts;
+    if ((mapPtr->nScreenPts != nPoints) || (mapPtr->indices[0] != 0) || (mapPtr->indices[nPoints - 1] != nPoints - 1)) {
+        /* Some data points were dropped or decimated. */
+        return FALSE;
     }
-    linePtr->nActivePts = 0;
-    if (linePtr->core.nActiveIndices <= 0) {
-        linePtr->core.flags &= ~ACTIVE_PENDING;
-        return;
+    fitPtr = GetLineSpline(linePtr);
+    if (fitPtr == NULL) {
+        return FALSE;
     }
-    {
-        size_t pointBytes;
-        size_t indexBytes;
+    xAxisPtr = linePtr->core.axes.x;
+    yAxisPtr = linePtr->core.axes.y;
+    /*
+     * The spline is fit to increasing x values, which map to screen
+     * coordinates that either all increase or all decrease.  As in
+     * GenerateSpline, decreasing ones are reflected so the pixels are
+     * sampled in increasing order.
+     */
+    if (graphPtr->inverted) {
+        plotMin = (double)graphPtr->top;
+        plotMax = (double)graphPtr->bottom;
+        span = (Tcl_WideInt)graphPtr->bottom - (Tcl_WideInt)graphPtr->top + 1;
+        reversed = (origPts[1].y < origPts[0].y);
+        t1 = Rbc_InvVMap(graphPtr, xAxisPtr, plotMin);
+        t2 = Rbc_InvVMap(graphPtr, xAxisPtr, plotMax);
+    } else {
+        plotMin = (double)graphPtr->left;
+        plotMax = (double)graphPtr->right;
+        span = (Tcl_WideInt)graphPtr->right - (Tcl_WideInt)graphPtr->left + 1;
+        reversed = (origPts[1].x < origPts[0].x);
+        t1 = Rbc_InvHMap(graphPtr, xAxisPtr, plotMin);
+        t2 = Rbc_InvHMap(graphPtr, xAxisPtr, plotMax);
+    }
+    if ((span < 1) || ((Tcl_WideUInt)span > (Tcl_WideUInt)(TCL_SIZE_MAX / 2))) {
+        return FALSE;
+    }
+    if (reversed) {
+        double tmp;
 
-        if ((GetLineArrayByteCount(linePtr->core.nActiveIndices, sizeof(*activePts), &pointBytes) != TCL_OK) ||
-            (GetLineArrayByteCount(linePtr->core.nActiveIndices, sizeof(*activeToData), &indexBytes) != TCL_OK)) {
-            linePtr->core.flags &= ~ACTIVE_PENDING;
-            return;
-        }
-        activePts = Tcl_AttemptAlloc(pointBytes);
-        if (activePts == NULL) {
-            linePtr->core.flags &= ~ACTIVE_PENDING;
-            return;
-        }
-        activeToData = Tcl_AttemptAlloc(indexBytes);
-        if (activeToData == NULL) {
-            ckfree(activePts);
-            linePtr->core.flags &= ~ACTIVE_PENDING;
-            return;
-        }
+        tmp = plotMin;
+        plotMin = -plotMax;
+        plotMax = -tmp;
+    }
+    if (xAxisPtr->logScale) {
+        t1 = log10(t1);
+        t2 = log10(t2);
+    }
+    if ((!FINITE(t1)) || (!FINITE(t2))) {
+        return FALSE;
+    }
+    /*
+     * Find the intervals in view.
+     */
+    first = Rbc_SplineInterval(fitPtr, MIN(t1, t2));
+    last = Rbc_SplineInterval(fitPtr, MAX(t1, t2));
+    capacity = (last - first + 2) + (Tcl_Size)span + 1;
+    if ((GetLineArrayByteCount(capacity, sizeof(*intpPts), &pointBytes) != TCL_OK) ||
+        (GetLineArrayByteCount(capacity, sizeof(*indices), &indexBytes) != TCL_OK)) {
+        return FALSE;
+    }
+    intpPts = Tcl_AttemptAlloc(pointBytes);
+    if (intpPts == NULL) {
+        return FALSE;
+    }
+    indices = Tcl_AttemptAlloc(indexBytes);
+    if (indices == NULL) {
+        ckfree(intpPts);
+        return FALSE;
     }
-    Rbc_GraphExtents(graphPtr, &exts);
-    nPoints = NumberOfPoints(&linePtr->core);
     count = 0;
-    for (i = 0; i < linePtr->core.nActiveIndices; i++) {
-        Point2D point;
-        double x;
-        double y;
-        pointIndex = linePtr->core.activeIndices[i];
-        if ((pointIndex < 0) || (pointIndex >= nPoints)) {
-            continue;
-        }
-        x = linePtr->core.x.valueArr[pointIndex];
-        y = linePtr->core.y.valueArr[pointIndex];
-        if (!FINITE(x) || !FINITE(y)) {
-            continue;
+    for (i = first; i <= last; i++) {
+        double u1, u2;
+        double sampleMin, sampleMax;
+        int sample, lastSample;
+
+        intpPts[count] = origPts[i];
+        indices[count] = i;
+        count++;
+        u1 = (graphPtr->inverted) ? origPts[i].y : origPts[i].x;
+        u2 = (graphPtr->inverted) ? origPts[i + 1].y : origPts[i + 1].x;
+        if (reversed) {
+            u1 = -u1;
+            u2 = -u2;
         }
-        point = Rbc_Map2D(graphPtr, x, y, &linePtr->core.axes);
-        if ((!FINITE(point.x)) || (!FINITE(point.y))) {
+        if ((u2 < plotMin) || (u1 > plotMax)) {
             continue;
         }
-        if (!PointInRegion(&exts, point.x, point.y)) {
-            continue;
+        /*
+         * Sample each pixel strictly inside the interval, clipped to
+         * the plotting area in floating point before converting to int.
+         */
+        sampleMin = MIN(MAX(u1 + 1.0, plotMin), plotMax);
+        sampleMax = MIN(MAX(u2, plotMin), plotMax);
+        lastSample = (int)sampleMax;
+        for (sample = (int)sampleMin; sample < lastSample; sample++) {
+            double u, t, y;
+
+            if (count >= capacity - 1) {
+                goto error;
+            }
+            u = (reversed) ? -(double)sample : (double)sample;
+            t = (graphPtr->inverted) ? Rbc_InvVMap(graphPtr, xAxisPtr, u) : Rbc_InvHMap(graphPtr, xAxisPtr, u);
+            if (xAxisPtr->logScale) {
+                t = log10(t);
+            }
+            y = Rbc_SplineValue(fitPtr, i, t);
+            if (yAxisPtr->logScale) {
+                y = pow(10.0, y);
+            }
+            if (graphPtr->inverted) {
+                intpPts[count].x = Rbc_HMap(graphPtr, yAxisPtr, y);
+                intpPts[count].y = u;
+            } else {
+                intpPts[count].x = u;
+                intpPts[count].y = Rbc_VMap(graphPtr, yAxisPtr, y);
+            }
+            if ((!FINITE(intpPts[count].x)) || (!FINITE(intpPts[count].y))) {
+                goto error;
+            }
+            indices[count] = i;
+            count++;
         }
-        activePts[count] = point;
-        activeToData[count] = pointIndex;
-        count++;
     }
-    if (count > 0) {
-        linePtr->activePts = activePts;
-        linePtr->activeToData = activeToData;
-        linePtr->nActivePts = count;
-    } else {
-        ckfree(activePts);
-        ckfree(activeToData);
+    intpPts[count] = origPts[last + 1];
+    indices[count] = last + 1;
+    count++;
+    ckfree(mapPtr->screenPts);
+    ckfree(mapPtr->indices);
+    mapPtr->indices = indices;
+    mapPtr->screenPts = intpPts;
+    mapPtr->nScreenPts = count;
+    return TRUE;
+
+error:
+    ckfree(intpPts);
+    ckfree(indices);
+    return FALSE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetLineSpline --
+ *
+ *      Returns the spline through the data points of the line element
+ *      for its smoothing, in axis coordinates.  The spline of the
+ *      element is reused unless the data, the smoothing or the scale
+ *      of an axis changed since it was fit.
+ *
+ * Parameters:
+ *      Line *linePtr
+ *
+ * Results:
+ *      Returns the spline, or NULL if the data points can't be fit:
+ *      there are too few of them, their x values aren't strictly
+ *      increasing or they aren't all positive on a logarithmic axis.
+ *
+ * Side Effects:
+ *      The spline may be fit again.
+ *
+ *----------------------------------------------------------------------
+ */
+static Rbc_Spline *GetLineSpline(Line *linePtr) {
+    LineSpline *splinePtr = &linePtr->spline;
+    Axis2D *axesPtr = &linePtr->core.axes;
+    const double *x;
+    const double *y;
+    Point2D *points;
+    Tcl_Size nPoints;
+    Tcl_Size i;
+    size_t pointBytes;
+    int logScales;
+
+    logScales = ((axesPtr->x->logScale) ? 1 : 0) | ((axesPtr->y->logScale) ? 2 : 0);
+    if ((splinePtr->smooth == linePtr->smooth) && (splinePtr->logScales == logScales) &&
+        (splinePtr->dataStamp == linePtr->core.dataStamp)) {
+        return splinePtr->fitPtr;
     }
-    linePtr->core.flags &= ~ACTIVE_PENDING;
+    FreeLineSpline(splinePtr);
+    nPoints = NumberOfPoints(&linePtr->core);
+    if (GetLineArrayByteCount(nPoints, sizeof(*points), &pointBytes) != TCL_OK) {
+        return NULL;
+    }
+    points = Tcl_AttemptAlloc(pointBytes);
+    if (points == NULL) {
+        return NULL;
+    }
+    x = linePtr->core.x.valueArr;
+    y = linePtr->core.y.valueArr;
+    for (i = 0; i < nPoints; i++) {
+        /*
+         * The logarithm of a non-positive value isn't finite, and
+         * Rbc_FitSpline rejects it.
+         */
+        points[i].x = (logScales & 1) ? log10(x[i]) : x[i];
+        points[i].y = (logScales & 2) ? log10(y[i]) : y[i];
+    }
+    splinePtr->fitPtr = Rbc_FitSpline((linePtr->smooth == PEN_SMOOTH_NATURAL) ? RBC_SPLINE_NATURAL
+                                                                              : RBC_SPLINE_QUADRATIC,
+                                      points, nPoints);
+    ckfree(points);
+    /* Remember a failed fit too, so it isn't tried on every map. */
+    splinePtr->smooth = linePtr->smooth;
+    splinePtr->logScales = logScales;
+    splinePtr->dataStamp = linePtr->core.dataStamp;
+    return splinePtr->fitPtr;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * MapStrip --
+ * FreeLineSpline --
  *
- *      Creates an array of line segments of the graph coordinates.
+ *      Releases the spline of a line element.
+ *
+ * Parameters:
+ *      LineSpline *splinePtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+static void FreeLineSpline(LineSpline *splinePtr) {
+    if (splinePtr->fitPtr != NULL) {
+        Rbc_FreeSpline(splinePtr->fitPtr);
+    }
+    memset(splinePtr, 0, sizeof(*splinePtr));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GenerateParametricSpline --
+ *
+ *      Computes a spline based upon the data points, returning a new
+ *      (larger) coordinate array or points.  With a positive spline
+ *      tolerance each interval gets as many points as it takes to
+ *      follow the curve within the tolerance (see
+ *      SubdivideParametricSpline).  Otherwise points are placed two
+ *      pixels apart (see StepParametricSpline).
  *
  * Parameters:
  *      Graph *graphPtr;
@@ -3765,697 +5309,773 @@ static void MapActiveSymbols(Graph *graphPtr, Line *linePtr) {
  * Results:
  *      None.
  *
- * Side effects:
- *      Memory is  allocated for the line segment array.
+ * Side Effects:
+ *      The temporary arrays for screen coordinates and data indices
+ *      are updated based upon spline.
  *
  *----------------------------------------------------------------------
  */
-static void MapStrip(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
+static void GenerateParametricSpline(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
     Extents2D exts;
-    Segment2D *strips;
+    Point2D *intpPts;
     Tcl_Size *indices;
-    Tcl_Size i;
-    Tcl_Size count;
-    Tcl_Size capacity;
+    Tcl_Size nIntpPts;
+    int result;
 
-    if (mapPtr->nScreenPts < 2) {
-        return;
+    assert(mapPtr->nScreenPts > 0);
+    intpPts = NULL;
+    indices = NULL;
+    Rbc_GraphExtents(graphPtr, &exts);
+    if (linePtr->splineTolerance > 0.0) {
+        result = SubdivideParametricSpline(mapPtr, &exts, linePtr->splineTolerance, &intpPts, &indices, &nIntpPts);
+    } else {
+        result = StepParametricSpline(mapPtr, &exts, &intpPts, &indices, &nIntpPts);
     }
-    capacity = mapPtr->nScreenPts - 1;
-    {
-        size_t stripBytes;
-        size_t indexBytes;
-
-        if ((GetLineArrayByteCount(capacity, sizeof(*strips), &stripBytes) != TCL_OK) ||
-            (GetLineArrayByteCount(capacity, sizeof(*indices), &indexBytes) != TCL_OK)) {
-            return;
-        }
-        strips = Tcl_AttemptAlloc(stripBytes);
-        if (strips == NULL) {
-            return;
-        }
-        indices = Tcl_AttemptAlloc(indexBytes);
-        if (indices == NULL) {
-            ckfree(strips);
-            return;
-        }
+    if (result) {
+        result = Rbc_CatromParametricSpline(mapPtr->screenPts, mapPtr->nScreenPts, intpPts, nIntpPts);
     }
-    count = 0;
-    Rbc_GraphExtents(graphPtr, &exts);
-    for (i = 0; i + 1 < mapPtr->nScreenPts; i++) {
-        if ((mapPtr->breakBefore != NULL) && mapPtr->breakBefore[i + 1]) {
-            continue;
+    if (!result) {
+        if (intpPts != NULL) {
+            ckfree(intpPts);
         }
-        if (Rbc_LineRectClip(&exts, &mapPtr->screenPts[i], &mapPtr->screenPts[i + 1], &strips[count])) {
-            indices[count] = mapPtr->indices[i];
-            count++;
+        if (indices != NULL) {
+            ckfree(indices);
         }
+        /*
+         * Preserve the original MapInfo arrays and fall back to straight
+         * line segments.
+         */
+        linePtr->smooth = PEN_SMOOTH_NONE;
+        return;
     }
-    if (count > 0) {
-        linePtr->stripToData = indices;
-        linePtr->nStrips = count;
-        linePtr->strips = strips;
-    } else {
-        ckfree(indices);
-        ckfree(strips);
-    }
+    /*
+     * Commit only after spline generation succeeds.
+     */
+    ckfree(mapPtr->screenPts);
+    ckfree(mapPtr->indices);
+    mapPtr->screenPts = intpPts;
+    mapPtr->indices = indices;
+    mapPtr->nScreenPts = nIntpPts;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * MergePens --
+ * StepParametricSpline --
  *
- *      Reorders the both arrays of points and segments to merge pens.
+ *      Chooses where to evaluate the Catmull-Rom spline through the
+ *      mapped points: at every point, and two pixels apart along the
+ *      visible part of each interval.
+ *
+ *      The evaluation parameters are stored as points:
+ *
+ *          x = source interval
+ *          y = parameter t within that interval
+ *
+ *      Rbc_CatromParametricSpline() replaces these parameters with
+ *      the corresponding interpolated screen coordinates.
  *
  * Parameters:
- *      Line *linePtr
- *      PenStyle **dataToStyle
+ *      MapInfo *mapPtr
+ *      Extents2D *extsPtr - Extents of the plotting area
+ *      Point2D **intpPtsPtr - (out) Evaluation parameters
+ *      Tcl_Size **indicesPtr - (out) Data index of each parameter
+ *      Tcl_Size *nIntpPtsPtr - (out) Number of parameters
  *
  * Results:
- *      None.
+ *      Returns TRUE if the parameters were chosen, FALSE if memory
+ *      ran out.  The arrays are allocated either way, or NULL.
  *
- * Side effects:
- *      The old arrays are freed and new ones allocated containing
- *      the reordered points and segments.
+ * Side Effects:
+ *      None.
  *
  *----------------------------------------------------------------------
  */
-static void MergePens(Line *linePtr, PenStyle **dataToStyle) {
-    LinePenStyle *stylePtr;
+static int StepParametricSpline(MapInfo *mapPtr, Extents2D *extsPtr, Point2D **intpPtsPtr, Tcl_Size **indicesPtr,
+                                Tcl_Size *nIntpPtsPtr) {
+    Point2D *origPts;
+    Point2D *intpPts;
+    Tcl_Size *indices;
+    Tcl_Size nOrigPts;
+    Tcl_Size capacity;
+    Tcl_Size count;
     Tcl_Size i;
-    Rbc_ChainLink *linkPtr;
-    size_t stripsBytes = 0;
-    size_t stripToDataBytes = 0;
-    size_t symbolPtsBytes = 0;
-    size_t symbolToDataBytes = 0;
-    size_t xErrorBarsBytes = 0;
-    size_t xErrorToDataBytes = 0;
-    size_t yErrorBarsBytes = 0;
-    size_t yErrorToDataBytes = 0;
+    Tcl_Size j;
+
+    origPts = mapPtr->screenPts;
+    nOrigPts = mapPtr->nScreenPts;
 
-    if (Rbc_ChainGetLength(linePtr->core.palette) < 2) {
-        linkPtr = Rbc_ChainFirstLink(linePtr->core.palette);
-        stylePtr = Rbc_ChainGetValue(linkPtr);
-        stylePtr->nStrips = linePtr->nStrips;
-        stylePtr->strips = linePtr->strips;
-        stylePtr->nSymbolPts = linePtr->nSymbolPts;
-        stylePtr->symbolPts = linePtr->symbolPts;
-        stylePtr->xErrorBarCnt = linePtr->core.xErrorBarCnt;
-        stylePtr->yErrorBarCnt = linePtr->core.yErrorBarCnt;
-        stylePtr->xErrorBars = linePtr->core.xErrorBars;
-        stylePtr->yErrorBars = linePtr->core.yErrorBars;
-        stylePtr->errorBarCapWidth = linePtr->core.errorBarCapWidth;
-        return;
-    }
     /*
-     * Validate all allocation sizes before modifying any style slices.
-     * Ordinary allocation failure remains handled by ckalloc().
+     * Every original point is retained. Additional points are generated
+     * at approximately two-pixel intervals along the visible portion of
+     * each segment.
      */
-    if ((linePtr->nStrips > 0) &&
-        ((GetLineArrayByteCount(linePtr->nStrips, sizeof(*linePtr->strips), &stripsBytes) != TCL_OK) ||
-         (GetLineArrayByteCount(linePtr->nStrips, sizeof(*linePtr->stripToData), &stripToDataBytes) != TCL_OK))) {
-        return;
-    }
-    if ((linePtr->nSymbolPts > 0) &&
-        ((GetLineArrayByteCount(linePtr->nSymbolPts, sizeof(*linePtr->symbolPts), &symbolPtsBytes) != TCL_OK) ||
-         (GetLineArrayByteCount(linePtr->nSymbolPts, sizeof(*linePtr->symbolToData), &symbolToDataBytes) != TCL_OK))) {
-        return;
-    }
-    if ((linePtr->core.xErrorBarCnt > 0) &&
-        ((GetLineArrayByteCount(linePtr->core.xErrorBarCnt, sizeof(*linePtr->core.xErrorBars), &xErrorBarsBytes) !=
-          TCL_OK) ||
-         (GetLineArrayByteCount(linePtr->core.xErrorBarCnt, sizeof(*linePtr->core.xErrorToData), &xErrorToDataBytes) !=
-          TCL_OK))) {
-        return;
-    }
-    if ((linePtr->core.yErrorBarCnt > 0) &&
-        ((GetLineArrayByteCount(linePtr->core.yErrorBarCnt, sizeof(*linePtr->core.yErrorBars), &yErrorBarsBytes) !=
-          TCL_OK) ||
-         (GetLineArrayByteCount(linePtr->core.yErrorBarCnt, sizeof(*linePtr->core.yErrorToData), &yErrorToDataBytes) !=
-          TCL_OK))) {
-        return;
-    }
-    /* We have more than one style. Group line segments and points of
-     * like pen styles.  */
-    if (linePtr->nStrips > 0) {
-        Segment2D *strips;
-        Segment2D *segPtr;
-        Tcl_Size *stripToData;
-        Tcl_Size *indexPtr;
-        Tcl_Size dataIndex;
+    capacity = nOrigPts;
+    for (i = 0, j = 1; j < nOrigPts; i++, j++) {
+        Segment2D clipped;
 
-        strips = ckalloc(stripsBytes);
-        stripToData = ckalloc(stripToDataBytes);
-        segPtr = strips;
-        indexPtr = stripToData;
-        for (linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL;
-             linkPtr = Rbc_ChainNextLink(linkPtr)) {
-            stylePtr = Rbc_ChainGetValue(linkPtr);
-            stylePtr->strips = segPtr;
-            for (i = 0; i < linePtr->nStrips; i++) {
-                dataIndex = linePtr->stripToData[i];
-                if (dataToStyle[dataIndex] == (PenStyle *)stylePtr) {
-                    *segPtr++ = linePtr->strips[i];
-                    *indexPtr++ = dataIndex;
+        if (Rbc_LineRectClip(extsPtr, &origPts[i], &origPts[j], &clipped)) {
+            double distP;
+            double distQ;
+
+            distP = hypot(clipped.p.x - origPts[i].x, clipped.p.y - origPts[i].y);
+            distQ = hypot(clipped.q.x - origPts[i].x, clipped.q.y - origPts[i].y);
+            /*
+             * The first additional sample is two pixels from the clipped
+             * starting point.
+             */
+            distP += 2.0;
+            if (distP <= distQ) {
+                double extraValue;
+                Tcl_Size extra;
+                extraValue = floor((distQ - distP) / 2.0) + 1.0;
+                if (!FINITE(extraValue) || (extraValue > (double)(TCL_SIZE_MAX - capacity))) {
+                    return FALSE;
                 }
+                extra = (Tcl_Size)extraValue;
+                capacity += extra;
             }
-            stylePtr->nStrips = (Tcl_Size)(segPtr - stylePtr->strips);
         }
-        ckfree(linePtr->strips);
-        linePtr->strips = strips;
-        ckfree(linePtr->stripToData);
-        linePtr->stripToData = stripToData;
     }
-    if (linePtr->nSymbolPts > 0) {
-        Point2D *symbolPts;
-        Point2D *pointPtr;
-        Tcl_Size *symbolToData;
-        Tcl_Size *indexPtr;
-        Tcl_Size dataIndex;
+    if (((size_t)capacity > (SIZE_MAX / sizeof(*intpPts))) || ((size_t)capacity > (SIZE_MAX / sizeof(*indices)))) {
+        return FALSE;
+    }
+    intpPts = *intpPtsPtr = Tcl_AttemptAlloc((size_t)capacity * sizeof(*intpPts));
+    if (intpPts == NULL) {
+        return FALSE;
+    }
+    indices = *indicesPtr = Tcl_AttemptAlloc((size_t)capacity * sizeof(*indices));
+    if (indices == NULL) {
+        return FALSE;
+    }
+    count = 0;
+    for (i = 0, j = 1; j < nOrigPts; i++, j++) {
+        Segment2D clipped;
+        double dist;
 
-        symbolPts = ckalloc(symbolPtsBytes);
-        symbolToData = ckalloc(symbolToDataBytes);
-        pointPtr = symbolPts;
-        indexPtr = symbolToData;
-        for (linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL;
-             linkPtr = Rbc_ChainNextLink(linkPtr)) {
-            stylePtr = Rbc_ChainGetValue(linkPtr);
-            stylePtr->symbolPts = pointPtr;
-            for (i = 0; i < linePtr->nSymbolPts; i++) {
-                dataIndex = linePtr->symbolToData[i];
-                if (dataToStyle[dataIndex] == (PenStyle *)stylePtr) {
-                    *pointPtr++ = linePtr->symbolPts[i];
-                    *indexPtr++ = dataIndex;
-                }
-            }
-            stylePtr->nSymbolPts = (Tcl_Size)(pointPtr - stylePtr->symbolPts);
+        if (count >= capacity) {
+            return FALSE;
         }
-        ckfree(linePtr->symbolPts);
-        linePtr->symbolPts = symbolPts;
-        ckfree(linePtr->symbolToData);
-        linePtr->symbolToData = symbolToData;
-    }
-    if (linePtr->core.xErrorBarCnt > 0) {
-        Segment2D *errorBars;
-        Segment2D *segPtr;
-        Tcl_Size *errorToData;
-        Tcl_Size *indexPtr;
-        Tcl_Size dataIndex;
-        Tcl_Size i;
-        errorBars = ckalloc(xErrorBarsBytes);
-        errorToData = ckalloc(xErrorToDataBytes);
-        segPtr = errorBars;
-        indexPtr = errorToData;
-        for (linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL;
-             linkPtr = Rbc_ChainNextLink(linkPtr)) {
-            stylePtr = Rbc_ChainGetValue(linkPtr);
-            stylePtr->xErrorBars = segPtr;
-            for (i = 0; i < linePtr->core.xErrorBarCnt; i++) {
-                dataIndex = linePtr->core.xErrorToData[i];
-                if (dataToStyle[dataIndex] == (PenStyle *)stylePtr) {
-                    *segPtr++ = linePtr->core.xErrorBars[i];
-                    *indexPtr++ = dataIndex;
-                }
-            }
-            stylePtr->xErrorBarCnt = (Tcl_Size)(segPtr - stylePtr->xErrorBars);
+        /*
+         * Retain the original point at the beginning of this interval.
+         */
+        intpPts[count].x = (double)i;
+        intpPts[count].y = 0.0;
+        indices[count] = mapPtr->indices[i];
+        count++;
+        dist = hypot(origPts[j].x - origPts[i].x, origPts[j].y - origPts[i].y);
+        if ((!FINITE(dist)) || (dist <= DBL_EPSILON)) {
+            continue;
         }
-        ckfree(linePtr->core.xErrorBars);
-        linePtr->core.xErrorBars = errorBars;
-        ckfree(linePtr->core.xErrorToData);
-        linePtr->core.xErrorToData = errorToData;
-    }
-    if (linePtr->core.yErrorBarCnt > 0) {
-        Segment2D *errorBars;
-        Segment2D *segPtr;
-        Tcl_Size *errorToData;
-        Tcl_Size *indexPtr;
-        Tcl_Size dataIndex;
-        Tcl_Size i;
+        if (Rbc_LineRectClip(extsPtr, &origPts[i], &origPts[j], &clipped)) {
+            double distP;
+            double distQ;
 
-        errorBars = ckalloc(yErrorBarsBytes);
-        errorToData = ckalloc(yErrorToDataBytes);
-        segPtr = errorBars;
-        indexPtr = errorToData;
-        for (linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL;
-             linkPtr = Rbc_ChainNextLink(linkPtr)) {
-            stylePtr = Rbc_ChainGetValue(linkPtr);
-            stylePtr->yErrorBars = segPtr;
-            for (i = 0; i < linePtr->core.yErrorBarCnt; i++) {
-                dataIndex = linePtr->core.yErrorToData[i];
-                if (dataToStyle[dataIndex] == (PenStyle *)stylePtr) {
-                    *segPtr++ = linePtr->core.yErrorBars[i];
-                    *indexPtr++ = dataIndex;
+            distP = hypot(clipped.p.x - origPts[i].x, clipped.p.y - origPts[i].y);
+            distQ = hypot(clipped.q.x - origPts[i].x, clipped.q.y - origPts[i].y);
+            /*
+             * Insert interpolated points every two screen pixels over
+             * the visible portion of the source interval.
+             */
+            distP += 2.0;
+            while (distP <= distQ) {
+                if (count >= capacity) {
+                    return FALSE;
                 }
+                /*
+                 * Identify the point by its source interval and its
+                 * normalized position within that interval.
+                 */
+                intpPts[count].x = (double)i;
+                intpPts[count].y = distP / dist;
+                /*
+                 * Interpolated points map to the source point beginning
+                 * the interval.
+                 */
+                indices[count] = mapPtr->indices[i];
+                count++;
+                distP += 2.0;
             }
-            stylePtr->yErrorBarCnt = (Tcl_Size)(segPtr - stylePtr->yErrorBars);
         }
-        ckfree(linePtr->core.yErrorBars);
-        linePtr->core.yErrorBars = errorBars;
-        ckfree(linePtr->core.yErrorToData);
-        linePtr->core.yErrorToData = errorToData;
     }
+    /*
+     * Append the final original point.
+     */
+    if (count >= capacity) {
+        return FALSE;
+    }
+    intpPts[count].x = (double)(nOrigPts - 1);
+    intpPts[count].y = 0.0;
+    indices[count] = mapPtr->indices[nOrigPts - 1];
+    count++;
+    *nIntpPtsPtr = count;
+    return TRUE;
 }
 
-#define CLIP_TOP (1 << 0)
-#define CLIP_BOTTOM (1 << 1)
-#define CLIP_RIGHT (1 << 2)
-#define CLIP_LEFT (1 << 3)
-
 /*
  *----------------------------------------------------------------------
  *
- * OutCode --
+ * SubdivideParametricSpline --
  *
- *      TODO: Description
+ *      Chooses where to evaluate the Catmull-Rom spline through the
+ *      mapped points: at every point, and inside each interval where
+ *      Rbc_CatromSubdivide needs points to follow the curve within
+ *      the tolerance.  Straight runs get no points besides their ends,
+ *      and neither do the parts of the curve outside the plotting
+ *      area.  The parameters are stored as by StepParametricSpline.
  *
  * Parameters:
- *      Extents2D *extsPtr
- *      Point2D *p
+ *      MapInfo *mapPtr
+ *      Extents2D *extsPtr - Extents of the plotting area
+ *      double tolerance - Largest distance in pixels between the
+ *                         curve and the line segments drawn for it
+ *      Point2D **intpPtsPtr - (out) Evaluation parameters
+ *      Tcl_Size **indicesPtr - (out) Data index of each parameter
+ *      Tcl_Size *nIntpPtsPtr - (out) Number of parameters
  *
  * Results:
- *      TODO: Results
+ *      Returns TRUE if the parameters were chosen, FALSE if memory
+ *      ran out.  The arrays are allocated either way, or NULL.
  *
  * Side Effects:
- *      TODO: Side Effects
+ *      None.
  *
  *----------------------------------------------------------------------
  */
-INLINE static int OutCode(Extents2D *extsPtr, Point2D *p) {
-    int code;
+static int SubdivideParametricSpline(MapInfo *mapPtr, Extents2D *extsPtr, double tolerance, Point2D **intpPtsPtr,
+                                     Tcl_Size **indicesPtr, Tcl_Size *nIntpPtsPtr) {
+    Point2D *origPts;
+    Point2D *intpPts;
+    Tcl_Size *indices;
+    Tcl_Size nOrigPts;
+    Tcl_Size capacity;
+    Tcl_Size count;
+    Tcl_Size i;
+    double *params;
 
-    code = 0;
-    if (p->x > extsPtr->right) {
-        code |= CLIP_RIGHT;
-    } else if (p->x < extsPtr->left) {
-        code |= CLIP_LEFT;
+    origPts = mapPtr->screenPts;
+    nOrigPts = mapPtr->nScreenPts;
+    params = Tcl_AttemptAlloc(RBC_CATROM_MAX_PARAMS * sizeof(double));
+    if (params == NULL) {
+        return FALSE;
     }
-    if (p->y > extsPtr->bottom) {
-        code |= CLIP_BOTTOM;
-    } else if (p->y < extsPtr->top) {
-        code |= CLIP_TOP;
+    /*
+     * The arrays start with room for twice the original points, and
+     * grow as needed.
+     */
+    intpPts = NULL;
+    indices = NULL;
+    capacity = 0;
+    count = 0;
+    for (i = 0; i < nOrigPts; i++) {
+        Tcl_Size nParams;
+        Tcl_Size k;
+
+        nParams = 0;
+        if ((i + 1 < nOrigPts) &&
+            (hypot(origPts[i + 1].x - origPts[i].x, origPts[i + 1].y - origPts[i].y) > DBL_EPSILON)) {
+            nParams = Rbc_CatromSubdivide(origPts, nOrigPts, i, tolerance, extsPtr, params);
+        }
+        if (count + nParams + 1 > capacity) {
+            Tcl_Size newCapacity;
+            size_t pointBytes;
+            size_t indexBytes;
+            Point2D *newPts;
+            Tcl_Size *newIndices;
+
+            newCapacity = MAX(count + nParams + 1, MAX(2 * capacity, 2 * nOrigPts));
+            if ((GetLineArrayByteCount(newCapacity, sizeof(*intpPts), &pointBytes) != TCL_OK) ||
+                (GetLineArrayByteCount(newCapacity, sizeof(*indices), &indexBytes) != TCL_OK)) {
+                goto error;
+            }
+            newPts = Tcl_AttemptRealloc(intpPts, pointBytes);
+            if (newPts == NULL) {
+                goto error;
+            }
+            intpPts = *intpPtsPtr = newPts;
+            newIndices = Tcl_AttemptRealloc(indices, indexBytes);
+            if (newIndices == NULL) {
+                goto error;
+            }
+            indices = *indicesPtr = newIndices;
+            capacity = newCapacity;
+        }
+        /*
+         * Retain the original point, then add the points chosen
+         * inside the interval it begins.  These map to the same data
+         * point.
+         */
+        intpPts[count].x = (double)i;
+        intpPts[count].y = 0.0;
+        indices[count] = mapPtr->indices[i];
+        count++;
+        for (k = 0; k < nParams; k++) {
+            intpPts[count].x = (double)i;
+            intpPts[count].y = params[k];
+            indices[count] = mapPtr->indices[i];
+            count++;
+        }
     }
-    return code;
+    ckfree(params);
+    *nIntpPtsPtr = count;
+    return TRUE;
+
+error:
+    ckfree(params);
+    return FALSE;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * ClipSegment --
+ * MapSymbols --
  *
- *      TODO: Description
+ *      Creates two arrays of points and pen indices, filled with
+ *      the screen coordinates of the visible
  *
  * Parameters:
- *      Extents2D *extsPtr
- *      register int code1
- *      register int code2
- *      register Point2D *p
- *      register Point2D *q
+ *      Graph *graphPtr;
+ *      Line *linePtr
+ *      MapInfo *mapPtr
  *
  * Results:
- *      TODO: Results
+ *      None.
  *
- * Side Effects:
- *      TODO: Side Effects
+ * Side effects:
+ *      Memory is freed and allocated for the index array.
  *
  *----------------------------------------------------------------------
  */
-static int ClipSegment(Extents2D *extsPtr, register int code1, register int code2, register Point2D *p,
-                       register Point2D *q) {
-    int inside, outside;
-
-    inside = ((code1 | code2) == 0);
-    outside = ((code1 & code2) != 0);
+static void MapSymbols(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
+    Extents2D exts;
+    Point2D *symbolPts;
+    Tcl_Size *indices;
+    Tcl_Size i;
+    Tcl_Size count;
+    size_t pointBytes;
+    size_t indexBytes;
 
-    /*
-     * In the worst case, we'll clip the line segment against each of
-     * the four sides of the bounding rectangle.
-     */
-    while ((!outside) && (!inside)) {
-        if (code1 == 0) {
-            Point2D *tmp;
-            int code;
-
-            /* Swap pointers and out codes */
-            tmp = p, p = q, q = tmp;
-            code = code1, code1 = code2, code2 = code;
-        }
-        if (code1 & CLIP_LEFT) {
-            p->y += (q->y - p->y) * (extsPtr->left - p->x) / (q->x - p->x);
-            p->x = extsPtr->left;
-        } else if (code1 & CLIP_RIGHT) {
-            p->y += (q->y - p->y) * (extsPtr->right - p->x) / (q->x - p->x);
-            p->x = extsPtr->right;
-        } else if (code1 & CLIP_BOTTOM) {
-            p->x += (q->x - p->x) * (extsPtr->bottom - p->y) / (q->y - p->y);
-            p->y = extsPtr->bottom;
-        } else if (code1 & CLIP_TOP) {
-            p->x += (q->x - p->x) * (extsPtr->top - p->y) / (q->y - p->y);
-            p->y = extsPtr->top;
+    if (mapPtr->nScreenPts <= 0) {
+        return;
+    }
+    if ((GetLineArrayByteCount(mapPtr->nScreenPts, sizeof(*symbolPts), &pointBytes) != TCL_OK) ||
+        (GetLineArrayByteCount(mapPtr->nScreenPts, sizeof(*indices), &indexBytes) != TCL_OK)) {
+        return;
+    }
+    symbolPts = Tcl_AttemptAlloc(pointBytes);
+    if (symbolPts == NULL) {
+        return;
+    }
+    indices = Tcl_AttemptAlloc(indexBytes);
+    if (indices == NULL) {
+        ckfree(symbolPts);
+        return;
+    }
+    Rbc_GraphExtents(graphPtr, &exts);
+    count = 0;
+    for (i = 0; i < mapPtr->nScreenPts; i++) {
+        if (PointInRegion(&exts, mapPtr->screenPts[i].x, mapPtr->screenPts[i].y)) {
+            symbolPts[count] = mapPtr->screenPts[i];
+            indices[count] = mapPtr->indices[i];
+            count++;
         }
-        code1 = OutCode(extsPtr, p);
-
-        inside = ((code1 | code2) == 0);
-        outside = ((code1 & code2) != 0);
     }
-    return (!inside);
+    if (count > 0) {
+        linePtr->symbolPts = symbolPts;
+        linePtr->symbolToData = indices;
+        linePtr->nSymbolPts = count;
+    } else {
+        ckfree(symbolPts);
+        ckfree(indices);
+    }
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * SaveTrace --
+ * MapActiveSymbols --
  *
- *      Creates a new trace and inserts it into the line's
- *      list of traces.
+ *      Creates an array of points of the active graph coordinates.
  *
  * Parameters:
+ *      Graph *graphPtr;
  *      Line *linePtr
- *      Tcl_Size start  - Starting index of the trace in the mapped
- *                        point array.
- *      Tcl_Size length - Number of points forming the trace.
- *      MapInfo *mapPtr
  *
  * Results:
  *      None.
  *
- * Side Effects:
- *      TODO: Side Effects
+ * Side effects:
+ *      Memory is freed and allocated for the active point array.
  *
  *----------------------------------------------------------------------
  */
-static void SaveTrace(Line *linePtr, Tcl_Size start, Tcl_Size length, MapInfo *mapPtr) {
-    LineTrace *tracePtr;
-    Point2D *screenPts;
-    Tcl_Size *indices;
+static void MapActiveSymbols(Graph *graphPtr, Line *linePtr) {
+    Extents2D exts;
+    Point2D *activePts;
+    Tcl_Size *activeToData;
+    Tcl_Size nPoints;
+    Tcl_Size pointIndex;
+    Tcl_Size first, last;
     Tcl_Size i;
-    Tcl_Size j;
+    Tcl_Size count;
+
+    if (linePtr->activePts != NULL) {
+        ckfree(linePtr->activePts);
+        linePtr->activePts = NULL;
+    }
+    if (linePtr->activeToData != NULL) {
+        ckfree(linePtr->activeToData);
+        linePtr->activeToData = NULL;
+    }
+    linePtr->nActivePts = 0;
+    if (linePtr->core.nActiveIndices <= 0) {
+        linePtr->core.flags &= ~ACTIVE_PENDING;
+        return;
+    }
+    {
+        size_t pointBytes;
+        size_t indexBytes;
 
-    tracePtr = ckalloc(sizeof(*tracePtr));
-    screenPts = ckalloc((size_t)length * sizeof(*screenPts));
-    indices = ckalloc((size_t)length * sizeof(*indices));
-    if (mapPtr->indices != NULL) {
-        for (i = 0, j = start; i < length; i++, j++) {
-            screenPts[i] = mapPtr->screenPts[j];
-            indices[i] = mapPtr->indices[j];
+        if ((GetLineArrayByteCount(linePtr->core.nActiveIndices, sizeof(*activePts), &pointBytes) != TCL_OK) ||
+            (GetLineArrayByteCount(linePtr->core.nActiveIndices, sizeof(*activeToData), &indexBytes) != TCL_OK)) {
+            linePtr->core.flags &= ~ACTIVE_PENDING;
+            return;
         }
-    } else {
-        for (i = 0, j = start; i < length; i++, j++) {
-            screenPts[i] = mapPtr->screenPts[j];
-            indices[i] = j;
+        activePts = Tcl_AttemptAlloc(pointBytes);
+        if (activePts == NULL) {
+            linePtr->core.flags &= ~ACTIVE_PENDING;
+            return;
+        }
+        activeToData = Tcl_AttemptAlloc(indexBytes);
+        if (activeToData == NULL) {
+            ckfree(activePts);
+            linePtr->core.flags &= ~ACTIVE_PENDING;
+            return;
         }
     }
-    tracePtr->nScreenPts = length;
-    tracePtr->screenPts = screenPts;
-    tracePtr->symbolToData = indices;
-    tracePtr->start = start;
-    if (linePtr->traces == NULL) {
-        linePtr->traces = Rbc_ChainCreate();
+    Rbc_GraphExtents(graphPtr, &exts);
+    nPoints = NumberOfPoints(&linePtr->core);
+    /*
+     * If the x values are ordered, active points out of view are
+     * rejected by index without being mapped.
+     */
+    if (!Rbc_GetElemVisibleRange(&linePtr->core, GetVisibleMargin(graphPtr, linePtr), &first, &last)) {
+        first = 0;
+        last = nPoints - 1;
+    }
+    count = 0;
+    for (i = 0; i < linePtr->core.nActiveIndices; i++) {
+        Point2D point;
+        double x;
+        double y;
+        pointIndex = linePtr->core.activeIndices[i];
+        if ((pointIndex < first) || (pointIndex > last)) {
+            continue;
+        }
+        x = linePtr->core.x.valueArr[pointIndex];
+        y = linePtr->core.y.valueArr[pointIndex];
+        if (!FINITE(x) || !FINITE(y)) {
+            continue;
+        }
+        point = Rbc_Map2D(graphPtr, x, y, &linePtr->core.axes);
+        if ((!FINITE(point.x)) || (!FINITE(point.y))) {
+            continue;
+        }
+        if (!PointInRegion(&exts, point.x, point.y)) {
+            continue;
+        }
+        activePts[count] = point;
+        activeToData[count] = pointIndex;
+        count++;
+    }
+    if (count > 0) {
+        linePtr->activePts = activePts;
+        linePtr->activeToData = activeToData;
+        linePtr->nActivePts = count;
+    } else {
+        ckfree(activePts);
+        ckfree(activeToData);
     }
-    Rbc_ChainAppend(linePtr->traces, tracePtr);
+    linePtr->core.flags &= ~ACTIVE_PENDING;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * FreeTraces --
+ * MapStrip --
  *
- *      Deletes all the traces for the line.
+ *      Creates an array of line segments of the graph coordinates.
  *
  * Parameters:
+ *      Graph *graphPtr;
  *      Line *linePtr
+ *      MapInfo *mapPtr
  *
  * Results:
  *      None.
  *
- * Side Effects:
- *      TODO: Side Effects
+ * Side effects:
+ *      Memory is  allocated for the line segment array.
  *
  *----------------------------------------------------------------------
  */
-static void FreeTraces(Line *linePtr) {
-    Rbc_ChainLink *linkPtr;
-    LineTrace *tracePtr;
+static void MapStrip(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
+    Extents2D exts;
+    Segment2D *strips;
+    Tcl_Size *indices;
+    Tcl_Size i;
+    Tcl_Size k;
+    Tcl_Size nClipped;
+    Tcl_Size count;
+    Tcl_Size capacity;
 
-    for (linkPtr = Rbc_ChainFirstLink(linePtr->traces); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
-        tracePtr = Rbc_ChainGetValue(linkPtr);
-        ckfree((char *)tracePtr->symbolToData);
-        ckfree((char *)tracePtr->screenPts);
-        ckfree((char *)tracePtr);
+    if (mapPtr->nScreenPts < 2) {
+        return;
     }
-    Rbc_ChainDestroy(linePtr->traces);
-    linePtr->traces = NULL;
-}
+    capacity = mapPtr->nScreenPts - 1;
+    {
+        size_t stripBytes;
+        size_t indexBytes;
 
-static double TraceAbscissa(Graph *graphPtr, Line *linePtr, const Point2D *pointPtr) {
-    double value;
-    
-    /*
-     * -trace increasing/decreasing refers to the element's data-X
-     * coordinate, not to left-to-right screen motion.
-     *
-     * Normally data X maps to screen X.  In an inverted graph it maps
-     * to screen Y; a normal vertical mapping runs in the opposite
-     * screen direction.
-     */
-    if (graphPtr->inverted) {
-        value = -pointPtr->y;
-    } else {
-        value = pointPtr->x;
+        if ((GetLineArrayByteCount(capacity, sizeof(*strips), &stripBytes) != TCL_OK) ||
+            (GetLineArrayByteCount(capacity, sizeof(*indices), &indexBytes) != TCL_OK)) {
+            return;
+        }
+        strips = Tcl_AttemptAlloc(stripBytes);
+        if (strips == NULL) {
+            return;
+        }
+        indices = Tcl_AttemptAlloc(indexBytes);
+        if (indices == NULL) {
+            ckfree(strips);
+            return;
+        }
     }
+    Rbc_GraphExtents(graphPtr, &exts);
+    nClipped = Rbc_ClipPolyline(&exts, mapPtr->screenPts, mapPtr->nScreenPts, strips, indices);
     /*
-     * Axis -descending reverses whichever screen direction maps data X.
-     * Undo that reversal so increasing value always corresponds to
-     * increasing data X.
+     * Drop the segments joining separate data runs, and map the rest
+     * back to their data points.
      */
-    if (linePtr->core.axes.x->descending) {
-        value = -value;
+    count = 0;
+    for (k = 0; k < nClipped; k++) {
+        i = indices[k];
+        if ((mapPtr->breakBefore != NULL) && mapPtr->breakBefore[i + 1]) {
+            continue;
+        }
+        strips[count] = strips[k];
+        indices[count] = mapPtr->indices[i];
+        count++;
+    }
+    if (count > 0) {
+        linePtr->stripToData = indices;
+        linePtr->nStrips = count;
+        linePtr->strips = strips;
+    } else {
+        ckfree(indices);
+        ckfree(strips);
     }
-    return value;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * MapTraces --
+ * MergePens --
  *
- *      Creates an array of line segments of the graph coordinates.
+ *      Reorders the both arrays of points and segments to merge pens.
+ *      The points and segments of each style keep their order.
  *
  * Parameters:
- *      Graph *graphPtr
  *      Line *linePtr
- *      MapInfo *mapPtr
+ *      StyleMap *mapPtr - Style of each data point, or NULL if the
+ *                         element has a single style
  *
  * Results:
  *      None.
  *
  * Side effects:
- *      Memory is  allocated for the line segment array.
+ *      The old arrays are freed and new ones allocated containing
+ *      the reordered points and segments.
  *
  *----------------------------------------------------------------------
  */
-static void MapTraces(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
-    Tcl_Size start;
-    Tcl_Size count;
-    int code1;
-    int code2;
-    Point2D *p;
-    Point2D *q;
-    Point2D s;
-    Extents2D exts;
+static void MergePens(Line *linePtr, StyleMap *mapPtr) {
+    LinePenStyle *stylePtr;
+    Tcl_Size *counts;
     Tcl_Size i;
-    int broken;
-    int offscreen;
-    double lastX;
-    double nextX;
+    int k;
+    Rbc_ChainLink *linkPtr;
+    size_t stripsBytes = 0;
+    size_t stripToDataBytes = 0;
+    size_t symbolPtsBytes = 0;
+    size_t symbolToDataBytes = 0;
+    size_t xErrorBarsBytes = 0;
+    size_t xErrorToDataBytes = 0;
+    size_t yErrorBarsBytes = 0;
+    size_t yErrorToDataBytes = 0;
 
-    Rbc_GraphExtents(graphPtr, &exts);
-    count = 1;
-    code1 = OutCode(&exts, mapPtr->screenPts);
-    p = mapPtr->screenPts;
-    q = p + 1;
-    for (i = 1; i < mapPtr->nScreenPts; i++, p++, q++) {
-        if ((mapPtr->breakBefore != NULL) && mapPtr->breakBefore[i]) {
-            /*
-             * q starts a new continuous data run.  Save the previous
-             * trace without ever clipping or testing the nonexistent
-             * p->q segment.
-             */
-            if (count > 1) {
-                start = i - count;
-                SaveTrace(linePtr, start, count, mapPtr);
-            }
-            count = 1;
-            code1 = OutCode(&exts, q);
-            continue;
-        }
-        code2 = OutCode(&exts, q);
-        if (code2 != 0) {
-            /*
-             * Save the coordinates of the last point before clipping.
-             */
-            s = *q;
-        }
-        /*
-         * Test direction in a coordinate whose increasing direction
-         * always corresponds to increasing element data X.
-         */
-        lastX = TraceAbscissa(graphPtr, linePtr, p);
-        nextX = TraceAbscissa(graphPtr, linePtr, q);
-        broken = BROKEN_TRACE(linePtr->penDir, lastX, nextX);
-        offscreen = ClipSegment(&exts, code1, code2, p, q);
-        if (broken || offscreen) {
-            /*
-             * The last line segment is either totally clipped by the
-             * plotting area or has the wrong data-X direction,
-             * breaking the trace.
-             */
-            if (count > 1) {
-                start = i - count;
-                SaveTrace(linePtr, start, count, mapPtr);
-                count = 1;
-            }
-        } else {
-            count++;
-            if (code2 != 0) {
-                /*
-                 * If the last point is clipped, the trace is broken
-                 * after this point.  Restore the original coordinate
-                 * after saving the trace.
-                 */
-                start = i - (count - 1);
-                SaveTrace(linePtr, start, count, mapPtr);
-                mapPtr->screenPts[i] = s;
-                count = 1;
-            }
-        }
-        code1 = code2;
-    }
-    if (count > 1) {
-        start = i - count;
-        SaveTrace(linePtr, start, count, mapPtr);
-    }
-}
-
-/*
- *----------------------------------------------------------------------
- *
- * MapFillArea --
- *
- *      Creates an array of points that represent a polygon that fills
- *      the area under the element.
- *
- * Parameters:
- *      Graph *graphPtr
- *      Line *linePtr
- *      MapInfo *mapPtr
- *
- * Results:
- *      None.
- *
- * Side effects:
- *      Memory is  allocated for the polygon point array.
- *
- *----------------------------------------------------------------------
- */
-static void MapFillArea(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
-    Point2D *origPts;
-    Point2D *clipPts;
-    Extents2D exts;
-    double maxY;
-    Tcl_Size inputCount;
-    Tcl_Size clipCapacity;
-    Tcl_Size n;
-    Tcl_Size i;
-
-    /*
-     * Always discard the previous mapped polygon first.  The old code
-     * performed its INT_MAX check before this cleanup, which could leave
-     * a stale fill polygon after remapping failed.
-     */
-    if (linePtr->fillPts != NULL) {
-        ckfree(linePtr->fillPts);
-        linePtr->fillPts = NULL;
-        linePtr->nFillPts = 0;
-    }
-    /*
-     * Line currently stores one fill polygon only.  Filling a mapped
-     * line containing discontinuities would incorrectly bridge separate
-     * data runs.
-     */
-    if (mapPtr->breakBefore != NULL) {
-        return;
-    }
-    if (mapPtr->nScreenPts < 3) {
+    if (Rbc_ChainGetLength(linePtr->core.palette) < 2) {
+        linkPtr = Rbc_ChainFirstLink(linePtr->core.palette);
+        stylePtr = Rbc_ChainGetValue(linkPtr);
+        stylePtr->nStrips = linePtr->nStrips;
+        stylePtr->strips = linePtr->strips;
+        stylePtr->nSymbolPts = linePtr->nSymbolPts;
+        stylePtr->symbolPts = linePtr->symbolPts;
+        stylePtr->xErrorBarCnt = linePtr->core.xErrorBarCnt;
+        stylePtr->yErrorBarCnt = linePtr->core.yErrorBarCnt;
+        stylePtr->xErrorBars = linePtr->core.xErrorBars;
+        stylePtr->yErrorBars = linePtr->core.yErrorBars;
+        stylePtr->errorBarCapWidth = linePtr->core.errorBarCapWidth;
         return;
     }
     /*
-     * Add two bottom vertices to close the fill polygon.
-     * Rbc_PolyRectClip() now generates the closing edge internally.
+     * Validate all allocation sizes before modifying any style slices.
+     * Ordinary allocation failure remains handled by ckalloc().
      */
-    if (mapPtr->nScreenPts > TCL_SIZE_MAX - 2) {
+    if ((linePtr->nStrips > 0) &&
+        ((GetLineArrayByteCount(linePtr->nStrips, sizeof(*linePtr->strips), &stripsBytes) != TCL_OK) ||
+         (GetLineArrayByteCount(linePtr->nStrips, sizeof(*linePtr->stripToData), &stripToDataBytes) != TCL_OK))) {
         return;
     }
-    inputCount = mapPtr->nScreenPts + 2;
-    /*
-     * The clipping routine can emit at most three vertices per input
-     * edge, followed by one closing vertex.
-     */
-    if (inputCount > (TCL_SIZE_MAX - 1) / 3) {
+    if ((linePtr->nSymbolPts > 0) &&
+        ((GetLineArrayByteCount(linePtr->nSymbolPts, sizeof(*linePtr->symbolPts), &symbolPtsBytes) != TCL_OK) ||
+         (GetLineArrayByteCount(linePtr->nSymbolPts, sizeof(*linePtr->symbolToData), &symbolToDataBytes) != TCL_OK))) {
         return;
     }
-    clipCapacity = inputCount * 3 + 1;
-    if ((inputCount > (Tcl_Size)(SIZE_MAX / sizeof(*origPts))) ||
-        (clipCapacity > (Tcl_Size)(SIZE_MAX / sizeof(*clipPts)))) {
+    if ((linePtr->core.xErrorBarCnt > 0) &&
+        ((GetLineArrayByteCount(linePtr->core.xErrorBarCnt, sizeof(*linePtr->core.xErrorBars), &xErrorBarsBytes) !=
+          TCL_OK) ||
+         (GetLineArrayByteCount(linePtr->core.xErrorBarCnt, sizeof(*linePtr->core.xErrorToData), &xErrorToDataBytes) !=
+          TCL_OK))) {
         return;
     }
-    origPts = (Point2D *)Tcl_AttemptAlloc((size_t)inputCount * sizeof(*origPts));
-    if (origPts == NULL) {
+    if ((linePtr->core.yErrorBarCnt > 0) &&
+        ((GetLineArrayByteCount(linePtr->core.yErrorBarCnt, sizeof(*linePtr->core.yErrorBars), &yErrorBarsBytes) !=
+          TCL_OK) ||
+         (GetLineArrayByteCount(linePtr->core.yErrorBarCnt, sizeof(*linePtr->core.yErrorToData), &yErrorToDataBytes) !=
+          TCL_OK))) {
         return;
     }
-    clipPts = (Point2D *)Tcl_AttemptAlloc((size_t)clipCapacity * sizeof(*clipPts));
-    if (clipPts == NULL) {
-        ckfree(origPts);
-        return;
+    /* We have more than one style. Group line segments and points of
+     * like pen styles.  */
+    counts = ckalloc(mapPtr->nStyles * sizeof(*counts));
+    if (linePtr->nStrips > 0) {
+        Segment2D *strips;
+        Tcl_Size *stripToData;
+        Tcl_Size *order;
+
+        strips = ckalloc(stripsBytes);
+        stripToData = ckalloc(stripToDataBytes);
+        order = Rbc_StyleMapOrder(mapPtr, linePtr->stripToData, linePtr->nStrips, counts);
+        for (i = 0; i < linePtr->nStrips; i++) {
+            strips[i] = linePtr->strips[order[i]];
+            stripToData[i] = linePtr->stripToData[order[i]];
+        }
+        ckfree(order);
+        i = 0;
+        for (k = 0, linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL;
+             k++, linkPtr = Rbc_ChainNextLink(linkPtr)) {
+            stylePtr = Rbc_ChainGetValue(linkPtr);
+            stylePtr->strips = strips + i;
+            stylePtr->nStrips = counts[k];
+            i += counts[k];
+        }
+        ckfree(linePtr->strips);
+        linePtr->strips = strips;
+        ckfree(linePtr->stripToData);
+        linePtr->stripToData = stripToData;
     }
-    Rbc_GraphExtents(graphPtr, &exts);
-    maxY = (double)graphPtr->bottom;
-    for (i = 0; i < mapPtr->nScreenPts; i++) {
-        origPts[i].x = mapPtr->screenPts[i].x + 1;
-        origPts[i].y = mapPtr->screenPts[i].y;
-        if (origPts[i].y > maxY) {
-            maxY = origPts[i].y;
+    if (linePtr->nSymbolPts > 0) {
+        Point2D *symbolPts;
+        Tcl_Size *symbolToData;
+        Tcl_Size *order;
+
+        symbolPts = ckalloc(symbolPtsBytes);
+        symbolToData = ckalloc(symbolToDataBytes);
+        order = Rbc_StyleMapOrder(mapPtr, linePtr->symbolToData, linePtr->nSymbolPts, counts);
+        for (i = 0; i < linePtr->nSymbolPts; i++) {
+            symbolPts[i] = linePtr->symbolPts[order[i]];
+            symbolToData[i] = linePtr->symbolToData[order[i]];
+        }
+        ckfree(order);
+        i = 0;
+        for (k = 0, linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL;
+             k++, linkPtr = Rbc_ChainNextLink(linkPtr)) {
+            stylePtr = Rbc_ChainGetValue(linkPtr);
+            stylePtr->symbolPts = symbolPts + i;
+            stylePtr->nSymbolPts = counts[k];
+            i += counts[k];
+        }
+        ckfree(linePtr->symbolPts);
+        linePtr->symbolPts = symbolPts;
+        ckfree(linePtr->symbolToData);
+        linePtr->symbolToData = symbolToData;
+    }
+    if (linePtr->core.xErrorBarCnt > 0) {
+        Segment2D *errorBars;
+        Tcl_Size *errorToData;
+        Tcl_Size *order;
+
+        errorBars = ckalloc(xErrorBarsBytes);
+        errorToData = ckalloc(xErrorToDataBytes);
+        order = Rbc_StyleMapOrder(mapPtr, linePtr->core.xErrorToData, linePtr->core.xErrorBarCnt, counts);
+        for (i = 0; i < linePtr->core.xErrorBarCnt; i++) {
+            errorBars[i] = linePtr->core.xErrorBars[order[i]];
+            errorToData[i] = linePtr->core.xErrorToData[order[i]];
+        }
+        ckfree(order);
+        i = 0;
+        for (k = 0, linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL;
+             k++, linkPtr = Rbc_ChainNextLink(linkPtr)) {
+            stylePtr = Rbc_ChainGetValue(linkPtr);
+            stylePtr->xErrorBars = errorBars + i;
+            stylePtr->xErrorBarCnt = counts[k];
+            i += counts[k];
         }
+        ckfree(linePtr->core.xErrorBars);
+        linePtr->core.xErrorBars = errorBars;
+        ckfree(linePtr->core.xErrorToData);
+        linePtr->core.xErrorToData = errorToData;
     }
-    /*
-     * Add edges that extend the polygon to the bottom of the plotting
-     * area.
-     */
-    origPts[i].x = origPts[i - 1].x;
-    origPts[i].y = maxY;
-    i++;
-    origPts[i].x = origPts[0].x;
-    origPts[i].y = maxY;
-    i++;
-    n = Rbc_PolyRectClip(&exts, origPts, inputCount, clipPts, clipCapacity);
-    ckfree(origPts);
-    if (n < 3) {
-        ckfree(clipPts);
-        return;
+    if (linePtr->core.yErrorBarCnt > 0) {
+        Segment2D *errorBars;
+        Tcl_Size *errorToData;
+        Tcl_Size *order;
+
+        errorBars = ckalloc(yErrorBarsBytes);
+        errorToData = ckalloc(yErrorToDataBytes);
+        order = Rbc_StyleMapOrder(mapPtr, linePtr->core.yErrorToData, linePtr->core.yErrorBarCnt, counts);
+        for (i = 0; i < linePtr->core.yErrorBarCnt; i++) {
+            errorBars[i] = linePtr->core.yErrorBars[order[i]];
+            errorToData[i] = linePtr->core.yErrorToData[order[i]];
+        }
+        ckfree(order);
+        i = 0;
+        for (k = 0, linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL;
+             k++, linkPtr = Rbc_ChainNextLink(linkPtr)) {
+            stylePtr = Rbc_ChainGetValue(linkPtr);
+            stylePtr->yErrorBars = errorBars + i;
+            stylePtr->yErrorBarCnt = counts[k];
+            i += counts[k];
+        }
+        ckfree(linePtr->core.yErrorBars);
+        linePtr->core.yErrorBars = errorBars;
+        ckfree(linePtr->core.yErrorToData);
+        linePtr->core.yErrorToData = errorToData;
     }
-    linePtr->fillPts = clipPts;
-    linePtr->nFillPts = n;
+    ckfree(counts);
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * ResetLine --
+ * OutCode --
  *
  *      TODO: Description
  *
  * Parameters:
- *      Line *linePtr
+ *      Extents2D *extsPtr
+ *      Point2D *p
  *
  * Results:
  *      TODO: Results
@@ -4465,1166 +6085,4532 @@ static void MapFillArea(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
  *
  *----------------------------------------------------------------------
  */
-static void ResetLine(Line *linePtr) {
-    FreeTraces(linePtr);
-    ClearPalette(linePtr->core.palette);
-    if (linePtr->symbolPts != NULL) {
-        ckfree((char *)linePtr->symbolPts);
+INLINE static int OutCode(Extents2D *extsPtr, Point2D *p) {
+    int code;
+
+    code = 0;
+    if (p->x > extsPtr->right) {
+        code |= RBC_CLIP_RIGHT;
+    } else if (p->x < extsPtr->left) {
+        code |= RBC_CLIP_LEFT;
     }
-    if (linePtr->symbolToData != NULL) {
-        ckfree((char *)linePtr->symbolToData);
+    if (p->y > extsPtr->bottom) {
+        code |= RBC_CLIP_BOTTOM;
+    } else if (p->y < extsPtr->top) {
+        code |= RBC_CLIP_TOP;
     }
-    if (linePtr->strips != NULL) {
-        ckfree((char *)linePtr->strips);
-    }
-    if (linePtr->stripToData != NULL) {
-        ckfree((char *)linePtr->stripToData);
-    }
-    if (linePtr->activePts != NULL) {
-        ckfree((char *)linePtr->activePts);
-    }
-    if (linePtr->activeToData != NULL) {
-        ckfree((char *)linePtr->activeToData);
-    }
-    if (linePtr->core.xErrorBars != NULL) {
-        ckfree((char *)linePtr->core.xErrorBars);
-    }
-    if (linePtr->core.xErrorToData != NULL) {
-        ckfree((char *)linePtr->core.xErrorToData);
-    }
-    if (linePtr->core.yErrorBars != NULL) {
-        ckfree((char *)linePtr->core.yErrorBars);
-    }
-    if (linePtr->core.yErrorToData != NULL) {
-        ckfree((char *)linePtr->core.yErrorToData);
-    }
-    linePtr->core.xErrorBars = linePtr->core.yErrorBars = linePtr->strips = NULL;
-    linePtr->symbolPts = linePtr->activePts = NULL;
-    linePtr->stripToData = NULL;
-    linePtr->symbolToData = NULL;
-    linePtr->activeToData = NULL;
-    linePtr->core.xErrorToData = NULL;
-    linePtr->core.yErrorToData = NULL;
-    linePtr->nActivePts = 0;
-    linePtr->nSymbolPts = 0;
-    linePtr->nStrips = 0;
-    linePtr->core.xErrorBarCnt = 0;
-    linePtr->core.yErrorBarCnt = 0;
+    return code;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * MapLine --
+ * ClipSegment --
  *
- *      Calculates the actual window coordinates of the line element.
- *      The window coordinates are saved in an allocated point array.
+ *      TODO: Description
  *
  * Parameters:
- *      Graph *graphPtr - Graph widget record
- *      Element *elemPtr - Element component record
+ *      Extents2D *extsPtr
+ *      register int code1
+ *      register int code2
+ *      register Point2D *p
+ *      register Point2D *q
  *
  * Results:
- *      None.
+ *      TODO: Results
  *
- * Side effects:
- *      Memory is (re)allocated for the point array.
+ * Side Effects:
+ *      TODO: Side Effects
  *
  *----------------------------------------------------------------------
  */
-static void MapLine(Graph *graphPtr, Element *elemPtr) {
-    Line *linePtr = LINE_FROM_CORE(elemPtr);
-    MapInfo mapInfo = {0};
-    Tcl_Size nPoints;
-    int size;
-    PenStyle **dataToStyle;
-    Rbc_ChainLink *linkPtr;
-    LinePenStyle *stylePtr;
+static int ClipSegment(Extents2D *extsPtr, register int code1, register int code2, register Point2D *p,
+                       register Point2D *q) {
+    int inside, outside;
+
+    inside = ((code1 | code2) == 0);
+    outside = ((code1 & code2) != 0);
 
-    ResetLine(linePtr);
-    nPoints = NumberOfPoints(&linePtr->core);
-    if (nPoints < 1) {
-        return;
-    }
-    GetScreenPoints(graphPtr, linePtr, &mapInfo);
-    if (mapInfo.nScreenPts < 1) {
-        return;
-    }
-    MapSymbols(graphPtr, linePtr, &mapInfo);
-    if ((linePtr->core.flags & ACTIVE_PENDING) && (linePtr->core.nActiveIndices > 0)) {
-        MapActiveSymbols(graphPtr, linePtr);
-    }
     /*
-     * Map connecting line segments if they are to be displayed.
+     * In the worst case, we'll clip the line segment against each of
+     * the four sides of the bounding rectangle.
      */
-    if ((nPoints > 1) && ((graphPtr->classUid == rbcStripElementUid) || (linePtr->builtinPen.traceWidth > 0))) {
-        linePtr->smooth = linePtr->reqSmooth;
-
-        /*
-         * Do smoothing if necessary.  This can extend the coordinate array,
-         * so both mapInfo.points and mapInfo.nPoints may change.
-         */
-
-        switch (linePtr->smooth) {
-        case PEN_SMOOTH_STEP:
-            GenerateSteps(graphPtr, linePtr, &mapInfo);
-            break;
-
-        case PEN_SMOOTH_NATURAL:
-        case PEN_SMOOTH_QUADRATIC:
-            if ((mapInfo.nScreenPts < 3) || (mapInfo.breakBefore != NULL)) {
-                /*
-                 * Never interpolate through missing data.  Proper per-run
-                 * spline generation can be added separately.
-                 */
-                linePtr->smooth = PEN_SMOOTH_NONE;
-            } else {
-                GenerateSpline(graphPtr, linePtr, &mapInfo);
-            }
-            break;
-
-        case PEN_SMOOTH_CATROM:
-            if ((mapInfo.nScreenPts < 3) || (mapInfo.breakBefore != NULL)) {
-                linePtr->smooth = PEN_SMOOTH_NONE;
-            } else {
-                GenerateParametricSpline(graphPtr, linePtr, &mapInfo);
-            }
-            break;
+    while ((!outside) && (!inside)) {
+        if (code1 == 0) {
+            Point2D *tmp;
+            int code;
 
-        default:
-            break;
-        }
-        if (linePtr->rTolerance > 0.0) {
-            ReducePoints(&mapInfo, linePtr->rTolerance);
-        }
-        if ((linePtr->fillTile != NULL) || (linePtr->fillStipple != None)) {
-            MapFillArea(graphPtr, linePtr, &mapInfo);
+            /* Swap pointers and out codes */
+            tmp = p, p = q, q = tmp;
+            code = code1, code1 = code2, code2 = code;
         }
-        if (graphPtr->classUid == rbcStripElementUid) {
-            MapStrip(graphPtr, linePtr, &mapInfo);
-        } else {
-            MapTraces(graphPtr, linePtr, &mapInfo);
+        if (code1 & RBC_CLIP_LEFT) {
+            p->y += (q->y - p->y) * (extsPtr->left - p->x) / (q->x - p->x);
+            p->x = extsPtr->left;
+        } else if (code1 & RBC_CLIP_RIGHT) {
+            p->y += (q->y - p->y) * (extsPtr->right - p->x) / (q->x - p->x);
+            p->x = extsPtr->right;
+        } else if (code1 & RBC_CLIP_BOTTOM) {
+            p->x += (q->x - p->x) * (extsPtr->bottom - p->y) / (q->y - p->y);
+            p->y = extsPtr->bottom;
+        } else if (code1 & RBC_CLIP_TOP) {
+            p->x += (q->x - p->x) * (extsPtr->top - p->y) / (q->y - p->y);
+            p->y = extsPtr->top;
         }
-    }
-    ckfree(mapInfo.screenPts);
-    ckfree(mapInfo.indices);
-    if (mapInfo.breakBefore != NULL) {
-        ckfree(mapInfo.breakBefore);
-    }
+        code1 = OutCode(extsPtr, p);
 
-    /* Set the symbol size of all the pen styles. */
-    for (linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
-        stylePtr = Rbc_ChainGetValue(linkPtr);
-        size = ScaleSymbol(elemPtr, stylePtr->penPtr->symbol.size);
-        stylePtr->symbolSize = size;
-        stylePtr->errorBarCapWidth =
-            (stylePtr->penPtr->errorBarCapWidth > 0) ? stylePtr->penPtr->errorBarCapWidth : (int)(size * 0.6666666);
-        stylePtr->errorBarCapWidth /= 2;
-    }
-    dataToStyle = Rbc_StyleMap(&linePtr->core);
-    if (((linePtr->core.yHigh.nValues > 0) && (linePtr->core.yLow.nValues > 0)) ||
-        ((linePtr->core.xHigh.nValues > 0) && (linePtr->core.xLow.nValues > 0)) || (linePtr->core.xError.nValues > 0) ||
-        (linePtr->core.yError.nValues > 0)) {
-        Rbc_MapErrorBars(graphPtr, &linePtr->core, dataToStyle);
+        inside = ((code1 | code2) == 0);
+        outside = ((code1 & code2) != 0);
     }
-    MergePens(linePtr, dataToStyle);
-    ckfree((char *)dataToStyle);
+    return (!inside);
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * DistanceToLine --
+ * TraceCoord --
  *
- *      TODO: Description
+ *      Converts a screen coordinate to single precision for a trace.
+ *      Rounding to the nearest float can carry a coordinate just
+ *      short of a whole pixel onto it, so the result is stepped back
+ *      toward zero when it would truncate to another pixel than the
+ *      coordinate itself.
  *
  * Parameters:
- *      int x - Sample X coordinate.
- *      int y - Sample Y coordinate.
- *      Point2D *p - End point of the line segment.
- *      Point2D *q - End point of the line segment.
- *      Point2D *t - (out) Point on line segment.
+ *      double value - Screen coordinate, inside the plotting area
  *
  * Results:
- *      TODO: Results
+ *      Returns the coordinate as a float that truncates to the same
+ *      pixel.
  *
  * Side Effects:
- *      TODO: Side Effects
+ *      None.
  *
  *----------------------------------------------------------------------
  */
-static double DistanceToLine(int x, int y, Point2D *p, Point2D *q, Point2D *t) {
-    Point2D sample;
+INLINE static float TraceCoord(double value) {
+    float coord;
 
-    sample.x = (double)x;
-    sample.y = (double)y;
-    return Rbc_GetClosestPointOnSegment(&sample, p, q, t);
+    coord = (float)value;
+    if ((int)coord != (int)value) {
+        coord = nextafterf(coord, 0.0f);
+    }
+    return coord;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * DistanceToX --
+ * SaveTrace --
  *
- *      TODO: Description
+ *      Appends a new trace to the line's traces.
  *
  * Parameters:
- *      int x - Sample X coordinate.
- *      int y - Sample Y coordinate.
- *      Point2D *p - End point of the line segment.
- *      Point2D *q - End point of the line segment.
- *      Point2D *t - (out) Point on line segment.
+ *      Line *linePtr
+ *      Tcl_Size start  - Starting index of the trace in the mapped
+ *                        point array.
+ *      Tcl_Size length - Number of points forming the trace.
+ *      MapInfo *mapPtr
  *
  * Results:
- *      TODO: Results
+ *      None.
  *
  * Side Effects:
- *      TODO: Side Effects
+ *      The arrays of the traces are grown as needed.
  *
  *----------------------------------------------------------------------
  */
-static double DistanceToX(int x, int y, Point2D *p, Point2D *q, Point2D *t) {
-    double dx, dy;
-    double dist;
+static void SaveTrace(Line *linePtr, Tcl_Size start, Tcl_Size length, MapInfo *mapPtr) {
+    LineTraces *tracesPtr = &linePtr->traces;
+    LineTrace *tracePtr;
+    TracePoint *screenPts;
+    Tcl_Size *indices;
+    Tcl_Size i;
 
-    if (p->x > q->x) {
-        if ((x > p->x) || (x < q->x)) {
-            return DBL_MAX; /* X-coordinate outside line segment. */
-        }
+    if (tracesPtr->nRuns == tracesPtr->runSpace) {
+        tracesPtr->runSpace = MAX(64, tracesPtr->runSpace * 2);
+        tracesPtr->runs = ckrealloc(tracesPtr->runs, (size_t)tracesPtr->runSpace * sizeof(LineTrace));
+    }
+    if (tracesPtr->nScreenPts + length > tracesPtr->pointSpace) {
+        /*
+         * The traces rarely hold many more points than were mapped,
+         * so that's the first size tried.
+         */
+        tracesPtr->pointSpace = MAX(tracesPtr->nScreenPts + length,
+                                    MAX(tracesPtr->pointSpace * 2, mapPtr->nScreenPts));
+        tracesPtr->screenPts = ckrealloc(tracesPtr->screenPts, (size_t)tracesPtr->pointSpace * sizeof(TracePoint));
+    }
+    tracePtr = tracesPtr->runs + tracesPtr->nRuns;
+    tracePtr->first = tracesPtr->nScreenPts;
+    screenPts = tracesPtr->screenPts + tracePtr->first;
+    for (i = 0; i < length; i++) {
+        screenPts[i].x = TraceCoord(mapPtr->screenPts[start + i].x);
+        screenPts[i].y = TraceCoord(mapPtr->screenPts[start + i].y);
+    }
+    /*
+     * Data indices are only stored for traces whose points don't map
+     * to consecutive data points, such as those of reduced, stepped
+     * or smoothed lines.  The traces of plain lines, even those split
+     * by gaps, don't need them.
+     */
+    tracePtr->firstIndex = -1;
+    if (mapPtr->indices == NULL) {
+        tracePtr->dataIndex = start;
     } else {
-        if ((x > q->x) || (x < p->x)) {
-            return DBL_MAX; /* X-coordinate outside line segment. */
+        indices = mapPtr->indices + start;
+        tracePtr->dataIndex = indices[0];
+        for (i = 1; i < length; i++) {
+            if (indices[i] != indices[0] + i) {
+                break;
+            }
+        }
+        if (i < length) {
+            if (tracesPtr->nIndices + length > tracesPtr->indexSpace) {
+                tracesPtr->indexSpace = MAX(tracesPtr->nIndices + length, tracesPtr->indexSpace * 2);
+                tracesPtr->symbolToData =
+                    ckrealloc(tracesPtr->symbolToData, (size_t)tracesPtr->indexSpace * sizeof(Tcl_Size));
+            }
+            tracePtr->firstIndex = tracesPtr->nIndices;
+            memcpy(tracesPtr->symbolToData + tracesPtr->nIndices, indices, (size_t)length * sizeof(Tcl_Size));
+            tracesPtr->nIndices += length;
         }
     }
-    dx = p->x - q->x;
-    dy = p->y - q->y;
-    t->x = (double)x;
-    if (FABS(dx) < DBL_EPSILON) {
-        double d1, d2;
-        /* Same X-coordinate indicates a vertical line.  Pick the
-         * closest end point. */
-        d1 = p->y - y;
-        d2 = q->y - y;
-        if (FABS(d1) < FABS(d2)) {
-            t->y = p->y, dist = d1;
-        } else {
-            t->y = q->y, dist = d2;
+    tracePtr->nScreenPts = length;
+    tracePtr->nDrawPts = length;
+    tracePtr->firstDraw = -1;
+    if (length > 2) {
+        /*
+         * Only the indices of the points drawn are kept, so that
+         * PostScript output and closest searches still see every
+         * point of the trace, in single precision.  The symbol
+         * points, which closest point searches use, stay double.
+         */
+        if (tracesPtr->nDrawPts + length > tracesPtr->drawSpace) {
+            Tcl_Size drawSpace;
+            Tcl_Size *drawPts;
+
+            drawSpace = MAX(tracesPtr->nDrawPts + length, tracesPtr->drawSpace * 2);
+            drawPts = Tcl_AttemptRealloc(tracesPtr->drawPts, (size_t)drawSpace * sizeof(Tcl_Size));
+            if (drawPts != NULL) {
+                tracesPtr->drawPts = drawPts;
+                tracesPtr->drawSpace = drawSpace;
+            }
         }
-    } else if (FABS(dy) < DBL_EPSILON) {
-        /* Horizontal line. */
-        t->y = p->y, dist = p->y - y;
-    } else {
-        double m, b;
+        if (tracesPtr->nDrawPts + length <= tracesPtr->drawSpace) {
+            Tcl_Size nDrawPts;
 
-        m = dy / dx;
-        b = p->y - (m * p->x);
-        t->y = (x * m) + b;
-        dist = y - t->y;
+            nDrawPts = CollapseTrace(screenPts, length, tracesPtr->drawPts + tracesPtr->nDrawPts);
+            if (nDrawPts < length) {
+                tracePtr->firstDraw = tracesPtr->nDrawPts;
+                tracePtr->nDrawPts = nDrawPts;
+                tracesPtr->nDrawPts += nDrawPts;
+            }
+        }
+    }
+    tracesPtr->nScreenPts += length;
+    tracesPtr->nRuns++;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CollapseTrace --
+ *
+ *      Selects the screen points of a trace that change what is
+ *      drawn once they are truncated to pixels, the way DrawTraces
+ *      hands them to the window system.  A point is skipped when it
+ *      falls on the same pixel as the previous point drawn, or when
+ *      it lies on the same pixel row or column between its
+ *      neighbours, so that the two segments through it cover the
+ *      same pixels as one.  Dense traces, even non-monotonic ones,
+ *      shrink this way without any change to the rasterized line.
+ *
+ * Parameters:
+ *      const TracePoint *screenPts - Screen points of the trace
+ *      Tcl_Size nScreenPts - Number of screen points, at least two
+ *      Tcl_Size *drawPts - (out) Indices of the points drawn
+ *
+ * Results:
+ *      Returns the number of indices stored in drawPts.  The first
+ *      and last points of the trace are always drawn.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static Tcl_Size CollapseTrace(const TracePoint *screenPts, Tcl_Size nScreenPts, Tcl_Size *drawPts) {
+    Tcl_Size i;
+    Tcl_Size count;
+    int x;
+    int y;
+    int lastX;
+    int lastY;
+    int prevX;
+    int prevY;
+
+    drawPts[0] = 0;
+    count = 1;
+    lastX = prevX = (int)screenPts[0].x;
+    lastY = prevY = (int)screenPts[0].y;
+    for (i = 1; i < nScreenPts; i++) {
+        x = (int)screenPts[i].x;
+        y = (int)screenPts[i].y;
+        if ((x == lastX) && (y == lastY)) {
+            /*
+             * Same pixel as the last point drawn.  Keep the last
+             * index of the run so the trace still ends on its final
+             * point.
+             */
+            if ((i == (nScreenPts - 1)) && (count > 1)) {
+                drawPts[count - 1] = i;
+            }
+            continue;
+        }
+        if ((count > 1) &&
+            (((y == lastY) && (lastY == prevY) && (((lastX - prevX) > 0) == ((x - lastX) > 0))) ||
+             ((x == lastX) && (lastX == prevX) && (((lastY - prevY) > 0) == ((y - lastY) > 0))))) {
+            /*
+             * The last point drawn lies between its neighbours on a
+             * single pixel row or column.  Extend the run instead.
+             */
+            drawPts[count - 1] = i;
+        } else {
+            prevX = lastX;
+            prevY = lastY;
+            drawPts[count] = i;
+            count++;
+        }
+        lastX = x;
+        lastY = y;
+    }
+    if (count == 1) {
+        /*
+         * The whole trace falls on one pixel.  A single point draws
+         * nothing, so keep the degenerate segment.
+         */
+        drawPts[count] = nScreenPts - 1;
+        count++;
+    }
+    return count;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClearTraces --
+ *
+ *      Empties the traces of the line, keeping their arrays for the
+ *      next map.
+ *
+ * Parameters:
+ *      Line *linePtr
+ *
+ * Results:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static void ClearTraces(Line *linePtr) {
+    linePtr->traces.nRuns = 0;
+    linePtr->traces.nScreenPts = 0;
+    linePtr->traces.nIndices = 0;
+    linePtr->traces.nDrawPts = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeTraces --
+ *
+ *      Deletes all the traces for the line.
+ *
+ * Parameters:
+ *      Line *linePtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      The arrays of the traces are freed.
+ *
+ *----------------------------------------------------------------------
+ */
+static void FreeTraces(Line *linePtr) {
+    LineTraces *tracesPtr = &linePtr->traces;
+
+    if (tracesPtr->runs != NULL) {
+        ckfree(tracesPtr->runs);
+    }
+    if (tracesPtr->screenPts != NULL) {
+        ckfree(tracesPtr->screenPts);
+    }
+    if (tracesPtr->symbolToData != NULL) {
+        ckfree(tracesPtr->symbolToData);
+    }
+    if (tracesPtr->drawPts != NULL) {
+        ckfree(tracesPtr->drawPts);
+    }
+    memset(tracesPtr, 0, sizeof(LineTraces));
+}
+
+static double TraceAbscissa(Graph *graphPtr, Line *linePtr, const Point2D *pointPtr) {
+    double value;
+    
+    /*
+     * -trace increasing/decreasing refers to the element's data-X
+     * coordinate, not to left-to-right screen motion.
+     *
+     * Normally data X maps to screen X.  In an inverted graph it maps
+     * to screen Y; a normal vertical mapping runs in the opposite
+     * screen direction.
+     */
+    if (graphPtr->inverted) {
+        value = -pointPtr->y;
+    } else {
+        value = pointPtr->x;
+    }
+    /*
+     * Axis -descending reverses whichever screen direction maps data X.
+     * Undo that reversal so increasing value always corresponds to
+     * increasing data X.
+     */
+    if (linePtr->core.axes.x->descending) {
+        value = -value;
+    }
+    return value;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MapTraces --
+ *
+ *      Creates an array of line segments of the graph coordinates.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Line *linePtr
+ *      MapInfo *mapPtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Memory is  allocated for the line segment array.
+ *
+ *----------------------------------------------------------------------
+ */
+static void MapTraces(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
+    unsigned char codes[TRACE_BLOCK_POINTS];
+    Tcl_Size start;
+    Tcl_Size count;
+    Tcl_Size blockStart;
+    Tcl_Size blockEnd;
+    int code1;
+    int code2;
+    Point2D *p;
+    Point2D *q;
+    Point2D s;
+    Extents2D exts;
+    Tcl_Size i;
+    int broken;
+    int offscreen;
+    double lastX;
+    double nextX;
+
+    Rbc_GraphExtents(graphPtr, &exts);
+    count = 1;
+    Rbc_ClipOutCodes(&exts, mapPtr->screenPts, 1, codes);
+    code1 = codes[0];
+    p = mapPtr->screenPts;
+    q = p + 1;
+    blockStart = blockEnd = 1;
+    for (i = 1; i < mapPtr->nScreenPts; i++, p++, q++) {
+        if (i == blockEnd) {
+            /*
+             * Compute the out codes of the next block of points at
+             * once.  Clipping a segment only moves its own end points,
+             * so the points ahead still have their mapped codes.
+             */
+            blockStart = i;
+            blockEnd = i + MIN(mapPtr->nScreenPts - i, TRACE_BLOCK_POINTS);
+            Rbc_ClipOutCodes(&exts, q, blockEnd - blockStart, codes);
+        }
+        code2 = codes[i - blockStart];
+        if ((mapPtr->breakBefore != NULL) && mapPtr->breakBefore[i]) {
+            /*
+             * q starts a new continuous data run.  Save the previous
+             * trace without ever clipping or testing the nonexistent
+             * p->q segment.
+             */
+            if (count > 1) {
+                start = i - count;
+                SaveTrace(linePtr, start, count, mapPtr);
+            }
+            count = 1;
+            code1 = code2;
+            continue;
+        }
+        if (code2 != 0) {
+            /*
+             * Save the coordinates of the last point before clipping.
+             */
+            s = *q;
+        }
+        /*
+         * Test direction in a coordinate whose increasing direction
+         * always corresponds to increasing element data X.
+         */
+        lastX = TraceAbscissa(graphPtr, linePtr, p);
+        nextX = TraceAbscissa(graphPtr, linePtr, q);
+        broken = BROKEN_TRACE(linePtr->penDir, lastX, nextX);
+        if ((code1 | code2) == 0) {
+            offscreen = FALSE;
+        } else if ((code1 | code2) & RBC_CLIP_NAN) {
+            offscreen = TRUE;
+        } else {
+            offscreen = ClipSegment(&exts, code1, code2, p, q);
+        }
+        if (broken || offscreen) {
+            /*
+             * The last line segment is either totally clipped by the
+             * plotting area or has the wrong data-X direction,
+             * breaking the trace.
+             */
+            if (count > 1) {
+                start = i - count;
+                SaveTrace(linePtr, start, count, mapPtr);
+                count = 1;
+            }
+        } else {
+            count++;
+            if (code2 != 0) {
+                /*
+                 * If the last point is clipped, the trace is broken
+                 * after this point.  Restore the original coordinate
+                 * after saving the trace.
+                 */
+                start = i - (count - 1);
+                SaveTrace(linePtr, start, count, mapPtr);
+                mapPtr->screenPts[i] = s;
+                count = 1;
+            }
+        }
+        code1 = code2;
+    }
+    if (count > 1) {
+        start = i - count;
+        SaveTrace(linePtr, start, count, mapPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MapFillArea --
+ *
+ *      Creates an array of points that represent a polygon that fills
+ *      the area under the element.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Line *linePtr
+ *      MapInfo *mapPtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Memory is  allocated for the polygon point array.
+ *
+ *----------------------------------------------------------------------
+ */
+static void MapFillArea(Graph *graphPtr, Line *linePtr, MapInfo *mapPtr) {
+    Point2D *origPts;
+    Point2D *clipPts;
+    Extents2D exts;
+    double maxY;
+    Tcl_Size inputCount;
+    Tcl_Size clipCapacity;
+    Tcl_Size n;
+    Tcl_Size i;
+
+    /*
+     * Always discard the previous mapped polygon first.  The old code
+     * performed its INT_MAX check before this cleanup, which could leave
+     * a stale fill polygon after remapping failed.
+     */
+    if (linePtr->fillPts != NULL) {
+        ckfree(linePtr->fillPts);
+        linePtr->fillPts = NULL;
+        linePtr->nFillPts = 0;
+    }
+    /*
+     * Line currently stores one fill polygon only.  Filling a mapped
+     * line containing discontinuities would incorrectly bridge separate
+     * data runs.
+     */
+    if (mapPtr->breakBefore != NULL) {
+        return;
+    }
+    if (mapPtr->nScreenPts < 3) {
+        return;
+    }
+    /*
+     * Add two bottom vertices to close the fill polygon.
+     * Rbc_PolyRectClip() now generates the closing edge internally.
+     */
+    if (mapPtr->nScreenPts > TCL_SIZE_MAX - 2) {
+        return;
+    }
+    inputCount = mapPtr->nScreenPts + 2;
+    /*
+     * The clipping routine can emit at most three vertices per input
+     * edge, followed by one closing vertex.
+     */
+    if (inputCount > (TCL_SIZE_MAX - 1) / 3) {
+        return;
+    }
+    clipCapacity = inputCount * 3 + 1;
+    if ((inputCount > (Tcl_Size)(SIZE_MAX / sizeof(*origPts))) ||
+        (clipCapacity > (Tcl_Size)(SIZE_MAX / sizeof(*clipPts)))) {
+        return;
+    }
+    origPts = (Point2D *)Tcl_AttemptAlloc((size_t)inputCount * sizeof(*origPts));
+    if (origPts == NULL) {
+        return;
+    }
+    clipPts = (Point2D *)Tcl_AttemptAlloc((size_t)clipCapacity * sizeof(*clipPts));
+    if (clipPts == NULL) {
+        ckfree(origPts);
+        return;
+    }
+    Rbc_GraphExtents(graphPtr, &exts);
+    maxY = (double)graphPtr->bottom;
+    for (i = 0; i < mapPtr->nScreenPts; i++) {
+        origPts[i].x = mapPtr->screenPts[i].x + 1;
+        origPts[i].y = mapPtr->screenPts[i].y;
+        if (origPts[i].y > maxY) {
+            maxY = origPts[i].y;
+        }
+    }
+    /*
+     * Add edges that extend the polygon to the bottom of the plotting
+     * area.
+     */
+    origPts[i].x = origPts[i - 1].x;
+    origPts[i].y = maxY;
+    i++;
+    origPts[i].x = origPts[0].x;
+    origPts[i].y = maxY;
+    i++;
+    n = Rbc_PolyRectClip(&exts, origPts, inputCount, clipPts, clipCapacity);
+    ckfree(origPts);
+    if (n < 3) {
+        ckfree(clipPts);
+        return;
+    }
+    linePtr->fillPts = clipPts;
+    linePtr->nFillPts = n;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ResetLine --
+ *
+ *      TODO: Description
+ *
+ * Parameters:
+ *      Line *linePtr
+ *
+ * Results:
+ *      TODO: Results
+ *
+ * Side Effects:
+ *      TODO: Side Effects
+ *
+ *----------------------------------------------------------------------
+ */
+static void ResetLine(Line *linePtr) {
+    ClearTraces(linePtr);
+    FreeDensityCounts(&linePtr->density);
+    ResetLineStyles(linePtr);
+    if (linePtr->symbolPts != NULL) {
+        ckfree((char *)linePtr->symbolPts);
+    }
+    if (linePtr->symbolToData != NULL) {
+        ckfree((char *)linePtr->symbolToData);
+    }
+    if (linePtr->strips != NULL) {
+        ckfree((char *)linePtr->strips);
+    }
+    if (linePtr->stripToData != NULL) {
+        ckfree((char *)linePtr->stripToData);
+    }
+    if (linePtr->activePts != NULL) {
+        ckfree((char *)linePtr->activePts);
+    }
+    if (linePtr->activeToData != NULL) {
+        ckfree((char *)linePtr->activeToData);
+    }
+    linePtr->strips = NULL;
+    linePtr->symbolPts = linePtr->activePts = NULL;
+    linePtr->stripToData = NULL;
+    linePtr->symbolToData = NULL;
+    linePtr->activeToData = NULL;
+    linePtr->nActivePts = 0;
+    linePtr->nSymbolPts = 0;
+    linePtr->nStrips = 0;
+    linePtr->decimated = FALSE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ResetLineStyles --
+ *
+ *      Releases what depends on the pen styles of the element: the
+ *      per-style slices of the mapped points and the error bars,
+ *      whose caps are sized by the styles.  The mapped points
+ *      themselves are kept, but the closest search grids go, since
+ *      grouping the points by style reorders them.
+ *
+ * Parameters:
+ *      Line *linePtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      The error bar arrays, closest search grids and symbol keys
+ *      are freed.
+ *
+ *----------------------------------------------------------------------
+ */
+static void ResetLineStyles(Line *linePtr) {
+    ClearPalette(linePtr->core.palette);
+    FreeClosestGrids(linePtr);
+    FreeSymbolKeys(linePtr);
+    if (linePtr->core.xErrorBars != NULL) {
+        ckfree((char *)linePtr->core.xErrorBars);
+    }
+    if (linePtr->core.xErrorToData != NULL) {
+        ckfree((char *)linePtr->core.xErrorToData);
+    }
+    if (linePtr->core.yErrorBars != NULL) {
+        ckfree((char *)linePtr->core.yErrorBars);
+    }
+    if (linePtr->core.yErrorToData != NULL) {
+        ckfree((char *)linePtr->core.yErrorToData);
+    }
+    linePtr->core.xErrorBars = linePtr->core.yErrorBars = NULL;
+    linePtr->core.xErrorToData = NULL;
+    linePtr->core.yErrorToData = NULL;
+    linePtr->core.xErrorBarCnt = 0;
+    linePtr->core.yErrorBarCnt = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetMappedStyles --
+ *
+ *      Collects the pen attributes that decide how the points of the
+ *      element are mapped: whether traces are mapped at all, and
+ *      whether automatic decimation may drop points.  A restyled
+ *      element can keep its mapped points only if these are the
+ *      same as when it was last mapped.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Line *linePtr
+ *
+ * Results:
+ *      Returns a mask of MAPPED_* bits.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static int GetMappedStyles(Graph *graphPtr, Line *linePtr) {
+    int mask;
+
+    mask = 0;
+    if ((graphPtr->classUid == rbcStripElementUid) || (linePtr->builtinPen.traceWidth > 0)) {
+        mask |= MAPPED_TRACES;
+    }
+    if ((linePtr->decimate == LINE_DECIMATE_AUTO) && (PensAllowDecimation(linePtr))) {
+        mask |= MAPPED_DECIMATE;
+    }
+    return mask;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MapLine --
+ *
+ *      Calculates the actual window coordinates of the line element.
+ *      The window coordinates are saved in an allocated point array.
+ *      If only the pen styles of the element changed, and the new
+ *      pens map the points the same way, the coordinates are kept
+ *      and only regrouped by style.
+ *
+ *      When the graph is laid out for display with -asyncmap set, a
+ *      long element is instead mapped on a worker thread, and the
+ *      points mapped before are drawn until it's done.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      Element *elemPtr - Element component record
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Memory is (re)allocated for the point array.  A map still in
+ *      progress on a worker thread is canceled.
+ *
+ *----------------------------------------------------------------------
+ */
+static void MapLine(Graph *graphPtr, Element *elemPtr) {
+    Line *linePtr = LINE_FROM_CORE(elemPtr);
+    int mappedStyles;
+
+    if (linePtr->render == LINE_RENDER_DENSITY) {
+        /*
+         * The counts don't depend on the pens, so there is nothing to
+         * do unless the points or the axes changed.
+         */
+        if ((!(elemPtr->flags & MAP_ITEM)) && (linePtr->density.counts != NULL)) {
+            return;
+        }
+        if (linePtr->asyncPtr != NULL) {
+            CancelAsyncMap(linePtr);
+        }
+        ResetLine(linePtr);
+        if (linePtr->fillPts != NULL) {
+            ckfree(linePtr->fillPts);
+            linePtr->fillPts = NULL;
+            linePtr->nFillPts = 0;
+        }
+        linePtr->mappedPoints = NumberOfPoints(elemPtr);
+        MapDensity(graphPtr, linePtr);
+        return;
+    }
+    mappedStyles = GetMappedStyles(graphPtr, linePtr);
+    if ((!(elemPtr->flags & MAP_ITEM)) && (mappedStyles == linePtr->mappedStyles) &&
+        (linePtr->symbolCull == LINE_SYMBOL_CULL_OFF)) {
+        /*
+         * Only the pen styles changed.  Keep the screen points, traces
+         * and strips, and just reassign them to the pens.  Culled
+         * symbol points are remapped, since a point hidden by the old
+         * styles may show with the new ones.
+         */
+        ResetLineStyles(linePtr);
+        MapLineStyles(graphPtr, linePtr);
+        return;
+    }
+    if (linePtr->asyncPtr != NULL) {
+        /* The points it maps are out of date. */
+        CancelAsyncMap(linePtr);
+    }
+    if ((graphPtr->flags & MAP_ASYNC) && (NumberOfPoints(elemPtr) >= ASYNC_MAP_MIN_POINTS) &&
+        (StartAsyncMap(graphPtr, linePtr, mappedStyles))) {
+        return;
+    }
+    ResetLine(linePtr);
+    linePtr->mappedStyles = mappedStyles;
+    linePtr->mappedPoints = NumberOfPoints(elemPtr);
+    MapLineGeometry(graphPtr, linePtr, NULL);
+    if ((linePtr->core.flags & ACTIVE_PENDING) && (linePtr->core.nActiveIndices > 0)) {
+        MapActiveSymbols(graphPtr, linePtr);
+    }
+    MapLineStyles(graphPtr, linePtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MapLineGeometry --
+ *
+ *      Maps the data points of the line element to its symbol points
+ *      and to its traces or strips and fill area.  The pens are not
+ *      read, other than through the mapped styles of the element.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      Line *linePtr - Line element, with no mapped points
+ *      AsyncMap *asyncPtr - Worker map that linePtr is the copy of,
+ *                           or NULL.  The map stops early when it's
+ *                           canceled.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Memory is allocated for the mapped points.
+ *
+ *----------------------------------------------------------------------
+ */
+static void MapLineGeometry(Graph *graphPtr, Line *linePtr, AsyncMap *asyncPtr) {
+    MapInfo mapInfo = {0};
+    Tcl_Size nPoints;
+
+    nPoints = NumberOfPoints(&linePtr->core);
+    if (nPoints < 1) {
+        return;
+    }
+    GetScreenPoints(graphPtr, linePtr, &mapInfo);
+    if (mapInfo.nScreenPts < 1) {
+        return;
+    }
+    if (CanDecimate(graphPtr, linePtr, mapInfo.nScreenPts)) {
+        DecimatePoints(graphPtr, &mapInfo);
+    }
+    linePtr->decimated = mapInfo.decimated;
+    if (AsyncMapCanceled(asyncPtr)) {
+        goto done;
+    }
+    MapSymbols(graphPtr, linePtr, &mapInfo);
+    /*
+     * Map connecting line segments if they are to be displayed.
+     */
+    if ((nPoints > 1) && (linePtr->mappedStyles & MAPPED_TRACES)) {
+        linePtr->smooth = linePtr->reqSmooth;
+
+        /*
+         * Do smoothing if necessary.  This can extend the coordinate array,
+         * so both mapInfo.points and mapInfo.nPoints may change.
+         */
+
+        switch (linePtr->smooth) {
+        case PEN_SMOOTH_STEP:
+            GenerateSteps(graphPtr, linePtr, &mapInfo);
+            break;
+
+        case PEN_SMOOTH_NATURAL:
+        case PEN_SMOOTH_QUADRATIC:
+            if ((mapInfo.nScreenPts < 3) || (mapInfo.breakBefore != NULL)) {
+                /*
+                 * Never interpolate through missing data.  Proper per-run
+                 * spline generation can be added separately.
+                 */
+                linePtr->smooth = PEN_SMOOTH_NONE;
+            } else {
+                GenerateSpline(graphPtr, linePtr, &mapInfo);
+            }
+            break;
+
+        case PEN_SMOOTH_CATROM:
+            if ((mapInfo.nScreenPts < 3) || (mapInfo.breakBefore != NULL)) {
+                linePtr->smooth = PEN_SMOOTH_NONE;
+            } else {
+                GenerateParametricSpline(graphPtr, linePtr, &mapInfo);
+            }
+            break;
+
+        default:
+            break;
+        }
+        if (AsyncMapCanceled(asyncPtr)) {
+            goto done;
+        }
+        if (linePtr->rTolerance > 0.0) {
+            ReducePoints(&mapInfo, linePtr->rTolerance);
+        }
+        if ((linePtr->fillTile != NULL) || (linePtr->fillStipple != None)) {
+            MapFillArea(graphPtr, linePtr, &mapInfo);
+        }
+        if (graphPtr->classUid == rbcStripElementUid) {
+            MapStrip(graphPtr, linePtr, &mapInfo);
+        } else {
+            MapTraces(graphPtr, linePtr, &mapInfo);
+        }
+    }
+done:
+    ckfree(mapInfo.screenPts);
+    ckfree(mapInfo.indices);
+    if (mapInfo.breakBefore != NULL) {
+        ckfree(mapInfo.breakBefore);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StartAsyncMap --
+ *
+ *      Starts mapping the line element on a worker thread.  The
+ *      worker maps a copy of the element, with snapshots of its data
+ *      values, its axes and the graph.  Meanwhile the points mapped
+ *      before are kept, and regrouped by the current pen styles.
+ *
+ *      If a canceled map of the element is still running, the new
+ *      one is only started after it finishes.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      Line *linePtr - Line element to map
+ *      int mappedStyles - Mask of MAPPED_* bits for the pens
+ *
+ * Results:
+ *      Returns TRUE if the element is mapped on a worker thread.
+ *      FALSE means that the snapshot couldn't be allocated or the
+ *      thread couldn't be started, and the element must be mapped
+ *      right away.
+ *
+ * Side effects:
+ *      The level-of-detail summaries and the spline of the element
+ *      are lent to the worker.
+ *
+ *----------------------------------------------------------------------
+ */
+static int StartAsyncMap(Graph *graphPtr, Line *linePtr, int mappedStyles) {
+    Tcl_Size nPoints;
+
+    nPoints = NumberOfPoints(&linePtr->core);
+    if (linePtr->asyncPtr == NULL) {
+        AsyncMap *asyncPtr;
+        Line *copyPtr;
+        Tcl_ThreadId threadId;
+        size_t valueBytes;
+
+        if (GetLineArrayByteCount(nPoints, 2 * sizeof(double), &valueBytes) != TCL_OK) {
+            return FALSE;
+        }
+        asyncPtr = Tcl_AttemptAlloc(sizeof(AsyncMap));
+        if (asyncPtr == NULL) {
+            return FALSE;
+        }
+        asyncPtr->values = Tcl_AttemptAlloc(valueBytes);
+        if (asyncPtr->values == NULL) {
+            ckfree(asyncPtr);
+            return FALSE;
+        }
+        /*
+         * Check the order of any new x values here, so that the element
+         * keeps the result and the worker needn't check them again.
+         */
+        Rbc_ElemXOrdered(&linePtr->core);
+        memcpy(asyncPtr->values, linePtr->core.x.valueArr, (size_t)nPoints * sizeof(double));
+        memcpy(asyncPtr->values + nPoints, linePtr->core.y.valueArr, (size_t)nPoints * sizeof(double));
+        asyncPtr->graph = *graphPtr;
+        asyncPtr->xAxis = *linePtr->core.axes.x;
+        asyncPtr->yAxis = *linePtr->core.axes.y;
+        asyncPtr->line = *linePtr;
+        asyncPtr->linePtr = linePtr;
+        asyncPtr->nPoints = nPoints;
+        asyncPtr->threadId = graphPtr->threadId;
+
+        /*
+         * The copy reads only the snapshots, and owns nothing of the
+         * element but its level-of-detail summaries and its spline.
+         */
+        copyPtr = &asyncPtr->line;
+        copyPtr->core.graphPtr = &asyncPtr->graph;
+        copyPtr->core.axes.x = &asyncPtr->xAxis;
+        copyPtr->core.axes.y = &asyncPtr->yAxis;
+        copyPtr->core.x.valueArr = asyncPtr->values;
+        copyPtr->core.y.valueArr = asyncPtr->values + nPoints;
+        copyPtr->core.x.nValues = copyPtr->core.y.nValues = nPoints;
+        copyPtr->core.palette = NULL;
+        copyPtr->core.activeIndices = NULL;
+        copyPtr->core.nActiveIndices = 0;
+        copyPtr->core.xErrorBars = copyPtr->core.yErrorBars = NULL;
+        copyPtr->core.xErrorToData = copyPtr->core.yErrorToData = NULL;
+        copyPtr->core.xErrorBarCnt = copyPtr->core.yErrorBarCnt = 0;
+        copyPtr->mappedStyles = mappedStyles;
+        copyPtr->asyncPtr = NULL;
+        copyPtr->fillPts = NULL;
+        copyPtr->nFillPts = 0;
+        copyPtr->symbolPts = copyPtr->activePts = NULL;
+        copyPtr->symbolToData = copyPtr->activeToData = NULL;
+        copyPtr->nSymbolPts = copyPtr->nActivePts = 0;
+        memset(&copyPtr->traces, 0, sizeof(copyPtr->traces));
+        copyPtr->strips = NULL;
+        copyPtr->stripToData = NULL;
+        copyPtr->nStrips = 0;
+        copyPtr->pointGrid = copyPtr->segmentGrid = NULL;
+        copyPtr->symbolColors = NULL;
+        copyPtr->symbolSizes = NULL;
+        copyPtr->colorTable = NULL;
+        copyPtr->colorGC = NULL;
+        memset(&copyPtr->core.styleMap, 0, sizeof(copyPtr->core.styleMap));
+        copyPtr->density.counts = NULL;
+        copyPtr->density.pixmap = copyPtr->density.mask = None;
+        copyPtr->density.colorTable = NULL;
+
+        /*
+         * Tcl creates a mutex when it is first locked.  Do that here,
+         * before the worker can race to lock it.
+         */
+        asyncPtr->mutex = NULL;
+        Tcl_MutexLock(&asyncPtr->mutex);
+        asyncPtr->canceled = FALSE;
+        Tcl_MutexUnlock(&asyncPtr->mutex);
+        if (Tcl_CreateThread(&threadId, AsyncMapThread, asyncPtr, TCL_THREAD_STACK_DEFAULT, TCL_THREAD_NOFLAGS) !=
+            TCL_OK) {
+            Tcl_MutexFinalize(&asyncPtr->mutex);
+            ckfree(asyncPtr->values);
+            ckfree(asyncPtr);
+            return FALSE;
+        }
+        /*
+         * The worker now updates the summaries.  Values changed from
+         * here on are marked in the element's y vector.
+         */
+        memset(&linePtr->lod, 0, sizeof(linePtr->lod));
+        memset(&linePtr->spline, 0, sizeof(linePtr->spline));
+        linePtr->core.y.changedFirst = linePtr->core.y.nValues;
+        linePtr->asyncPtr = asyncPtr;
+    } else {
+        linePtr->asyncPending = TRUE;
+    }
+    if (nPoints < linePtr->mappedPoints) {
+        /* The points mapped before refer to data that's gone. */
+        ResetLine(linePtr);
+        linePtr->mappedPoints = 0;
+    }
+    ResetLineStyles(linePtr);
+    MapLineStyles(graphPtr, linePtr);
+    return TRUE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CancelAsyncMap --
+ *
+ *      Marks the map of the line element in progress on a worker
+ *      thread as no longer wanted.  Its result is thrown away when it
+ *      finishes.
+ *
+ * Parameters:
+ *      Line *linePtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The worker stops early if it can.
+ *
+ *----------------------------------------------------------------------
+ */
+static void CancelAsyncMap(Line *linePtr) {
+    AsyncMap *asyncPtr = linePtr->asyncPtr;
+
+    Tcl_MutexLock(&asyncPtr->mutex);
+    asyncPtr->canceled = TRUE;
+    Tcl_MutexUnlock(&asyncPtr->mutex);
+    linePtr->asyncPending = FALSE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AsyncMapCanceled --
+ *
+ *      Indicates if a map on a worker thread was canceled.
+ *
+ * Parameters:
+ *      AsyncMap *asyncPtr - Worker map, or NULL.
+ *
+ * Results:
+ *      Returns TRUE if the map was canceled.  A NULL map is never
+ *      canceled.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static int AsyncMapCanceled(AsyncMap *asyncPtr) {
+    int canceled;
+
+    if (asyncPtr == NULL) {
+        return FALSE;
+    }
+    Tcl_MutexLock(&asyncPtr->mutex);
+    canceled = asyncPtr->canceled;
+    Tcl_MutexUnlock(&asyncPtr->mutex);
+    return canceled;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AsyncMapThread --
+ *
+ *      Body of the worker thread started by StartAsyncMap.  Maps the
+ *      copy of the element, then queues an event to the thread of
+ *      the graph, which takes over the result.
+ *
+ * Parameters:
+ *      ClientData clientData - Worker map.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The thread exits.
+ *
+ *----------------------------------------------------------------------
+ */
+static Tcl_ThreadCreateType AsyncMapThread(ClientData clientData) {
+    AsyncMap *asyncPtr = clientData;
+    AsyncMapEvent *eventPtr;
+
+    MapLineGeometry(&asyncPtr->graph, &asyncPtr->line, asyncPtr);
+    eventPtr = ckalloc(sizeof(AsyncMapEvent));
+    eventPtr->header.proc = AsyncMapEventProc;
+    eventPtr->asyncPtr = asyncPtr;
+    Tcl_ThreadQueueEvent(asyncPtr->threadId, &eventPtr->header, TCL_QUEUE_TAIL);
+    Tcl_ThreadAlert(asyncPtr->threadId);
+    Tcl_ExitThread(TCL_OK);
+    TCL_THREAD_CREATE_RETURN;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AsyncMapEventProc --
+ *
+ *      Invoked in the thread of the graph when a worker has finished
+ *      mapping a line element.  If the element, its data, its axes
+ *      and its mapped styles haven't changed since the map started,
+ *      the new points replace those of the element and the graph is
+ *      redrawn.  Otherwise they are thrown away, and the element is
+ *      mapped again if that was asked for meanwhile.
+ *
+ * Parameters:
+ *      Tcl_Event *eventPtr
+ *      int flags
+ *
+ * Results:
+ *      Returns 1, the event is always handled.
+ *
+ * Side effects:
+ *      The worker map is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+static int AsyncMapEventProc(Tcl_Event *eventPtr, int flags) {
+    AsyncMap *asyncPtr = ((AsyncMapEvent *)eventPtr)->asyncPtr;
+    Line *linePtr = asyncPtr->linePtr;
+    Line *copyPtr = &asyncPtr->line;
+    Graph *graphPtr;
+
+    if (linePtr != NULL) {
+        graphPtr = linePtr->core.graphPtr;
+        linePtr->asyncPtr = NULL;
+        /*
+         * Take back the level-of-detail summaries, unless the element
+         * was mapped meanwhile and built new ones.
+         */
+        if (linePtr->lod.nLevels == 0) {
+            FreeLod(&linePtr->lod);
+            linePtr->lod = copyPtr->lod;
+            memset(&copyPtr->lod, 0, sizeof(copyPtr->lod));
+            linePtr->core.y.changedFirst = MIN(linePtr->core.y.changedFirst, copyPtr->core.y.changedFirst);
+        }
+        /* Likewise the spline, which knows the data it was fit to. */
+        if (linePtr->spline.smooth == PEN_SMOOTH_NONE) {
+            FreeLineSpline(&linePtr->spline);
+            linePtr->spline = copyPtr->spline;
+            memset(&copyPtr->spline, 0, sizeof(copyPtr->spline));
+        }
+        if ((!AsyncMapCanceled(asyncPtr)) && (!(linePtr->core.flags & MAP_ITEM)) && (!(graphPtr->flags & MAP_ALL))) {
+            if (GetMappedStyles(graphPtr, linePtr) == copyPtr->mappedStyles) {
+                SwapAsyncMap(graphPtr, linePtr, asyncPtr);
+            } else {
+                /* The pens now map the points differently. */
+                linePtr->asyncPending = TRUE;
+            }
+        }
+        if (linePtr->asyncPending) {
+            linePtr->asyncPending = FALSE;
+            linePtr->core.flags |= MAP_ITEM;
+            Rbc_EventuallyRedrawGraph(graphPtr);
+        }
+    }
+    FreeAsyncMap(asyncPtr);
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SwapAsyncMap --
+ *
+ *      Replaces the mapped points of the line element with those
+ *      mapped on a worker thread, and groups them by pen style.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      Line *linePtr - Line element
+ *      AsyncMap *asyncPtr - Finished worker map of the element
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The graph is redrawn.
+ *
+ *----------------------------------------------------------------------
+ */
+static void SwapAsyncMap(Graph *graphPtr, Line *linePtr, AsyncMap *asyncPtr) {
+    Line *copyPtr = &asyncPtr->line;
+
+    ResetLine(linePtr);
+    if (linePtr->fillPts != NULL) {
+        ckfree(linePtr->fillPts);
+    }
+    linePtr->fillPts = copyPtr->fillPts;
+    linePtr->nFillPts = copyPtr->nFillPts;
+    linePtr->symbolPts = copyPtr->symbolPts;
+    linePtr->symbolToData = copyPtr->symbolToData;
+    linePtr->nSymbolPts = copyPtr->nSymbolPts;
+    {
+        LineTraces traces;
+
+        /* The copy frees the arrays of the element's old traces. */
+        traces = linePtr->traces;
+        linePtr->traces = copyPtr->traces;
+        copyPtr->traces = traces;
+    }
+    linePtr->strips = copyPtr->strips;
+    linePtr->stripToData = copyPtr->stripToData;
+    linePtr->nStrips = copyPtr->nStrips;
+    linePtr->smooth = copyPtr->smooth;
+    linePtr->mappedStyles = copyPtr->mappedStyles;
+    linePtr->mappedPoints = asyncPtr->nPoints;
+    linePtr->decimated = copyPtr->decimated;
+    copyPtr->fillPts = NULL;
+    copyPtr->symbolPts = NULL;
+    copyPtr->symbolToData = NULL;
+    copyPtr->strips = NULL;
+    copyPtr->stripToData = NULL;
+
+    if (linePtr->core.nActiveIndices > 0) {
+        MapActiveSymbols(graphPtr, linePtr);
+    }
+    MapLineStyles(graphPtr, linePtr);
+    graphPtr->flags |= REDRAW_BACKING_STORE;
+    Rbc_EventuallyRedrawGraph(graphPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeAsyncMap --
+ *
+ *      Releases a finished worker map, with whatever the copy of the
+ *      element still owns.
+ *
+ * Parameters:
+ *      AsyncMap *asyncPtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+static void FreeAsyncMap(AsyncMap *asyncPtr) {
+    Line *copyPtr = &asyncPtr->line;
+
+    ResetLine(copyPtr);
+    FreeTraces(copyPtr);
+    if (copyPtr->fillPts != NULL) {
+        ckfree(copyPtr->fillPts);
+    }
+    FreeLod(&copyPtr->lod);
+    FreeLineSpline(&copyPtr->spline);
+    Tcl_MutexFinalize(&asyncPtr->mutex);
+    ckfree(asyncPtr->values);
+    ckfree(asyncPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MapLineStyles --
+ *
+ *      Sizes the symbols of each pen style, assigns the data points
+ *      to their styles, maps the error bars and groups the mapped
+ *      points by style.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      Line *linePtr - Line element whose points are mapped
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The mapped points are reordered by style, and within each
+ *      style by the color and size given them by the element's
+ *      -colorvector and -sizevector.
+ *
+ *----------------------------------------------------------------------
+ */
+static void MapLineStyles(Graph *graphPtr, Line *linePtr) {
+    StyleMap *mapPtr;
+    Rbc_ChainLink *linkPtr;
+    LinePenStyle *stylePtr;
+    int size;
+    int errorBars;
+
+    if (NumberOfPoints(&linePtr->core) < 1) {
+        return;
+    }
+    /* Set the symbol size of all the pen styles. */
+    for (linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
+        stylePtr = Rbc_ChainGetValue(linkPtr);
+        size = ScaleSymbol(&linePtr->core, stylePtr->penPtr->symbol.size);
+        stylePtr->symbolSize = size;
+        stylePtr->errorBarCapWidth =
+            (stylePtr->penPtr->errorBarCapWidth > 0) ? stylePtr->penPtr->errorBarCapWidth : (int)(size * 0.6666666);
+        stylePtr->errorBarCapWidth /= 2;
+    }
+    errorBars = (((linePtr->core.yHigh.nValues > 0) && (linePtr->core.yLow.nValues > 0)) ||
+                 ((linePtr->core.xHigh.nValues > 0) && (linePtr->core.xLow.nValues > 0)) ||
+                 (linePtr->core.xError.nValues > 0) || (linePtr->core.yError.nValues > 0));
+    if ((Rbc_ChainGetLength(linePtr->core.palette) < 2) && (!errorBars)) {
+        /* Every point has the normal style, so no style map is needed. */
+        MergePens(linePtr, NULL);
+    } else {
+        mapPtr = Rbc_StyleMap(&linePtr->core);
+        if (errorBars) {
+            Rbc_MapErrorBars(graphPtr, &linePtr->core, mapPtr);
+        }
+        MergePens(linePtr, mapPtr);
+    }
+    /* Symbols sized by a vector can't be hidden by those at the same pixel. */
+    if ((linePtr->symbolCull == LINE_SYMBOL_CULL_PIXEL) && (linePtr->core.sizeData.nValues == 0)) {
+        CullSymbols(graphPtr, linePtr);
+    }
+    if ((linePtr->core.colorData.nValues > 0) || (linePtr->core.sizeData.nValues > 0)) {
+        GroupSymbolColors(linePtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CullSymbols --
+ *
+ *      Drops the symbol points that are drawn over by a later point
+ *      of the same pen style at the same pixel.  The points of each
+ *      style are drawn in order, so only the last one at a pixel can
+ *      be seen.  A bitmap of the plotting area marks the pixels
+ *      already taken while each style's points are walked backwards.
+ *
+ *      The points kept stay in their order, and the indices of their
+ *      data points move with them.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      Line *linePtr - Line element whose points are grouped by style
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The symbol points and the style slices are compacted.  If the
+ *      bitmap can't be allocated, every point is kept.
+ *
+ *----------------------------------------------------------------------
+ */
+static void CullSymbols(Graph *graphPtr, Line *linePtr) {
+    Extents2D exts;
+    Rbc_ChainLink *linkPtr;
+    LinePenStyle *stylePtr;
+    unsigned char *bitmap;
+    Tcl_Size width, height;
+    Tcl_Size total, count;
+    Tcl_Size left, top;
+    Tcl_Size first, last, i;
+    Tcl_Size bit;
+
+    if (linePtr->nSymbolPts < 2) {
+        return;
+    }
+    /* The styles must slice the points, in order, end to end. */
+    total = 0;
+    for (linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
+        stylePtr = Rbc_ChainGetValue(linkPtr);
+        if ((stylePtr->nSymbolPts > 0) && (stylePtr->symbolPts != linePtr->symbolPts + total)) {
+            return;
+        }
+        total += stylePtr->nSymbolPts;
+    }
+    if (total != linePtr->nSymbolPts) {
+        return;
+    }
+    Rbc_GraphExtents(graphPtr, &exts);
+    left = (Tcl_Size)exts.left;
+    top = (Tcl_Size)exts.top;
+    width = (Tcl_Size)exts.right - left + 1;
+    height = (Tcl_Size)exts.bottom - top + 1;
+    if ((width < 1) || (height < 1) || (width > (TCL_SIZE_MAX - 7) / height)) {
+        return;
+    }
+    bitmap = Tcl_AttemptAlloc((size_t)((width * height + 7) / 8));
+    if (bitmap == NULL) {
+        return;
+    }
+    memset(bitmap, 0, (size_t)((width * height + 7) / 8));
+
+    count = 0;
+    first = 0;
+    for (linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
+        stylePtr = Rbc_ChainGetValue(linkPtr);
+        if (stylePtr->nSymbolPts == 0) {
+            stylePtr->symbolPts = linePtr->symbolPts + count;
+            continue;
+        }
+        /*
+         * Walk the style's points from the last drawn, moving those
+         * kept to the end of its slice.
+         */
+        last = first + stylePtr->nSymbolPts;
+        i = last;
+        while (i > first) {
+            Point2D *pointPtr;
+            Tcl_Size x, y;
+
+            i--;
+            pointPtr = linePtr->symbolPts + i;
+            x = (Tcl_Size)pointPtr->x - left;
+            y = (Tcl_Size)pointPtr->y - top;
+            if ((x >= 0) && (x < width) && (y >= 0) && (y < height)) {
+                bit = y * width + x;
+                if (bitmap[bit >> 3] & (1 << (bit & 7))) {
+                    continue;
+                }
+                bitmap[bit >> 3] |= (1 << (bit & 7));
+            }
+            last--;
+            linePtr->symbolPts[last] = *pointPtr;
+            linePtr->symbolToData[last] = linePtr->symbolToData[i];
+        }
+        first += stylePtr->nSymbolPts;
+        stylePtr->nSymbolPts = first - last;
+        /* Close the gap left by the points dropped before. */
+        if (last > count) {
+            memmove(linePtr->symbolPts + count, linePtr->symbolPts + last,
+                    (size_t)stylePtr->nSymbolPts * sizeof(*linePtr->symbolPts));
+            memmove(linePtr->symbolToData + count, linePtr->symbolToData + last,
+                    (size_t)stylePtr->nSymbolPts * sizeof(*linePtr->symbolToData));
+        }
+        stylePtr->symbolPts = linePtr->symbolPts + count;
+        /* Clear the pixels for the next style. */
+        for (i = count; i < count + stylePtr->nSymbolPts; i++) {
+            Tcl_Size x, y;
+
+            x = (Tcl_Size)linePtr->symbolPts[i].x - left;
+            y = (Tcl_Size)linePtr->symbolPts[i].y - top;
+            if ((x >= 0) && (x < width) && (y >= 0) && (y < height)) {
+                bit = y * width + x;
+                bitmap[bit >> 3] &= ~(1 << (bit & 7));
+            }
+        }
+        count += stylePtr->nSymbolPts;
+    }
+    linePtr->nSymbolPts = count;
+    ckfree(bitmap);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GroupSymbolColors --
+ *
+ *      Gives each symbol point the color and size keys of its data
+ *      point's values in the element's -colorvector and -sizevector,
+ *      and sorts the points of each pen style by them, so that the
+ *      symbols of the same color and size are drawn together.  The
+ *      colors are the SYMBOL_COLORS steps of the colormap over the
+ *      range of the color vector.  The sizes are in pixels.  Points
+ *      without a finite value keep the colors or size of their pen
+ *      style.
+ *
+ *      The points are sorted in two stable counting passes, by size
+ *      and then by color, moving the indices of their data points
+ *      with them.
+ *
+ * Parameters:
+ *      Line *linePtr - Line element whose points are grouped by style
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The symbol points of each style are reordered.  If the keys
+ *      can't be allocated, the symbols are drawn as their styles'.
+ *
+ *----------------------------------------------------------------------
+ */
+static void GroupSymbolColors(Line *linePtr) {
+    ElemVector *colorPtr = &linePtr->core.colorData;
+    ElemVector *sizePtr = &linePtr->core.sizeData;
+    Rbc_ChainLink *linkPtr;
+    LinePenStyle *stylePtr;
+    SymbolSort sort;
+    double scale;
+    Tcl_Size total, i;
+
+    if (linePtr->nSymbolPts < 1) {
+        return;
+    }
+    /* The styles must slice the points, in order, end to end. */
+    total = 0;
+    for (linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
+        stylePtr = Rbc_ChainGetValue(linkPtr);
+        if ((stylePtr->nSymbolPts > 0) && (stylePtr->symbolPts != linePtr->symbolPts + total)) {
+            return;
+        }
+        total += stylePtr->nSymbolPts;
+    }
+    if (total != linePtr->nSymbolPts) {
+        return;
+    }
+    memset(&sort, 0, sizeof(sort));
+    sort.points = Tcl_AttemptAlloc((size_t)total * sizeof(Point2D));
+    sort.toData = Tcl_AttemptAlloc((size_t)total * sizeof(Tcl_Size));
+    if (colorPtr->nValues > 0) {
+        linePtr->symbolColors = Tcl_AttemptAlloc((size_t)total * sizeof(unsigned short));
+        sort.colors = Tcl_AttemptAlloc((size_t)total * sizeof(unsigned short));
+    }
+    if (sizePtr->nValues > 0) {
+        linePtr->symbolSizes = Tcl_AttemptAlloc((size_t)total);
+        sort.sizes = Tcl_AttemptAlloc((size_t)total);
+    }
+    if ((sort.points == NULL) || (sort.toData == NULL) ||
+        ((colorPtr->nValues > 0) && ((linePtr->symbolColors == NULL) || (sort.colors == NULL))) ||
+        ((sizePtr->nValues > 0) && ((linePtr->symbolSizes == NULL) || (sort.sizes == NULL)))) {
+        FreeSymbolKeys(linePtr);
+        goto done;
+    }
+
+    scale = 0.0;
+    if (FINITE(colorPtr->min) && FINITE(colorPtr->max) && (colorPtr->max > colorPtr->min)) {
+        scale = (SYMBOL_COLORS - 1) / (colorPtr->max - colorPtr->min);
+    }
+    for (i = 0; i < total; i++) {
+        Tcl_Size dataIndex;
+        double value;
+
+        dataIndex = linePtr->symbolToData[i];
+        if (linePtr->symbolColors != NULL) {
+            linePtr->symbolColors[i] = SYMBOL_COLOR_PEN;
+            if (dataIndex < colorPtr->nValues) {
+                value = colorPtr->valueArr[dataIndex];
+                if (FINITE(value)) {
+                    value = (value - colorPtr->min) * scale + 0.5;
+                    linePtr->symbolColors[i] = (unsigned short)MIN(MAX(value, 0.0), SYMBOL_COLORS - 1);
+                }
+            }
+        }
+        if (linePtr->symbolSizes != NULL) {
+            linePtr->symbolSizes[i] = SYMBOL_SIZE_STYLE;
+            if (dataIndex < sizePtr->nValues) {
+                value = sizePtr->valueArr[dataIndex];
+                if (FINITE(value)) {
+                    value += 0.5;
+                    linePtr->symbolSizes[i] = (unsigned char)MIN(MAX(value, 0.0), SYMBOL_SIZE_STYLE - 1);
+                }
+            }
+        }
+    }
+
+    total = 0;
+    for (linkPtr = Rbc_ChainFirstLink(linePtr->core.palette); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
+        stylePtr = Rbc_ChainGetValue(linkPtr);
+        if (stylePtr->nSymbolPts > 1) {
+            if (linePtr->symbolSizes != NULL) {
+                SortSymbolKeys(linePtr, total, stylePtr->nSymbolPts, TRUE, &sort);
+            }
+            if (linePtr->symbolColors != NULL) {
+                SortSymbolKeys(linePtr, total, stylePtr->nSymbolPts, FALSE, &sort);
+            }
+        }
+        total += stylePtr->nSymbolPts;
+    }
+done:
+    if (sort.points != NULL) {
+        ckfree(sort.points);
+    }
+    if (sort.toData != NULL) {
+        ckfree(sort.toData);
+    }
+    if (sort.colors != NULL) {
+        ckfree(sort.colors);
+    }
+    if (sort.sizes != NULL) {
+        ckfree(sort.sizes);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SortSymbolKeys --
+ *
+ *      Sorts the symbol points of a pen style by their size or color
+ *      keys, in one stable counting pass.
+ *
+ * Parameters:
+ *      Line *linePtr - Line element
+ *      Tcl_Size first - Index of the style's first symbol point
+ *      Tcl_Size n - Number of the style's symbol points
+ *      int bySize - If non-zero, sort by size, otherwise by color
+ *      SymbolSort *sortPtr - Scratch arrays, as large as the points
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The points, their data indices and keys are reordered.
+ *
+ *----------------------------------------------------------------------
+ */
+static void SortSymbolKeys(Line *linePtr, Tcl_Size first, Tcl_Size n, int bySize, SymbolSort *sortPtr) {
+    Tcl_Size counts[SYMBOL_COLORS + 1];
+    Tcl_Size i, j, sum;
+    int key;
+
+    memset(counts, 0, sizeof(counts));
+    for (i = first; i < first + n; i++) {
+        key = (bySize) ? linePtr->symbolSizes[i] : linePtr->symbolColors[i];
+        counts[key]++;
+    }
+    /* Already one bucket: nothing to move. */
+    key = (bySize) ? linePtr->symbolSizes[first] : linePtr->symbolColors[first];
+    if (counts[key] == n) {
+        return;
+    }
+    sum = 0;
+    for (key = 0; key <= SYMBOL_COLORS; key++) {
+        Tcl_Size count;
+
+        count = counts[key];
+        counts[key] = sum;
+        sum += count;
+    }
+    for (i = first; i < first + n; i++) {
+        key = (bySize) ? linePtr->symbolSizes[i] : linePtr->symbolColors[i];
+        j = counts[key]++;
+        sortPtr->points[j] = linePtr->symbolPts[i];
+        sortPtr->toData[j] = linePtr->symbolToData[i];
+        if (linePtr->symbolColors != NULL) {
+            sortPtr->colors[j] = linePtr->symbolColors[i];
+        }
+        if (linePtr->symbolSizes != NULL) {
+            sortPtr->sizes[j] = linePtr->symbolSizes[i];
+        }
+    }
+    memcpy(linePtr->symbolPts + first, sortPtr->points, (size_t)n * sizeof(Point2D));
+    memcpy(linePtr->symbolToData + first, sortPtr->toData, (size_t)n * sizeof(Tcl_Size));
+    if (linePtr->symbolColors != NULL) {
+        memcpy(linePtr->symbolColors + first, sortPtr->colors, (size_t)n * sizeof(unsigned short));
+    }
+    if (linePtr->symbolSizes != NULL) {
+        memcpy(linePtr->symbolSizes + first, sortPtr->sizes, (size_t)n);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MapDensity --
+ *
+ *      Counts the data points of the line element falling in each
+ *      pixel of the plotting area, for drawing them as one image.
+ *      No symbol points, traces or strips are mapped.
+ *
+ *      Long elements are counted on several threads, each with its
+ *      own grid for a share of the points.  The grids are then added
+ *      up.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      Line *linePtr - Line element, with no mapped points
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Memory is allocated for the counts.  If it can't be, the
+ *      element isn't drawn.
+ *
+ *----------------------------------------------------------------------
+ */
+static void MapDensity(Graph *graphPtr, Line *linePtr) {
+    DensityGrid *gridPtr = &linePtr->density;
+    DensityTask tasks[DENSITY_MAX_THREADS];
+    Tcl_ThreadId threadIds[DENSITY_MAX_THREADS];
+    Extents2D exts;
+    Tcl_Size nPoints, first, last;
+    Tcl_Size nCells, i;
+    size_t gridBytes;
+    int nThreads;
+    int t, result;
+
+    FreeDensityCounts(gridPtr);
+    gridPtr->stamp++;
+    nPoints = NumberOfPoints(&linePtr->core);
+    if (nPoints < 1) {
+        return;
+    }
+    Rbc_GraphExtents(graphPtr, &exts);
+    gridPtr->x = (int)exts.left;
+    gridPtr->y = (int)exts.top;
+    gridPtr->width = (int)exts.right - gridPtr->x + 1;
+    gridPtr->height = (int)exts.bottom - gridPtr->y + 1;
+    if ((gridPtr->width < 1) || (gridPtr->height < 1)) {
+        return;
+    }
+    nCells = (Tcl_Size)gridPtr->width * gridPtr->height;
+    if ((GetLineArrayByteCount(nCells, sizeof(uint32_t), &gridBytes) != TCL_OK) ||
+        ((gridPtr->counts = Tcl_AttemptAlloc(gridBytes)) == NULL)) {
+        return;
+    }
+    memset(gridPtr->counts, 0, gridBytes);
+    if (!Rbc_GetElemVisibleRange(&linePtr->core, GetVisibleMargin(graphPtr, linePtr), &first, &last)) {
+        first = 0;
+        last = nPoints - 1;
+    }
+
+    nThreads = 1;
+    if ((last - first + 1 >= DENSITY_PARALLEL_MIN_POINTS) && (Rbc_GetProcessorCount() > 1)) {
+        nThreads = MIN(Rbc_GetProcessorCount(), DENSITY_MAX_THREADS);
+    }
+    for (t = 0; t < nThreads; t++) {
+        tasks[t].graphPtr = graphPtr;
+        tasks[t].axesPtr = &linePtr->core.axes;
+        tasks[t].x = linePtr->core.x.valueArr;
+        tasks[t].y = linePtr->core.y.valueArr;
+        tasks[t].first = first + (last - first + 1) * t / nThreads;
+        tasks[t].last = first + (last - first + 1) * (t + 1) / nThreads;
+        tasks[t].gridPtr = gridPtr;
+        tasks[t].counts = gridPtr->counts;
+    }
+    /*
+     * The calling thread counts the first share into the element's
+     * grid.  The other threads get grids of their own.
+     */
+    for (t = 1; t < nThreads; t++) {
+        tasks[t].counts = Tcl_AttemptAlloc(gridBytes);
+        if (tasks[t].counts != NULL) {
+            memset(tasks[t].counts, 0, gridBytes);
+        }
+        if ((tasks[t].counts == NULL) ||
+            (Tcl_CreateThread(&threadIds[t], DensityThread, &tasks[t], TCL_THREAD_STACK_DEFAULT,
+                              TCL_THREAD_JOINABLE) != TCL_OK)) {
+            /* Count the share here instead. */
+            if (tasks[t].counts != NULL) {
+                ckfree(tasks[t].counts);
+            }
+            tasks[t].counts = gridPtr->counts;
+            CountDensity(&tasks[t]);
+            tasks[t].counts = NULL;
+        }
+    }
+    CountDensity(&tasks[0]);
+    for (t = 1; t < nThreads; t++) {
+        uint32_t *counts;
+
+        counts = tasks[t].counts;
+        if (counts == NULL) {
+            continue;
+        }
+        Tcl_JoinThread(threadIds[t], &result);
+        for (i = 0; i < nCells; i++) {
+            /* Saturate rather than wrap around. */
+            gridPtr->counts[i] = (counts[i] > UINT32_MAX - gridPtr->counts[i]) ? UINT32_MAX
+                                                                               : gridPtr->counts[i] + counts[i];
+        }
+        ckfree(counts);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CountDensity --
+ *
+ *      Maps a range of data points, a block at a time, and counts
+ *      those falling in each pixel of the grid.  Non-finite points
+ *      and points outside the plotting area aren't counted.
+ *
+ * Parameters:
+ *      DensityTask *taskPtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The counts of the task's grid are incremented.
+ *
+ *----------------------------------------------------------------------
+ */
+static void CountDensity(DensityTask *taskPtr) {
+    const DensityGrid *gridPtr = taskPtr->gridPtr;
+    Point2D *points;
+    unsigned char *keep;
+    Tcl_Size i, j, n;
+
+    points = Tcl_AttemptAlloc(DENSITY_BLOCK_POINTS * sizeof(*points));
+    keep = Tcl_AttemptAlloc(DENSITY_BLOCK_POINTS * sizeof(*keep));
+    if ((points == NULL) || (keep == NULL)) {
+        goto done;
+    }
+    for (i = taskPtr->first; i < taskPtr->last; i += n) {
+        n = MIN(taskPtr->last - i, DENSITY_BLOCK_POINTS);
+        if (Rbc_MapArray2D(taskPtr->graphPtr, taskPtr->axesPtr, taskPtr->x + i, taskPtr->y + i, n, points, keep) ==
+            0) {
+            continue;
+        }
+        for (j = 0; j < n; j++) {
+            double x, y;
+
+            x = points[j].x - gridPtr->x;
+            y = points[j].y - gridPtr->y;
+            if ((keep[j]) && (x >= 0.0) && (x < gridPtr->width) && (y >= 0.0) && (y < gridPtr->height)) {
+                uint32_t *countPtr;
+
+                countPtr = taskPtr->counts + (size_t)y * gridPtr->width + (size_t)x;
+                if (*countPtr < UINT32_MAX) {
+                    (*countPtr)++;
+                }
+            }
+        }
+    }
+done:
+    if (points != NULL) {
+        ckfree(points);
+    }
+    if (keep != NULL) {
+        ckfree(keep);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DensityThread --
+ *
+ *      Body of the threads started by MapDensity.
+ *
+ * Parameters:
+ *      ClientData clientData - Share of the points to count.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The thread exits once the points are counted.
+ *
+ *----------------------------------------------------------------------
+ */
+static Tcl_ThreadCreateType DensityThread(ClientData clientData) {
+    CountDensity(clientData);
+    Tcl_ExitThread(TCL_OK);
+    TCL_THREAD_CREATE_RETURN;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeDensityCounts --
+ *
+ *      Releases the counts of a density image.  The image itself is
+ *      kept until it's next drawn, since only the thread of the graph
+ *      may free it.
+ *
+ * Parameters:
+ *      DensityGrid *gridPtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+static void FreeDensityCounts(DensityGrid *gridPtr) {
+    if (gridPtr->counts != NULL) {
+        ckfree(gridPtr->counts);
+        gridPtr->counts = NULL;
+        gridPtr->stamp++;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DistanceToLine --
+ *
+ *      TODO: Description
+ *
+ * Parameters:
+ *      int x - Sample X coordinate.
+ *      int y - Sample Y coordinate.
+ *      Point2D *p - End point of the line segment.
+ *      Point2D *q - End point of the line segment.
+ *      Point2D *t - (out) Point on line segment.
+ *
+ * Results:
+ *      TODO: Results
+ *
+ * Side Effects:
+ *      TODO: Side Effects
+ *
+ *----------------------------------------------------------------------
+ */
+static double DistanceToLine(int x, int y, Point2D *p, Point2D *q, Point2D *t) {
+    Point2D sample;
+
+    sample.x = (double)x;
+    sample.y = (double)y;
+    return Rbc_GetClosestPointOnSegment(&sample, p, q, t);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DistanceToX --
+ *
+ *      TODO: Description
+ *
+ * Parameters:
+ *      int x - Sample X coordinate.
+ *      int y - Sample Y coordinate.
+ *      Point2D *p - End point of the line segment.
+ *      Point2D *q - End point of the line segment.
+ *      Point2D *t - (out) Point on line segment.
+ *
+ * Results:
+ *      TODO: Results
+ *
+ * Side Effects:
+ *      TODO: Side Effects
+ *
+ *----------------------------------------------------------------------
+ */
+static double DistanceToX(int x, int y, Point2D *p, Point2D *q, Point2D *t) {
+    double dx, dy;
+    double dist;
+
+    if (p->x > q->x) {
+        if ((x > p->x) || (x < q->x)) {
+            return DBL_MAX; /* X-coordinate outside line segment. */
+        }
+    } else {
+        if ((x > q->x) || (x < p->x)) {
+            return DBL_MAX; /* X-coordinate outside line segment. */
+        }
+    }
+    dx = p->x - q->x;
+    dy = p->y - q->y;
+    t->x = (double)x;
+    if (FABS(dx) < DBL_EPSILON) {
+        double d1, d2;
+        /* Same X-coordinate indicates a vertical line.  Pick the
+         * closest end point. */
+        d1 = p->y - y;
+        d2 = q->y - y;
+        if (FABS(d1) < FABS(d2)) {
+            t->y = p->y, dist = d1;
+        } else {
+            t->y = q->y, dist = d2;
+        }
+    } else if (FABS(dy) < DBL_EPSILON) {
+        /* Horizontal line. */
+        t->y = p->y, dist = p->y - y;
+    } else {
+        double m, b;
+
+        m = dy / dx;
+        b = p->y - (m * p->x);
+        t->y = (x * m) + b;
+        dist = y - t->y;
+    }
+    return FABS(dist);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DistanceToY --
+ *
+ *      TODO: Description
+ *
+ * Parameters:
+ *      int x - Sample X coordinate.
+ *      int y - Sample Y coordinate.
+ *      Point2D *p - End point of the line segment.
+ *      Point2D *q - End point of the line segment.
+ *      Point2D *t - (out) Point on line segment.
+ *
+ * Results:
+ *      TODO: Results
+ *
+ * Side Effects:
+ *      TODO: Side Effects
+ *
+ *----------------------------------------------------------------------
+ */
+static double DistanceToY(int x, int y, Point2D *p, Point2D *q, Point2D *t) {
+    double dx, dy;
+    double dist;
+
+    if (p->y > q->y) {
+        if ((y > p->y) || (y < q->y)) {
+            return DBL_MAX;
+        }
+    } else {
+        if ((y > q->y) || (y < p->y)) {
+            return DBL_MAX;
+        }
+    }
+    dx = p->x - q->x;
+    dy = p->y - q->y;
+    t->y = y;
+    if (FABS(dy) < DBL_EPSILON) {
+        double d1, d2;
+
+        /* Save Y-coordinate indicates an horizontal line. Pick the
+         * closest end point. */
+        d1 = p->x - x;
+        d2 = q->x - x;
+        if (FABS(d1) < FABS(d2)) {
+            t->x = p->x, dist = d1;
+        } else {
+            t->x = q->x, dist = d2;
+        }
+    } else if (FABS(dx) < DBL_EPSILON) {
+        /* Vertical line. */
+        t->x = p->x, dist = p->x - x;
+    } else {
+        double m, b;
+
+        m = dy / dx;
+        b = p->y - (m * p->x);
+        t->x = (y - b) / m;
+        dist = x - t->x;
+    }
+    return FABS(dist);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClosestTrace --
+ *
+ *      Find the line segment closest to the given window coordinate
+ *      in the element.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      Line *linePtr - Line element record
+ *      ClosestSearch *searchPtr - Info about closest point in element
+ *      DistanceProc *distProc
+ *
+ * Results:
+ *      If a new minimum distance is found, the information regarding
+ *      it is returned via searchPtr.
+ *
+ * Side Effects:
+ *      The element's segment grid may be built.
+ *
+ *----------------------------------------------------------------------
+ */
+static int ClosestTrace(Graph *graphPtr, Line *linePtr, ClosestSearch *searchPtr, DistanceProc *distProc) {
+    Point2D closest, b, p, q;
+    LineTrace *tracePtr;
+    ClosestGrid *gridPtr;
+    double dist, minDist;
+    TracePoint *screenPts;
+    Tcl_Size dataIndex;
+    Tcl_Size i;
+
+    gridPtr = GetSegmentGrid(linePtr, FALSE);
+    if (gridPtr != NULL) {
+        return SearchSegmentGrid(graphPtr, linePtr, gridPtr, searchPtr, distProc);
+    }
+    dataIndex = -1;
+    closest.x = closest.y = 0; /* Suppress compiler warning. */
+    minDist = searchPtr->dist;
+    for (tracePtr = linePtr->traces.runs; tracePtr < linePtr->traces.runs + linePtr->traces.nRuns; tracePtr++) {
+        screenPts = TRACE_POINTS(linePtr, tracePtr);
+        for (i = 0; i < (tracePtr->nScreenPts - 1); i++) {
+            p.x = screenPts[i].x;
+            p.y = screenPts[i].y;
+            q.x = screenPts[i + 1].x;
+            q.y = screenPts[i + 1].y;
+            dist = (*distProc)(searchPtr->x, searchPtr->y, &p, &q, &b);
+            if (dist < minDist) {
+                closest = b;
+                dataIndex = TRACE_DATA_INDEX(linePtr, tracePtr, i);
+                minDist = dist;
+            }
+        }
+    }
+    if (minDist < searchPtr->dist) {
+        searchPtr->dist = minDist;
+        searchPtr->elemPtr = &linePtr->core;
+        searchPtr->index = dataIndex;
+        searchPtr->point = Rbc_InvMap2D(graphPtr, closest.x, closest.y, &(linePtr->core.axes));
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClosestStrip --
+ *
+ *      Find the line segment closest to the given window coordinate
+ *      in the element.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      Line *linePtr - Line element record
+ *      ClosestSearch *searchPtr - Info about closest point in element
+ *      DistanceProc *distProc
+ *
+ * Results:
+ *      If a new minimum distance is found, the information regarding
+ *      it is returned via searchPtr.
+ *
+ * Side Effects:
+ *      The element's segment grid may be built.
+ *
+ *----------------------------------------------------------------------
+ */
+static int ClosestStrip(Graph *graphPtr, Line *linePtr, ClosestSearch *searchPtr, DistanceProc *distProc) {
+    Point2D closest, b;
+    ClosestGrid *gridPtr;
+    double dist, minDist;
+    Tcl_Size count;
+    register Segment2D *s;
+    Tcl_Size dataIndex;
+
+    gridPtr = GetSegmentGrid(linePtr, TRUE);
+    if (gridPtr != NULL) {
+        return SearchSegmentGrid(graphPtr, linePtr, gridPtr, searchPtr, distProc);
+    }
+    dataIndex = 0;
+    closest.x = closest.y = 0; /* compiler warning */
+    minDist = searchPtr->dist;
+    s = linePtr->strips;
+    for (count = 0; count < linePtr->nStrips; count++, s++) {
+        dist = (*distProc)(searchPtr->x, searchPtr->y, &(s->p), &(s->q), &b);
+        if (dist < minDist) {
+            closest = b;
+            dataIndex = linePtr->stripToData[count];
+            minDist = dist;
+        }
+    }
+    if (minDist < searchPtr->dist) {
+        searchPtr->dist = minDist;
+        searchPtr->elemPtr = &linePtr->core;
+        searchPtr->index = dataIndex;
+        searchPtr->point = Rbc_InvMap2D(graphPtr, closest.x, closest.y, &(linePtr->core.axes));
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PointDistance --
+ *
+ *      Measures the distance from the sample coordinate of a closest
+ *      search to a screen point, along the axes of the search.
+ *
+ * Parameters:
+ *      ClosestSearch *searchPtr
+ *      Point2D *pointPtr - Screen point
+ *
+ * Results:
+ *      Returns the distance in pixels, or DBL_MAX if the search has no
+ *      valid axes.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static double PointDistance(ClosestSearch *searchPtr, Point2D *pointPtr) {
+    double dx;
+    double dy;
+
+    dx = fabs((double)searchPtr->x - pointPtr->x);
+    dy = fabs((double)searchPtr->y - pointPtr->y);
+    switch (searchPtr->along) {
+    case SEARCH_BOTH:
+        return hypot(dx, dy);
+    case SEARCH_X:
+        return dx;
+    case SEARCH_Y:
+        return dy;
+    default:
+        return DBL_MAX;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClosestPoint --
+ *
+ *      Find the element whose data point is closest to the given screen
+ *      coordinate.
+ *
+ * Parameters:
+ *      Line *linePtr - Line element that we are looking at
+ *      ClosestSearch *searchPtr - Assorted information related to searching for the closest point
+ *
+ * Results:
+ *      If a new minimum distance is found, the information regarding
+ *      it is returned via searchPtr.
+ *
+ * Side Effects:
+ *      The element's point grid may be built.
+ *
+ *----------------------------------------------------------------------
+ */
+static void ClosestPoint(Line *linePtr, ClosestSearch *searchPtr) {
+    Point2D *pointPtr;
+    ClosestGrid *gridPtr;
+    double minDist;
+    Tcl_Size count;
+    Tcl_Size dataIndex;
+
+    minDist = searchPtr->dist;
+    dataIndex = -1;
+    /*
+     * Instead of testing each data point in graph coordinates, look at
+     * the array of mapped screen coordinates.  The advantages are:
+     *
+     * 1) only visible, unclipped points are examined;
+     * 2) distances are already measured in screen coordinates.
+     */
+    gridPtr = GetPointGrid(linePtr);
+    if (gridPtr != NULL) {
+        count = SearchPointGrid(linePtr, gridPtr, searchPtr, &minDist);
+        if (count >= 0) {
+            dataIndex = linePtr->symbolToData[count];
+        }
+    } else {
+        pointPtr = linePtr->symbolPts;
+        for (count = 0; count < linePtr->nSymbolPts; count++, pointPtr++) {
+            double dist;
+
+            dist = PointDistance(searchPtr, pointPtr);
+            if (dist < minDist) {
+                dataIndex = linePtr->symbolToData[count];
+                minDist = dist;
+            }
+        }
+    }
+    if ((dataIndex >= 0) && (minDist < searchPtr->dist)) {
+        searchPtr->elemPtr = &linePtr->core;
+        searchPtr->dist = minDist;
+        searchPtr->index = dataIndex;
+        searchPtr->point.x = linePtr->core.x.valueArr[dataIndex];
+        searchPtr->point.y = linePtr->core.y.valueArr[dataIndex];
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClosestDataPoint --
+ *
+ *      Finds the data point closest to the given screen coordinate
+ *      among all the points in view, not just the ones that were kept
+ *      when the element was decimated.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      Line *linePtr - Line element that we are looking at
+ *      ClosestSearch *searchPtr - Assorted information related to searching for the closest point
+ *
+ * Results:
+ *      If a new minimum distance is found, the information regarding
+ *      it is returned via searchPtr.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static void ClosestDataPoint(Graph *graphPtr, Line *linePtr, ClosestSearch *searchPtr) {
+    Extents2D exts;
+    const double *x;
+    const double *y;
+    double minDist;
+    Tcl_Size first, last;
+    Tcl_Size dataIndex;
+    Tcl_Size i;
+
+    if (!Rbc_GetElemVisibleRange(&linePtr->core, GetVisibleMargin(graphPtr, linePtr), &first, &last)) {
+        first = 0;
+        last = NumberOfPoints(&linePtr->core) - 1;
+    }
+    last = MIN(last, linePtr->mappedPoints - 1);
+    Rbc_GraphExtents(graphPtr, &exts);
+    x = linePtr->core.x.valueArr;
+    y = linePtr->core.y.valueArr;
+    minDist = searchPtr->dist;
+    dataIndex = -1;
+    for (i = first; i <= last; i++) {
+        Point2D point;
+        double dist;
+
+        if ((!FINITE(x[i])) || (!FINITE(y[i]))) {
+            continue;
+        }
+        point = Rbc_Map2D(graphPtr, x[i], y[i], &linePtr->core.axes);
+        if (!PointInRegion(&exts, point.x, point.y)) {
+            continue;
+        }
+        dist = PointDistance(searchPtr, &point);
+        if (dist < minDist) {
+            dataIndex = i;
+            minDist = dist;
+        }
+    }
+    if ((dataIndex >= 0) && (minDist < searchPtr->dist)) {
+        searchPtr->elemPtr = &linePtr->core;
+        searchPtr->dist = minDist;
+        searchPtr->index = dataIndex;
+        searchPtr->point.x = x[dataIndex];
+        searchPtr->point.y = y[dataIndex];
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClosestDataTrace --
+ *
+ *      Finds the line segment closest to the given screen coordinate
+ *      among the segments joining all the data points in view, not
+ *      just the ones that were kept when the element was decimated.
+ *      Strips join every pair of points; traces break where the data
+ *      runs against the pen direction.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      Line *linePtr - Line element record
+ *      ClosestSearch *searchPtr - Info about closest point in element
+ *      DistanceProc *distProc
+ *
+ * Results:
+ *      If a new minimum distance is found, the information regarding
+ *      it is returned via searchPtr.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static int ClosestDataTrace(Graph *graphPtr, Line *linePtr, ClosestSearch *searchPtr, DistanceProc *distProc) {
+    Extents2D exts;
+    Point2D closest, b, p, q;
+    const double *x;
+    const double *y;
+    double minDist;
+    Tcl_Size first, last;
+    Tcl_Size dataIndex;
+    Tcl_Size i;
+    int valid, strip;
+
+    if (!Rbc_GetElemVisibleRange(&linePtr->core, GetVisibleMargin(graphPtr, linePtr), &first, &last)) {
+        first = 0;
+        last = NumberOfPoints(&linePtr->core) - 1;
+    }
+    last = MIN(last, linePtr->mappedPoints - 1);
+    Rbc_GraphExtents(graphPtr, &exts);
+    x = linePtr->core.x.valueArr;
+    y = linePtr->core.y.valueArr;
+    strip = (linePtr->core.classUid == rbcStripElementUid);
+    dataIndex = -1;
+    closest.x = closest.y = 0; /* Suppress compiler warning. */
+    minDist = searchPtr->dist;
+    p.x = p.y = 0.0;
+    valid = FALSE;
+    for (i = first; i <= last; i++) {
+        Segment2D seg;
+        double dist;
+
+        if ((!FINITE(x[i])) || (!FINITE(y[i]))) {
+            valid = FALSE;
+            continue;
+        }
+        q = Rbc_Map2D(graphPtr, x[i], y[i], &linePtr->core.axes);
+        if ((valid) && (!strip) &&
+            (BROKEN_TRACE(linePtr->penDir, TraceAbscissa(graphPtr, linePtr, &p),
+                          TraceAbscissa(graphPtr, linePtr, &q)))) {
+            valid = FALSE;
+        }
+        if ((valid) && (Rbc_LineRectClip(&exts, &p, &q, &seg))) {
+            dist = (*distProc)(searchPtr->x, searchPtr->y, &seg.p, &seg.q, &b);
+            if (dist < minDist) {
+                closest = b;
+                dataIndex = i - 1;
+                minDist = dist;
+            }
+        }
+        p = q;
+        valid = TRUE;
+    }
+    if (minDist < searchPtr->dist) {
+        searchPtr->dist = minDist;
+        searchPtr->elemPtr = &linePtr->core;
+        searchPtr->index = dataIndex;
+        searchPtr->point = Rbc_InvMap2D(graphPtr, closest.x, closest.y, &(linePtr->core.axes));
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetSegmentEnds --
+ *
+ *      Returns the end points of a segment of a grid, as the points
+ *      closest searches measure distances to.
+ *
+ * Parameters:
+ *      const ClosestSegment *segPtr
+ *      Point2D *p - (out) First end point
+ *      Point2D *q - (out) Second end point
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static void GetSegmentEnds(const ClosestSegment *segPtr, Point2D *p, Point2D *q) {
+    p->x = segPtr->x1;
+    p->y = segPtr->y1;
+    q->x = segPtr->x2;
+    q->y = segPtr->y2;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetGridCell --
+ *
+ *      Finds the column and row of the grid cell holding a screen
+ *      coordinate.  Coordinates outside the grid are given the
+ *      nearest cell.
+ *
+ * Parameters:
+ *      ClosestGrid *gridPtr
+ *      double x - Screen X coordinate
+ *      double y - Screen Y coordinate
+ *      int *columnPtr - (out) Column of the cell
+ *      int *rowPtr - (out) Row of the cell
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static void GetGridCell(ClosestGrid *gridPtr, double x, double y, int *columnPtr, int *rowPtr) {
+    double column;
+    double row;
+
+    column = floor((x - gridPtr->left) / gridPtr->cellSize);
+    row = floor((y - gridPtr->top) / gridPtr->cellSize);
+    *columnPtr = (int)MIN(MAX(column, 0.0), (double)(gridPtr->nColumns - 1));
+    *rowPtr = (int)MIN(MAX(row, 0.0), (double)(gridPtr->nRows - 1));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewClosestGrid --
+ *
+ *      Builds a grid over the symbol points or the segments of an
+ *      element.  Each point is put in the cell holding it, and each
+ *      segment in every cell its bounding box covers, unless it
+ *      covers too many.
+ *
+ * Parameters:
+ *      Point2D *points - Symbol points, or NULL
+ *      Tcl_Size nPoints - Number of symbol points
+ *      ClosestSegment *segments - Segments, if points is NULL.  The
+ *                                 grid takes them over.
+ *      Tcl_Size nSegments - Number of segments
+ *
+ * Results:
+ *      Returns the new grid, or NULL if a coordinate isn't finite or
+ *      memory ran out.  The segments are freed in that case.
+ *
+ * Side Effects:
+ *      Memory is allocated for the grid.
+ *
+ *----------------------------------------------------------------------
+ */
+static ClosestGrid *NewClosestGrid(Point2D *points, Tcl_Size nPoints, ClosestSegment *segments,
+                                   Tcl_Size nSegments) {
+    ClosestGrid *gridPtr;
+    Extents2D exts;
+    Point2D p;
+    Point2D q;
+    Tcl_Size nItems;
+    Tcl_Size nCells;
+    Tcl_Size nCellItems;
+    Tcl_Size i;
+    Tcl_Size cell;
+    size_t bytes;
+    double width;
+    double height;
+    double columns;
+    double rows;
+    int c0, r0, c1, r1;
+    int column;
+    int row;
+    int pass;
+
+    nItems = (segments != NULL) ? nSegments : nPoints;
+    exts.left = exts.top = DBL_MAX;
+    exts.right = exts.bottom = -DBL_MAX;
+    for (i = 0; i < nItems; i++) {
+        if (segments != NULL) {
+            GetSegmentEnds(segments + i, &p, &q);
+        } else {
+            p = q = points[i];
+        }
+        if ((!FINITE(p.x)) || (!FINITE(p.y)) || (!FINITE(q.x)) || (!FINITE(q.y))) {
+            goto error;
+        }
+        exts.left = MIN(exts.left, MIN(p.x, q.x));
+        exts.right = MAX(exts.right, MAX(p.x, q.x));
+        exts.top = MIN(exts.top, MIN(p.y, q.y));
+        exts.bottom = MAX(exts.bottom, MAX(p.y, q.y));
+    }
+    gridPtr = RbcCalloc(1, sizeof(ClosestGrid));
+    if (gridPtr == NULL) {
+        goto error;
+    }
+    gridPtr->segments = segments;
+    gridPtr->nSegments = nSegments;
+
+    /*
+     * Size the cells for CLOSEST_GRID_CELL_ITEMS items each on
+     * average.  Bounding the cell size by the longer side as well
+     * keeps the number of cells below twice the number of items, even
+     * when the items lie on a line.
+     */
+    width = exts.right - exts.left;
+    height = exts.bottom - exts.top;
+    gridPtr->cellSize = sqrt(width * height * CLOSEST_GRID_CELL_ITEMS / (double)nItems);
+    gridPtr->cellSize = MAX(gridPtr->cellSize, MAX(width, height) * CLOSEST_GRID_CELL_ITEMS / (double)nItems);
+    gridPtr->cellSize = MAX(gridPtr->cellSize, 1.0);
+    columns = floor(width / gridPtr->cellSize) + 1.0;
+    rows = floor(height / gridPtr->cellSize) + 1.0;
+    if ((columns >= (double)INT_MAX) || (rows >= (double)INT_MAX) || ((columns * rows) >= (double)(TCL_SIZE_MAX / 2))) {
+        FreeClosestGrid(gridPtr);
+        return NULL;
+    }
+    gridPtr->left = exts.left;
+    gridPtr->top = exts.top;
+    gridPtr->nColumns = (int)columns;
+    gridPtr->nRows = (int)rows;
+    nCells = (Tcl_Size)gridPtr->nColumns * gridPtr->nRows;
+    if ((GetLineArrayByteCount(nCells + 1, sizeof(Tcl_Size), &bytes) != TCL_OK) ||
+        ((gridPtr->cellStart = Tcl_AttemptAlloc(bytes)) == NULL)) {
+        FreeClosestGrid(gridPtr);
+        return NULL;
+    }
+    memset(gridPtr->cellStart, 0, bytes);
+
+    /*
+     * Count the items of each cell on the first pass and store them on
+     * the second.  Counts go one cell ahead, so that summing them
+     * yields where each cell starts.
+     */
+    nCellItems = 0;
+    for (pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            for (cell = 0; cell < nCells; cell++) {
+                gridPtr->cellStart[cell + 1] += gridPtr->cellStart[cell];
+            }
+            nCellItems = gridPtr->cellStart[nCells];
+            if ((GetLineArrayByteCount(MAX(nCellItems, 1), sizeof(Tcl_Size), &bytes) != TCL_OK) ||
+                ((gridPtr->cellItems = Tcl_AttemptAlloc(bytes)) == NULL)) {
+                FreeClosestGrid(gridPtr);
+                return NULL;
+            }
+            if (gridPtr->nWideItems > 0) {
+                if ((GetLineArrayByteCount(gridPtr->nWideItems, sizeof(Tcl_Size), &bytes) != TCL_OK) ||
+                    ((gridPtr->wideItems = Tcl_AttemptAlloc(bytes)) == NULL)) {
+                    FreeClosestGrid(gridPtr);
+                    return NULL;
+                }
+                gridPtr->nWideItems = 0;
+            }
+        }
+        for (i = 0; i < nItems; i++) {
+            if (segments != NULL) {
+                GetSegmentEnds(segments + i, &p, &q);
+            } else {
+                p = q = points[i];
+            }
+            GetGridCell(gridPtr, MIN(p.x, q.x), MIN(p.y, q.y), &c0, &r0);
+            GetGridCell(gridPtr, MAX(p.x, q.x), MAX(p.y, q.y), &c1, &r1);
+            if (((Tcl_Size)(c1 - c0 + 1) * (r1 - r0 + 1)) > CLOSEST_GRID_MAX_SPAN) {
+                if (pass == 1) {
+                    gridPtr->wideItems[gridPtr->nWideItems] = i;
+                }
+                gridPtr->nWideItems++;
+                continue;
+            }
+            for (row = r0; row <= r1; row++) {
+                for (column = c0; column <= c1; column++) {
+                    cell = (Tcl_Size)row * gridPtr->nColumns + column;
+                    if (pass == 0) {
+                        gridPtr->cellStart[cell + 1]++;
+                    } else {
+                        gridPtr->cellItems[gridPtr->cellStart[cell]++] = i;
+                    }
+                }
+            }
+        }
+    }
+    /*
+     * Storing the items moved the start of each cell to the start of
+     * the next.  Move them back.
+     */
+    memmove(gridPtr->cellStart + 1, gridPtr->cellStart, (size_t)nCells * sizeof(Tcl_Size));
+    gridPtr->cellStart[0] = 0;
+    return gridPtr;
+
+error:
+    if (segments != NULL) {
+        ckfree(segments);
+    }
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeClosestGrid --
+ *
+ *      Frees a grid built by NewClosestGrid.
+ *
+ * Parameters:
+ *      ClosestGrid *gridPtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+static void FreeClosestGrid(ClosestGrid *gridPtr) {
+    if (gridPtr->cellStart != NULL) {
+        ckfree(gridPtr->cellStart);
+    }
+    if (gridPtr->cellItems != NULL) {
+        ckfree(gridPtr->cellItems);
+    }
+    if (gridPtr->wideItems != NULL) {
+        ckfree(gridPtr->wideItems);
+    }
+    if (gridPtr->segments != NULL) {
+        ckfree(gridPtr->segments);
+    }
+    ckfree(gridPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeClosestGrids --
+ *
+ *      Frees the closest search grids of an element, when its mapped
+ *      points change.
+ *
+ * Parameters:
+ *      Line *linePtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      The grids are built again by the next closest search.
+ *
+ *----------------------------------------------------------------------
+ */
+static void FreeClosestGrids(Line *linePtr) {
+    if (linePtr->pointGrid != NULL) {
+        FreeClosestGrid(linePtr->pointGrid);
+        linePtr->pointGrid = NULL;
+    }
+    if (linePtr->segmentGrid != NULL) {
+        FreeClosestGrid(linePtr->segmentGrid);
+        linePtr->segmentGrid = NULL;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetPointGrid --
+ *
+ *      Returns the grid over the symbol points of an element, building
+ *      it if needed.
+ *
+ * Parameters:
+ *      Line *linePtr
+ *
+ * Results:
+ *      Returns the grid, or NULL if the element has too few symbol
+ *      points to need one, or it can't be built.
+ *
+ * Side Effects:
+ *      The grid is kept until the mapped points change.
+ *
+ *----------------------------------------------------------------------
+ */
+static ClosestGrid *GetPointGrid(Line *linePtr) {
+    if ((linePtr->pointGrid == NULL) && (linePtr->nSymbolPts >= CLOSEST_GRID_MIN_ITEMS)) {
+        linePtr->pointGrid = NewClosestGrid(linePtr->symbolPts, linePtr->nSymbolPts, NULL, 0);
+    }
+    return linePtr->pointGrid;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetSegmentGrid --
+ *
+ *      Returns the grid over the trace segments, or the strips, of an
+ *      element, building it if needed.  The segments are numbered in
+ *      the order ClosestTrace and ClosestStrip examine them.
+ *
+ * Parameters:
+ *      Line *linePtr
+ *      int strips - If non-zero, index the strips of a strip element.
+ *
+ * Results:
+ *      Returns the grid, or NULL if the element has too few segments
+ *      to need one, or it can't be built.
+ *
+ * Side Effects:
+ *      The grid is kept until the mapped points change.
+ *
+ *----------------------------------------------------------------------
+ */
+static ClosestGrid *GetSegmentGrid(Line *linePtr, int strips) {
+    LineTrace *tracePtr;
+    ClosestSegment *segments;
+    ClosestSegment *segPtr;
+    Tcl_Size nSegments;
+    Tcl_Size i;
+    size_t bytes;
+
+    if (linePtr->segmentGrid != NULL) {
+        return linePtr->segmentGrid;
+    }
+    if (strips) {
+        nSegments = linePtr->nStrips;
+    } else {
+        nSegments = 0;
+        for (tracePtr = linePtr->traces.runs; tracePtr < linePtr->traces.runs + linePtr->traces.nRuns; tracePtr++) {
+            if (tracePtr->nScreenPts > 1) {
+                nSegments += tracePtr->nScreenPts - 1;
+            }
+        }
+    }
+    if (nSegments < CLOSEST_GRID_MIN_ITEMS) {
+        return NULL;
+    }
+    if ((GetLineArrayByteCount(nSegments, sizeof(ClosestSegment), &bytes) != TCL_OK) ||
+        ((segments = Tcl_AttemptAlloc(bytes)) == NULL)) {
+        return NULL;
+    }
+    segPtr = segments;
+    if (strips) {
+        for (i = 0; i < linePtr->nStrips; i++, segPtr++) {
+            segPtr->x1 = (float)linePtr->strips[i].p.x;
+            segPtr->y1 = (float)linePtr->strips[i].p.y;
+            segPtr->x2 = (float)linePtr->strips[i].q.x;
+            segPtr->y2 = (float)linePtr->strips[i].q.y;
+            segPtr->dataIndex = linePtr->stripToData[i];
+        }
+    } else {
+        for (tracePtr = linePtr->traces.runs; tracePtr < linePtr->traces.runs + linePtr->traces.nRuns; tracePtr++) {
+            TracePoint *screenPts;
+
+            screenPts = TRACE_POINTS(linePtr, tracePtr);
+            for (i = 0; i < (tracePtr->nScreenPts - 1); i++, segPtr++) {
+                segPtr->x1 = screenPts[i].x;
+                segPtr->y1 = screenPts[i].y;
+                segPtr->x2 = screenPts[i + 1].x;
+                segPtr->y2 = screenPts[i + 1].y;
+                segPtr->dataIndex = TRACE_DATA_INDEX(linePtr, tracePtr, i);
+            }
+        }
+    }
+    linePtr->segmentGrid = NewClosestGrid(NULL, 0, segments, nSegments);
+    return linePtr->segmentGrid;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetSearchCells --
+ *
+ *      Finds the range of grid cells that can hold items within the
+ *      given distance of the sample coordinate of a closest search.
+ *
+ * Parameters:
+ *      ClosestGrid *gridPtr
+ *      ClosestSearch *searchPtr
+ *      double dist - Search distance
+ *      int alongX - Include every row if non-zero
+ *      int alongY - Include every column if non-zero
+ *      int *cellsPtr - (out) First column and row, and last column
+ *                      and row of the range
+ *
+ * Results:
+ *      Returns FALSE if no cell is in range.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static int GetSearchCells(ClosestGrid *gridPtr, ClosestSearch *searchPtr, double dist, int alongX, int alongY,
+                          int *cellsPtr) {
+    double x0, y0, x1, y1;
+
+    x0 = (double)searchPtr->x - dist;
+    x1 = (double)searchPtr->x + dist;
+    y0 = (double)searchPtr->y - dist;
+    y1 = (double)searchPtr->y + dist;
+    if (alongY) {
+        x0 = -DBL_MAX, x1 = DBL_MAX;
+    }
+    if (alongX) {
+        y0 = -DBL_MAX, y1 = DBL_MAX;
+    }
+    if ((x1 < gridPtr->left) || (y1 < gridPtr->top) ||
+        (x0 > (gridPtr->left + gridPtr->nColumns * gridPtr->cellSize)) ||
+        (y0 > (gridPtr->top + gridPtr->nRows * gridPtr->cellSize))) {
+        return FALSE;
+    }
+    GetGridCell(gridPtr, x0, y0, cellsPtr, cellsPtr + 1);
+    GetGridCell(gridPtr, x1, y1, cellsPtr + 2, cellsPtr + 3);
+    return TRUE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SearchPointGrid --
+ *
+ *      Finds the symbol point closest to the sample coordinate of a
+ *      closest search, examining only the grid cells within the
+ *      search distance.  Of points equally close, the first is
+ *      chosen, as a plain scan would.
+ *
+ * Parameters:
+ *      Line *linePtr
+ *      ClosestGrid *gridPtr - Grid over the symbol points
+ *      ClosestSearch *searchPtr
+ *      double *minDistPtr - Search distance.  Returns the distance
+ *                           of the point found.
+ *
+ * Results:
+ *      Returns the index of the closest symbol point, or -1 if none
+ *      is closer than the search distance.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static Tcl_Size SearchPointGrid(Line *linePtr, ClosestGrid *gridPtr, ClosestSearch *searchPtr,
+                                double *minDistPtr) {
+    Tcl_Size closest;
+    Tcl_Size i;
+    Tcl_Size item;
+    double dist;
+    int cells[4];
+    int column;
+    int row;
+
+    closest = -1;
+    if (!GetSearchCells(gridPtr, searchPtr, *minDistPtr, (searchPtr->along == SEARCH_X),
+                        (searchPtr->along == SEARCH_Y), cells)) {
+        return -1;
+    }
+    if ((cells[0] == 0) && (cells[1] == 0) && (cells[2] == (gridPtr->nColumns - 1)) &&
+        (cells[3] == (gridPtr->nRows - 1))) {
+        /*
+         * Every cell is in range.  Scan the points themselves, so that
+         * none is examined twice.
+         */
+        for (i = 0; i < linePtr->nSymbolPts; i++) {
+            dist = PointDistance(searchPtr, linePtr->symbolPts + i);
+            if (dist < *minDistPtr) {
+                closest = i;
+                *minDistPtr = dist;
+            }
+        }
+        return closest;
+    }
+    for (row = cells[1]; row <= cells[3]; row++) {
+        for (column = cells[0]; column <= cells[2]; column++) {
+            Tcl_Size cell;
+
+            cell = (Tcl_Size)row * gridPtr->nColumns + column;
+            for (i = gridPtr->cellStart[cell]; i < gridPtr->cellStart[cell + 1]; i++) {
+                item = gridPtr->cellItems[i];
+                dist = PointDistance(searchPtr, linePtr->symbolPts + item);
+                if ((dist < *minDistPtr) || ((dist == *minDistPtr) && (closest >= 0) && (item < closest))) {
+                    closest = item;
+                    *minDistPtr = dist;
+                }
+            }
+        }
+    }
+    return closest;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SearchSegmentGrid --
+ *
+ *      Finds the trace segment or strip closest to the sample
+ *      coordinate of a closest search, examining only the grid cells
+ *      within the search distance and the segments kept out of the
+ *      cells.  Of segments equally close, the first is chosen, as
+ *      ClosestTrace and ClosestStrip would.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      Line *linePtr - Line element record
+ *      ClosestGrid *gridPtr - Grid over the segments
+ *      ClosestSearch *searchPtr - Info about closest point in element
+ *      DistanceProc *distProc
+ *
+ * Results:
+ *      If a new minimum distance is found, the information regarding
+ *      it is returned via searchPtr.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static int SearchSegmentGrid(Graph *graphPtr, Line *linePtr, ClosestGrid *gridPtr, ClosestSearch *searchPtr,
+                             DistanceProc *distProc) {
+    ClosestSegment *segPtr;
+    Point2D closest, b, p, q;
+    Tcl_Size closestItem;
+    Tcl_Size i;
+    Tcl_Size item;
+    double dist, minDist;
+    int cells[4];
+    int column;
+    int row;
+
+    closestItem = -1;
+    closest.x = closest.y = 0; /* Suppress compiler warning. */
+    minDist = searchPtr->dist;
+    /*
+     * A segment within the search distance has a point within it on
+     * both axes, even when the distance is measured along one.
+     */
+    if (GetSearchCells(gridPtr, searchPtr, minDist, FALSE, FALSE, cells)) {
+        if ((cells[0] == 0) && (cells[1] == 0) && (cells[2] == (gridPtr->nColumns - 1)) &&
+            (cells[3] == (gridPtr->nRows - 1))) {
+            /*
+             * Every cell is in range.  Scan the segments themselves,
+             * so that none is examined twice.
+             */
+            for (item = 0, segPtr = gridPtr->segments; item < gridPtr->nSegments; item++, segPtr++) {
+                GetSegmentEnds(segPtr, &p, &q);
+                dist = (*distProc)(searchPtr->x, searchPtr->y, &p, &q, &b);
+                if (dist < minDist) {
+                    closest = b;
+                    closestItem = item;
+                    minDist = dist;
+                }
+            }
+        } else {
+            for (row = cells[1]; row <= cells[3]; row++) {
+                for (column = cells[0]; column <= cells[2]; column++) {
+                    Tcl_Size cell;
+
+                    cell = (Tcl_Size)row * gridPtr->nColumns + column;
+                    for (i = gridPtr->cellStart[cell]; i < gridPtr->cellStart[cell + 1]; i++) {
+                        item = gridPtr->cellItems[i];
+                        segPtr = gridPtr->segments + item;
+                        GetSegmentEnds(segPtr, &p, &q);
+                        dist = (*distProc)(searchPtr->x, searchPtr->y, &p, &q, &b);
+                        if ((dist < minDist) || ((dist == minDist) && (closestItem >= 0) && (item < closestItem))) {
+                            closest = b;
+                            closestItem = item;
+                            minDist = dist;
+                        }
+                    }
+                }
+            }
+            for (i = 0; i < gridPtr->nWideItems; i++) {
+                item = gridPtr->wideItems[i];
+                segPtr = gridPtr->segments + item;
+                GetSegmentEnds(segPtr, &p, &q);
+                dist = (*distProc)(searchPtr->x, searchPtr->y, &p, &q, &b);
+                if ((dist < minDist) || ((dist == minDist) && (closestItem >= 0) && (item < closestItem))) {
+                    closest = b;
+                    closestItem = item;
+                    minDist = dist;
+                }
+            }
+        }
+    }
+    if (closestItem >= 0) {
+        searchPtr->dist = minDist;
+        searchPtr->elemPtr = &linePtr->core;
+        searchPtr->index = gridPtr->segments[closestItem].dataIndex;
+        searchPtr->point = Rbc_InvMap2D(graphPtr, closest.x, closest.y, &(linePtr->core.axes));
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetLineExtents --
+ *
+ *      Retrieves the range of the line element
+ *
+ * Parameters:
+ *      Element *elemPtr
+ *      Extents2D *extsPtr
+ *
+ * Results:
+ *      Returns the number of data points in the element.
+ *
+ * Side Effects:
+ *      TODO: Side Effects
+ *
+ *----------------------------------------------------------------------
+ */
+static void GetLineExtents(Element *elemPtr, Extents2D *extsPtr) {
+    Tcl_Size nPoints;
+
+    extsPtr->top = extsPtr->left = DBL_MAX;
+    extsPtr->bottom = extsPtr->right = -DBL_MAX;
+
+    nPoints = NumberOfPoints(elemPtr);
+    if (nPoints < 1) {
+        return;
+    }
+    extsPtr->right = elemPtr->x.max;
+    if ((elemPtr->x.min <= 0.0) && (elemPtr->axes.x->logScale)) {
+        extsPtr->left = Rbc_FindElemVectorMinimum(&elemPtr->x, DBL_MIN);
+    } else {
+        extsPtr->left = elemPtr->x.min;
+    }
+    extsPtr->bottom = elemPtr->y.max;
+    if ((elemPtr->y.min <= 0.0) && (elemPtr->axes.y->logScale)) {
+        extsPtr->top = Rbc_FindElemVectorMinimum(&elemPtr->y, DBL_MIN);
+    } else {
+        extsPtr->top = elemPtr->y.min;
+    }
+    Rbc_ExpandErrorBarExtents(elemPtr, extsPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TileChangedProc
+ *
+ *      Rebuilds the designated GC with the new tile pixmap.
+ *
+ * Parameters:
+ *      ClientData clientData
+ *      Rbc_Tile tile - Not used.
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      TODO: Side Effects
+ *
+ *----------------------------------------------------------------------
+ */
+static void TileChangedProc(ClientData clientData, Rbc_Tile tile) {
+    Line *linePtr = clientData;
+    Graph *graphPtr;
+
+    graphPtr = linePtr->core.graphPtr;
+    if (graphPtr->tkwin != NULL) {
+        graphPtr->flags |= REDRAW_WORLD;
+        Rbc_EventuallyRedrawGraph(graphPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ConfigureLine --
+ *
+ *      Sets up the appropriate configuration parameters in the GC.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Element *elemPtr
+ *
+ * Results:
+ *      The return value is a standard Tcl result.  If TCL_ERROR is
+ *      returned, then the interpreter result contains an error message.
+ *
+ * Side effects:
+ *      Configuration information such as line width, line style, color
+ *      etc. get set in a new GC.
+ *
+ *----------------------------------------------------------------------
+ */
+static int ConfigureLine(Graph *graphPtr, Element *elemPtr) {
+    Line *linePtr;
+    ElemDataTransaction dataTransaction;
+    ElemPenTransaction penTransaction;
+    ElemAxisTransaction axisTransaction;
+    ElemStateTransaction stateTransaction;
+    ElemTagsTransaction tagsTransaction;
+    ElemStylesTransaction stylesTransaction;
+    LineScalarTransaction scalarTransaction;
+    LineAreaTransaction areaTransaction;    
+    Rbc_ChainLink *linkPtr;
+    int dataTransactionPrepared;
+    int penTransactionPrepared;
+    int axisTransactionPrepared;
+    int stateTransactionPrepared;
+    int tagsTransactionPrepared;
+    int stylesTransactionPrepared;
+    int scalarTransactionPrepared;
+    int areaTransactionPrepared;    
+
+    linePtr = LINE_FROM_CORE(elemPtr);
+
+    memset(&dataTransaction, 0, sizeof(dataTransaction));
+    memset(&penTransaction, 0, sizeof(penTransaction));
+    memset(&axisTransaction, 0, sizeof(axisTransaction));
+    memset(&stateTransaction, 0, sizeof(stateTransaction));
+    memset(&tagsTransaction, 0, sizeof(tagsTransaction));
+    memset(&stylesTransaction, 0, sizeof(stylesTransaction));
+    memset(&scalarTransaction, 0, sizeof(scalarTransaction));
+    memset(&areaTransaction, 0, sizeof(areaTransaction));
+
+    dataTransactionPrepared = FALSE;
+    penTransactionPrepared = FALSE;
+    axisTransactionPrepared = FALSE;
+    stateTransactionPrepared = FALSE;
+    tagsTransactionPrepared = FALSE;
+    stylesTransactionPrepared = FALSE;
+    scalarTransactionPrepared = FALSE;
+    areaTransactionPrepared = FALSE;
+
+    /*
+     * Parse all data-vector replacements before modifying the live
+     * element.
+     */
+    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_DATA_MASK))) {
+        if (Rbc_PrepareElemDataTransaction(graphPtr, elemPtr, &dataTransaction) != TCL_OK) {
+            goto error;
+        }
+
+        dataTransactionPrepared = TRUE;
+    }
+
+    /*
+     * Resolve named active and normal pens before modifying the live
+     * element. Line and strip elements both require line-type pens.
+     */
+    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_PEN_MASK))) {
+        if (Rbc_PrepareElemPenTransaction(graphPtr, elemPtr, rbcLineElementUid, &penTransaction) != TCL_OK) {
+            goto error;
+        }
+
+        penTransactionPrepared = TRUE;
+    }
+
+    /*
+     * Resolve the X and Y axis mappings before modifying the live
+     * element.
+     */
+    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_AXES_MASK))) {
+        if (Rbc_PrepareElemAxisTransaction(graphPtr, elemPtr, &axisTransaction) != TCL_OK) {
+            goto error;
+        }
+
+        axisTransactionPrepared = TRUE;
+    }
+
+    /*
+     * Parse the element state before modifying the live element.
+     *
+     * Strip elements have no -state entry in their modern option table,
+     * so stateObjPtr remains NULL and this transaction stages nothing for
+     * them during initial configuration.
+     */
+    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_STATE_MASK))) {
+        if (Rbc_PrepareElemStateTransaction(graphPtr, elemPtr, &stateTransaction) != TCL_OK) {
+            goto error;
+        }
+
+        stateTransactionPrepared = TRUE;
+    }
+
+    /*
+     * Parse the element bind tags before modifying the live element.
+     *
+     * Both line and strip elements expose -bindtags in their modern
+     * option tables.
+     */
+    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_TAGS_MASK))) {
+        if (Rbc_PrepareElemTagsTransaction(graphPtr, elemPtr, &tagsTransaction) != TCL_OK) {
+            goto error;
+        }
+
+        tagsTransactionPrepared = TRUE;
+    }
+
+    /*
+     * Parse the element's weighted pen styles before modifying the live
+     * palette.
+     *
+     * Line and strip elements both use line pens and LinePenStyle palette
+     * records.
+     */
+    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_STYLES_MASK))) {
+        if (Rbc_PrepareElemStylesTransaction(graphPtr, elemPtr, rbcLineElementUid, sizeof(LinePenStyle),
+                                             &stylesTransaction) != TCL_OK) {
+            goto error;
+        }
+
+        stylesTransactionPrepared = TRUE;
+    }
+
+    /*
+     * Parse line-specific scalar values before modifying the live element.
+     *
+     * Both line and strip elements expose -maxsymbols and -smooth. Only
+     * graph line elements expose -trace.
+     */
+    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_SCALAR_MASK))) {
+        if (PrepareLineScalarTransaction(graphPtr, elemPtr, linePtr, &scalarTransaction) != TCL_OK) {
+            goto error;
+        }
+
+        scalarTransactionPrepared = TRUE;
+    }
+
+    /*
+     * Resolve line-area resources and construct the replacement fill GC
+     * before modifying the live element.
+     *
+     * Strip elements have no area options, but initial modern
+     * configuration may still construct their empty fill GC.
+     */
+    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_AREA_MASK))) {
+        if (PrepareLineAreaTransaction(graphPtr, elemPtr, linePtr, &areaTransaction) != TCL_OK) {
+            goto error;
+        }
+
+        areaTransactionPrepared = TRUE;
+    }
+
+    /*
+     * Configure the embedded line pen only when its options may have
+     * changed.
+     */
+    if (!elemPtr->optionsConfigured || (elemPtr->optionMask & LINE_ELEM_BUILTIN_PEN_MASK)) {
+        if (ConfigurePen(graphPtr, &linePtr->builtinPen.core) != TCL_OK) {
+            goto error;
+        }
+    }
+
+    /*
+     * No remaining operation before palette synchronisation can report a
+     * Tcl configuration error. Transfer all staged values and references
+     * to the live element.
+     */
+    if (axisTransactionPrepared) {
+        Rbc_CommitElemAxisTransaction(graphPtr, elemPtr, &axisTransaction);
+    }
+
+    if (penTransactionPrepared) {
+        Rbc_CommitElemPenTransaction(graphPtr, elemPtr, &linePtr->builtinPen.core, &penTransaction);
+    }
+
+    if (stateTransactionPrepared) {
+        Rbc_CommitElemStateTransaction(elemPtr, &stateTransaction);
+    }
+
+    if (tagsTransactionPrepared) {
+        Rbc_CommitElemTagsTransaction(elemPtr, &tagsTransaction);
+    }
+    
+    if (stylesTransactionPrepared) {
+        Rbc_CommitElemStylesTransaction(graphPtr, elemPtr, &stylesTransaction);
+    }
+
+    if (scalarTransactionPrepared) {
+        CommitLineScalarTransaction(linePtr, &scalarTransaction);
+    }
+
+    if (areaTransactionPrepared) {
+        CommitLineAreaTransaction(graphPtr, linePtr, &areaTransaction);
+    }
+
+    assert(elemPtr->normalPenPtr != NULL);
+
+    linkPtr = Rbc_ChainFirstLink(elemPtr->palette);
+
+    if (linkPtr != NULL) {
+        LinePenStyle *stylePtr;
+
+        stylePtr = Rbc_ChainGetValue(linkPtr);
+        stylePtr->penPtr = LINE_PEN_FROM_CORE(elemPtr->normalPenPtr);
+    }
+
+    /*
+     * Nothing below this point can fail. Commit the staged vectors and
+     * synchronize their retained Tcl representations.
+     */
+    if (dataTransactionPrepared) {
+        Rbc_CommitElemDataTransaction(elemPtr, &dataTransaction);
+
+        Rbc_SyncElemDataOptionObjects(elemPtr);
+    }
+
+    if (!elemPtr->optionsConfigured || (elemPtr->optionMask & LINE_ELEM_SCALE_SYMBOL_MASK)) {
+        elemPtr->flags |= MAP_STYLE | SCALE_SYMBOL;
+    }
+
+    /*
+     * Pen and style changes keep the mapped points. MapLine decides
+     * whether they still fit the new pens.
+     */
+    if (elemPtr->optionMask & (LINE_ELEM_BUILTIN_PEN_MASK | LINE_ELEM_MAP_STYLE_MASK)) {
+        elemPtr->flags |= MAP_STYLE;
+    }
+
+    if (!elemPtr->optionsConfigured || (elemPtr->optionMask & LINE_ELEM_MAP_ITEM_MASK)) {
+        elemPtr->flags |= MAP_ITEM;
+    }
+
+    return TCL_OK;
+
+error:
+    if (areaTransactionPrepared) {
+        FreeLineAreaTransaction(graphPtr, &areaTransaction);
+    }
+
+    if (stylesTransactionPrepared) {
+        Rbc_FreeElemStylesTransaction(graphPtr, &stylesTransaction);
     }
-    return FABS(dist);
-}
 
-/*
- *----------------------------------------------------------------------
- *
- * DistanceToY --
- *
- *      TODO: Description
- *
- * Parameters:
- *      int x - Sample X coordinate.
- *      int y - Sample Y coordinate.
- *      Point2D *p - End point of the line segment.
- *      Point2D *q - End point of the line segment.
- *      Point2D *t - (out) Point on line segment.
- *
- * Results:
- *      TODO: Results
- *
- * Side Effects:
- *      TODO: Side Effects
- *
- *----------------------------------------------------------------------
- */
-static double DistanceToY(int x, int y, Point2D *p, Point2D *q, Point2D *t) {
-    double dx, dy;
-    double dist;
+    if (tagsTransactionPrepared) {
+        Rbc_FreeElemTagsTransaction(&tagsTransaction);
+    }
 
-    if (p->y > q->y) {
-        if ((y > p->y) || (y < q->y)) {
-            return DBL_MAX;
-        }
-    } else {
-        if ((y > q->y) || (y < p->y)) {
-            return DBL_MAX;
-        }
+    if (axisTransactionPrepared) {
+        Rbc_FreeElemAxisTransaction(graphPtr, &axisTransaction);
     }
-    dx = p->x - q->x;
-    dy = p->y - q->y;
-    t->y = y;
-    if (FABS(dy) < DBL_EPSILON) {
-        double d1, d2;
 
-        /* Save Y-coordinate indicates an horizontal line. Pick the
-         * closest end point. */
-        d1 = p->x - x;
-        d2 = q->x - x;
-        if (FABS(d1) < FABS(d2)) {
-            t->x = p->x, dist = d1;
-        } else {
-            t->x = q->x, dist = d2;
-        }
-    } else if (FABS(dx) < DBL_EPSILON) {
-        /* Vertical line. */
-        t->x = p->x, dist = p->x - x;
-    } else {
-        double m, b;
+    if (penTransactionPrepared) {
+        Rbc_FreeElemPenTransaction(graphPtr, &penTransaction);
+    }
 
-        m = dy / dx;
-        b = p->y - (m * p->x);
-        t->x = (y - b) / m;
-        dist = x - t->x;
+    if (dataTransactionPrepared) {
+        Rbc_FreeElemDataTransaction(&dataTransaction);
     }
-    return FABS(dist);
+
+    return TCL_ERROR;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * ClosestTrace --
+ * ClosestLine --
  *
- *      Find the line segment closest to the given window coordinate
- *      in the element.
+ *      Find the closest point or line segment (if interpolated) to
+ *      the given window coordinate in the line element.
  *
  * Parameters:
  *      Graph *graphPtr - Graph widget record
- *      Line *linePtr - Line element record
+ *      Element *elemPtr - Element to examine
  *      ClosestSearch *searchPtr - Info about closest point in element
- *      DistanceProc *distProc
  *
  * Results:
- *      If a new minimum distance is found, the information regarding
- *      it is returned via searchPtr.
+ *      Returns the distance of the closest point among other
+ *      information.
  *
  * Side Effects:
  *      TODO: Side Effects
  *
  *----------------------------------------------------------------------
  */
-static int ClosestTrace(Graph *graphPtr, Line *linePtr, ClosestSearch *searchPtr, DistanceProc *distProc) {
-    Rbc_ChainLink *linkPtr;
-    Point2D closest, b;
-    LineTrace *tracePtr;
-    double dist, minDist;
-    register Point2D *pointPtr, *endPtr;
-    Tcl_Size dataIndex;
+static void ClosestLine(Graph *graphPtr, Element *elemPtr, ClosestSearch *searchPtr) {
+    Line *linePtr = LINE_FROM_CORE(elemPtr);
+    int mode;
 
-    dataIndex = -1;
-    closest.x = closest.y = 0; /* Suppress compiler warning. */
-    minDist = searchPtr->dist;
-    for (linkPtr = Rbc_ChainFirstLink(linePtr->traces); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
-        tracePtr = Rbc_ChainGetValue(linkPtr);
-        for (pointPtr = tracePtr->screenPts, endPtr = tracePtr->screenPts + (tracePtr->nScreenPts - 1);
-             pointPtr < endPtr; pointPtr++) {
-            dist = (*distProc)(searchPtr->x, searchPtr->y, pointPtr, pointPtr + 1, &b);
-            if (dist < minDist) {
-                closest = b;
-                dataIndex = tracePtr->symbolToData[pointPtr - tracePtr->screenPts];
-                minDist = dist;
-            }
+    mode = searchPtr->mode;
+    if (mode == SEARCH_AUTO) {
+        LinePen *penPtr = LINE_PEN_FROM_CORE(elemPtr->normalPenPtr);
+
+        mode = SEARCH_POINTS;
+        if ((NumberOfPoints(elemPtr) > 1) && (penPtr->traceWidth > 0)) {
+            mode = SEARCH_TRACES;
         }
     }
-    if (minDist < searchPtr->dist) {
-        searchPtr->dist = minDist;
-        searchPtr->elemPtr = &linePtr->core;
-        searchPtr->index = dataIndex;
-        searchPtr->point = Rbc_InvMap2D(graphPtr, closest.x, closest.y, &(linePtr->core.axes));
-        return TRUE;
+    if (mode == SEARCH_POINTS) {
+        if (linePtr->decimated) {
+            ClosestDataPoint(graphPtr, linePtr, searchPtr);
+        } else {
+            ClosestPoint(linePtr, searchPtr);
+        }
+    } else {
+        DistanceProc *distProc;
+        int found;
+
+        if (searchPtr->along == SEARCH_X) {
+            distProc = DistanceToX;
+        } else if (searchPtr->along == SEARCH_Y) {
+            distProc = DistanceToY;
+        } else {
+            distProc = DistanceToLine;
+        }
+        if (linePtr->decimated) {
+            found = ClosestDataTrace(graphPtr, linePtr, searchPtr, distProc);
+        } else if (elemPtr->classUid == rbcStripElementUid) {
+            found = ClosestStrip(graphPtr, linePtr, searchPtr, distProc);
+        } else {
+            found = ClosestTrace(graphPtr, linePtr, searchPtr, distProc);
+        }
+        if ((!found) && (searchPtr->along != SEARCH_BOTH)) {
+            if (linePtr->decimated) {
+                ClosestDataPoint(graphPtr, linePtr, searchPtr);
+            } else {
+                ClosestPoint(linePtr, searchPtr);
+            }
+        }
     }
-    return FALSE;
 }
 
 /*
- *----------------------------------------------------------------------
- *
- * ClosestStrip --
- *
- *      Find the line segment closest to the given window coordinate
- *      in the element.
- *
- * Parameters:
- *      Graph *graphPtr - Graph widget record
- *      Line *linePtr - Line element record
- *      ClosestSearch *searchPtr - Info about closest point in element
- *      DistanceProc *distProc
- *
- * Results:
- *      If a new minimum distance is found, the information regarding
- *      it is returned via searchPtr.
- *
- * Side Effects:
- *      TODO: Side Effects
- *
- *----------------------------------------------------------------------
+ * XDrawLines() points: XMaxRequestSize(dpy) - 3
+ * XFillPolygon() points:  XMaxRequestSize(dpy) - 4
+ * XDrawSegments() segments:  (XMaxRequestSize(dpy) - 3) / 2
+ * XDrawRectangles() rectangles:  (XMaxRequestSize(dpy) - 3) / 2
+ * XFillRectangles() rectangles:  (XMaxRequestSize(dpy) - 3) / 2
+ * XDrawArcs() or XFillArcs() arcs:  (XMaxRequestSize(dpy) - 3) / 3
  */
-static int ClosestStrip(Graph *graphPtr, Line *linePtr, ClosestSearch *searchPtr, DistanceProc *distProc) {
-    Point2D closest, b;
-    double dist, minDist;
-    Tcl_Size count;
-    register Segment2D *s;
-    Tcl_Size dataIndex;
 
-    dataIndex = 0;
-    closest.x = closest.y = 0; /* compiler warning */
-    minDist = searchPtr->dist;
-    s = linePtr->strips;
-    for (count = 0; count < linePtr->nStrips; count++, s++) {
-        dist = (*distProc)(searchPtr->x, searchPtr->y, &(s->p), &(s->q), &b);
-        if (dist < minDist) {
-            closest = b;
-            dataIndex = linePtr->stripToData[count];
-            minDist = dist;
-        }
-    }
-    if (minDist < searchPtr->dist) {
-        searchPtr->dist = minDist;
-        searchPtr->elemPtr = &linePtr->core;
-        searchPtr->index = dataIndex;
-        searchPtr->point = Rbc_InvMap2D(graphPtr, closest.x, closest.y, &(linePtr->core.axes));
-        return TRUE;
-    }
-    return FALSE;
-}
+#define MAX_DRAWLINES(d) Rbc_MaxRequestSize(d, sizeof(XPoint))
+#define MAX_DRAWPOLYGON(d) Rbc_MaxRequestSize(d, sizeof(XPoint))
+#define MAX_DRAWSEGMENTS(d) Rbc_MaxRequestSize(d, sizeof(XSegment))
+#define MAX_DRAWRECTANGLES(d) Rbc_MaxRequestSize(d, sizeof(XRectangle))
+#define MAX_DRAWARCS(d) Rbc_MaxRequestSize(d, sizeof(XArc))
 
 /*
- *----------------------------------------------------------------------
- *
- * ClosestPoint --
- *
- *      Find the element whose data point is closest to the given screen
- *      coordinate.
- *
- * Parameters:
- *      Line *linePtr - Line element that we are looking at
- *      ClosestSearch *searchPtr - Assorted information related to searching for the closest point
- *
- * Results:
- *      If a new minimum distance is found, the information regarding
- *      it is returned via searchPtr.
- *
- * Side Effects:
- *      TODO: Side Effects
- *
- *----------------------------------------------------------------------
+ * Symbols are stamped from sprites once at least SPRITE_MIN_SYMBOLS
+ * are drawn together, and only if the symbol fits in a square of
+ * SPRITE_MAX_WIDTH pixels.
  */
-static void ClosestPoint(Line *linePtr, ClosestSearch *searchPtr) {
-    Point2D *pointPtr;
-    double minDist;
-    Tcl_Size count;
-    Tcl_Size dataIndex;
+#define SPRITE_MIN_SYMBOLS 4096
+#define SPRITE_MAX_WIDTH 255
 
-    minDist = searchPtr->dist;
-    dataIndex = -1;
-    /*
-     * Instead of testing each data point in graph coordinates, look at
-     * the array of mapped screen coordinates.  The advantages are:
-     *
-     * 1) only visible, unclipped points are examined;
-     * 2) distances are already measured in screen coordinates.
-     */
-    pointPtr = linePtr->symbolPts;
-    for (count = 0; count < linePtr->nSymbolPts; count++, pointPtr++) {
-        double dx;
-        double dy;
-        double dist;
-
-        dx = fabs((double)searchPtr->x - pointPtr->x);
-        dy = fabs((double)searchPtr->y - pointPtr->y);
-        switch (searchPtr->along) {
-        case SEARCH_BOTH:
-            dist = hypot(dx, dy);
-            break;
-        case SEARCH_X:
-            dist = dx;
-            break;
-        case SEARCH_Y:
-            dist = dy;
-            break;
-        default:
-            continue;
-        }
-        if (dist < minDist) {
-            dataIndex = linePtr->symbolToData[count];
-            minDist = dist;
-        }
-    }
-    if ((dataIndex >= 0) && (minDist < searchPtr->dist)) {
-        searchPtr->elemPtr = &linePtr->core;
-        searchPtr->dist = minDist;
-        searchPtr->index = dataIndex;
-        searchPtr->point.x = linePtr->core.x.valueArr[dataIndex];
-        searchPtr->point.y = linePtr->core.y.valueArr[dataIndex];
-    }
-}
+/*
+ * A pen keeps no more than SPRITE_MAX_COUNT sprites, one for each size
+ * and color its symbols are drawn in.
+ */
+#define SPRITE_MAX_COUNT 1024
+
+#ifdef WIN32
 
 /*
  *----------------------------------------------------------------------
  *
- * GetLineExtents --
+ * DrawCircles --
  *
- *      Retrieves the range of the line element
+ *      TODO: Description
  *
  * Parameters:
- *      Element *elemPtr
- *      Extents2D *extsPtr
+ *      Display *display
+ *      Drawable drawable
+ *      Line *linePtr
+ *      LinePen *penPtr
+ *      int nSymbolPts
+ *      Point2D *symbolPts
+ *      int radius
  *
  * Results:
- *      Returns the number of data points in the element.
+ *      TODO: Results
  *
  * Side Effects:
  *      TODO: Side Effects
  *
  *----------------------------------------------------------------------
  */
-static void GetLineExtents(Element *elemPtr, Extents2D *extsPtr) {
-    Tcl_Size nPoints;
-
-    extsPtr->top = extsPtr->left = DBL_MAX;
-    extsPtr->bottom = extsPtr->right = -DBL_MAX;
+static void DrawCircles(Display *display, Drawable drawable, Line *linePtr, LinePen *penPtr, Tcl_Size nSymbolPts,
+                        Point2D *symbolPts, int radius) {
+    HBRUSH brush, oldBrush;
+    HPEN pen, oldPen;
+    HDC dc;
+    Rbc_WinDrawableDC *dcStatePtr;
+    register Point2D *pointPtr, *endPtr;
 
-    nPoints = NumberOfPoints(elemPtr);
-    if (nPoints < 1) {
+    if (drawable == None) {
+        return; /* Huh? */
+    }
+    if ((penPtr->symbol.fillGC == NULL) && (penPtr->symbol.outlineWidth == 0)) {
         return;
     }
-    extsPtr->right = elemPtr->x.max;
-    if ((elemPtr->x.min <= 0.0) && (elemPtr->axes.x->logScale)) {
-        extsPtr->left = Rbc_FindElemVectorMinimum(&elemPtr->x, DBL_MIN);
+    dc = Rbc_WinAcquireDrawableDC(display, drawable, &dcStatePtr);
+    if (penPtr->symbol.fillGC != NULL) {
+        brush = CreateSolidBrush(penPtr->symbol.fillGC->foreground);
     } else {
-        extsPtr->left = elemPtr->x.min;
+        brush = GetStockBrush(NULL_BRUSH);
     }
-    extsPtr->bottom = elemPtr->y.max;
-    if ((elemPtr->y.min <= 0.0) && (elemPtr->axes.y->logScale)) {
-        extsPtr->top = Rbc_FindElemVectorMinimum(&elemPtr->y, DBL_MIN);
+    if (penPtr->symbol.outlineWidth > 0) {
+        pen = Rbc_GCToPen(dc, penPtr->symbol.outlineGC);
     } else {
-        extsPtr->top = elemPtr->y.min;
+        pen = GetStockPen(NULL_PEN);
     }
-    Rbc_ExpandErrorBarExtents(elemPtr, extsPtr);
+    oldPen = SelectPen(dc, pen);
+    oldBrush = SelectBrush(dc, brush);
+    for (pointPtr = symbolPts, endPtr = symbolPts + nSymbolPts; pointPtr < endPtr; pointPtr++) {
+        Ellipse(dc, (int)pointPtr->x - radius, (int)pointPtr->y - radius, (int)pointPtr->x + radius + 1,
+                (int)pointPtr->y + radius + 1);
+    }
+    DeleteBrush(SelectBrush(dc, oldBrush));
+    DeletePen(SelectPen(dc, oldPen));
+    Rbc_WinReleaseDrawableDC(dcStatePtr);
 }
 
+#else
+
 /*
  *----------------------------------------------------------------------
  *
- * TileChangedProc
+ * DrawCircles --
  *
- *      Rebuilds the designated GC with the new tile pixmap.
+ *      TODO: Description
  *
  * Parameters:
- *      ClientData clientData
- *      Rbc_Tile tile - Not used.
+ *      Display *display
+ *      Drawable drawable
+ *      Line *linePtr
+ *      LinePen *penPtr
+ *      int nSymbolPts
+ *      Point2D *symbolPts
+ *      int radius
  *
  * Results:
- *      None.
+ *      TODO: Results
  *
  * Side Effects:
  *      TODO: Side Effects
  *
  *----------------------------------------------------------------------
  */
-static void TileChangedProc(ClientData clientData, Rbc_Tile tile) {
-    Line *linePtr = clientData;
-    Graph *graphPtr;
-
-    graphPtr = linePtr->core.graphPtr;
-    if (graphPtr->tkwin != NULL) {
-        graphPtr->flags |= REDRAW_WORLD;
-        Rbc_EventuallyRedrawGraph(graphPtr);
-    }
-}
-
-/*
- *----------------------------------------------------------------------
- *
- * ConfigureLine --
- *
- *      Sets up the appropriate configuration parameters in the GC.
- *
- * Parameters:
- *      Graph *graphPtr
- *      Element *elemPtr
- *
- * Results:
- *      The return value is a standard Tcl result.  If TCL_ERROR is
- *      returned, then the interpreter result contains an error message.
- *
- * Side effects:
- *      Configuration information such as line width, line style, color
- *      etc. get set in a new GC.
- *
- *----------------------------------------------------------------------
- */
-static int ConfigureLine(Graph *graphPtr, Element *elemPtr) {
-    Line *linePtr;
-    ElemDataTransaction dataTransaction;
-    ElemPenTransaction penTransaction;
-    ElemAxisTransaction axisTransaction;
-    ElemStateTransaction stateTransaction;
-    ElemTagsTransaction tagsTransaction;
-    ElemStylesTransaction stylesTransaction;
-    LineScalarTransaction scalarTransaction;
-    LineAreaTransaction areaTransaction;    
-    Rbc_ChainLink *linkPtr;
-    int dataTransactionPrepared;
-    int penTransactionPrepared;
-    int axisTransactionPrepared;
-    int stateTransactionPrepared;
-    int tagsTransactionPrepared;
-    int stylesTransactionPrepared;
-    int scalarTransactionPrepared;
-    int areaTransactionPrepared;    
-
-    linePtr = LINE_FROM_CORE(elemPtr);
-
-    memset(&dataTransaction, 0, sizeof(dataTransaction));
-    memset(&penTransaction, 0, sizeof(penTransaction));
-    memset(&axisTransaction, 0, sizeof(axisTransaction));
-    memset(&stateTransaction, 0, sizeof(stateTransaction));
-    memset(&tagsTransaction, 0, sizeof(tagsTransaction));
-    memset(&stylesTransaction, 0, sizeof(stylesTransaction));
-    memset(&scalarTransaction, 0, sizeof(scalarTransaction));
-    memset(&areaTransaction, 0, sizeof(areaTransaction));
-
-    dataTransactionPrepared = FALSE;
-    penTransactionPrepared = FALSE;
-    axisTransactionPrepared = FALSE;
-    stateTransactionPrepared = FALSE;
-    tagsTransactionPrepared = FALSE;
-    stylesTransactionPrepared = FALSE;
-    scalarTransactionPrepared = FALSE;
-    areaTransactionPrepared = FALSE;
-
-    /*
-     * Parse all data-vector replacements before modifying the live
-     * element.
-     */
-    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_DATA_MASK))) {
-        if (Rbc_PrepareElemDataTransaction(graphPtr, elemPtr, &dataTransaction) != TCL_OK) {
-            goto error;
-        }
-
-        dataTransactionPrepared = TRUE;
-    }
-
-    /*
-     * Resolve named active and normal pens before modifying the live
-     * element. Line and strip elements both require line-type pens.
-     */
-    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_PEN_MASK))) {
-        if (Rbc_PrepareElemPenTransaction(graphPtr, elemPtr, rbcLineElementUid, &penTransaction) != TCL_OK) {
-            goto error;
-        }
-
-        penTransactionPrepared = TRUE;
-    }
-
-    /*
-     * Resolve the X and Y axis mappings before modifying the live
-     * element.
-     */
-    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_AXES_MASK))) {
-        if (Rbc_PrepareElemAxisTransaction(graphPtr, elemPtr, &axisTransaction) != TCL_OK) {
-            goto error;
-        }
-
-        axisTransactionPrepared = TRUE;
-    }
-
-    /*
-     * Parse the element state before modifying the live element.
-     *
-     * Strip elements have no -state entry in their modern option table,
-     * so stateObjPtr remains NULL and this transaction stages nothing for
-     * them during initial configuration.
-     */
-    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_STATE_MASK))) {
-        if (Rbc_PrepareElemStateTransaction(graphPtr, elemPtr, &stateTransaction) != TCL_OK) {
-            goto error;
-        }
-
-        stateTransactionPrepared = TRUE;
-    }
-
-    /*
-     * Parse the element bind tags before modifying the live element.
-     *
-     * Both line and strip elements expose -bindtags in their modern
-     * option tables.
-     */
-    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_TAGS_MASK))) {
-        if (Rbc_PrepareElemTagsTransaction(graphPtr, elemPtr, &tagsTransaction) != TCL_OK) {
-            goto error;
-        }
-
-        tagsTransactionPrepared = TRUE;
-    }
-
-    /*
-     * Parse the element's weighted pen styles before modifying the live
-     * palette.
-     *
-     * Line and strip elements both use line pens and LinePenStyle palette
-     * records.
-     */
-    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_STYLES_MASK))) {
-        if (Rbc_PrepareElemStylesTransaction(graphPtr, elemPtr, rbcLineElementUid, sizeof(LinePenStyle),
-                                             &stylesTransaction) != TCL_OK) {
-            goto error;
-        }
-
-        stylesTransactionPrepared = TRUE;
-    }
-
-    /*
-     * Parse line-specific scalar values before modifying the live element.
-     *
-     * Both line and strip elements expose -maxsymbols and -smooth. Only
-     * graph line elements expose -trace.
-     */
-    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_SCALAR_MASK))) {
-        if (PrepareLineScalarTransaction(graphPtr, elemPtr, linePtr, &scalarTransaction) != TCL_OK) {
-            goto error;
-        }
-
-        scalarTransactionPrepared = TRUE;
-    }
-
-    /*
-     * Resolve line-area resources and construct the replacement fill GC
-     * before modifying the live element.
-     *
-     * Strip elements have no area options, but initial modern
-     * configuration may still construct their empty fill GC.
-     */
-    if (((!elemPtr->optionsConfigured) || (elemPtr->optionMask & LINE_ELEM_AREA_MASK))) {
-        if (PrepareLineAreaTransaction(graphPtr, elemPtr, linePtr, &areaTransaction) != TCL_OK) {
-            goto error;
-        }
+static void DrawCircles(Display *display, Drawable drawable, Line *linePtr, LinePen *penPtr, Tcl_Size nSymbolPts,
+                        Point2D *symbolPts, int radius) {
+    Tcl_Size i;
+    XArc *arcArr; /* Array of arcs (circle) */
+    XArc *arcPtr;
+    int reqSize, nArcs;
+    int s;
+    Tcl_Size count;
+    register Point2D *pointPtr, *endPtr;
 
-        areaTransactionPrepared = TRUE;
+    s = radius + radius;
+    if ((nSymbolPts <= 0) || ((size_t)nSymbolPts > SIZE_MAX / sizeof(*arcArr))) {
+        return;
+    }
+    arcArr = Tcl_AttemptAlloc((size_t)nSymbolPts * sizeof(*arcArr));
+    if (arcArr == NULL) {
+        return;
     }
+    arcPtr = arcArr;
 
-    /*
-     * Configure the embedded line pen only when its options may have
-     * changed.
-     */
-    if (!elemPtr->optionsConfigured || (elemPtr->optionMask & LINE_ELEM_BUILTIN_PEN_MASK)) {
-        if (ConfigurePen(graphPtr, &linePtr->builtinPen.core) != TCL_OK) {
-            goto error;
+    if (linePtr->symbolInterval > 0) {
+        count = 0;
+        for (pointPtr = symbolPts, endPtr = symbolPts + nSymbolPts; pointPtr < endPtr; pointPtr++) {
+            if (DRAW_SYMBOL(linePtr)) {
+                arcPtr->x = (short int)pointPtr->x - radius;
+                arcPtr->y = (short int)pointPtr->y - radius;
+                arcPtr->width = arcPtr->height = (unsigned short)s;
+                arcPtr->angle1 = 0;
+                arcPtr->angle2 = 23040;
+                arcPtr++, count++;
+            }
+            linePtr->symbolCounter++;
+        }
+    } else {
+        count = nSymbolPts;
+        for (pointPtr = symbolPts, endPtr = symbolPts + nSymbolPts; pointPtr < endPtr; pointPtr++) {
+            arcPtr->x = (short int)pointPtr->x - radius;
+            arcPtr->y = (short int)pointPtr->y - radius;
+            arcPtr->width = arcPtr->height = (unsigned short)s;
+            arcPtr->angle1 = 0;
+            arcPtr->angle2 = 23040;
+            arcPtr++;
         }
     }
-
-    /*
-     * No remaining operation before palette synchronisation can report a
-     * Tcl configuration error. Transfer all staged values and references
-     * to the live element.
-     */
-    if (axisTransactionPrepared) {
-        Rbc_CommitElemAxisTransaction(graphPtr, elemPtr, &axisTransaction);
+    reqSize = MAX_DRAWARCS(display);
+    if (reqSize < 1) {
+        ckfree(arcArr);
+        return;
     }
+    for (i = 0; i < count; i += (Tcl_Size)reqSize) {
+        Tcl_Size remaining;
 
-    if (penTransactionPrepared) {
-        Rbc_CommitElemPenTransaction(graphPtr, elemPtr, &linePtr->builtinPen.core, &penTransaction);
+        remaining = count - i;
+        nArcs = (remaining > (Tcl_Size)reqSize) ? reqSize : (int)remaining;
+        if (penPtr->symbol.fillGC != NULL) {
+            XFillArcs(display, drawable, penPtr->symbol.fillGC, arcArr + i, nArcs);
+        }
+        if (penPtr->symbol.outlineWidth > 0) {
+            XDrawArcs(display, drawable, penPtr->symbol.outlineGC, arcArr + i, nArcs);
+        }
     }
+    ckfree((char *)arcArr);
+}
 
-    if (stateTransactionPrepared) {
-        Rbc_CommitElemStateTransaction(elemPtr, &stateTransaction);
-    }
+#endif
 
-    if (tagsTransactionPrepared) {
-        Rbc_CommitElemTagsTransaction(elemPtr, &tagsTransaction);
+/*
+ *----------------------------------------------------------------------
+ *
+ * DrawSquares --
+ *
+ *      TODO: Description
+ *
+ * Parameters:
+ *      Display *display
+ *      Drawable drawable
+ *      Line *linePtr
+ *      LinePen *penPtr
+ *      int nSymbolPts
+ *      register Point2D *symbolPts
+ *      int r
+ *
+ * Results:
+ *      TODO: Results
+ *
+ * Side Effects:
+ *      TODO: Side Effects
+ *
+ *----------------------------------------------------------------------
+ */
+static void DrawSquares(Display *display, Drawable drawable, Line *linePtr, LinePen *penPtr, Tcl_Size nSymbolPts,
+                        register Point2D *symbolPts, int r) {
+    XRectangle *rectArr;
+    register Point2D *pointPtr, *endPtr;
+    register XRectangle *rectPtr;
+    int reqSize;
+    int nRects;
+    int s;
+    Tcl_Size i;
+    Tcl_Size count;
+
+    s = r + r;
+    if ((nSymbolPts <= 0) || ((size_t)nSymbolPts > SIZE_MAX / sizeof(*rectArr))) {
+        return;
     }
-    
-    if (stylesTransactionPrepared) {
-        Rbc_CommitElemStylesTransaction(graphPtr, elemPtr, &stylesTransaction);
+    rectArr = Tcl_AttemptAlloc((size_t)nSymbolPts * sizeof(*rectArr));
+    if (rectArr == NULL) {
+        return;
     }
+    rectPtr = rectArr;
 
-    if (scalarTransactionPrepared) {
-        CommitLineScalarTransaction(linePtr, &scalarTransaction);
+    if (linePtr->symbolInterval > 0) {
+        count = 0;
+        for (pointPtr = symbolPts, endPtr = symbolPts + nSymbolPts; pointPtr < endPtr; pointPtr++) {
+            if (DRAW_SYMBOL(linePtr)) {
+                rectPtr->x = (short int)(pointPtr->x - r);
+                rectPtr->y = (short int)(pointPtr->y - r);
+                rectPtr->width = rectPtr->height = (unsigned short)s;
+                rectPtr++, count++;
+            }
+            linePtr->symbolCounter++;
+        }
+    } else {
+        count = nSymbolPts;
+        for (pointPtr = symbolPts, endPtr = symbolPts + nSymbolPts; pointPtr < endPtr; pointPtr++) {
+            rectPtr->x = (short int)(pointPtr->x - r);
+            rectPtr->y = (short int)(pointPtr->y - r);
+            rectPtr->width = rectPtr->height = (unsigned short)s;
+            rectPtr++;
+        }
     }
-
-    if (areaTransactionPrepared) {
-        CommitLineAreaTransaction(graphPtr, linePtr, &areaTransaction);
+    reqSize = MAX_DRAWRECTANGLES(display);
+    if (reqSize < 1) {
+        ckfree(rectArr);
+        return;
     }
+    for (i = 0; i < count; i += (Tcl_Size)reqSize) {
+        Tcl_Size remaining;
 
-    assert(elemPtr->normalPenPtr != NULL);
-
-    linkPtr = Rbc_ChainFirstLink(elemPtr->palette);
+        remaining = count - i;
+        nRects = (remaining > (Tcl_Size)reqSize) ? reqSize : (int)remaining;
+        if (penPtr->symbol.fillGC != NULL) {
+            XFillRectangles(display, drawable, penPtr->symbol.fillGC, rectArr + i, nRects);
+        }
+        if (penPtr->symbol.outlineWidth > 0) {
+            XDrawRectangles(display, drawable, penPtr->symbol.outlineGC, rectArr + i, nRects);
+        }
+    }
+    ckfree((char *)rectArr);
+}
 
-    if (linkPtr != NULL) {
-        LinePenStyle *stylePtr;
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeSymbolSprites --
+ *
+ *      Releases the sprites of a pen's symbol.
+ *
+ * Parameters:
+ *      LinePen *penPtr
+ *
+ * Results:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static void FreeSymbolSprites(LinePen *penPtr) {
+    SymbolSprite *spritePtr, *nextPtr;
 
-        stylePtr = Rbc_ChainGetValue(linkPtr);
-        stylePtr->penPtr = LINE_PEN_FROM_CORE(elemPtr->normalPenPtr);
+    for (spritePtr = penPtr->sprites; spritePtr != NULL; spritePtr = nextPtr) {
+        nextPtr = spritePtr->nextPtr;
+        if (spritePtr->runs != NULL) {
+            ckfree(spritePtr->runs);
+        }
+        if (spritePtr->pixels != NULL) {
+            ckfree(spritePtr->pixels);
+        }
+        ckfree(spritePtr);
     }
+    penPtr->sprites = NULL;
+}
 
-    /*
-     * Nothing below this point can fail. Commit the staged vectors and
-     * synchronize their retained Tcl representations.
-     */
-    if (dataTransactionPrepared) {
-        Rbc_CommitElemDataTransaction(elemPtr, &dataTransaction);
+#ifndef WIN32
 
-        Rbc_SyncElemDataOptionObjects(elemPtr);
-    }
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetSymbolSprite --
+ *
+ *      Returns the sprite of a pen's symbol at the given size, in
+ *      the color it's currently drawn in, creating it if needed.  The
+ *      symbol is drawn by DrawSymbols into a pixmap twice, over two
+ *      different backgrounds.  The pixels that are the same in both
+ *      are the symbol's.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Drawable drawable - Drawable the symbols are drawn into
+ *      Line *linePtr
+ *      LinePen *penPtr
+ *      int size - Size of the symbol
+ *
+ * Results:
+ *      Returns the sprite, or NULL if the symbol is too large or the
+ *      pen has too many sprites.
+ *
+ *----------------------------------------------------------------------
+ */
+static SymbolSprite *GetSymbolSprite(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePen *penPtr, int size) {
+    SymbolSprite *spritePtr;
+    XImage *images[2];
+    Pixmap pixmap;
+    GC gc;
+    Point2D center;
+    Tcl_Size nRuns, nPixels;
+    Tcl_Size symbolInterval;
+    int half, width;
+    int x, y, pass;
+    int nSprites;
 
-    if (!elemPtr->optionsConfigured || (elemPtr->optionMask & LINE_ELEM_SCALE_SYMBOL_MASK)) {
-        elemPtr->flags |= MAP_ITEM | SCALE_SYMBOL;
+    nSprites = 0;
+    for (spritePtr = penPtr->sprites; spritePtr != NULL; spritePtr = spritePtr->nextPtr) {
+        if ((spritePtr->size == size) && (spritePtr->colorKey == linePtr->symbolColorKey)) {
+            return spritePtr;
+        }
+        nSprites++;
     }
-
-    if (!elemPtr->optionsConfigured || (elemPtr->optionMask & LINE_ELEM_MAP_ITEM_MASK)) {
-        elemPtr->flags |= MAP_ITEM;
+    half = size + penPtr->symbol.outlineWidth + 2;
+    width = half + half + 1;
+    if ((width > SPRITE_MAX_WIDTH) || (nSprites >= SPRITE_MAX_COUNT)) {
+        return NULL;
     }
+    pixmap = Tk_GetPixmap(graphPtr->display, drawable, width, width, Tk_Depth(graphPtr->tkwin));
+    gc = XCreateGC(graphPtr->display, pixmap, 0, NULL);
+    center.x = center.y = (double)half;
+    /* Draw the one symbol regardless of the element's -scalesymbols interval. */
+    symbolInterval = linePtr->symbolInterval;
+    linePtr->symbolInterval = 0;
+    for (pass = 0; pass < 2; pass++) {
+        XSetForeground(graphPtr->display, gc, (pass == 0) ? 0UL : ~0UL);
+        XFillRectangle(graphPtr->display, pixmap, gc, 0, 0, width, width);
+        DrawSymbols(graphPtr, pixmap, linePtr, penPtr, size, 1, &center);
+        images[pass] = XGetImage(graphPtr->display, pixmap, 0, 0, width, width, AllPlanes, ZPixmap);
+    }
+    linePtr->symbolInterval = symbolInterval;
+    XFreeGC(graphPtr->display, gc);
+    Tk_FreePixmap(graphPtr->display, pixmap);
+    if ((images[0] == NULL) || (images[1] == NULL)) {
+        spritePtr = NULL;
+        goto done;
+    }
+    spritePtr = RbcCalloc(1, sizeof(SymbolSprite));
+    spritePtr->size = size;
+    spritePtr->colorKey = linePtr->symbolColorKey;
+    spritePtr->runs = ckalloc((size_t)width * width * sizeof(SpriteRun));
+    spritePtr->pixels = ckalloc((size_t)width * width * sizeof(unsigned long));
+    spritePtr->left = spritePtr->top = half;
+    spritePtr->right = spritePtr->bottom = -half;
+    nRuns = nPixels = 0;
+    for (y = 0; y < width; y++) {
+        SpriteRun *runPtr;
+
+        runPtr = NULL;
+        for (x = 0; x < width; x++) {
+            unsigned long pixel;
+
+            pixel = XGetPixel(images[0], x, y);
+            if (pixel != XGetPixel(images[1], x, y)) {
+                runPtr = NULL;
+                continue;
+            }
+            if (runPtr == NULL) {
+                runPtr = spritePtr->runs + nRuns++;
+                runPtr->x = x - half;
+                runPtr->y = y - half;
+                runPtr->length = 0;
+                runPtr->first = nPixels;
+            }
+            runPtr->length++;
+            spritePtr->pixels[nPixels++] = pixel;
+            spritePtr->left = MIN(spritePtr->left, x - half);
+            spritePtr->right = MAX(spritePtr->right, x - half);
+            spritePtr->top = MIN(spritePtr->top, y - half);
+            spritePtr->bottom = MAX(spritePtr->bottom, y - half);
+        }
+    }
+    spritePtr->nRuns = nRuns;
+    /* A pen may keep many sprites, so give back what's left over. */
+    spritePtr->runs = ckrealloc(spritePtr->runs, (size_t)MAX(nRuns, 1) * sizeof(SpriteRun));
+    spritePtr->pixels = ckrealloc(spritePtr->pixels, (size_t)MAX(nPixels, 1) * sizeof(unsigned long));
+    spritePtr->nextPtr = penPtr->sprites;
+    penPtr->sprites = spritePtr;
+done:
+    for (pass = 0; pass < 2; pass++) {
+        if (images[pass] != NULL) {
+            XDestroyImage(images[pass]);
+        }
+    }
+    return spritePtr;
+}
 
-    return TCL_OK;
+/* ARGSUSED */
+static int StampErrorProc(ClientData clientData, XErrorEvent *errEventPtr) {
+    int *errorPtr = clientData;
 
-error:
-    if (areaTransactionPrepared) {
-        FreeLineAreaTransaction(graphPtr, &areaTransaction);
-    }
+    *errorPtr = TCL_ERROR;
+    return 0;
+}
 
-    if (stylesTransactionPrepared) {
-        Rbc_FreeElemStylesTransaction(graphPtr, &stylesTransaction);
-    }
+/*
+ *----------------------------------------------------------------------
+ *
+ * StampSprites --
+ *
+ *      Draws symbols by reading back the part of the drawable they
+ *      cover, copying the pixels of each symbol's sprite into it at
+ *      its point, and writing it back.  This takes two requests of
+ *      the X server, rather than one or more for every symbol.  Each
+ *      symbol looks the same as if drawn by the X server, but overlaps
+ *      the symbols drawn before it completely.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Drawable drawable - Pixmap to draw into
+ *      Line *linePtr
+ *      SpriteBatch *batches - Symbols of each sprite, in the order
+ *                             they're drawn.  A batch without a
+ *                             sprite isn't drawn.
+ *      Tcl_Size nBatches - Number of batches
+ *
+ * Results:
+ *      Returns TRUE if the symbols were drawn.  Otherwise they must be
+ *      drawn one by one.
+ *
+ * Side Effects:
+ *      Advances the element's symbol counter as DrawSymbols does.
+ *
+ *----------------------------------------------------------------------
+ */
+static int StampSprites(Graph *graphPtr, Drawable drawable, Line *linePtr, SpriteBatch *batches,
+                        Tcl_Size nBatches) {
+    SymbolSprite *spritePtr;
+    XImage *imagePtr;
+    Tk_ErrorHandler errHandler;
+    Window root;
+    GC gc;
+    Tcl_Size b, i, j;
+    int left, right, top, bottom;
+    int x, y;
+    unsigned int width, height, borderWidth, depth;
+    Tcl_Size symbolCounter;
+    int fast, result;
 
-    if (tagsTransactionPrepared) {
-        Rbc_FreeElemTagsTransaction(&tagsTransaction);
+    if (!XGetGeometry(graphPtr->display, drawable, &root, &x, &y, &width, &height, &borderWidth, &depth)) {
+        return FALSE;
+    }
+    /*
+     * Find the part of the drawable covered by the symbols.
+     */
+    left = top = INT_MAX;
+    right = bottom = INT_MIN;
+    symbolCounter = linePtr->symbolCounter;
+    for (b = 0; b < nBatches; b++) {
+        spritePtr = batches[b].spritePtr;
+        for (i = 0; i < batches[b].nSymbolPts; i++) {
+            if ((linePtr->symbolInterval > 0) && (!DRAW_SYMBOL(linePtr))) {
+                linePtr->symbolCounter++;
+                continue;
+            }
+            linePtr->symbolCounter++;
+            if ((spritePtr == NULL) || (spritePtr->nRuns == 0)) {
+                continue;
+            }
+            x = (int)batches[b].symbolPts[i].x;
+            y = (int)batches[b].symbolPts[i].y;
+            left = MIN(left, x + spritePtr->left);
+            right = MAX(right, x + spritePtr->right);
+            top = MIN(top, y + spritePtr->top);
+            bottom = MAX(bottom, y + spritePtr->bottom);
+        }
+    }
+    left = MAX(left, 0);
+    top = MAX(top, 0);
+    right = MIN(right, (int)width - 1);
+    bottom = MIN(bottom, (int)height - 1);
+    if ((left > right) || (top > bottom)) {
+        return TRUE; /* No symbol is visible. */
+    }
+    result = TCL_OK;
+    errHandler = Tk_CreateErrorHandler(graphPtr->display, BadMatch, X_GetImage, -1, StampErrorProc, &result);
+    imagePtr = XGetImage(graphPtr->display, drawable, left, top, right - left + 1, bottom - top + 1, AllPlanes,
+                         ZPixmap);
+    XSync(graphPtr->display, False);
+    Tk_DeleteErrorHandler(errHandler);
+    if ((result != TCL_OK) || (imagePtr == NULL)) {
+        if (imagePtr != NULL) {
+            XDestroyImage(imagePtr);
+        }
+        linePtr->symbolCounter = symbolCounter;
+        return FALSE;
     }
+    /*
+     * Store 32-bit pixels directly when they're in the client's byte
+     * order.
+     */
+    {
+        const int one = 1;
 
-    if (axisTransactionPrepared) {
-        Rbc_FreeElemAxisTransaction(graphPtr, &axisTransaction);
+        fast = (imagePtr->bits_per_pixel == 32) &&
+               (imagePtr->byte_order == ((*(const char *)&one) ? LSBFirst : MSBFirst));
     }
+    linePtr->symbolCounter = symbolCounter;
+    for (b = 0; b < nBatches; b++) {
+        Point2D *symbolPts;
 
-    if (penTransactionPrepared) {
-        Rbc_FreeElemPenTransaction(graphPtr, &penTransaction);
-    }
+        spritePtr = batches[b].spritePtr;
+        symbolPts = batches[b].symbolPts;
+        for (i = 0; i < batches[b].nSymbolPts; i++) {
+            int cx, cy;
 
-    if (dataTransactionPrepared) {
-        Rbc_FreeElemDataTransaction(&dataTransaction);
-    }
+            if ((linePtr->symbolInterval > 0) && (!DRAW_SYMBOL(linePtr))) {
+                linePtr->symbolCounter++;
+                continue;
+            }
+            linePtr->symbolCounter++;
+            if (spritePtr == NULL) {
+                continue;
+            }
+            cx = (int)symbolPts[i].x - left;
+            cy = (int)symbolPts[i].y - top;
+            if ((cx + spritePtr->right < 0) || (cx + spritePtr->left >= imagePtr->width) ||
+                (cy + spritePtr->bottom < 0) || (cy + spritePtr->top >= imagePtr->height)) {
+                continue;
+            }
+            for (j = 0; j < spritePtr->nRuns; j++) {
+                SpriteRun *runPtr;
+                const unsigned long *pixelPtr;
+                int x1, x2;
+
+                runPtr = spritePtr->runs + j;
+                y = cy + runPtr->y;
+                if ((y < 0) || (y >= imagePtr->height)) {
+                    continue;
+                }
+                x1 = cx + runPtr->x;
+                x2 = x1 + runPtr->length;
+                pixelPtr = spritePtr->pixels + runPtr->first;
+                if (x1 < 0) {
+                    pixelPtr -= x1;
+                    x1 = 0;
+                }
+                x2 = MIN(x2, imagePtr->width);
+                if (fast) {
+                    uint32_t *rowPtr;
 
-    return TCL_ERROR;
+                    rowPtr = (uint32_t *)(imagePtr->data + (size_t)y * imagePtr->bytes_per_line);
+                    for (x = x1; x < x2; x++) {
+                        rowPtr[x] = (uint32_t)*pixelPtr++;
+                    }
+                } else {
+                    for (x = x1; x < x2; x++) {
+                        XPutPixel(imagePtr, x, y, *pixelPtr++);
+                    }
+                }
+            }
+        }
+    }
+    gc = XCreateGC(graphPtr->display, drawable, 0, NULL);
+    XPutImage(graphPtr->display, drawable, gc, imagePtr, 0, 0, left, top, imagePtr->width, imagePtr->height);
+    XFreeGC(graphPtr->display, gc);
+    XDestroyImage(imagePtr);
+    return TRUE;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * ClosestLine --
+ * StampSymbols --
  *
- *      Find the closest point or line segment (if interpolated) to
- *      the given window coordinate in the line element.
+ *      Draws symbols of a pen by stamping its sprite (see
+ *      StampSprites).
  *
  * Parameters:
- *      Graph *graphPtr - Graph widget record
- *      Element *elemPtr - Element to examine
- *      ClosestSearch *searchPtr - Info about closest point in element
+ *      Graph *graphPtr
+ *      Drawable drawable - Pixmap or window to draw into
+ *      Line *linePtr
+ *      LinePen *penPtr
+ *      int size - Size of the symbols
+ *      Tcl_Size nSymbolPts - Number of symbols
+ *      Point2D *symbolPts - Centers of the symbols
  *
  * Results:
- *      Returns the distance of the closest point among other
- *      information.
+ *      Returns TRUE if the symbols were drawn.  Otherwise they must be
+ *      drawn one by one.
  *
  * Side Effects:
- *      TODO: Side Effects
+ *      Advances the element's symbol counter as DrawSymbols does.
  *
  *----------------------------------------------------------------------
  */
-static void ClosestLine(Graph *graphPtr, Element *elemPtr, ClosestSearch *searchPtr) {
-    Line *linePtr = LINE_FROM_CORE(elemPtr);
-    int mode;
-
-    mode = searchPtr->mode;
-    if (mode == SEARCH_AUTO) {
-        LinePen *penPtr = LINE_PEN_FROM_CORE(elemPtr->normalPenPtr);
+static int StampSymbols(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePen *penPtr, int size,
+                        Tcl_Size nSymbolPts, Point2D *symbolPts) {
+    SpriteBatch batch;
 
-        mode = SEARCH_POINTS;
-        if ((NumberOfPoints(elemPtr) > 1) && (penPtr->traceWidth > 0)) {
-            mode = SEARCH_TRACES;
-        }
+    /*
+     * Windows may be partly obscured, so only pixmaps can be read
+     * back.
+     */
+    if (drawable == Tk_WindowId(graphPtr->tkwin)) {
+        return FALSE;
     }
-    if (mode == SEARCH_POINTS) {
-        ClosestPoint(linePtr, searchPtr);
-    } else {
-        DistanceProc *distProc;
-        int found;
-
-        if (searchPtr->along == SEARCH_X) {
-            distProc = DistanceToX;
-        } else if (searchPtr->along == SEARCH_Y) {
-            distProc = DistanceToY;
-        } else {
-            distProc = DistanceToLine;
-        }
-        if (elemPtr->classUid == rbcStripElementUid) {
-            found = ClosestStrip(graphPtr, linePtr, searchPtr, distProc);
-        } else {
-            found = ClosestTrace(graphPtr, linePtr, searchPtr, distProc);
-        }
-        if ((!found) && (searchPtr->along != SEARCH_BOTH)) {
-            ClosestPoint(linePtr, searchPtr);
-        }
+    batch.spritePtr = GetSymbolSprite(graphPtr, drawable, linePtr, penPtr, size);
+    if (batch.spritePtr == NULL) {
+        return FALSE;
+    }
+    if (batch.spritePtr->nRuns == 0) {
+        linePtr->symbolCounter += nSymbolPts;
+        return TRUE;
     }
+    batch.nSymbolPts = nSymbolPts;
+    batch.symbolPts = symbolPts;
+    return StampSprites(graphPtr, drawable, linePtr, &batch, 1);
 }
 
 /*
- * XDrawLines() points: XMaxRequestSize(dpy) - 3
- * XFillPolygon() points:  XMaxRequestSize(dpy) - 4
- * XDrawSegments() segments:  (XMaxRequestSize(dpy) - 3) / 2
- * XDrawRectangles() rectangles:  (XMaxRequestSize(dpy) - 3) / 2
- * XFillRectangles() rectangles:  (XMaxRequestSize(dpy) - 3) / 2
- * XDrawArcs() or XFillArcs() arcs:  (XMaxRequestSize(dpy) - 3) / 3
+ *----------------------------------------------------------------------
+ *
+ * StampSymbolRuns --
+ *
+ *      Draws the symbols of a pen style in their colors and sizes by
+ *      stamping the sprite of each run of them, reading back and
+ *      writing the drawable only once for all.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Drawable drawable - Pixmap or window to draw into
+ *      Line *linePtr
+ *      LinePen *penPtr - Pen of the style
+ *      SymbolRun *runs - Runs of the style's symbols
+ *      Tcl_Size nRuns - Number of runs
+ *
+ * Results:
+ *      Returns TRUE if the symbols were drawn.  Otherwise they must be
+ *      drawn one by one.
+ *
+ * Side Effects:
+ *      Advances the element's symbol counter as DrawSymbols does.
+ *
+ *----------------------------------------------------------------------
  */
+static int StampSymbolRuns(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePen *penPtr, SymbolRun *runs,
+                           Tcl_Size nRuns) {
+    SpriteBatch *batches;
+    GC fillGC, outlineGC;
+    Tcl_Size nSymbolPts, i;
+    int result;
 
-#define MAX_DRAWLINES(d) Rbc_MaxRequestSize(d, sizeof(XPoint))
-#define MAX_DRAWPOLYGON(d) Rbc_MaxRequestSize(d, sizeof(XPoint))
-#define MAX_DRAWSEGMENTS(d) Rbc_MaxRequestSize(d, sizeof(XSegment))
-#define MAX_DRAWRECTANGLES(d) Rbc_MaxRequestSize(d, sizeof(XRectangle))
-#define MAX_DRAWARCS(d) Rbc_MaxRequestSize(d, sizeof(XArc))
+    nSymbolPts = 0;
+    for (i = 0; i < nRuns; i++) {
+        nSymbolPts += runs[i].nSymbolPts;
+    }
+    if ((nSymbolPts < SPRITE_MIN_SYMBOLS) || (penPtr->symbol.type == SYMBOL_NONE) ||
+        (penPtr->symbol.type == SYMBOL_BITMAP) || (drawable == Tk_WindowId(graphPtr->tkwin))) {
+        return FALSE;
+    }
+    batches = Tcl_AttemptAlloc((size_t)nRuns * sizeof(SpriteBatch));
+    if (batches == NULL) {
+        return FALSE;
+    }
+    fillGC = penPtr->symbol.fillGC;
+    outlineGC = penPtr->symbol.outlineGC;
+    result = TRUE;
+    for (i = 0; i < nRuns; i++) {
+        batches[i].spritePtr = NULL;
+        batches[i].nSymbolPts = runs[i].nSymbolPts;
+        batches[i].symbolPts = linePtr->symbolPts + runs[i].first;
+        if (runs[i].size == 0) {
+            continue; /* Symbols of no size aren't drawn. */
+        }
+        SetSymbolColor(graphPtr, drawable, linePtr, penPtr, runs[i].color);
+        batches[i].spritePtr = GetSymbolSprite(graphPtr, drawable, linePtr, penPtr, runs[i].size);
+        penPtr->symbol.fillGC = fillGC;
+        penPtr->symbol.outlineGC = outlineGC;
+        linePtr->symbolColorKey = 0;
+        if (batches[i].spritePtr == NULL) {
+            result = FALSE;
+            break;
+        }
+    }
+    if (result) {
+        result = StampSprites(graphPtr, drawable, linePtr, batches, nRuns);
+    }
+    ckfree(batches);
+    return result;
+}
 
-#ifdef WIN32
+#endif
 
 /*
  *----------------------------------------------------------------------
  *
- * DrawCircles --
+ * FreeSymbolKeys --
  *
- *      TODO: Description
+ *      Releases the color and size keys of the symbol points.
  *
  * Parameters:
- *      Display *display
- *      Drawable drawable
  *      Line *linePtr
- *      LinePen *penPtr
- *      int nSymbolPts
- *      Point2D *symbolPts
- *      int radius
  *
  * Results:
- *      TODO: Results
+ *      None.
  *
- * Side Effects:
- *      TODO: Side Effects
+ *----------------------------------------------------------------------
+ */
+static void FreeSymbolKeys(Line *linePtr) {
+    if (linePtr->symbolColors != NULL) {
+        ckfree(linePtr->symbolColors);
+        linePtr->symbolColors = NULL;
+    }
+    if (linePtr->symbolSizes != NULL) {
+        ckfree(linePtr->symbolSizes);
+        linePtr->symbolSizes = NULL;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeSymbolColorTable --
+ *
+ *      Releases the colors allocated for the symbols and the GC that
+ *      draws them.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Line *linePtr
+ *
+ * Results:
+ *      None.
  *
  *----------------------------------------------------------------------
  */
-static void DrawCircles(Display *display, Drawable drawable, Line *linePtr, LinePen *penPtr, Tcl_Size nSymbolPts,
-                        Point2D *symbolPts, int radius) {
-    HBRUSH brush, oldBrush;
-    HPEN pen, oldPen;
-    HDC dc;
-    Rbc_WinDrawableDC *dcStatePtr;
-    register Point2D *pointPtr, *endPtr;
+static void FreeSymbolColorTable(Graph *graphPtr, Line *linePtr) {
+    int i;
 
-    if (drawable == None) {
-        return; /* Huh? */
+    if (linePtr->colorTable != NULL) {
+        for (i = 0; i < SYMBOL_COLORS; i++) {
+            if (linePtr->colorTable[i] != NULL) {
+                Tk_FreeColor(linePtr->colorTable[i]);
+            }
+        }
+        ckfree(linePtr->colorTable);
+        linePtr->colorTable = NULL;
     }
-    if ((penPtr->symbol.fillGC == NULL) && (penPtr->symbol.outlineWidth == 0)) {
-        return;
+    if (linePtr->colorGC != NULL) {
+        XFreeGC(graphPtr->display, linePtr->colorGC);
+        linePtr->colorGC = NULL;
     }
-    dc = Rbc_WinAcquireDrawableDC(display, drawable, &dcStatePtr);
-    if (penPtr->symbol.fillGC != NULL) {
-        brush = CreateSolidBrush(penPtr->symbol.fillGC->foreground);
-    } else {
-        brush = GetStockBrush(NULL_BRUSH);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetSymbolRuns --
+ *
+ *      Splits the symbol points of a pen style, grouped by
+ *      GroupSymbolColors, into runs of the same color and size.
+ *
+ * Parameters:
+ *      Line *linePtr
+ *      Tcl_Size first - Index of the style's first symbol point
+ *      Tcl_Size nSymbolPts - Number of the style's symbol points
+ *      int size - Symbol size of the style
+ *      Tcl_Size *nRunsPtr - Returns the number of runs
+ *
+ * Results:
+ *      Returns an array of the runs, or NULL if it can't be allocated.
+ *      The caller frees it.
+ *
+ *----------------------------------------------------------------------
+ */
+static SymbolRun *GetSymbolRuns(Line *linePtr, Tcl_Size first, Tcl_Size nSymbolPts, int size, Tcl_Size *nRunsPtr) {
+    SymbolRun *runs, *runPtr;
+    Tcl_Size nRuns, i;
+    int color, symbolSize;
+
+    nRuns = 0;
+    for (i = first; i < first + nSymbolPts; i++) {
+        if ((i == first) ||
+            ((linePtr->symbolColors != NULL) && (linePtr->symbolColors[i] != linePtr->symbolColors[i - 1])) ||
+            ((linePtr->symbolSizes != NULL) && (linePtr->symbolSizes[i] != linePtr->symbolSizes[i - 1]))) {
+            nRuns++;
+        }
     }
-    if (penPtr->symbol.outlineWidth > 0) {
-        pen = Rbc_GCToPen(dc, penPtr->symbol.outlineGC);
-    } else {
-        pen = GetStockPen(NULL_PEN);
+    runs = Tcl_AttemptAlloc((size_t)MAX(nRuns, 1) * sizeof(SymbolRun));
+    if (runs == NULL) {
+        return NULL;
     }
-    oldPen = SelectPen(dc, pen);
-    oldBrush = SelectBrush(dc, brush);
-    for (pointPtr = symbolPts, endPtr = symbolPts + nSymbolPts; pointPtr < endPtr; pointPtr++) {
-        Ellipse(dc, (int)pointPtr->x - radius, (int)pointPtr->y - radius, (int)pointPtr->x + radius + 1,
-                (int)pointPtr->y + radius + 1);
+    runPtr = runs - 1;
+    for (i = first; i < first + nSymbolPts; i++) {
+        color = (linePtr->symbolColors != NULL) ? linePtr->symbolColors[i] : SYMBOL_COLOR_PEN;
+        symbolSize = (linePtr->symbolSizes != NULL) ? linePtr->symbolSizes[i] : SYMBOL_SIZE_STYLE;
+        if (symbolSize == SYMBOL_SIZE_STYLE) {
+            symbolSize = size;
+        }
+        if ((i == first) || (color != runPtr->color) || (symbolSize != runPtr->size)) {
+            runPtr++;
+            runPtr->first = i;
+            runPtr->nSymbolPts = 0;
+            runPtr->color = color;
+            runPtr->size = symbolSize;
+        }
+        runPtr->nSymbolPts++;
     }
-    DeleteBrush(SelectBrush(dc, oldBrush));
-    DeletePen(SelectPen(dc, oldPen));
-    Rbc_WinReleaseDrawableDC(dcStatePtr);
+    *nRunsPtr = nRuns;
+    return runs;
 }
 
-#else
-
 /*
  *----------------------------------------------------------------------
  *
- * DrawCircles --
+ * SetSymbolColor --
  *
- *      TODO: Description
+ *      Makes the pen draw its symbols in a color of the element's
+ *      colormap, by putting the element's color GC in place of the
+ *      pen's symbol GCs.  Hollow symbols stay hollow, and bitmaps
+ *      keep their colors.  The caller puts the pen's GCs back, and
+ *      resets the element's symbolColorKey, when done.
  *
  * Parameters:
- *      Display *display
- *      Drawable drawable
+ *      Graph *graphPtr
+ *      Drawable drawable - Pixmap or window drawn into
  *      Line *linePtr
  *      LinePen *penPtr
- *      int nSymbolPts
- *      Point2D *symbolPts
- *      int radius
+ *      int color - Color key: index in the colormap, or
+ *                  SYMBOL_COLOR_PEN for the pen's colors
  *
  * Results:
- *      TODO: Results
+ *      None.
  *
  * Side Effects:
- *      TODO: Side Effects
+ *      The color is allocated the first time it's drawn.
+ *      symbolColorKey of the element is set to tell the sprites of
+ *      the color apart.
  *
  *----------------------------------------------------------------------
  */
-static void DrawCircles(Display *display, Drawable drawable, Line *linePtr, LinePen *penPtr, Tcl_Size nSymbolPts,
-                        Point2D *symbolPts, int radius) {
-    Tcl_Size i;
-    XArc *arcArr; /* Array of arcs (circle) */
-    XArc *arcPtr;
-    int reqSize, nArcs;
-    int s;
-    Tcl_Size count;
-    register Point2D *pointPtr, *endPtr;
+static void SetSymbolColor(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePen *penPtr, int color) {
+    XGCValues gcValues;
+    XColor *colorPtr;
 
-    s = radius + radius;
-    if ((nSymbolPts <= 0) || ((size_t)nSymbolPts > SIZE_MAX / sizeof(*arcArr))) {
-        return;
-    }
-    arcArr = Tcl_AttemptAlloc((size_t)nSymbolPts * sizeof(*arcArr));
-    if (arcArr == NULL) {
+    linePtr->symbolColorKey = 0;
+    if ((color == SYMBOL_COLOR_PEN) || (penPtr->symbol.type == SYMBOL_BITMAP)) {
         return;
     }
-    arcPtr = arcArr;
+    if ((linePtr->colorTable != NULL) && (linePtr->colorTableMap != linePtr->colormap)) {
+        int i;
 
-    if (linePtr->symbolInterval > 0) {
-        count = 0;
-        for (pointPtr = symbolPts, endPtr = symbolPts + nSymbolPts; pointPtr < endPtr; pointPtr++) {
-            if (DRAW_SYMBOL(linePtr)) {
-                arcPtr->x = (short int)pointPtr->x - radius;
-                arcPtr->y = (short int)pointPtr->y - radius;
-                arcPtr->width = arcPtr->height = (unsigned short)s;
-                arcPtr->angle1 = 0;
-                arcPtr->angle2 = 23040;
-                arcPtr++, count++;
+        for (i = 0; i < SYMBOL_COLORS; i++) {
+            if (linePtr->colorTable[i] != NULL) {
+                Tk_FreeColor(linePtr->colorTable[i]);
+                linePtr->colorTable[i] = NULL;
             }
-            linePtr->symbolCounter++;
-        }
-    } else {
-        count = nSymbolPts;
-        for (pointPtr = symbolPts, endPtr = symbolPts + nSymbolPts; pointPtr < endPtr; pointPtr++) {
-            arcPtr->x = (short int)pointPtr->x - radius;
-            arcPtr->y = (short int)pointPtr->y - radius;
-            arcPtr->width = arcPtr->height = (unsigned short)s;
-            arcPtr->angle1 = 0;
-            arcPtr->angle2 = 23040;
-            arcPtr++;
         }
     }
-    reqSize = MAX_DRAWARCS(display);
-    if (reqSize < 1) {
-        ckfree(arcArr);
-        return;
+    if (linePtr->colorTable == NULL) {
+        linePtr->colorTable = RbcCalloc(SYMBOL_COLORS, sizeof(XColor *));
     }
-    for (i = 0; i < count; i += (Tcl_Size)reqSize) {
-        Tcl_Size remaining;
-
-        remaining = count - i;
-        nArcs = (remaining > (Tcl_Size)reqSize) ? reqSize : (int)remaining;
-        if (penPtr->symbol.fillGC != NULL) {
-            XFillArcs(display, drawable, penPtr->symbol.fillGC, arcArr + i, nArcs);
-        }
-        if (penPtr->symbol.outlineWidth > 0) {
-            XDrawArcs(display, drawable, penPtr->symbol.outlineGC, arcArr + i, nArcs);
+    linePtr->colorTableMap = linePtr->colormap;
+    colorPtr = linePtr->colorTable[color];
+    if (colorPtr == NULL) {
+        Pix32 colors[SYMBOL_COLORS];
+        XColor value;
+
+        GetColormapColors(linePtr->colormap, colors);
+        value.red = colors[color].Red * 257;
+        value.green = colors[color].Green * 257;
+        value.blue = colors[color].Blue * 257;
+        value.flags = DoRed | DoGreen | DoBlue;
+        colorPtr = Tk_GetColorByValue(graphPtr->tkwin, &value);
+        if (colorPtr == NULL) {
+            return;
         }
+        linePtr->colorTable[color] = colorPtr;
+    }
+    if (linePtr->colorGC == NULL) {
+        linePtr->colorGC = XCreateGC(graphPtr->display, drawable, 0, NULL);
     }
-    ckfree((char *)arcArr);
+    /* The symbol GCs of a pen differ only in their color. */
+    gcValues.foreground = colorPtr->pixel;
+    gcValues.line_width = LineWidth(penPtr->symbol.outlineWidth);
+    XChangeGC(graphPtr->display, linePtr->colorGC, GCForeground | GCLineWidth, &gcValues);
+    if (penPtr->symbol.fillGC != NULL) {
+        penPtr->symbol.fillGC = linePtr->colorGC;
+    }
+    penPtr->symbol.outlineGC = linePtr->colorGC;
+    linePtr->symbolColorKey =
+        0x1000000 | ((colorPtr->red >> 8) << 16) | ((colorPtr->green >> 8) << 8) | (colorPtr->blue >> 8);
 }
 
-#endif
-
 /*
  *----------------------------------------------------------------------
  *
- * DrawSquares --
+ * DrawSymbolRuns --
  *
- *      TODO: Description
+ *      Draws the symbols of a pen style in the colors and sizes given
+ *      them by the element's -colorvector and -sizevector.  Each run
+ *      of the same color and size is drawn at once, through the
+ *      element's color GC, so no pen is reconfigured.
  *
  * Parameters:
- *      Display *display
- *      Drawable drawable
+ *      Graph *graphPtr
+ *      Drawable drawable - Pixmap or window to draw into
  *      Line *linePtr
- *      LinePen *penPtr
- *      int nSymbolPts
- *      register Point2D *symbolPts
- *      int r
+ *      LinePenStyle *stylePtr
+ *      Tcl_Size first - Index of the style's first symbol point
  *
  * Results:
- *      TODO: Results
- *
- * Side Effects:
- *      TODO: Side Effects
+ *      None.
  *
  *----------------------------------------------------------------------
  */
-static void DrawSquares(Display *display, Drawable drawable, Line *linePtr, LinePen *penPtr, Tcl_Size nSymbolPts,
-                        register Point2D *symbolPts, int r) {
-    XRectangle *rectArr;
-    register Point2D *pointPtr, *endPtr;
-    register XRectangle *rectPtr;
-    int reqSize;
-    int nRects;
-    int s;
-    Tcl_Size i;
-    Tcl_Size count;
-
-    s = r + r;
-    if ((nSymbolPts <= 0) || ((size_t)nSymbolPts > SIZE_MAX / sizeof(*rectArr))) {
-        return;
-    }
-    rectArr = Tcl_AttemptAlloc((size_t)nSymbolPts * sizeof(*rectArr));
-    if (rectArr == NULL) {
+static void DrawSymbolRuns(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePenStyle *stylePtr,
+                           Tcl_Size first) {
+    LinePen *penPtr = stylePtr->penPtr;
+    SymbolRun *runs;
+    GC fillGC, outlineGC;
+    Tcl_Size nRuns, i;
+
+    runs = GetSymbolRuns(linePtr, first, stylePtr->nSymbolPts, stylePtr->symbolSize, &nRuns);
+    if (runs == NULL) {
+        DrawSymbols(graphPtr, drawable, linePtr, penPtr, stylePtr->symbolSize, stylePtr->nSymbolPts,
+                    stylePtr->symbolPts);
         return;
     }
-    rectPtr = rectArr;
-
-    if (linePtr->symbolInterval > 0) {
-        count = 0;
-        for (pointPtr = symbolPts, endPtr = symbolPts + nSymbolPts; pointPtr < endPtr; pointPtr++) {
-            if (DRAW_SYMBOL(linePtr)) {
-                rectPtr->x = (short int)(pointPtr->x - r);
-                rectPtr->y = (short int)(pointPtr->y - r);
-                rectPtr->width = rectPtr->height = (unsigned short)s;
-                rectPtr++, count++;
-            }
-            linePtr->symbolCounter++;
-        }
-    } else {
-        count = nSymbolPts;
-        for (pointPtr = symbolPts, endPtr = symbolPts + nSymbolPts; pointPtr < endPtr; pointPtr++) {
-            rectPtr->x = (short int)(pointPtr->x - r);
-            rectPtr->y = (short int)(pointPtr->y - r);
-            rectPtr->width = rectPtr->height = (unsigned short)s;
-            rectPtr++;
-        }
-    }
-    reqSize = MAX_DRAWRECTANGLES(display);
-    if (reqSize < 1) {
-        ckfree(rectArr);
+#ifndef WIN32
+    if (StampSymbolRuns(graphPtr, drawable, linePtr, penPtr, runs, nRuns)) {
+        ckfree(runs);
         return;
     }
-    for (i = 0; i < count; i += (Tcl_Size)reqSize) {
-        Tcl_Size remaining;
-
-        remaining = count - i;
-        nRects = (remaining > (Tcl_Size)reqSize) ? reqSize : (int)remaining;
-        if (penPtr->symbol.fillGC != NULL) {
-            XFillRectangles(display, drawable, penPtr->symbol.fillGC, rectArr + i, nRects);
-        }
-        if (penPtr->symbol.outlineWidth > 0) {
-            XDrawRectangles(display, drawable, penPtr->symbol.outlineGC, rectArr + i, nRects);
+#endif
+    fillGC = penPtr->symbol.fillGC;
+    outlineGC = penPtr->symbol.outlineGC;
+    for (i = 0; i < nRuns; i++) {
+        if (runs[i].size == 0) {
+            linePtr->symbolCounter += runs[i].nSymbolPts;
+            continue;
         }
+        SetSymbolColor(graphPtr, drawable, linePtr, penPtr, runs[i].color);
+        DrawSymbols(graphPtr, drawable, linePtr, penPtr, runs[i].size, runs[i].nSymbolPts,
+                    linePtr->symbolPts + runs[i].first);
+        penPtr->symbol.fillGC = fillGC;
+        penPtr->symbol.outlineGC = outlineGC;
+        linePtr->symbolColorKey = 0;
     }
-    ckfree((char *)rectArr);
+    ckfree(runs);
 }
 
 /*
@@ -5701,6 +10687,13 @@ static void DrawSymbols(Graph *graphPtr, Drawable drawable, Line *linePtr, LineP
         }
         return;
     }
+#ifndef WIN32
+    if ((nSymbolPts >= SPRITE_MIN_SYMBOLS) && (penPtr->symbol.type != SYMBOL_NONE) &&
+        (penPtr->symbol.type != SYMBOL_BITMAP) &&
+        (StampSymbols(graphPtr, drawable, linePtr, penPtr, size, nSymbolPts, symbolPts))) {
+        return;
+    }
+#endif
     r1 = (int)ceil(size * 0.5);
     r2 = (int)ceil(size * S_RATIO * 0.5);
 
@@ -6142,7 +11135,6 @@ static void DrawSymbol(Graph *graphPtr, Drawable drawable, Element *elemPtr, int
  *----------------------------------------------------------------------
  */
 static void DrawTraces(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePen *penPtr) {
-    Rbc_ChainLink *linkPtr;
     HBRUSH brush, oldBrush;
     HDC dc;
     HPEN pen, oldPen;
@@ -6190,49 +11182,48 @@ static void DrawTraces(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePe
     brush = CreateSolidBrush(penPtr->traceGC->foreground);
     oldBrush = SelectBrush(dc, brush);
     Rbc_WinSetROP2(dc, penPtr->traceGC->function);
-    for (linkPtr = Rbc_ChainFirstLink(linePtr->traces); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
+    for (tracePtr = linePtr->traces.runs; tracePtr < linePtr->traces.runs + linePtr->traces.nRuns; tracePtr++) {
         Tcl_Size firstCount;
 
-        tracePtr = Rbc_ChainGetValue(linkPtr);
         /*
          * A polyline requires at least two points.
          */
-        if (tracePtr->nScreenPts < 2) {
+        if (tracePtr->nDrawPts < 2) {
             continue;
         }
         /*
          * Step 1: draw the first section.  It may contain the entire
          * trace.
          */
-        firstCount = MIN((Tcl_Size)maxPoints, tracePtr->nScreenPts);
+        firstCount = MIN((Tcl_Size)maxPoints, tracePtr->nDrawPts);
         for (count = 0; count < firstCount; count++) {
-            points[count].x = (int)tracePtr->screenPts[count].x;
-            points[count].y = (int)tracePtr->screenPts[count].y;
+            points[count].x = (int)TRACE_DRAW_POINT(linePtr, tracePtr, count)->x;
+            points[count].y = (int)TRACE_DRAW_POINT(linePtr, tracePtr, count)->y;
         }
         Polyline(dc, points, (int)firstCount);
         /*
          * Step 2: draw full continuation chunks.  Each continuation
          * starts with the last point drawn by the preceding request.
          */
-        while ((tracePtr->nScreenPts - count) > (Tcl_Size)maxPoints) {
-            points[0].x = (int)tracePtr->screenPts[count - 1].x;
-            points[0].y = (int)tracePtr->screenPts[count - 1].y;
+        while ((tracePtr->nDrawPts - count) > (Tcl_Size)maxPoints) {
+            points[0].x = (int)TRACE_DRAW_POINT(linePtr, tracePtr, count - 1)->x;
+            points[0].y = (int)TRACE_DRAW_POINT(linePtr, tracePtr, count - 1)->y;
             for (j = 0; j < (Tcl_Size)maxPoints; j++, count++) {
-                points[j + 1].x = (int)tracePtr->screenPts[count].x;
-                points[j + 1].y = (int)tracePtr->screenPts[count].y;
+                points[j + 1].x = (int)TRACE_DRAW_POINT(linePtr, tracePtr, count)->x;
+                points[j + 1].y = (int)TRACE_DRAW_POINT(linePtr, tracePtr, count)->y;
             }
             Polyline(dc, points, maxPoints + 1);
         }
         /*
          * Step 3: draw the final partial chunk.
          */
-        remaining = tracePtr->nScreenPts - count;
+        remaining = tracePtr->nDrawPts - count;
         if (remaining > 0) {
-            points[0].x = (int)tracePtr->screenPts[count - 1].x;
-            points[0].y = (int)tracePtr->screenPts[count - 1].y;
+            points[0].x = (int)TRACE_DRAW_POINT(linePtr, tracePtr, count - 1)->x;
+            points[0].y = (int)TRACE_DRAW_POINT(linePtr, tracePtr, count - 1)->y;
             for (j = 0; j < remaining; j++, count++) {
-                points[j + 1].x = (int)tracePtr->screenPts[count].x;
-                points[j + 1].y = (int)tracePtr->screenPts[count].y;
+                points[j + 1].x = (int)TRACE_DRAW_POINT(linePtr, tracePtr, count)->x;
+                points[j + 1].y = (int)TRACE_DRAW_POINT(linePtr, tracePtr, count)->y;
             }
             Polyline(dc, points, (int)remaining + 1);
         }
@@ -6267,7 +11258,6 @@ static void DrawTraces(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePe
  *----------------------------------------------------------------------
  */
 static void DrawTraces(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePen *penPtr) {
-    Rbc_ChainLink *linkPtr;
     LineTrace *tracePtr;
     XPoint *points;
     Tcl_Size count;
@@ -6296,50 +11286,49 @@ static void DrawTraces(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePe
     if (points == NULL) {
         return;
     }
-    for (linkPtr = Rbc_ChainFirstLink(linePtr->traces); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
+    for (tracePtr = linePtr->traces.runs; tracePtr < linePtr->traces.runs + linePtr->traces.nRuns; tracePtr++) {
         Tcl_Size firstCount;
 
-        tracePtr = Rbc_ChainGetValue(linkPtr);
         /*
          * XDrawLines requires at least two useful points to produce a
          * line.
          */
-        if (tracePtr->nScreenPts < 2) {
+        if (tracePtr->nDrawPts < 2) {
             continue;
         }
         /*
          * Step 1: draw the first section.  It may contain the entire
          * trace.
          */
-        firstCount = MIN((Tcl_Size)maxPoints, tracePtr->nScreenPts);
+        firstCount = MIN((Tcl_Size)maxPoints, tracePtr->nDrawPts);
         for (count = 0; count < firstCount; count++) {
-            points[count].x = (short int)tracePtr->screenPts[count].x;
-            points[count].y = (short int)tracePtr->screenPts[count].y;
+            points[count].x = (short int)TRACE_DRAW_POINT(linePtr, tracePtr, count)->x;
+            points[count].y = (short int)TRACE_DRAW_POINT(linePtr, tracePtr, count)->y;
         }
         XDrawLines(graphPtr->display, drawable, penPtr->traceGC, points, (int)firstCount, CoordModeOrigin);
         /*
          * Step 2: draw full continuation chunks.  Each continuation
          * starts with the last point drawn by the preceding request.
          */
-        while ((tracePtr->nScreenPts - count) > (Tcl_Size)maxPoints) {
-            points[0].x = (short int)tracePtr->screenPts[count - 1].x;
-            points[0].y = (short int)tracePtr->screenPts[count - 1].y;
+        while ((tracePtr->nDrawPts - count) > (Tcl_Size)maxPoints) {
+            points[0].x = (short int)TRACE_DRAW_POINT(linePtr, tracePtr, count - 1)->x;
+            points[0].y = (short int)TRACE_DRAW_POINT(linePtr, tracePtr, count - 1)->y;
             for (j = 0; j < (Tcl_Size)maxPoints; j++, count++) {
-                points[j + 1].x = (short int)tracePtr->screenPts[count].x;
-                points[j + 1].y = (short int)tracePtr->screenPts[count].y;
+                points[j + 1].x = (short int)TRACE_DRAW_POINT(linePtr, tracePtr, count)->x;
+                points[j + 1].y = (short int)TRACE_DRAW_POINT(linePtr, tracePtr, count)->y;
             }
             XDrawLines(graphPtr->display, drawable, penPtr->traceGC, points, maxPoints + 1, CoordModeOrigin);
         }
         /*
          * Step 3: draw the final partial chunk.
          */
-        remaining = tracePtr->nScreenPts - count;
+        remaining = tracePtr->nDrawPts - count;
         if (remaining > 0) {
-            points[0].x = (short int)tracePtr->screenPts[count - 1].x;
-            points[0].y = (short int)tracePtr->screenPts[count - 1].y;
+            points[0].x = (short int)TRACE_DRAW_POINT(linePtr, tracePtr, count - 1)->x;
+            points[0].y = (short int)TRACE_DRAW_POINT(linePtr, tracePtr, count - 1)->y;
             for (j = 0; j < remaining; j++, count++) {
-                points[j + 1].x = (short int)tracePtr->screenPts[count].x;
-                points[j + 1].y = (short int)tracePtr->screenPts[count].y;
+                points[j + 1].x = (short int)TRACE_DRAW_POINT(linePtr, tracePtr, count)->x;
+                points[j + 1].y = (short int)TRACE_DRAW_POINT(linePtr, tracePtr, count)->y;
             }
             XDrawLines(graphPtr->display, drawable, penPtr->traceGC, points, (int)remaining + 1, CoordModeOrigin);
         }
@@ -6392,6 +11381,294 @@ static void DrawValues(Graph *graphPtr, Drawable drawable, Line *linePtr, LinePe
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetColormapColors --
+ *
+ *      Fills a table with 256 colors running through the stops of a
+ *      colormap.
+ *
+ * Parameters:
+ *      int colormap - Index in colormapInfo
+ *      Pix32 *colors - (out) Table of 256 colors
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static void GetColormapColors(int colormap, Pix32 *colors) {
+    const ColormapInfo *infoPtr = colormapInfo + colormap;
+    const ColormapStop *lowPtr, *highPtr;
+    double t, f;
+    int i, k;
+
+    for (i = 0; i < 256; i++) {
+        t = i * (infoPtr->nStops - 1) / 255.0;
+        k = MIN((int)t, infoPtr->nStops - 2);
+        f = t - k;
+        lowPtr = infoPtr->stops + k;
+        highPtr = lowPtr + 1;
+        colors[i].Red = (unsigned char)(lowPtr->red + f * (highPtr->red - lowPtr->red) + 0.5);
+        colors[i].Green = (unsigned char)(lowPtr->green + f * (highPtr->green - lowPtr->green) + 0.5);
+        colors[i].Blue = (unsigned char)(lowPtr->blue + f * (highPtr->blue - lowPtr->blue) + 0.5);
+        colors[i].Alpha = 0xFF;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompareCounts --
+ *
+ *      Orders density counts for qsort.
+ *
+ *----------------------------------------------------------------------
+ */
+static int CompareCounts(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetDensityImage --
+ *
+ *      Colors the counts of the density image of the line element.
+ *      The -densityscale option of the element maps each count to a
+ *      fraction of the colormap:
+ *
+ *        linear  the count over the largest count,
+ *        log     the same of log(1 + count),
+ *        eqhist  the fraction of the pixels with points that have at
+ *                most the count.
+ *
+ * Parameters:
+ *      Line *linePtr - Line element mapped as a density image
+ *      XColor *bgColorPtr - Color of the pixels with no points, or
+ *                           NULL to leave them transparent.
+ *
+ * Results:
+ *      Returns a new color image.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static Rbc_ColorImage GetDensityImage(Line *linePtr, XColor *bgColorPtr) {
+    DensityGrid *gridPtr = &linePtr->density;
+    Rbc_ColorImage image;
+    Pix32 colors[256];
+    Pix32 empty;
+    Pix32 *destPtr;
+    uint32_t *sorted;
+    uint32_t max;
+    double scale, t;
+    Tcl_Size nCells, nSorted;
+    Tcl_Size i;
+
+    image = Rbc_CreateColorImage(gridPtr->width, gridPtr->height);
+    GetColormapColors(linePtr->colormap, colors);
+    empty.value = 0;
+    if (bgColorPtr != NULL) {
+        empty.Red = (unsigned char)(bgColorPtr->red >> 8);
+        empty.Green = (unsigned char)(bgColorPtr->green >> 8);
+        empty.Blue = (unsigned char)(bgColorPtr->blue >> 8);
+        empty.Alpha = 0xFF;
+    }
+    nCells = (Tcl_Size)gridPtr->width * gridPtr->height;
+    max = 0;
+    nSorted = 0;
+    for (i = 0; i < nCells; i++) {
+        if (gridPtr->counts[i] > 0) {
+            max = MAX(max, gridPtr->counts[i]);
+            nSorted++;
+        }
+    }
+    sorted = NULL;
+    if ((linePtr->densityScale == DENSITY_SCALE_EQHIST) && (nSorted > 0)) {
+        sorted = ckalloc((size_t)nSorted * sizeof(*sorted));
+        nSorted = 0;
+        for (i = 0; i < nCells; i++) {
+            if (gridPtr->counts[i] > 0) {
+                sorted[nSorted++] = gridPtr->counts[i];
+            }
+        }
+        qsort(sorted, (size_t)nSorted, sizeof(*sorted), CompareCounts);
+    }
+    scale = (linePtr->densityScale == DENSITY_SCALE_LOG) ? log1p((double)max) : (double)max;
+    destPtr = Rbc_ColorImageBits(image);
+    for (i = 0; i < nCells; i++, destPtr++) {
+        uint32_t count;
+
+        count = gridPtr->counts[i];
+        if (count == 0) {
+            *destPtr = empty;
+            continue;
+        }
+        if (sorted != NULL) {
+            Tcl_Size low, high;
+
+            /* Find the number of pixels with at most this count. */
+            low = 0;
+            high = nSorted;
+            while (low < high) {
+                Tcl_Size mid;
+
+                mid = low + (high - low) / 2;
+                if (sorted[mid] <= count) {
+                    low = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+            t = (double)low / nSorted;
+        } else if (linePtr->densityScale == DENSITY_SCALE_LOG) {
+            t = log1p((double)count) / scale;
+        } else {
+            t = (double)count / scale;
+        }
+        *destPtr = colors[(int)(MIN(t, 1.0) * 255.0 + 0.5)];
+    }
+    if (sorted != NULL) {
+        ckfree(sorted);
+    }
+    return image;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeDensityPixmap --
+ *
+ *      Releases the image drawn for the density of the line element.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      Line *linePtr - Line element
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The pixmaps and colors of the image are freed.
+ *
+ *----------------------------------------------------------------------
+ */
+static void FreeDensityPixmap(Graph *graphPtr, Line *linePtr) {
+    DensityGrid *gridPtr = &linePtr->density;
+
+    if (gridPtr->pixmap != None) {
+        Tk_FreePixmap(graphPtr->display, gridPtr->pixmap);
+        gridPtr->pixmap = None;
+    }
+    if (gridPtr->mask != None) {
+        Tk_FreePixmap(graphPtr->display, gridPtr->mask);
+        gridPtr->mask = None;
+    }
+    if (gridPtr->colorTable != NULL) {
+        Rbc_FreeColorTable(gridPtr->colorTable);
+        gridPtr->colorTable = NULL;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DrawDensity --
+ *
+ *      Draws the density image of the line element.  The image is
+ *      built once for each map of the element, and copied through a
+ *      mask of the pixels with points.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      Drawable drawable - Pixmap or window to draw into
+ *      Line *linePtr - Line element mapped as a density image
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The image is built if its counts changed.
+ *
+ *----------------------------------------------------------------------
+ */
+static void DrawDensity(Graph *graphPtr, Drawable drawable, Line *linePtr) {
+    DensityGrid *gridPtr = &linePtr->density;
+    GC gc;
+
+    if (gridPtr->pixmapStamp != gridPtr->stamp) {
+        FreeDensityPixmap(graphPtr, linePtr);
+    }
+    if (gridPtr->counts == NULL) {
+        return;
+    }
+    if (gridPtr->pixmap == None) {
+        Rbc_ColorImage image;
+
+        image = GetDensityImage(linePtr, NULL);
+        gridPtr->pixmap = Rbc_ColorImageToPixmap(graphPtr->interp, graphPtr->tkwin, image, &gridPtr->colorTable);
+        if (gridPtr->pixmap != None) {
+            gridPtr->mask = Rbc_ColorImageMask(graphPtr->tkwin, image);
+        }
+        gridPtr->pixmapStamp = gridPtr->stamp;
+        Rbc_FreeColorImage(image);
+        if (gridPtr->pixmap == None) {
+            return;
+        }
+    }
+    gc = XCreateGC(graphPtr->display, drawable, 0, NULL);
+    if (gridPtr->mask != None) {
+        XSetClipMask(graphPtr->display, gc, gridPtr->mask);
+        XSetClipOrigin(graphPtr->display, gc, gridPtr->x, gridPtr->y);
+    }
+    XCopyArea(graphPtr->display, gridPtr->pixmap, drawable, gc, 0, 0, (unsigned int)gridPtr->width,
+              (unsigned int)gridPtr->height, gridPtr->x, gridPtr->y);
+    XFreeGC(graphPtr->display, gc);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DensityToPostScript --
+ *
+ *      Outputs the density image of the line element.  PostScript
+ *      images have no transparency, so pixels with no points are
+ *      painted with the background of the plotting area.
+ *
+ * Parameters:
+ *      Graph *graphPtr - Graph widget record
+ *      PsToken psToken
+ *      Line *linePtr - Line element mapped as a density image
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      PostScript for the image is appended to psToken.
+ *
+ *----------------------------------------------------------------------
+ */
+static void DensityToPostScript(Graph *graphPtr, PsToken psToken, Line *linePtr) {
+    Rbc_ColorImage image;
+
+    if (linePtr->density.counts == NULL) {
+        return;
+    }
+    image = GetDensityImage(linePtr, graphPtr->plotBg);
+    Rbc_ColorImageToPostScript(psToken, image, (double)linePtr->density.x, (double)linePtr->density.y);
+    Rbc_FreeColorImage(image);
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -6423,7 +11700,7 @@ static void DrawActiveLine(Graph *graphPtr, Drawable drawable, Element *elemPtr)
     penPtr = (elemPtr->activePenPtr != NULL) ? LINE_PEN_FROM_CORE(elemPtr->activePenPtr) : NULL;
     int symbolSize;
 
-    if (penPtr == NULL) {
+    if ((penPtr == NULL) || (linePtr->render == LINE_RENDER_DENSITY)) {
         return;
     }
     symbolSize = ScaleSymbol(elemPtr, penPtr->symbol.size);
@@ -6449,7 +11726,7 @@ static void DrawActiveLine(Graph *graphPtr, Drawable drawable, Element *elemPtr)
         if (penPtr->traceWidth > 0) {
             if (linePtr->nStrips > 0) {
                 Rbc_Draw2DSegments(graphPtr->display, drawable, penPtr->traceGC, linePtr->strips, linePtr->nStrips);
-            } else if (Rbc_ChainGetLength(linePtr->traces) > 0) {
+            } else if (linePtr->traces.nRuns > 0) {
                 DrawTraces(graphPtr, drawable, linePtr, penPtr);
             }
         }
@@ -6496,6 +11773,15 @@ static void DrawNormalLine(Graph *graphPtr, Drawable drawable, Element *elemPtr)
     register LinePenStyle *stylePtr;
     Tcl_Size count;
 
+    if (linePtr->render == LINE_RENDER_DENSITY) {
+        DrawDensity(graphPtr, drawable, linePtr);
+        return;
+    }
+    if (linePtr->density.pixmap != None) {
+        /* The element was drawn as a density image before. */
+        FreeDensityPixmap(graphPtr, linePtr);
+    }
+
     /* Fill area under the curve */
     if (linePtr->fillPts != NULL) {
         XPoint *points;
@@ -6529,7 +11815,7 @@ static void DrawNormalLine(Graph *graphPtr, Drawable drawable, Element *elemPtr)
                 Rbc_Draw2DSegments(graphPtr->display, drawable, penPtr->traceGC, stylePtr->strips, stylePtr->nStrips);
             }
         }
-    } else if ((Rbc_ChainGetLength(linePtr->traces) > 0) && (normalPenPtr->traceWidth > 0)) {
+    } else if ((linePtr->traces.nRuns > 0) && (normalPenPtr->traceWidth > 0)) {
         DrawTraces(graphPtr, drawable, linePtr, normalPenPtr);
     }
 
@@ -6561,8 +11847,12 @@ static void DrawNormalLine(Graph *graphPtr, Drawable drawable, Element *elemPtr)
                                stylePtr->yErrorBarCnt);
         }
         if ((stylePtr->nSymbolPts > 0) && (penPtr->symbol.type != SYMBOL_NONE)) {
-            DrawSymbols(graphPtr, drawable, linePtr, penPtr, stylePtr->symbolSize, stylePtr->nSymbolPts,
-                        stylePtr->symbolPts);
+            if ((linePtr->symbolColors != NULL) || (linePtr->symbolSizes != NULL)) {
+                DrawSymbolRuns(graphPtr, drawable, linePtr, stylePtr, count);
+            } else {
+                DrawSymbols(graphPtr, drawable, linePtr, penPtr, stylePtr->symbolSize, stylePtr->nSymbolPts,
+                            stylePtr->symbolPts);
+            }
         }
         if (penPtr->valueShow != SHOW_NONE) {
             DrawValues(graphPtr, drawable, linePtr, penPtr, stylePtr->nSymbolPts, stylePtr->symbolPts,
@@ -6729,6 +12019,67 @@ static void SymbolsToPostScript(Graph *graphPtr, PsToken psToken, LinePen *penPt
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * SymbolRunsToPostScript --
+ *
+ *      Generates PostScript for the symbols of a pen style in the
+ *      colors and sizes given them by the element's -colorvector and
+ *      -sizevector, one run of the same color and size at a time.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      PsToken psToken
+ *      Line *linePtr
+ *      LinePenStyle *stylePtr
+ *      Tcl_Size first - Index of the style's first symbol point
+ *
+ * Results:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static void SymbolRunsToPostScript(Graph *graphPtr, PsToken psToken, Line *linePtr, LinePenStyle *stylePtr,
+                                   Tcl_Size first) {
+    LinePen *penPtr = stylePtr->penPtr;
+    Pix32 colors[SYMBOL_COLORS];
+    SymbolRun *runs;
+    XColor *fillColor, *outlineColor;
+    Tcl_Size nRuns, i;
+
+    runs = GetSymbolRuns(linePtr, first, stylePtr->nSymbolPts, stylePtr->symbolSize, &nRuns);
+    if (runs == NULL) {
+        SymbolsToPostScript(graphPtr, psToken, penPtr, stylePtr->symbolSize, stylePtr->nSymbolPts,
+                            stylePtr->symbolPts);
+        return;
+    }
+    GetColormapColors(linePtr->colormap, colors);
+    fillColor = penPtr->symbol.fillColor;
+    outlineColor = penPtr->symbol.outlineColor;
+    for (i = 0; i < nRuns; i++) {
+        XColor color;
+
+        if (runs[i].size == 0) {
+            continue;
+        }
+        if ((runs[i].color != SYMBOL_COLOR_PEN) && (penPtr->symbol.type != SYMBOL_BITMAP)) {
+            color.red = colors[runs[i].color].Red * 257;
+            color.green = colors[runs[i].color].Green * 257;
+            color.blue = colors[runs[i].color].Blue * 257;
+            if (fillColor != NULL) {
+                penPtr->symbol.fillColor = &color;
+            }
+            penPtr->symbol.outlineColor = &color;
+        }
+        SymbolsToPostScript(graphPtr, psToken, penPtr, runs[i].size, runs[i].nSymbolPts,
+                            linePtr->symbolPts + runs[i].first);
+        penPtr->symbol.fillColor = fillColor;
+        penPtr->symbol.outlineColor = outlineColor;
+    }
+    ckfree(runs);
+}
+
 /*
  * -----------------------------------------------------------------
  *
@@ -6828,10 +12179,9 @@ static void SetLineAttributes(PsToken psToken, LinePen *penPtr) {
  *----------------------------------------------------------------------
  */
 static void TracesToPostScript(PsToken psToken, Line *linePtr, LinePen *penPtr) {
-    Rbc_ChainLink *linkPtr;
     LineTrace *tracePtr;
-    register Point2D *pointPtr;
-    register Point2D *endPtr;
+    register TracePoint *pointPtr;
+    register TracePoint *endPtr;
     int count;
 
 #define PS_MAXPATH 1500
@@ -6840,19 +12190,18 @@ static void TracesToPostScript(PsToken psToken, Line *linePtr, LinePen *penPtr)
      */
 
     SetLineAttributes(psToken, penPtr);
-    for (linkPtr = Rbc_ChainFirstLink(linePtr->traces); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
-        tracePtr = Rbc_ChainGetValue(linkPtr);
+    for (tracePtr = linePtr->traces.runs; tracePtr < linePtr->traces.runs + linePtr->traces.nRuns; tracePtr++) {
         if (tracePtr->nScreenPts <= 0) {
             continue;
         }
-        pointPtr = tracePtr->screenPts;
+        pointPtr = TRACE_POINTS(linePtr, tracePtr);
         Rbc_FormatToPostScript(psToken, " newpath %g %g moveto\n", pointPtr->x, pointPtr->y);
         pointPtr++;
         /*
          * Count path components, including the initial moveto.
          */
         count = 1;
-        endPtr = tracePtr->screenPts + (tracePtr->nScreenPts - 1);
+        endPtr = TRACE_POINTS(linePtr, tracePtr) + (tracePtr->nScreenPts - 1);
         for (; pointPtr < endPtr; pointPtr++) {
             Rbc_FormatToPostScript(psToken, " %g %g lineto\n", pointPtr->x, pointPtr->y);
             count++;
@@ -6950,7 +12299,7 @@ static void ActiveLineToPostScript(Graph *graphPtr, PsToken psToken, Element *el
     linePtr = LINE_FROM_CORE(elemPtr);
     penPtr = (elemPtr->activePenPtr != NULL) ? LINE_PEN_FROM_CORE(elemPtr->activePenPtr) : NULL;
 
-    if (penPtr == NULL) {
+    if ((penPtr == NULL) || (linePtr->render == LINE_RENDER_DENSITY)) {
         return;
     }
 
@@ -6973,7 +12322,7 @@ static void ActiveLineToPostScript(Graph *graphPtr, PsToken psToken, Element *el
                 SetLineAttributes(psToken, penPtr);
                 Rbc_2DSegmentsToPostScript(psToken, linePtr->strips, linePtr->nStrips);
             }
-            if (Rbc_ChainGetLength(linePtr->traces) > 0) {
+            if (linePtr->traces.nRuns > 0) {
                 TracesToPostScript(psToken, linePtr, penPtr);
             }
         }
@@ -7017,6 +12366,11 @@ static void NormalLineToPostScript(Graph *graphPtr, PsToken psToken, Element *el
     Tcl_Size count;
     XColor *colorPtr;
 
+    if (linePtr->render == LINE_RENDER_DENSITY) {
+        DensityToPostScript(graphPtr, psToken, linePtr);
+        return;
+    }
+
     /* Draw fill area */
     if (linePtr->fillPts != NULL) {
         /* Create a path to use for both the polygon and its outline. */
@@ -7049,7 +12403,7 @@ static void NormalLineToPostScript(Graph *graphPtr, PsToken psToken, Element *el
                 Rbc_2DSegmentsToPostScript(psToken, stylePtr->strips, stylePtr->nStrips);
             }
         }
-    } else if ((Rbc_ChainGetLength(linePtr->traces) > 0) && (normalPenPtr->traceWidth > 0)) {
+    } else if ((linePtr->traces.nRuns > 0) && (normalPenPtr->traceWidth > 0)) {
         TracesToPostScript(psToken, linePtr, normalPenPtr);
     }
 
@@ -7072,8 +12426,12 @@ static void NormalLineToPostScript(Graph *graphPtr, PsToken psToken, Element *el
             Rbc_2DSegmentsToPostScript(psToken, stylePtr->yErrorBars, stylePtr->yErrorBarCnt);
         }
         if ((stylePtr->nSymbolPts > 0) && (stylePtr->penPtr->symbol.type != SYMBOL_NONE)) {
-            SymbolsToPostScript(graphPtr, psToken, penPtr, stylePtr->symbolSize, stylePtr->nSymbolPts,
-                                stylePtr->symbolPts);
+            if ((linePtr->symbolColors != NULL) || (linePtr->symbolSizes != NULL)) {
+                SymbolRunsToPostScript(graphPtr, psToken, linePtr, stylePtr, count);
+            } else {
+                SymbolsToPostScript(graphPtr, psToken, penPtr, stylePtr->symbolSize, stylePtr->nSymbolPts,
+                                    stylePtr->symbolPts);
+            }
         }
         if (penPtr->valueShow != SHOW_NONE) {
             ValuesToPostScript(psToken, linePtr, penPtr, stylePtr->nSymbolPts, stylePtr->symbolPts,
@@ -7122,7 +12480,20 @@ static void DestroyLine(Graph *graphPtr, Element *elemPtr) {
     Rbc_FreeElemVector(&elemPtr->yHigh);
     Rbc_FreeElemVector(&elemPtr->yLow);
     Rbc_FreeElemVector(&elemPtr->yError);
+    Rbc_FreeElemVector(&elemPtr->colorData);
+    Rbc_FreeElemVector(&elemPtr->sizeData);
+    if (linePtr->asyncPtr != NULL) {
+        /* The worker frees its map once it's done. */
+        CancelAsyncMap(linePtr);
+        linePtr->asyncPtr->linePtr = NULL;
+        linePtr->asyncPtr = NULL;
+    }
     ResetLine(linePtr);
+    FreeTraces(linePtr);
+    FreeDensityPixmap(graphPtr, linePtr);
+    FreeSymbolColorTable(graphPtr, linePtr);
+    FreeLod(&linePtr->lod);
+    FreeLineSpline(&linePtr->spline);
     if (elemPtr->palette != NULL) {
         Rbc_FreePalette(graphPtr, elemPtr->palette);
         Rbc_ChainDestroy(elemPtr->palette);
@@ -25,6 +25,13 @@ static int GetColorPair(Tcl_Interp *interp, Tk_Window tkwin, const char *fgStr,
 static const char *NameOfColor(XColor *colorPtr);
 static int ClipTest(double ds, double dr, double *t1, double *t2);
 static double FindSplit(const Point2D points[], Tcl_Size i, Tcl_Size j, Tcl_Size *split);
+static Tcl_Size GetPolygonBand(double y, double top, double scale, Tcl_Size nBands);
+
+/*
+ * Polygons are cut into at most this many horizontal bands when
+ * testing many points against them.
+ */
+#define POLYGON_MAX_BANDS 256
 
 /* ----------------------------------------------------------------------
  * Custom option parse and print procedures
@@ -468,6 +475,213 @@ int Rbc_PointInPolygon(const Point2D *samplePtr, const Point2D *points, Tcl_Size
     return inside;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetPolygonBand --
+ *
+ *      Finds the horizontal band of a polygon containing the given
+ *      y-coordinate.  Coordinates outside of the polygon are put in
+ *      the first or last band.
+ *
+ * Parameters:
+ *      double y - Y-coordinate
+ *      double top - Top of the polygon
+ *      double scale - Number of bands per unit of height
+ *      Tcl_Size nBands - Number of bands
+ *
+ * Results:
+ *      Returns the index of the band.  The index never decreases as
+ *      y increases.
+ *
+ *----------------------------------------------------------------------
+ */
+static Tcl_Size GetPolygonBand(double y, double top, double scale, Tcl_Size nBands) {
+    double t;
+
+    t = (y - top) * scale;
+    if (!(t > 0.0)) {
+        return 0;
+    }
+    if (t >= (double)nBands) {
+        return nBands - 1;
+    }
+    return (Tcl_Size)t;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Rbc_PointsInPolygon --
+ *
+ *      Tests an array of points against a polygon.  Each point gets
+ *      the same answer as from Rbc_PointInPolygon, but the polygon is
+ *      first cut into horizontal bands, each listing the edges that
+ *      overlap it.  A point is then only tested against the edges of
+ *      its own band, rather than every edge of the polygon.
+ *
+ * Parameters:
+ *      const Point2D *samples - Points to be tested
+ *      Tcl_Size nSamples - Number of points to be tested
+ *      const Point2D *points - Vertices of the polygon
+ *      Tcl_Size nPoints - Number of vertices
+ *      unsigned char *inside - (out) Receives TRUE for each point
+ *                              inside of the polygon.
+ *
+ * Results:
+ *      Returns the number of points inside of the polygon.
+ *
+ *----------------------------------------------------------------------
+ */
+Tcl_Size Rbc_PointsInPolygon(const Point2D *samples, Tcl_Size nSamples, const Point2D *points, Tcl_Size nPoints,
+                             unsigned char *inside) {
+    Tcl_Size *bandStart, *bandEdges;
+    Tcl_Size nBands, nEdges, nEntries;
+    Tcl_Size count;
+    Tcl_Size i;
+    double top, bottom, scale;
+
+    if (nSamples < 1) {
+        return 0;
+    }
+    memset(inside, 0, (size_t)nSamples);
+    if ((points == NULL) || (nPoints < 3)) {
+        return 0;
+    }
+    top = bottom = points[0].y;
+    for (i = 0; i < nPoints; i++) {
+        if (!IsFinitePoint(points + i)) {
+            return 0;
+        }
+        top = MIN(top, points[i].y);
+        bottom = MAX(bottom, points[i].y);
+    }
+    if (!(bottom > top)) {
+        return 0; /* No edge can be crossed. */
+    }
+    nBands = MIN(nPoints, POLYGON_MAX_BANDS);
+    scale = (double)nBands / (bottom - top);
+    if (!FINITE(scale)) {
+        nBands = 1, scale = 0.0;
+    }
+    /*
+     * Edge i runs from vertex i - 1 to vertex i.  It's listed in
+     * every band between those of its end points.  Horizontal edges
+     * are never crossed and aren't listed.  The band of a point is
+     * never less than the band of an edge's upper end point, or more
+     * than the band of its lower end point, when the point is between
+     * the two.
+     */
+    bandStart = Tcl_AttemptAlloc((size_t)(nBands + 1) * sizeof(Tcl_Size));
+    if (bandStart == NULL) {
+        goto oneByOne;
+    }
+    memset(bandStart, 0, (size_t)(nBands + 1) * sizeof(Tcl_Size));
+    for (i = 0; i < nPoints; i++) {
+        const Point2D *p, *q;
+        Tcl_Size first, last;
+
+        p = points + ((i > 0) ? i - 1 : nPoints - 1);
+        q = points + i;
+        if (p->y == q->y) {
+            continue;
+        }
+        first = GetPolygonBand(MIN(p->y, q->y), top, scale, nBands);
+        last = GetPolygonBand(MAX(p->y, q->y), top, scale, nBands);
+        bandStart[first]++;
+        bandStart[last + 1]--;
+    }
+    /*
+     * The counts so far are the changes in the number of edges from
+     * one band to the next.  Turn them into the start of each band's
+     * list.
+     */
+    nEdges = nEntries = 0;
+    for (i = 0; i < nBands; i++) {
+        nEdges += bandStart[i];
+        bandStart[i] = nEntries;
+        nEntries += nEdges;
+    }
+    bandStart[nBands] = nEntries;
+    bandEdges = Tcl_AttemptAlloc((size_t)MAX(nEntries, 1) * sizeof(Tcl_Size));
+    if (bandEdges == NULL) {
+        ckfree(bandStart);
+        goto oneByOne;
+    }
+    for (i = 0; i < nPoints; i++) {
+        const Point2D *p, *q;
+        Tcl_Size first, last, band;
+
+        p = points + ((i > 0) ? i - 1 : nPoints - 1);
+        q = points + i;
+        if (p->y == q->y) {
+            continue;
+        }
+        first = GetPolygonBand(MIN(p->y, q->y), top, scale, nBands);
+        last = GetPolygonBand(MAX(p->y, q->y), top, scale, nBands);
+        for (band = first; band <= last; band++) {
+            bandEdges[bandStart[band]++] = i;
+        }
+    }
+    for (i = nBands; i > 0; i--) {
+        bandStart[i] = bandStart[i - 1];
+    }
+    bandStart[0] = 0;
+
+    count = 0;
+    for (i = 0; i < nSamples; i++) {
+        const Point2D *samplePtr;
+        Tcl_Size band, j;
+        int isInside;
+
+        samplePtr = samples + i;
+        if ((!IsFinitePoint(samplePtr)) || (samplePtr->y < top) || (samplePtr->y >= bottom)) {
+            continue;
+        }
+        band = GetPolygonBand(samplePtr->y, top, scale, nBands);
+        isInside = FALSE;
+        for (j = bandStart[band]; j < bandStart[band + 1]; j++) {
+            const Point2D *p, *q;
+            Tcl_Size edge;
+
+            edge = bandEdges[j];
+            p = points + ((edge > 0) ? edge - 1 : nPoints - 1);
+            q = points + edge;
+            if (((p->y <= samplePtr->y) && (samplePtr->y < q->y)) || ((q->y <= samplePtr->y) && (samplePtr->y < p->y))) {
+                double dx, dy, xIntersection;
+
+                dx = q->x - p->x;
+                dy = q->y - p->y;
+                if ((!FINITE(dx)) || (!FINITE(dy))) {
+                    isInside = FALSE;
+                    break;
+                }
+                xIntersection = p->x + (((samplePtr->y - p->y) / dy) * dx);
+                if (!FINITE(xIntersection)) {
+                    isInside = FALSE;
+                    break;
+                }
+                if (samplePtr->x < xIntersection) {
+                    isInside = !isInside;
+                }
+            }
+        }
+        inside[i] = (unsigned char)isInside;
+        count += isInside;
+    }
+    ckfree(bandEdges);
+    ckfree(bandStart);
+    return count;
+
+oneByOne:
+    count = 0;
+    for (i = 0; i < nSamples; i++) {
+        inside[i] = (unsigned char)Rbc_PointInPolygon(samples + i, points, nPoints);
+        count += inside[i];
+    }
+    return count;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -684,6 +898,255 @@ int Rbc_LineRectClip(const Extents2D *extsPtr, const Point2D *p, const Point2D *
     return TRUE;
 }
 
+/*
+ * Batch clipping computes the out codes of a block of
+ * CLIP_BLOCK_POINTS points on the stack before clipping any of its
+ * segments.
+ */
+#define CLIP_BLOCK_POINTS 256
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClipOutCode --
+ *
+ *      Computes the out code of a point against a rectangular region.
+ *      It's written without branches, so that loops over arrays of
+ *      points can be vectorized.
+ *
+ * Parameters:
+ *      const Extents2D *extsPtr - Rectangular clipping region
+ *      double x
+ *      double y
+ *
+ * Results:
+ *      Returns the sides of the region the point lies beyond, or'ed
+ *      with RBC_CLIP_NAN if a coordinate isn't a number.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+INLINE static int ClipOutCode(const Extents2D *extsPtr, double x, double y) {
+    return (((y < extsPtr->top) ? RBC_CLIP_TOP : 0) | ((y > extsPtr->bottom) ? RBC_CLIP_BOTTOM : 0) |
+            ((x > extsPtr->right) ? RBC_CLIP_RIGHT : 0) | ((x < extsPtr->left) ? RBC_CLIP_LEFT : 0) |
+            (((x != x) | (y != y)) ? RBC_CLIP_NAN : 0));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Rbc_ClipOutCodes --
+ *
+ *      Computes the out codes of an array of points against a
+ *      rectangular region.  A segment whose end points have no out
+ *      code is inside the region, and one whose end points share a
+ *      side is outside of it.  Only the other segments need to be
+ *      clipped.
+ *
+ * Parameters:
+ *      const Extents2D *extsPtr - Rectangular clipping region
+ *      const Point2D *points
+ *      Tcl_Size nPoints
+ *      unsigned char *codes - (out) Out code of each point
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+void Rbc_ClipOutCodes(const Extents2D *extsPtr, const Point2D *points, Tcl_Size nPoints, unsigned char *codes) {
+    Tcl_Size i;
+
+    for (i = 0; i < nPoints; i++) {
+        codes[i] = (unsigned char)ClipOutCode(extsPtr, points[i].x, points[i].y);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Rbc_ClipSegments --
+ *
+ *      Clips an array of line segments to a rectangular region.  The
+ *      out codes of the end points are computed for a block of
+ *      segments at a time; segments entirely inside or outside of the
+ *      region are kept or dropped on their codes alone, and only
+ *      those crossing its sides are clipped by Rbc_LineRectClip.
+ *
+ * Parameters:
+ *      const Extents2D *extsPtr - Rectangular clipping region
+ *      Segment2D *segments - Segments, replaced by the clipped
+ *                            segments
+ *      Tcl_Size nSegments
+ *      Tcl_Size *indices - Index of each segment, kept alongside the
+ *                          clipped segments, or NULL
+ *
+ * Results:
+ *      Returns the number of segments within the region.  They're
+ *      stored at the start of the array, in their original order.
+ *      The same segments are kept as by Rbc_LineRectClip.
+ *
+ * Side Effects:
+ *      The segments, and their indices, are overwritten.
+ *
+ *----------------------------------------------------------------------
+ */
+Tcl_Size Rbc_ClipSegments(const Extents2D *extsPtr, Segment2D *segments, Tcl_Size nSegments, Tcl_Size *indices) {
+    unsigned char pCodes[CLIP_BLOCK_POINTS];
+    unsigned char qCodes[CLIP_BLOCK_POINTS];
+    Segment2D clipped;
+    Tcl_Size count;
+    Tcl_Size start;
+    Tcl_Size nBlock;
+    Tcl_Size j;
+
+    if ((!IsValidExtents(extsPtr)) || (segments == NULL)) {
+        return 0;
+    }
+    count = 0;
+    for (start = 0; start < nSegments; start += CLIP_BLOCK_POINTS) {
+        nBlock = MIN(nSegments - start, CLIP_BLOCK_POINTS);
+        for (j = 0; j < nBlock; j++) {
+            pCodes[j] = (unsigned char)ClipOutCode(extsPtr, segments[start + j].p.x, segments[start + j].p.y);
+            qCodes[j] = (unsigned char)ClipOutCode(extsPtr, segments[start + j].q.x, segments[start + j].q.y);
+        }
+        for (j = 0; j < nBlock; j++) {
+            if ((pCodes[j] & qCodes[j]) != 0) {
+                continue;
+            }
+            if ((pCodes[j] | qCodes[j]) == 0) {
+                clipped = segments[start + j];
+            } else if (!Rbc_LineRectClip(extsPtr, &segments[start + j].p, &segments[start + j].q, &clipped)) {
+                continue;
+            }
+            segments[count] = clipped;
+            if (indices != NULL) {
+                indices[count] = indices[start + j];
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Rbc_ClipPolyline --
+ *
+ *      Clips the segments joining consecutive points of an array to
+ *      a rectangular region.  This is Rbc_ClipSegments for a
+ *      polyline: each point's out code is computed once, for both
+ *      segments it ends.
+ *
+ * Parameters:
+ *      const Extents2D *extsPtr - Rectangular clipping region
+ *      const Point2D *points
+ *      Tcl_Size nPoints
+ *      Segment2D *segments - (out) Clipped segments.  Room for
+ *                            nPoints - 1 segments is needed.
+ *      Tcl_Size *starts - (out) Index of the first point of each
+ *                         clipped segment
+ *
+ * Results:
+ *      Returns the number of segments within the region.
+ *
+ * Side Effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+Tcl_Size Rbc_ClipPolyline(const Extents2D *extsPtr, const Point2D *points, Tcl_Size nPoints, Segment2D *segments,
+                          Tcl_Size *starts) {
+    unsigned char codes[CLIP_BLOCK_POINTS + 1];
+    const Point2D *p;
+    Tcl_Size count;
+    Tcl_Size start;
+    Tcl_Size nBlock;
+    Tcl_Size j;
+
+    if ((!IsValidExtents(extsPtr)) || (points == NULL) || (segments == NULL) || (starts == NULL)) {
+        return 0;
+    }
+    count = 0;
+    for (start = 0; (start + 1) < nPoints; start += CLIP_BLOCK_POINTS) {
+        /*
+         * The block's last point starts the next block as well.
+         */
+        nBlock = MIN(nPoints - 1 - start, CLIP_BLOCK_POINTS);
+        Rbc_ClipOutCodes(extsPtr, points + start, nBlock + 1, codes);
+        for (j = 0; j < nBlock; j++) {
+            if ((codes[j] & codes[j + 1]) != 0) {
+                continue;
+            }
+            p = points + start + j;
+            if ((codes[j] | codes[j + 1]) == 0) {
+                segments[count].p = p[0];
+                segments[count].q = p[1];
+            } else if (!Rbc_LineRectClip(extsPtr, p, p + 1, segments + count)) {
+                continue;
+            }
+            starts[count] = start + j;
+            count++;
+        }
+    }
+    return count;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PolygonInside --
+ *
+ *      Tests, a block of out codes at a time, whether every vertex of
+ *      a polygon lies at least one pixel inside a rectangular region.
+ *      Vertices on or next to the sides are left to the general
+ *      clipping path, which treats nearly vertical and horizontal
+ *      edges there specially.
+ *
+ * Parameters:
+ *      const Extents2D *extsPtr - Rectangular clipping region
+ *      const Point2D *points
+ *      Tcl_Size nPoints
+ *
+ * Results:
+ *      Returns TRUE if the polygon needs no clipping.
+ *
+ *----------------------------------------------------------------------
+ */
+static int PolygonInside(const Extents2D *extsPtr, const Point2D *points, Tcl_Size nPoints) {
+    unsigned char codes[CLIP_BLOCK_POINTS];
+    Extents2D inner;
+    Tcl_Size start;
+    Tcl_Size nBlock;
+    Tcl_Size j;
+
+    inner = *extsPtr;
+    inner.left += 1.0;
+    inner.top += 1.0;
+    inner.right -= 1.0;
+    inner.bottom -= 1.0;
+    for (start = 0; start < nPoints; start += CLIP_BLOCK_POINTS) {
+        int code;
+
+        nBlock = MIN(nPoints - start, CLIP_BLOCK_POINTS);
+        Rbc_ClipOutCodes(&inner, points + start, nBlock, codes);
+        code = 0;
+        for (j = 0; j < nBlock; j++) {
+            code |= codes[j];
+        }
+        if (code != 0) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
 #define EPSILON FLT_EPSILON
 
 /*
@@ -703,6 +1166,10 @@ int Rbc_LineRectClip(const Extents2D *extsPtr, const Point2D *p, const Point2D *
  *      outputCapacity is the number of Point2D entries available in
  *      outputPts.
  *
+ *      The vertices are first tested in blocks of out codes.  A
+ *      polygon well inside the region is copied without clipping any
+ *      of its edges.
+ *
  *      Reference:  Liang-Barsky Polygon Clipping Algorithm
  *
  * Parameters:
@@ -750,6 +1217,17 @@ Tcl_Size Rbc_PolyRectClip(const Extents2D *extsPtr, const Point2D *points, Tcl_S
             return 0;
         }
     }
+    if ((nPoints < clipCapacity) && (PolygonInside(extsPtr, points, nPoints))) {
+        /*
+         * Every edge is kept whole.  Produce the vertices in the order
+         * the edge loop below would: the end point of each edge, then
+         * the closing vertex.
+         */
+        memcpy(clipPts, points + 1, (size_t)(nPoints - 1) * sizeof(Point2D));
+        clipPts[nPoints - 1] = points[0];
+        clipPts[nPoints] = clipPts[0];
+        return nPoints + 1;
+    }
     count = 0;
     for (i = 0; i < nPoints; i++) {
         const Point2D *p;
@@ -10,10 +10,12 @@
  */
 
 #include "rbcGraph.h"
+#include "rbcGrElem.h"
 #include <X11/Xutil.h>
 
 
 static Pen *NameToPen(Graph *graphPtr, Tcl_Obj *nameObj);
+static void RemapPenElements(Graph *graphPtr, Pen *penPtr);
 
 typedef int RbcGrPenOp(Graph *graphPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]);
 
@@ -553,6 +555,7 @@ static int ConfigureOp(Graph *graphPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_O
         }
 
         if (penPtr->refCount > 0) {
+            RemapPenElements(graphPtr, penPtr);
             redraw++;
         }
     }
@@ -566,6 +569,53 @@ static int ConfigureOp(Graph *graphPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_O
     return TCL_OK;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * RemapPenElements --
+ *
+ *      Marks every element using the pen, as a normal, active or
+ *      palette pen, to be mapped again.  What an element maps can
+ *      depend on its pens, for example whether a line is decimated.
+ *
+ * Parameters:
+ *      Graph *graphPtr
+ *      Pen *penPtr - The reconfigured pen
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      MAP_ITEM is set on the elements using the pen.
+ *
+ *----------------------------------------------------------------------
+ */
+static void RemapPenElements(Graph *graphPtr, Pen *penPtr) {
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch cursor;
+
+    for (hPtr = Tcl_FirstHashEntry(&graphPtr->elements.table, &cursor); hPtr != NULL;
+         hPtr = Tcl_NextHashEntry(&cursor)) {
+        Element *elemPtr;
+        Rbc_ChainLink *linkPtr;
+
+        elemPtr = (Element *)Tcl_GetHashValue(hPtr);
+        if ((elemPtr->normalPenPtr == penPtr) || (elemPtr->activePenPtr == penPtr)) {
+            elemPtr->flags |= MAP_ITEM;
+            continue;
+        }
+        for (linkPtr = Rbc_ChainFirstLink(elemPtr->palette); linkPtr != NULL; linkPtr = Rbc_ChainNextLink(linkPtr)) {
+            PenStyle *stylePtr;
+
+            stylePtr = Rbc_ChainGetValue(linkPtr);
+            if (stylePtr->penPtr == penPtr) {
+                elemPtr->flags |= MAP_ITEM;
+                break;
+            }
+        }
+    }
+}
+
 /*
  *----------------------------------------------------------------------
  *
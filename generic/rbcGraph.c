@@ -45,6 +45,7 @@ Rbc_Uid rbcPolygonMarkerUid;
 Rbc_Uid rbcWindowMarkerUid;
 
 #define DEF_GRAPH_ASPECT_RATIO "0.0"
+#define DEF_GRAPH_ASYNC_MAP "0"
 #define DEF_GRAPH_BAR_BASELINE "0.0"
 #define DEF_GRAPH_BAR_MODE "normal"
 #define DEF_GRAPH_BAR_WIDTH "0.8"
@@ -185,6 +186,8 @@ typedef struct {
 static const Tk_OptionSpec graphOptionSpecs[] = {
     {TK_OPTION_DOUBLE, "-aspect", "aspect", "Aspect", DEF_GRAPH_ASPECT_RATIO, -1, offsetof(Graph, aspect),
      TK_OPTION_DONT_SET_DEFAULT, NULL, GRAPH_LAYOUT_MASK | GRAPH_REDRAW_MASK},
+    {TK_OPTION_BOOLEAN, "-asyncmap", "asyncMap", "AsyncMap", DEF_GRAPH_ASYNC_MAP, -1, offsetof(Graph, asyncMap), 0,
+     NULL, GRAPH_REDRAW_MASK},
     {TK_OPTION_BORDER, "-background", "background", "Background", DEF_GRAPH_BACKGROUND, -1, offsetof(Graph, border), 0,
      DEF_GRAPH_BG_MONO, GRAPH_GC_MASK | GRAPH_REDRAW_MASK},
     {TK_OPTION_STRING, "-barmode", "barMode", "BarMode", DEF_GRAPH_BAR_MODE, offsetof(Graph, barModeObjPtr), -1, 0,
@@ -2008,6 +2011,7 @@ static Graph *CreateGraph(Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv
     graphPtr->display = Tk_Display(tkwin);
     graphPtr->interp = interp;
     graphPtr->classUid = classUid;
+    graphPtr->threadId = Tcl_GetCurrentThread();
     /*
      * Graph option lifecycle state.
      */
@@ -3437,7 +3441,11 @@ static void DisplayGraph(ClientData clientData) {
     }
     graphPtr->width = Tk_Width(graphPtr->tkwin);
     graphPtr->height = Tk_Height(graphPtr->tkwin);
+    if (graphPtr->asyncMap) {
+        graphPtr->flags |= MAP_ASYNC;
+    }
     Rbc_LayoutGraph(graphPtr);
+    graphPtr->flags &= ~MAP_ASYNC;
     Rbc_UpdateCrosshairs(graphPtr);
     if (!Tk_IsMapped(graphPtr->tkwin)) {
         /* The graph's window isn't displayed, so don't bother
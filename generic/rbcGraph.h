@@ -500,6 +500,13 @@ struct GraphStruct {
                                 * redrawing each element. */
     int backWidth, backHeight; /* Size of element backing store pixmap. */
 
+    int asyncMap;         /* If non-zero, long elements are mapped
+                           * on worker threads while the graph is
+                           * displayed, and the previously mapped
+                           * geometry is drawn until they finish. */
+    Tcl_ThreadId threadId; /* Thread the widget belongs to.  Worker
+                            * threads post their results to it. */
+
     /*
      * barchart specific information
      */
@@ -560,6 +567,12 @@ struct GraphStruct {
  *
  *    LAYOUT_NEEDED
  *
+ *    MAP_ASYNC        Set while the graph is laid out to be
+ *                displayed.  Elements may then be mapped on
+ *                a worker thread (see -asyncmap).  Other
+ *                layouts, for PostScript output or snapshots,
+ *                always map elements right away.
+ *
  *    REDRAW_BACKING_STORE    If set, redraw all elements into the pixmap
  *                used for buffering elements.
  *
@@ -588,6 +601,7 @@ struct GraphStruct {
 #define GET_AXIS_GEOMETRY (1 << 2) /* 0x0004 */
 #define RESET_AXES (1 << 3)        /* 0x0008 */
 #define LAYOUT_NEEDED (1 << 4)     /* 0x0010 */
+#define MAP_ASYNC (1 << 5)         /* 0x0020 */
 
 #define REDRAW_PENDING (1 << 8)        /* 0x0100 */
 #define DRAW_LEGEND (1 << 9)           /* 0x0200 */
@@ -601,6 +615,16 @@ struct GraphStruct {
 #define REDRAW_WORLD (DRAW_MARGINS | DRAW_LEGEND)
 #define RESET_WORLD (REDRAW_WORLD | MAP_WORLD)
 
+/*
+ * Out codes of a point against a clipping region: the sides of the
+ * region the point lies beyond.  See Rbc_ClipOutCodes.
+ */
+#define RBC_CLIP_TOP (1 << 0)
+#define RBC_CLIP_BOTTOM (1 << 1)
+#define RBC_CLIP_RIGHT (1 << 2)
+#define RBC_CLIP_LEFT (1 << 3)
+#define RBC_CLIP_NAN (1 << 4) /* A coordinate isn't a number. */
+
 /*
  * ---------------------- Forward declarations ------------------------
  */
@@ -617,8 +641,14 @@ double Rbc_HMap(Graph *graphPtr, Axis *axisPtr, double x);
 double Rbc_VMap(Graph *graphPtr, Axis *axisPtr, double y);
 Point2D Rbc_InvMap2D(Graph *graphPtr, double x, double y, Axis2D *pairPtr);
 Point2D Rbc_Map2D(Graph *graphPtr, double x, double y, Axis2D *pairPtr);
+Tcl_Size Rbc_MapArray2D(Graph *graphPtr, Axis2D *pairPtr, const double *x, const double *y, Tcl_Size nPoints,
+                        Point2D *screenPts, unsigned char *keep);
 Graph *Rbc_GetGraphFromWindowData(Tk_Window tkwin);
 int Rbc_LineRectClip(const Extents2D *extsPtr, const Point2D *p, const Point2D *q, Segment2D *clippedPtr);
+void Rbc_ClipOutCodes(const Extents2D *extsPtr, const Point2D *points, Tcl_Size nPoints, unsigned char *codes);
+Tcl_Size Rbc_ClipSegments(const Extents2D *extsPtr, Segment2D *segments, Tcl_Size nSegments, Tcl_Size *indices);
+Tcl_Size Rbc_ClipPolyline(const Extents2D *extsPtr, const Point2D *points, Tcl_Size nPoints, Segment2D *segments,
+                          Tcl_Size *starts);
 Tcl_Size Rbc_PolyRectClip(const Extents2D *extsPtr, const Point2D *inputPts, Tcl_Size nInputPts, Point2D *outputPts,
                           Tcl_Size outputCapacity);
 void Rbc_ReleaseLegendTkResources(Graph *graphPtr);
@@ -670,6 +700,8 @@ int Rbc_CrosshairsOp(Graph *graphPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj
 int Rbc_MarkerOp(Graph *graphPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]);
 int Rbc_PenOp(Graph *graphPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]);
 int Rbc_PointInPolygon(const Point2D *samplePtr, const Point2D *points, Tcl_Size nPoints);
+Tcl_Size Rbc_PointsInPolygon(const Point2D *samples, Tcl_Size nSamples, const Point2D *points, Tcl_Size nPoints,
+                             unsigned char *inside);
 int Rbc_RegionInPolygon(const Extents2D *extsPtr, const Point2D *points, Tcl_Size nPoints, int enclosed);
 int Rbc_PointInSegments(const Point2D *samplePtr, const Segment2D *segments, Tcl_Size nSegments, double halo);
 int Rbc_PostScriptOp(Graph *graphPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]);
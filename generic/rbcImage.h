@@ -179,6 +179,8 @@ typedef struct {
 
 /* Prototypes of image routines */
 
+Pixmap Rbc_ColorImageMask(Tk_Window tkwin, Rbc_ColorImage image);
+
 void Rbc_ColorImageToGreyscale(Rbc_ColorImage image);
 
 void Rbc_ColorImageToPhoto(Tcl_Interp *interp, Rbc_ColorImage image, Tk_PhotoHandle photo);
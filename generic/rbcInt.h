@@ -36,6 +36,7 @@
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
 #include <assert.h>
 
 #if defined(WIN32)
@@ -450,13 +451,60 @@ char *Rbc_Itoa(int value);
 char *Rbc_Utoa(unsigned int value);
 char *Rbc_Dtoa(Tcl_Interp *interp, double value);
 double Rbc_RandomDouble(void);
+int Rbc_GetProcessorCount(void);
+
+/*
+ * Rbc_Random --
+ *
+ *      State of an xoshiro256** pseudo-random number generator.  The
+ *      generator is implemented in rbcUtil.c so that generated
+ *      sequences are identical on every platform for a given seed.
+ */
+typedef struct {
+    uint64_t s[4];
+} Rbc_Random;
+
+void Rbc_RandomSeed(Rbc_Random *rngPtr, uint64_t seed);
+uint64_t Rbc_RandomNext(Rbc_Random *rngPtr);
+void Rbc_RandomJump(Rbc_Random *rngPtr);
+Rbc_Random *Rbc_RandomThreadState(void);
+void Rbc_RandomUniform(Rbc_Random *rngPtr, double *valueArr, Tcl_Size length, double min, double max);
+void Rbc_RandomNormal(Rbc_Random *rngPtr, double *valueArr, Tcl_Size length, double mean, double stdDev);
+void Rbc_RandomExponential(Rbc_Random *rngPtr, double *valueArr, Tcl_Size length, double rate);
 
 int Rbc_NaturalSpline(const Point2D *origPts, Tcl_Size nOrigPts, Point2D *intpPts, Tcl_Size nIntpPts);
 int Rbc_QuadraticSpline(const Point2D *origPts, Tcl_Size nOrigPts, Point2D *intpPts, Tcl_Size nIntpPts);
+
+/*
+ * Rbc_Spline --
+ *
+ *      A natural cubic or quadratic spline fitted once through a set
+ *      of data points, and evaluated later at any number of values.
+ *      It's defined in rbcSpline.c.
+ */
+typedef enum {
+    RBC_SPLINE_NATURAL,  /* Natural cubic spline. */
+    RBC_SPLINE_QUADRATIC /* Shape preserving quadratic spline. */
+} Rbc_SplineType;
+
+typedef struct Rbc_SplineStruct Rbc_Spline;
+
+Rbc_Spline *Rbc_FitSpline(Rbc_SplineType type, const Point2D *origPts, Tcl_Size nOrigPts);
+void Rbc_FreeSpline(Rbc_Spline *splinePtr);
+Tcl_Size Rbc_SplineInterval(const Rbc_Spline *splinePtr, double x);
+double Rbc_SplineValue(const Rbc_Spline *splinePtr, Tcl_Size interval, double x);
 Tcl_Size Rbc_SimplifyLine(const Point2D *origPts, Tcl_Size low, Tcl_Size high, double tolerance, Tcl_Size indices[]);
 Tcl_Size Rbc_NaturalParametricSpline(const Point2D *origPts, Tcl_Size nOrigPts, const Extents2D *extsPtr, int isClosed,
                                      Point2D *intpPts, Tcl_Size nIntpPts);
 int Rbc_CatromParametricSpline(const Point2D *origPts, Tcl_Size nOrigPts, Point2D *intpPts, Tcl_Size nIntpPts);
+Tcl_Size Rbc_CatromSubdivide(const Point2D *points, Tcl_Size nPoints, Tcl_Size interval, double tolerance,
+                             const Extents2D *extsPtr, double *params);
+
+/*
+ * Largest number of parameters chosen by Rbc_CatromSubdivide for an
+ * interval.
+ */
+#define RBC_CATROM_MAX_PARAMS 1023
 int Rbc_GetShadowFromObj(Tcl_Interp *interp, Tk_Window tkwin, Tcl_Obj *objPtr, Shadow *shadowPtr);
 int Rbc_GetFillFromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, int *fillPtr);
 int Rbc_GetStateFromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, int *statePtr);
@@ -35,8 +35,30 @@ typedef struct {
     double y; /* 2nd derivative of Y with respect to T */
 } CubicSpline;
 
+/*
+ * A spline fitted by Rbc_FitSpline, ready to be evaluated.
+ */
+struct Rbc_SplineStruct {
+    Rbc_SplineType type; /* RBC_SPLINE_NATURAL or RBC_SPLINE_QUADRATIC. */
+    Tcl_Size nPoints;    /* Number of data points. */
+    Point2D *points;     /* Copy of the data points. */
+    void *coeffs;        /* Coefficients of each interval (Cubic2D)
+                          * of a natural spline, or the slope at
+                          * each data point (double) of a quadratic
+                          * spline. */
+};
+
 #define SQR(x) ((x) * (x))
 
+/*
+ * Catmull-Rom intervals are split in halves at most CATROM_MAX_DEPTH
+ * times by Rbc_CatromSubdivide.
+ */
+#define CATROM_MAX_DEPTH 10
+
+_Static_assert(RBC_CATROM_MAX_PARAMS == (1 << CATROM_MAX_DEPTH) - 1,
+               "RBC_CATROM_MAX_PARAMS must hold every split of an interval");
+
 /*
  * Quadratic spline parameters
  */
@@ -68,6 +90,9 @@ static CubicSpline *CubicSlopes(const Point2D points[], Tcl_Size nPoints, int is
 static Tcl_Size CubicEval(const Point2D origPts[], Tcl_Size nOrigPts, Point2D intpPts[], Tcl_Size nIntpPts,
                           const CubicSpline spline[]);
 static void CatromCoeffs(const Point2D *p, Point2D *a, Point2D *b, Point2D *c, Point2D *d);
+static int NaturalCoeffs(const Point2D points[], Tcl_Size nPoints, Cubic2D eq[]);
+static void CatromSplit(const Point2D b[], double t0, double t1, int depth, double tolerance2,
+                        const Extents2D *extsPtr, double *params, Tcl_Size *countPtr);
 
 
 static int GetSplineArrayByteCount(Tcl_Size count, size_t elementSize, size_t *byteCountPtr) {
@@ -873,7 +898,10 @@ int Rbc_QuadraticSpline(const Point2D origPts[], Tcl_Size nOrigPts, Point2D intp
 /*
  *--------------------------------------------------------------
  *
- * Rbc_NaturalSpline --
+ * NaturalCoeffs --
+ *
+ *      Computes the coefficients of the natural cubic spline through
+ *      the data points.
  *
  *      Reference:
  *
@@ -881,28 +909,22 @@ int Rbc_QuadraticSpline(const Point2D origPts[], Tcl_Size nOrigPts, Point2D intp
  *          and A. Reynolds.
  *        Prindle, Weber & Schmidt 1981 pp 112
  *
- *      Parameters:
- *
- *        origPts - vector of points, assumed to be
- *                  sorted along x.
- *        intpPts - vector of new points.
- *
  * Parameters:
- *      Point2D origPts[]
- *      int nOrigPts
- *      Point2D intpPts[]
- *      int nIntpPts
+ *      Point2D points[] - Data points, with strictly increasing x.
+ *      Tcl_Size nPoints - Number of data points, at least 3.
+ *      Cubic2D eq[] - (out) To be filled with the coefficients of
+ *                     each interval.  Has nPoints entries.
  *
  * Results:
- *      TODO: Results
+ *      Returns TRUE if the system could be solved, FALSE if memory
+ *      ran out or a coefficient isn't finite.
  *
  * Side effects:
- *      TODO: Side Effects
+ *      None.
  *
  *--------------------------------------------------------------
  */
-int Rbc_NaturalSpline(const Point2D origPts[], Tcl_Size nOrigPts, Point2D intpPts[], Tcl_Size nIntpPts) {
-    Cubic2D *eq;
+static int NaturalCoeffs(const Point2D points[], Tcl_Size nPoints, Cubic2D eq[]) {
     TriDiagonalMatrix *A;
     double *dx;
     Tcl_Size nIntervals;
@@ -910,24 +932,14 @@ int Rbc_NaturalSpline(const Point2D origPts[], Tcl_Size nOrigPts, Point2D intpPt
     Tcl_Size j;
     size_t dxBytes;
     size_t matrixBytes;
-    size_t equationBytes;
     int result;
 
-    eq = NULL;
     A = NULL;
     dx = NULL;
     result = FALSE;
-    if ((nOrigPts < 3) || (nIntpPts < 0) || !SplinePointsHaveIncreasingX(origPts, nOrigPts) ||
-        !SplineEvaluationPointsAreFinite(intpPts, nIntpPts)) {
-        return FALSE;
-    }
-    if (nIntpPts == 0) {
-        return TRUE;
-    }
-    nIntervals = nOrigPts - 1;
+    nIntervals = nPoints - 1;
     if ((GetSplineArrayByteCount(nIntervals, sizeof(*dx), &dxBytes) != TCL_OK) ||
-        (GetSplineArrayByteCount(nOrigPts, sizeof(*A), &matrixBytes) != TCL_OK) ||
-        (GetSplineArrayByteCount(nOrigPts, sizeof(*eq), &equationBytes) != TCL_OK)) {
+        (GetSplineArrayByteCount(nPoints, sizeof(*A), &matrixBytes) != TCL_OK)) {
         return FALSE;
     }
     dx = Tcl_AttemptAlloc(dxBytes);
@@ -935,10 +947,10 @@ int Rbc_NaturalSpline(const Point2D origPts[], Tcl_Size nOrigPts, Point2D intpPt
         goto cleanup;
     }
     for (i = 0; i < nIntervals; i++) {
-        dx[i] = origPts[i + 1].x - origPts[i].x;
+        dx[i] = points[i + 1].x - points[i].x;
         /*
-         * Strictly increasing X values were checked above, but retain
-         * the local check before every later division.
+         * Strictly increasing X values were checked by the caller, but
+         * retain the local check before every later division.
          */
         if (!FINITE(dx[i]) || (dx[i] <= 0.0)) {
             goto cleanup;
@@ -957,7 +969,7 @@ int Rbc_NaturalSpline(const Point2D origPts[], Tcl_Size nOrigPts, Point2D intpPt
     for (i = 0, j = 1; j < nIntervals; i++, j++) {
         double alpha;
 
-        alpha = 3.0 * ((origPts[j + 1].y - origPts[j].y) / dx[j] - (origPts[j].y - origPts[i].y) / dx[i]);
+        alpha = 3.0 * ((points[j + 1].y - points[j].y) / dx[j] - (points[j].y - points[i].y) / dx[i]);
         if (!FINITE(alpha)) {
             goto cleanup;
         }
@@ -971,12 +983,10 @@ int Rbc_NaturalSpline(const Point2D origPts[], Tcl_Size nOrigPts, Point2D intpPt
             goto cleanup;
         }
     }
-    eq = Tcl_AttemptAlloc(equationBytes);
-    if (eq == NULL) {
-        goto cleanup;
-    }
     eq[0].c = 0.0;
+    eq[nIntervals].b = 0.0;
     eq[nIntervals].c = 0.0;
+    eq[nIntervals].d = 0.0;
     /*
      * Back-substitute from interval nIntervals - 1 down to zero.
      * This form avoids relying on a signed index becoming negative.
@@ -986,13 +996,79 @@ int Rbc_NaturalSpline(const Point2D origPts[], Tcl_Size nOrigPts, Point2D intpPt
 
         j = i + 1;
         eq[i].c = A[i][2] - A[i][1] * eq[j].c;
-        dy = origPts[i + 1].y - origPts[i].y;
+        dy = points[i + 1].y - points[i].y;
         eq[i].b = dy / dx[i] - dx[i] * (eq[j].c + 2.0 * eq[i].c) / 3.0;
         eq[i].d = (eq[j].c - eq[i].c) / (3.0 * dx[i]);
         if ((!FINITE(eq[i].b)) || (!FINITE(eq[i].c)) || (!FINITE(eq[i].d))) {
             goto cleanup;
         }
     }
+    result = TRUE;
+
+cleanup:
+    if (A != NULL) {
+        ckfree(A);
+    }
+    if (dx != NULL) {
+        ckfree(dx);
+    }
+    return result;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_NaturalSpline --
+ *
+ *      Interpolates the data points with a natural cubic spline
+ *      (see NaturalCoeffs).
+ *
+ *      Parameters:
+ *
+ *        origPts - vector of points, assumed to be
+ *                  sorted along x.
+ *        intpPts - vector of new points.
+ *
+ * Parameters:
+ *      Point2D origPts[]
+ *      int nOrigPts
+ *      Point2D intpPts[]
+ *      int nIntpPts
+ *
+ * Results:
+ *      TODO: Results
+ *
+ * Side effects:
+ *      TODO: Side Effects
+ *
+ *--------------------------------------------------------------
+ */
+int Rbc_NaturalSpline(const Point2D origPts[], Tcl_Size nOrigPts, Point2D intpPts[], Tcl_Size nIntpPts) {
+    Cubic2D *eq;
+    Tcl_Size nIntervals;
+    Tcl_Size i;
+    size_t equationBytes;
+    int result;
+
+    result = FALSE;
+    if ((nOrigPts < 3) || (nIntpPts < 0) || !SplinePointsHaveIncreasingX(origPts, nOrigPts) ||
+        !SplineEvaluationPointsAreFinite(intpPts, nIntpPts)) {
+        return FALSE;
+    }
+    if (nIntpPts == 0) {
+        return TRUE;
+    }
+    nIntervals = nOrigPts - 1;
+    if (GetSplineArrayByteCount(nOrigPts, sizeof(*eq), &equationBytes) != TCL_OK) {
+        return FALSE;
+    }
+    eq = Tcl_AttemptAlloc(equationBytes);
+    if (eq == NULL) {
+        return FALSE;
+    }
+    if (!NaturalCoeffs(origPts, nOrigPts, eq)) {
+        goto cleanup;
+    }
     for (i = 0; i < nIntpPts; i++) {
         double x;
         double localX;
@@ -1043,16 +1119,197 @@ int Rbc_NaturalSpline(const Point2D origPts[], Tcl_Size nOrigPts, Point2D intpPt
     result = TRUE;
 
 cleanup:
-    if (eq != NULL) {
-        ckfree(eq);
+    ckfree(eq);
+    return result;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_FitSpline --
+ *
+ *      Fits a natural cubic or a quadratic spline through the data
+ *      points, so that it can be evaluated later, any number of
+ *      times, without solving for its coefficients again.
+ *
+ * Parameters:
+ *      Rbc_SplineType type - RBC_SPLINE_NATURAL or RBC_SPLINE_QUADRATIC
+ *      Point2D origPts[] - Data points, with strictly increasing x.
+ *      Tcl_Size nOrigPts - Number of data points.
+ *
+ * Results:
+ *      Returns the fitted spline, or NULL if there are fewer than 3
+ *      points, the x values aren't strictly increasing, or the
+ *      spline can't be computed.
+ *
+ * Side effects:
+ *      Memory is allocated for the spline.  It holds a copy of the
+ *      data points.
+ *
+ *--------------------------------------------------------------
+ */
+Rbc_Spline *Rbc_FitSpline(Rbc_SplineType type, const Point2D origPts[], Tcl_Size nOrigPts) {
+    Rbc_Spline *splinePtr;
+    size_t pointBytes;
+    size_t coeffBytes;
+    Tcl_Size i;
+
+    if ((nOrigPts < 3) || !SplinePointsHaveIncreasingX(origPts, nOrigPts)) {
+        return NULL;
     }
-    if (A != NULL) {
-        ckfree(A);
+    if ((GetSplineArrayByteCount(nOrigPts, sizeof(Point2D), &pointBytes) != TCL_OK) ||
+        (GetSplineArrayByteCount(nOrigPts, (type == RBC_SPLINE_NATURAL) ? sizeof(Cubic2D) : sizeof(double),
+                                 &coeffBytes) != TCL_OK)) {
+        return NULL;
     }
-    if (dx != NULL) {
-        ckfree(dx);
+    splinePtr = Tcl_AttemptAlloc(sizeof(Rbc_Spline));
+    if (splinePtr == NULL) {
+        return NULL;
+    }
+    splinePtr->type = type;
+    splinePtr->nPoints = nOrigPts;
+    splinePtr->points = Tcl_AttemptAlloc(pointBytes);
+    splinePtr->coeffs = Tcl_AttemptAlloc(coeffBytes);
+    if ((splinePtr->points == NULL) || (splinePtr->coeffs == NULL)) {
+        goto error;
+    }
+    memcpy(splinePtr->points, origPts, pointBytes);
+    if (type == RBC_SPLINE_NATURAL) {
+        if (!NaturalCoeffs(origPts, nOrigPts, splinePtr->coeffs)) {
+            goto error;
+        }
+    } else {
+        double *m = splinePtr->coeffs;
+
+        QuadSlopes(origPts, m, nOrigPts);
+        for (i = 0; i < nOrigPts; i++) {
+            if (!FINITE(m[i])) {
+                goto error;
+            }
+        }
+    }
+    return splinePtr;
+
+error:
+    Rbc_FreeSpline(splinePtr);
+    return NULL;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_FreeSpline --
+ *
+ *      Releases a spline fitted by Rbc_FitSpline.
+ *
+ * Parameters:
+ *      Rbc_Spline *splinePtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Memory is freed.
+ *
+ *--------------------------------------------------------------
+ */
+void Rbc_FreeSpline(Rbc_Spline *splinePtr) {
+    if (splinePtr->points != NULL) {
+        ckfree(splinePtr->points);
+    }
+    if (splinePtr->coeffs != NULL) {
+        ckfree(splinePtr->coeffs);
+    }
+    ckfree(splinePtr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_SplineInterval --
+ *
+ *      Finds the interval of a fitted spline that contains a value,
+ *      by binary search over its data points.
+ *
+ * Parameters:
+ *      const Rbc_Spline *splinePtr
+ *      double x
+ *
+ * Results:
+ *      Returns the index of the data point that starts the interval.
+ *      Values before the first or after the last data point are in
+ *      the first or the last interval.
+ *
+ * Side effects:
+ *      None.
+ *
+ *--------------------------------------------------------------
+ */
+Tcl_Size Rbc_SplineInterval(const Rbc_Spline *splinePtr, double x) {
+    Tcl_Size last;
+    Tcl_Size position;
+    int isKnot;
+
+    last = splinePtr->nPoints - 1;
+    if (!(x > splinePtr->points[0].x)) {
+        return 0;
+    }
+    if (!(x < splinePtr->points[last].x)) {
+        return last - 1;
+    }
+    position = Search(splinePtr->points, splinePtr->nPoints, x, &isKnot);
+    return (isKnot) ? position : position - 1;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_SplineValue --
+ *
+ *      Evaluates a fitted spline in one of its intervals.
+ *
+ * Parameters:
+ *      const Rbc_Spline *splinePtr
+ *      Tcl_Size interval - Interval of x, from Rbc_SplineInterval.
+ *      double x
+ *
+ * Results:
+ *      Returns the value of the spline at x.  The data points are
+ *      preserved exactly.
+ *
+ * Side effects:
+ *      None.
+ *
+ *--------------------------------------------------------------
+ */
+double Rbc_SplineValue(const Rbc_Spline *splinePtr, Tcl_Size interval, double x) {
+    const Point2D *left = splinePtr->points + interval;
+    const Point2D *right = left + 1;
+
+    if (x == left->x) {
+        return left->y;
+    }
+    if (x == right->x) {
+        return right->y;
+    }
+    if (splinePtr->type == RBC_SPLINE_NATURAL) {
+        const Cubic2D *eq = (Cubic2D *)splinePtr->coeffs + interval;
+        double localX;
+
+        localX = x - left->x;
+        return left->y + localX * (eq->b + localX * (eq->c + localX * eq->d));
+    } else {
+        const double *m = splinePtr->coeffs;
+        double param[QUAD_PARAM_COUNT];
+        Point2D point;
+        int ncase;
+
+        ncase = QuadSelect(left, right, m[interval], m[interval + 1], 0.0, param);
+        point.x = x;
+        point.y = 0.0;
+        QuadSpline(&point, left, right, param, ncase);
+        return point.y;
     }
-    return result;
 }
 
 static const SplineOpSpec splineOps[] = {{{"natural", 6, 6, "x y splx sply"}, Rbc_NaturalSpline},
@@ -1900,3 +2157,161 @@ int Rbc_CatromParametricSpline(const Point2D *points, Tcl_Size nPoints, Point2D
     ckfree(origPts);
     return TRUE;
 }
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CatromSplit --
+ *
+ *      Splits a piece of a Catmull-Rom interval, given as a cubic
+ *      Bezier curve, in halves until each half is flat: its control
+ *      points are within the tolerance of the chord joining its end
+ *      points.  The curve lies within its control polygon, so the
+ *      chord is then within the tolerance of the curve too.  Pieces
+ *      whose control polygon is outside the extents aren't split.
+ *
+ * Parameters:
+ *      const Point2D b[] - Bezier control points of the piece.
+ *      double t0, t1 - Parameters of the piece in the interval.
+ *      int depth - Number of splits left.
+ *      double tolerance2 - Square of the tolerance.
+ *      const Extents2D *extsPtr - Extents of interest, or NULL.
+ *      double *params - (out) Parameters of the splits.
+ *      Tcl_Size *countPtr - (in/out) Number of parameters in params.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The parameters of the splits are appended to params, in
+ *      increasing order.
+ *
+ *--------------------------------------------------------------
+ */
+static void CatromSplit(const Point2D b[], double t0, double t1, int depth, double tolerance2,
+                        const Extents2D *extsPtr, double *params, Tcl_Size *countPtr) {
+    Point2D left[4], right[4];
+    Point2D p01, p12, p23, p012, p123;
+    double dx, dy, length2;
+    double d1, d2;
+    double tm;
+    int i;
+
+    if (depth == 0) {
+        return;
+    }
+    if (extsPtr != NULL) {
+        double xMin, xMax, yMin, yMax;
+
+        xMin = xMax = b[0].x;
+        yMin = yMax = b[0].y;
+        for (i = 1; i < 4; i++) {
+            xMin = MIN(xMin, b[i].x), xMax = MAX(xMax, b[i].x);
+            yMin = MIN(yMin, b[i].y), yMax = MAX(yMax, b[i].y);
+        }
+        if ((xMax < extsPtr->left) || (xMin > extsPtr->right) || (yMax < extsPtr->top) ||
+            (yMin > extsPtr->bottom)) {
+            return;
+        }
+    }
+    dx = b[3].x - b[0].x;
+    dy = b[3].y - b[0].y;
+    length2 = dx * dx + dy * dy;
+    if (length2 > DBL_EPSILON) {
+        double cross;
+
+        /* Squared distances from the chord, times its squared length. */
+        cross = (b[1].x - b[0].x) * dy - (b[1].y - b[0].y) * dx;
+        d1 = cross * cross;
+        cross = (b[2].x - b[0].x) * dy - (b[2].y - b[0].y) * dx;
+        d2 = cross * cross;
+        if (MAX(d1, d2) <= tolerance2 * length2) {
+            return;
+        }
+    } else {
+        d1 = SQR(b[1].x - b[0].x) + SQR(b[1].y - b[0].y);
+        d2 = SQR(b[2].x - b[0].x) + SQR(b[2].y - b[0].y);
+        if (MAX(d1, d2) <= tolerance2) {
+            return;
+        }
+    }
+    /*
+     * Split at the middle, by de Casteljau's algorithm.
+     */
+    p01.x = (b[0].x + b[1].x) * 0.5, p01.y = (b[0].y + b[1].y) * 0.5;
+    p12.x = (b[1].x + b[2].x) * 0.5, p12.y = (b[1].y + b[2].y) * 0.5;
+    p23.x = (b[2].x + b[3].x) * 0.5, p23.y = (b[2].y + b[3].y) * 0.5;
+    p012.x = (p01.x + p12.x) * 0.5, p012.y = (p01.y + p12.y) * 0.5;
+    p123.x = (p12.x + p23.x) * 0.5, p123.y = (p12.y + p23.y) * 0.5;
+    left[0] = b[0];
+    left[1] = p01;
+    left[2] = p012;
+    left[3].x = (p012.x + p123.x) * 0.5, left[3].y = (p012.y + p123.y) * 0.5;
+    right[0] = left[3];
+    right[1] = p123;
+    right[2] = p23;
+    right[3] = b[3];
+    tm = (t0 + t1) * 0.5;
+    CatromSplit(left, t0, tm, depth - 1, tolerance2, extsPtr, params, countPtr);
+    params[(*countPtr)++] = tm;
+    CatromSplit(right, tm, t1, depth - 1, tolerance2, extsPtr, params, countPtr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_CatromSubdivide --
+ *
+ *      Chooses where to evaluate an interval of the Catmull-Rom
+ *      spline through the points (see Rbc_CatromParametricSpline),
+ *      so that the line segments joining the evaluated points stray
+ *      from the curve by no more than a tolerance.  Flat intervals
+ *      need no points at all, while sharp bends get as many as they
+ *      need, up to RBC_CATROM_MAX_PARAMS.
+ *
+ * Parameters:
+ *      const Point2D *points - Points the spline passes through.
+ *      Tcl_Size nPoints - Number of points.
+ *      Tcl_Size interval - Interval between points[interval] and
+ *                          points[interval + 1].
+ *      double tolerance - Tolerance, in the units of the points.
+ *      const Extents2D *extsPtr - If not NULL, parts of the interval
+ *                                 outside these extents get no points.
+ *      double *params - (out) Receives the parameters of the points,
+ *                       in increasing order, strictly between 0 and
+ *                       1.  Has room for RBC_CATROM_MAX_PARAMS.
+ *
+ * Results:
+ *      Returns the number of parameters stored in params.
+ *
+ * Side effects:
+ *      None.
+ *
+ *--------------------------------------------------------------
+ */
+Tcl_Size Rbc_CatromSubdivide(const Point2D *points, Tcl_Size nPoints, Tcl_Size interval, double tolerance,
+                             const Extents2D *extsPtr, double *params) {
+    const Point2D *p0, *p1, *p2, *p3;
+    Point2D b[4];
+    Tcl_Size count;
+
+    /*
+     * The end points are repeated, as in Rbc_CatromParametricSpline.
+     */
+    p0 = points + ((interval > 0) ? interval - 1 : 0);
+    p1 = points + interval;
+    p2 = points + interval + 1;
+    p3 = points + ((interval + 2 < nPoints) ? interval + 2 : nPoints - 1);
+    /*
+     * The Bezier control points of the interval.
+     */
+    b[0] = *p1;
+    b[1].x = p1->x + (p2->x - p0->x) / 6.0;
+    b[1].y = p1->y + (p2->y - p0->y) / 6.0;
+    b[2].x = p2->x - (p3->x - p1->x) / 6.0;
+    b[2].y = p2->y - (p3->y - p1->y) / 6.0;
+    b[3] = *p2;
+    count = 0;
+    CatromSplit(b, 0.0, 1.0, CATROM_MAX_DEPTH, tolerance * tolerance, extsPtr, params, &count);
+    return count;
+}
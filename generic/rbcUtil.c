@@ -355,7 +355,320 @@ void Rbc_Panic(char *format, ...) {
 }
 
 
-double Rbc_RandomDouble(void) { return (double)rand() / ((double)RAND_MAX + 1.0); }
+/*
+ * Pseudo-random numbers are generated with xoshiro256** (Blackman and
+ * Vigna).  The 256-bit state is expanded from a 64-bit seed with
+ * splitmix64, which guarantees a non-zero state for every seed.
+ */
+#define RANDOM_TO_UNIT(x) ((double)((x) >> 11) * 0x1.0p-53)         /* [0, 1) */
+#define RANDOM_TO_OPEN_UNIT(x) ((double)(((x) >> 11) + 1) * 0x1.0p-53) /* (0, 1] */
+
+typedef struct {
+    int initialized;
+    Rbc_Random rng;
+} RandomThreadData;
+
+static Tcl_ThreadDataKey randomDataKey;
+
+static inline uint64_t RotateLeft(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_RandomSeed --
+ *
+ *      Initializes the generator state from a 64-bit seed.
+ *
+ * Parameters:
+ *      Rbc_Random *rngPtr - Generator state to initialize.
+ *      uint64_t seed - Seed value.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The generator state is overwritten.  The same seed always
+ *      produces the same sequence.
+ *
+ *--------------------------------------------------------------
+ */
+void Rbc_RandomSeed(Rbc_Random *rngPtr, uint64_t seed) {
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        uint64_t z;
+
+        seed += UINT64_C(0x9e3779b97f4a7c15);
+        z = seed;
+        z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+        z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+        rngPtr->s[i] = z ^ (z >> 31);
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_RandomNext --
+ *
+ *      Advances the generator by one step.
+ *
+ * Parameters:
+ *      Rbc_Random *rngPtr - Generator state.
+ *
+ * Results:
+ *      Returns the next 64-bit pseudo-random value.
+ *
+ * Side effects:
+ *      The generator state is advanced.
+ *
+ *--------------------------------------------------------------
+ */
+uint64_t Rbc_RandomNext(Rbc_Random *rngPtr) {
+    uint64_t *s = rngPtr->s;
+    uint64_t result, t;
+
+    result = RotateLeft(s[1] * 5, 7) * 9;
+    t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = RotateLeft(s[3], 45);
+    return result;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_RandomJump --
+ *
+ *      Advances the generator by 2^128 steps.  Repeated jumps split
+ *      one seeded sequence into non-overlapping substreams that can
+ *      be filled independently of each other.
+ *
+ * Parameters:
+ *      Rbc_Random *rngPtr - Generator state.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The generator state is advanced.
+ *
+ *--------------------------------------------------------------
+ */
+void Rbc_RandomJump(Rbc_Random *rngPtr) {
+    static const uint64_t jump[] = {UINT64_C(0x180ec6d33cfd0aba), UINT64_C(0xd5a61266f0c9392c),
+                                    UINT64_C(0xa9582618e03fc9aa), UINT64_C(0x39abdc4529b1661c)};
+    uint64_t s0, s1, s2, s3;
+    int i, b;
+
+    s0 = s1 = s2 = s3 = 0;
+    for (i = 0; i < 4; i++) {
+        for (b = 0; b < 64; b++) {
+            if (jump[i] & (UINT64_C(1) << b)) {
+                s0 ^= rngPtr->s[0];
+                s1 ^= rngPtr->s[1];
+                s2 ^= rngPtr->s[2];
+                s3 ^= rngPtr->s[3];
+            }
+            Rbc_RandomNext(rngPtr);
+        }
+    }
+    rngPtr->s[0] = s0;
+    rngPtr->s[1] = s1;
+    rngPtr->s[2] = s2;
+    rngPtr->s[3] = s3;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_RandomThreadState --
+ *
+ *      Gets the unseeded generator of the current thread.  The
+ *      generator is seeded from the clock on first use.
+ *
+ * Parameters:
+ *      None.
+ *
+ * Results:
+ *      Returns the thread's generator state.
+ *
+ * Side effects:
+ *      The thread's generator may be initialized.
+ *
+ *--------------------------------------------------------------
+ */
+Rbc_Random *Rbc_RandomThreadState(void) {
+    RandomThreadData *dataPtr;
+
+    dataPtr = (RandomThreadData *)Tcl_GetThreadData(&randomDataKey, sizeof(RandomThreadData));
+    if (!dataPtr->initialized) {
+        Tcl_Time now;
+
+        Tcl_GetTime(&now);
+        Rbc_RandomSeed(&dataPtr->rng,
+                       ((uint64_t)now.sec << 20) ^ (uint64_t)now.usec ^ (uint64_t)(uintptr_t)dataPtr);
+        dataPtr->initialized = TRUE;
+    }
+    return &dataPtr->rng;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_RandomUniform --
+ *
+ *      Fills an array with values uniformly distributed over
+ *      [min, max).
+ *
+ * Parameters:
+ *      Rbc_Random *rngPtr - Generator state.
+ *      double *valueArr - Array to fill.
+ *      Tcl_Size length - Number of values to generate.
+ *      double min - Lower bound.
+ *      double max - Upper bound.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The generator state is advanced once per value.
+ *
+ *--------------------------------------------------------------
+ */
+void Rbc_RandomUniform(Rbc_Random *rngPtr, double *valueArr, Tcl_Size length, double min, double max) {
+    Rbc_Random rng = *rngPtr;
+    double range = max - min;
+    Tcl_Size i;
+
+    for (i = 0; i < length; i++) {
+        valueArr[i] = min + range * RANDOM_TO_UNIT(Rbc_RandomNext(&rng));
+    }
+    *rngPtr = rng;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_RandomNormal --
+ *
+ *      Fills an array with normally distributed values using the
+ *      Box-Muller transform.  Each pair of uniform values yields two
+ *      normal values, so the generator advances by an even number of
+ *      steps.
+ *
+ * Parameters:
+ *      Rbc_Random *rngPtr - Generator state.
+ *      double *valueArr - Array to fill.
+ *      Tcl_Size length - Number of values to generate.
+ *      double mean - Mean of the distribution.
+ *      double stdDev - Standard deviation of the distribution.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The generator state is advanced.
+ *
+ *--------------------------------------------------------------
+ */
+void Rbc_RandomNormal(Rbc_Random *rngPtr, double *valueArr, Tcl_Size length, double mean, double stdDev) {
+    Rbc_Random rng = *rngPtr;
+    Tcl_Size i;
+
+    for (i = 0; i < length; i += 2) {
+        double r, theta;
+
+        r = stdDev * sqrt(-2.0 * log(RANDOM_TO_OPEN_UNIT(Rbc_RandomNext(&rng))));
+        theta = 2.0 * M_PI * RANDOM_TO_UNIT(Rbc_RandomNext(&rng));
+        valueArr[i] = mean + r * cos(theta);
+        if ((i + 1) < length) {
+            valueArr[i + 1] = mean + r * sin(theta);
+        }
+    }
+    *rngPtr = rng;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_RandomExponential --
+ *
+ *      Fills an array with exponentially distributed values.
+ *
+ * Parameters:
+ *      Rbc_Random *rngPtr - Generator state.
+ *      double *valueArr - Array to fill.
+ *      Tcl_Size length - Number of values to generate.
+ *      double rate - Rate parameter (inverse of the mean).
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The generator state is advanced once per value.
+ *
+ *--------------------------------------------------------------
+ */
+void Rbc_RandomExponential(Rbc_Random *rngPtr, double *valueArr, Tcl_Size length, double rate) {
+    Rbc_Random rng = *rngPtr;
+    double scale = -1.0 / rate;
+    Tcl_Size i;
+
+    for (i = 0; i < length; i++) {
+        valueArr[i] = scale * log(RANDOM_TO_OPEN_UNIT(Rbc_RandomNext(&rng)));
+    }
+    *rngPtr = rng;
+}
+
+double Rbc_RandomDouble(void) { return RANDOM_TO_UNIT(Rbc_RandomNext(Rbc_RandomThreadState())); }
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_GetProcessorCount --
+ *
+ *      Returns the number of processors available to the process.
+ *      The count is looked up once.
+ *
+ * Parameters:
+ *      None.
+ *
+ * Results:
+ *      Returns the number of processors, at least 1.
+ *
+ * Side effects:
+ *      None.
+ *
+ *--------------------------------------------------------------
+ */
+int Rbc_GetProcessorCount(void) {
+    static int nProcessors = 0;
+
+    if (nProcessors == 0) {
+        int count;
+
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+
+        GetSystemInfo(&info);
+        count = (int)info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+        long n;
+
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        count = (n > INT_MAX) ? INT_MAX : (int)n;
+#else
+        count = 1;
+#endif
+        nProcessors = (count > 0) ? count : 1;
+    }
+    return nProcessors;
+}
 
 /*
  *--------------------------------------------------------------
@@ -0,0 +1,580 @@
+/*
+ * rbcVecChunk.c --
+ *
+ *      This module implements the chunked storage used by compressed
+ *      vectors.  Values are grouped into chunks of
+ *      RBC_VECTOR_CHUNK_VALUES values and each chunk is encoded with
+ *      the scheme that gives the smallest result:
+ *
+ *        o XOR encoding (as in Facebook's Gorilla): each value is
+ *          XOR-ed with its predecessor and only the meaningful bits
+ *          of the difference are stored.  Slowly varying values
+ *          compress well.
+ *
+ *        o Delta-of-delta encoding of the IEEE bit patterns.
+ *          Sequences with a (nearly) constant step, such as time
+ *          axes, compress to a few bits per value.
+ *
+ *        o Raw values, when neither encoding helps.
+ *
+ *      Both encodings are lossless.  Every chunk records the range of
+ *      its finite values, so range queries can skip whole chunks.
+ *
+ * Copyright (c) 2009 Samuel Green, Nicholas Hudson, Stanton Sievers, Jarrod Stormo
+ * All rights reserved.
+ *
+ * See "license.terms" for details.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "rbcVector.h"
+
+enum ChunkEncodings { CHUNK_RAW, CHUNK_XOR, CHUNK_DOD };
+
+/*
+ * Worst case sizes of the encodings of one chunk.  A XOR encoded
+ * value takes at most 2 + 6 + 6 + 64 bits, a delta-of-delta encoded
+ * value at most 4 + 64 bits.
+ */
+#define CHUNK_RAW_BYTES (RBC_VECTOR_CHUNK_VALUES * sizeof(double))
+#define CHUNK_MAX_BYTES ((RBC_VECTOR_CHUNK_VALUES * 78 + 7) / 8 + 8)
+
+typedef struct {
+    unsigned char *bytes; /* Output buffer. */
+    size_t nBytes;        /* Number of complete bytes written. */
+    uint64_t acc;         /* Pending bits, right aligned. */
+    int nBits;            /* Number of pending bits. */
+} BitWriter;
+
+typedef struct {
+    const unsigned char *bytes; /* Input buffer. */
+    size_t nBytes;              /* Size of the input buffer. */
+    size_t pos;                 /* Next byte to load. */
+    uint64_t acc;               /* Loaded bits, right aligned. */
+    int nBits;                  /* Number of unread bits in acc. */
+} BitReader;
+
+static uint64_t DoubleToBits(double value) {
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static double BitsToDouble(uint64_t bits) {
+    double value;
+
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static int CountLeadingZeros(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+
+    while (!(x & ((uint64_t)1 << 63))) {
+        x <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static int CountTrailingZeros(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/*
+ * Appends the low nBits bits (1 to 32) of value to the writer.
+ */
+static void PutBits32(BitWriter *writerPtr, uint64_t value, int nBits) {
+    writerPtr->acc = (writerPtr->acc << nBits) | (value & (((uint64_t)1 << nBits) - 1));
+    writerPtr->nBits += nBits;
+    while (writerPtr->nBits >= 8) {
+        writerPtr->nBits -= 8;
+        writerPtr->bytes[writerPtr->nBytes++] = (unsigned char)(writerPtr->acc >> writerPtr->nBits);
+    }
+}
+
+static void PutBits(BitWriter *writerPtr, uint64_t value, int nBits) {
+    if (nBits > 32) {
+        PutBits32(writerPtr, value >> 32, nBits - 32);
+        nBits = 32;
+    }
+    PutBits32(writerPtr, value, nBits);
+}
+
+static void FlushBits(BitWriter *writerPtr) {
+    if (writerPtr->nBits > 0) {
+        writerPtr->bytes[writerPtr->nBytes++] = (unsigned char)(writerPtr->acc << (8 - writerPtr->nBits));
+        writerPtr->nBits = 0;
+    }
+}
+
+/*
+ * Reads nBits bits (1 to 32).  Reading past the end of the buffer
+ * gives zero bits.
+ */
+static uint64_t GetBits32(BitReader *readerPtr, int nBits) {
+    while (readerPtr->nBits < nBits) {
+        readerPtr->acc <<= 8;
+        if (readerPtr->pos < readerPtr->nBytes) {
+            readerPtr->acc |= readerPtr->bytes[readerPtr->pos++];
+        }
+        readerPtr->nBits += 8;
+    }
+    readerPtr->nBits -= nBits;
+    return (readerPtr->acc >> readerPtr->nBits) & (((uint64_t)1 << nBits) - 1);
+}
+
+static uint64_t GetBits(BitReader *readerPtr, int nBits) {
+    uint64_t high = 0;
+
+    if (nBits > 32) {
+        high = GetBits32(readerPtr, nBits - 32) << 32;
+        nBits = 32;
+    }
+    return high | GetBits32(readerPtr, nBits);
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * EncodeXor --
+ *
+ *      Encodes values with Gorilla's XOR scheme.  The first value is
+ *      stored verbatim.  For each following value, the XOR with its
+ *      predecessor is written as:
+ *
+ *          0                       value repeats
+ *          1 0 <bits>              meaningful bits fit in the previous
+ *                                  leading/trailing zero window
+ *          1 1 <6> <6> <bits>      new window: leading zeros, number
+ *                                  of meaningful bits minus one
+ *
+ * Results:
+ *      Returns the number of bytes written to bytes.
+ *
+ * ----------------------------------------------------------------------
+ */
+static size_t EncodeXor(const double *valueArr, Tcl_Size length, unsigned char *bytes) {
+    BitWriter writer = {bytes, 0, 0, 0};
+    uint64_t prev;
+    int prevLeading, prevTrailing;
+    Tcl_Size i;
+
+    prev = DoubleToBits(valueArr[0]);
+    PutBits(&writer, prev, 64);
+    prevLeading = -1;
+    prevTrailing = 0;
+    for (i = 1; i < length; i++) {
+        uint64_t bits, x;
+        int leading, trailing;
+
+        bits = DoubleToBits(valueArr[i]);
+        x = bits ^ prev;
+        prev = bits;
+        if (x == 0) {
+            PutBits(&writer, 0, 1);
+            continue;
+        }
+        leading = CountLeadingZeros(x);
+        trailing = CountTrailingZeros(x);
+        if ((prevLeading >= 0) && (leading >= prevLeading) && (trailing >= prevTrailing)) {
+            PutBits(&writer, 2, 2);
+            PutBits(&writer, x >> prevTrailing, 64 - prevLeading - prevTrailing);
+        } else {
+            int nSignificant = 64 - leading - trailing;
+
+            PutBits(&writer, 3, 2);
+            PutBits(&writer, (uint64_t)leading, 6);
+            PutBits(&writer, (uint64_t)(nSignificant - 1), 6);
+            PutBits(&writer, x >> trailing, nSignificant);
+            prevLeading = leading;
+            prevTrailing = trailing;
+        }
+    }
+    FlushBits(&writer);
+    return writer.nBytes;
+}
+
+static void DecodeXor(const unsigned char *bytes, size_t nBytes, Tcl_Size length, double *valueArr) {
+    BitReader reader = {bytes, nBytes, 0, 0, 0};
+    uint64_t prev;
+    int prevLeading, prevTrailing;
+    Tcl_Size i;
+
+    prev = GetBits(&reader, 64);
+    valueArr[0] = BitsToDouble(prev);
+    prevLeading = 0;
+    prevTrailing = 0;
+    for (i = 1; i < length; i++) {
+        if (GetBits(&reader, 1)) {
+            if (GetBits(&reader, 1)) {
+                prevLeading = (int)GetBits(&reader, 6);
+                prevTrailing = 64 - prevLeading - ((int)GetBits(&reader, 6) + 1);
+                if (prevTrailing < 0) {
+                    prevTrailing = 0; /* Corrupt window. */
+                }
+            }
+            prev ^= GetBits(&reader, 64 - prevLeading - prevTrailing) << prevTrailing;
+        }
+        valueArr[i] = BitsToDouble(prev);
+    }
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * EncodeDeltaOfDelta --
+ *
+ *      Encodes the IEEE bit patterns of the values as integers.  The
+ *      first pattern is stored verbatim, then the zigzag encoded
+ *      difference between consecutive deltas is written as:
+ *
+ *          0                       same delta
+ *          10   <7>                difference below 2^7
+ *          110  <12>               difference below 2^12
+ *          1110 <20>               difference below 2^20
+ *          1111 <64>               any other difference
+ *
+ *      All arithmetic wraps modulo 2^64, so the encoding is lossless
+ *      for any values.
+ *
+ * Results:
+ *      Returns the number of bytes written to bytes.
+ *
+ * ----------------------------------------------------------------------
+ */
+static size_t EncodeDeltaOfDelta(const double *valueArr, Tcl_Size length, unsigned char *bytes) {
+    BitWriter writer = {bytes, 0, 0, 0};
+    uint64_t prev, prevDelta;
+    Tcl_Size i;
+
+    prev = DoubleToBits(valueArr[0]);
+    PutBits(&writer, prev, 64);
+    prevDelta = 0;
+    for (i = 1; i < length; i++) {
+        uint64_t bits, delta, dod, zigzag;
+
+        bits = DoubleToBits(valueArr[i]);
+        delta = bits - prev;
+        dod = delta - prevDelta;
+        zigzag = (dod << 1) ^ (uint64_t)(-(int64_t)(dod >> 63));
+        prev = bits;
+        prevDelta = delta;
+        if (zigzag == 0) {
+            PutBits(&writer, 0, 1);
+        } else if (zigzag < ((uint64_t)1 << 7)) {
+            PutBits(&writer, 2, 2);
+            PutBits(&writer, zigzag, 7);
+        } else if (zigzag < ((uint64_t)1 << 12)) {
+            PutBits(&writer, 6, 3);
+            PutBits(&writer, zigzag, 12);
+        } else if (zigzag < ((uint64_t)1 << 20)) {
+            PutBits(&writer, 14, 4);
+            PutBits(&writer, zigzag, 20);
+        } else {
+            PutBits(&writer, 15, 4);
+            PutBits(&writer, zigzag, 64);
+        }
+    }
+    FlushBits(&writer);
+    return writer.nBytes;
+}
+
+static void DecodeDeltaOfDelta(const unsigned char *bytes, size_t nBytes, Tcl_Size length, double *valueArr) {
+    BitReader reader = {bytes, nBytes, 0, 0, 0};
+    uint64_t prev, delta;
+    Tcl_Size i;
+
+    prev = GetBits(&reader, 64);
+    valueArr[0] = BitsToDouble(prev);
+    delta = 0;
+    for (i = 1; i < length; i++) {
+        uint64_t zigzag;
+
+        if (!GetBits(&reader, 1)) {
+            zigzag = 0;
+        } else if (!GetBits(&reader, 1)) {
+            zigzag = GetBits(&reader, 7);
+        } else if (!GetBits(&reader, 1)) {
+            zigzag = GetBits(&reader, 12);
+        } else if (!GetBits(&reader, 1)) {
+            zigzag = GetBits(&reader, 20);
+        } else {
+            zigzag = GetBits(&reader, 64);
+        }
+        delta += (zigzag >> 1) ^ (uint64_t)(-(int64_t)(zigzag & 1));
+        prev += delta;
+        valueArr[i] = BitsToDouble(prev);
+    }
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * EncodeChunk --
+ *
+ *      Encodes one full chunk of values with the smallest encoding
+ *      and records the range of its finite values.
+ *
+ * Results:
+ *      A standard Tcl result.  TCL_ERROR is returned if memory for
+ *      the encoded bytes can't be allocated.
+ *
+ * ----------------------------------------------------------------------
+ */
+static int EncodeChunk(Rbc_VectorChunk *chunkPtr, const double *valueArr) {
+    unsigned char xorBytes[CHUNK_MAX_BYTES], dodBytes[CHUNK_MAX_BYTES];
+    const unsigned char *bytes;
+    size_t nXor, nDod, nBytes;
+    double min, max;
+    Tcl_Size i;
+
+    min = DBL_MAX, max = -DBL_MAX;
+    for (i = 0; i < RBC_VECTOR_CHUNK_VALUES; i++) {
+        if (FINITE(valueArr[i])) {
+            if (min > valueArr[i]) {
+                min = valueArr[i];
+            }
+            if (max < valueArr[i]) {
+                max = valueArr[i];
+            }
+        }
+    }
+    nXor = EncodeXor(valueArr, RBC_VECTOR_CHUNK_VALUES, xorBytes);
+    nDod = EncodeDeltaOfDelta(valueArr, RBC_VECTOR_CHUNK_VALUES, dodBytes);
+    if ((nXor <= nDod) && (nXor < CHUNK_RAW_BYTES)) {
+        chunkPtr->encoding = CHUNK_XOR;
+        bytes = xorBytes, nBytes = nXor;
+    } else if (nDod < CHUNK_RAW_BYTES) {
+        chunkPtr->encoding = CHUNK_DOD;
+        bytes = dodBytes, nBytes = nDod;
+    } else {
+        chunkPtr->encoding = CHUNK_RAW;
+        bytes = (const unsigned char *)valueArr, nBytes = CHUNK_RAW_BYTES;
+    }
+    chunkPtr->bytes = Tcl_AttemptAlloc(nBytes);
+    if (chunkPtr->bytes == NULL) {
+        return TCL_ERROR;
+    }
+    memcpy(chunkPtr->bytes, bytes, nBytes);
+    chunkPtr->nBytes = nBytes;
+    chunkPtr->min = min;
+    chunkPtr->max = max;
+    return TCL_OK;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * Rbc_VectorChunksDecodeChunk --
+ *
+ *      Decodes the values of one full chunk.
+ *
+ * Parameters:
+ *      const Rbc_VectorChunks *storePtr
+ *      Tcl_Size index - Index of the chunk.
+ *      double *valueArr - Receives RBC_VECTOR_CHUNK_VALUES values.
+ *
+ * Results:
+ *      None.
+ *
+ * ----------------------------------------------------------------------
+ */
+void Rbc_VectorChunksDecodeChunk(const Rbc_VectorChunks *storePtr, Tcl_Size index, double *valueArr) {
+    const Rbc_VectorChunk *chunkPtr = storePtr->chunkArr + index;
+
+    switch (chunkPtr->encoding) {
+    case CHUNK_XOR:
+        DecodeXor(chunkPtr->bytes, chunkPtr->nBytes, RBC_VECTOR_CHUNK_VALUES, valueArr);
+        break;
+    case CHUNK_DOD:
+        DecodeDeltaOfDelta(chunkPtr->bytes, chunkPtr->nBytes, RBC_VECTOR_CHUNK_VALUES, valueArr);
+        break;
+    default:
+        memcpy(valueArr, chunkPtr->bytes, CHUNK_RAW_BYTES);
+        break;
+    }
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * Rbc_VectorChunksDecode --
+ *
+ *      Decodes a range of values.  Only the chunks overlapping the
+ *      range are decoded.
+ *
+ * Parameters:
+ *      const Rbc_VectorChunks *storePtr
+ *      Tcl_Size first - Index of the first value.
+ *      Tcl_Size count - Number of values.
+ *      double *valueArr - Receives the values.
+ *
+ * Results:
+ *      None.
+ *
+ * ----------------------------------------------------------------------
+ */
+void Rbc_VectorChunksDecode(const Rbc_VectorChunks *storePtr, Tcl_Size first, Tcl_Size count, double *valueArr) {
+    double scratch[RBC_VECTOR_CHUNK_VALUES];
+    Tcl_Size encoded;
+
+    encoded = storePtr->nChunks * RBC_VECTOR_CHUNK_VALUES;
+    while ((count > 0) && (first < encoded)) {
+        Tcl_Size index, offset, n;
+
+        index = first / RBC_VECTOR_CHUNK_VALUES;
+        offset = first % RBC_VECTOR_CHUNK_VALUES;
+        n = RBC_VECTOR_CHUNK_VALUES - offset;
+        if (n > count) {
+            n = count;
+        }
+        if (n == RBC_VECTOR_CHUNK_VALUES) {
+            Rbc_VectorChunksDecodeChunk(storePtr, index, valueArr);
+        } else {
+            Rbc_VectorChunksDecodeChunk(storePtr, index, scratch);
+            memcpy(valueArr, scratch + offset, (size_t)n * sizeof(double));
+        }
+        valueArr += n, first += n, count -= n;
+    }
+    if (count > 0) {
+        memcpy(valueArr, storePtr->tailArr + (first - encoded), (size_t)count * sizeof(double));
+    }
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * Rbc_VectorChunksAppend --
+ *
+ *      Appends values to the store.  Values are collected in the tail
+ *      buffer, which is encoded as a new chunk whenever it fills.
+ *
+ * Parameters:
+ *      Rbc_VectorChunks *storePtr
+ *      const double *valueArr
+ *      Tcl_Size length
+ *
+ * Results:
+ *      A standard Tcl result.  TCL_ERROR is returned if memory can't
+ *      be allocated; the values appended up to that point are kept.
+ *
+ * ----------------------------------------------------------------------
+ */
+int Rbc_VectorChunksAppend(Rbc_VectorChunks *storePtr, const double *valueArr, Tcl_Size length) {
+    while (length > 0) {
+        Tcl_Size n;
+
+        n = RBC_VECTOR_CHUNK_VALUES - storePtr->nTail;
+        if (n > length) {
+            n = length;
+        }
+        memcpy(storePtr->tailArr + storePtr->nTail, valueArr, (size_t)n * sizeof(double));
+        storePtr->nTail += n;
+        valueArr += n, length -= n;
+        if (storePtr->nTail < RBC_VECTOR_CHUNK_VALUES) {
+            break;
+        }
+        if (storePtr->nChunks == storePtr->chunkCapacity) {
+            Rbc_VectorChunk *chunkArr;
+            Tcl_Size capacity;
+
+            capacity = (storePtr->chunkCapacity > 0) ? storePtr->chunkCapacity * 2 : 16;
+            if ((capacity > (TCL_SIZE_MAX / RBC_VECTOR_CHUNK_VALUES)) ||
+                ((size_t)capacity > ((size_t)-1 / sizeof(Rbc_VectorChunk)))) {
+                return TCL_ERROR;
+            }
+            chunkArr = Tcl_AttemptRealloc(storePtr->chunkArr, (size_t)capacity * sizeof(Rbc_VectorChunk));
+            if (chunkArr == NULL) {
+                return TCL_ERROR;
+            }
+            storePtr->chunkArr = chunkArr;
+            storePtr->chunkCapacity = capacity;
+        }
+        if (EncodeChunk(storePtr->chunkArr + storePtr->nChunks, storePtr->tailArr) != TCL_OK) {
+            return TCL_ERROR;
+        }
+        storePtr->nBytes += storePtr->chunkArr[storePtr->nChunks].nBytes;
+        storePtr->nChunks++;
+        storePtr->nTail = 0;
+    }
+    return TCL_OK;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * Rbc_VectorChunksCreate --
+ *
+ *      Creates a store holding the given values.
+ *
+ * Parameters:
+ *      const double *valueArr
+ *      Tcl_Size length
+ *
+ * Results:
+ *      Returns the new store, or NULL if memory can't be allocated.
+ *
+ * ----------------------------------------------------------------------
+ */
+Rbc_VectorChunks *Rbc_VectorChunksCreate(const double *valueArr, Tcl_Size length) {
+    Rbc_VectorChunks *storePtr;
+
+    storePtr = Tcl_AttemptAlloc(sizeof(Rbc_VectorChunks));
+    if (storePtr == NULL) {
+        return NULL;
+    }
+    memset(storePtr, 0, sizeof(Rbc_VectorChunks));
+    storePtr->tailArr = Tcl_AttemptAlloc(CHUNK_RAW_BYTES);
+    if ((storePtr->tailArr == NULL) || (Rbc_VectorChunksAppend(storePtr, valueArr, length) != TCL_OK)) {
+        Rbc_VectorChunksFree(storePtr);
+        return NULL;
+    }
+    return storePtr;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * Rbc_VectorChunksFree --
+ *
+ *      Releases a store and all of its chunks.
+ *
+ * Parameters:
+ *      Rbc_VectorChunks *storePtr
+ *
+ * Results:
+ *      None.
+ *
+ * ----------------------------------------------------------------------
+ */
+void Rbc_VectorChunksFree(Rbc_VectorChunks *storePtr) {
+    Tcl_Size i;
+
+    for (i = 0; i < storePtr->nChunks; i++) {
+        ckfree(storePtr->chunkArr[i].bytes);
+    }
+    if (storePtr->chunkArr != NULL) {
+        ckfree(storePtr->chunkArr);
+    }
+    if (storePtr->tailArr != NULL) {
+        ckfree(storePtr->tailArr);
+    }
+    ckfree(storePtr);
+}
@@ -60,8 +60,9 @@ enum NativeFormats {
 
 static int AppendVector(VectorObject *destPtr, VectorObject *srcPtr);
 static int AppendList(VectorObject *vPtr, Tcl_Size objc, Tcl_Obj *const objv[]);
-static int CopyValues(VectorObject *vPtr, char *byteArr, enum NativeFormats fmt, int size, Tcl_Size length, int swap,
-                      Tcl_Size *indexPtr);
+static int AppendChunks(VectorObject *vPtr, const double *valueArr, Tcl_Size length);
+static int SearchValues(Tcl_Interp *interp, VectorObject *vPtr, Tcl_Obj *listObjPtr, const double *valueArr,
+                        Tcl_Size base, Tcl_Size length, double min, double max, int wantValue);
 static int InRange(double value, double min, double max);
 static int CopyList(VectorObject *vPtr, Tcl_Size objc, Tcl_Obj *const objv[]);
 static Tcl_Size *SortVectors(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const *objv);
@@ -85,6 +86,7 @@ static RbcVectorCmdOp DeleteOp;
 static RbcVectorCmdOp DupOp;
 static RbcVectorCmdOp ExprOp;
 static RbcVectorCmdOp IndexOp;
+static RbcVectorCmdOp IsinOp;
 static RbcVectorCmdOp LengthOp;
 static RbcVectorCmdOp MergeOp;
 static RbcVectorCmdOp NormalizeOp;
@@ -97,6 +99,7 @@ static RbcVectorCmdOp SeqOp;
 static RbcVectorCmdOp SetOp;
 static RbcVectorCmdOp SortOp;
 static RbcVectorCmdOp SplitOp;
+static RbcVectorCmdOp UniqueOp;
 static RbcVectorCmdOp VariableOp;
 
 static const VectorInstOpSpec vectorInstOpCmd[] = {{{"*", 3, 3, "list"}, ArithOp},
@@ -110,18 +113,20 @@ static const VectorInstOpSpec vectorInstOpCmd[] = {{{"*", 3, 3, "list"}, ArithOp
                                                    {{"dup", 3, 3, "vecname"}, DupOp},
                                                    {{"expr", 3, 3, "expression"}, ExprOp},
                                                    {{"index", 3, 4, "index ?value?"}, IndexOp},
+                                                   {{"isin", 4, 4, "vecName maskName"}, IsinOp},
                                                    {{"length", 2, 3, "?newSize?"}, LengthOp},
                                                    {{"merge", 3, 0, "vecName ?vecName?..."}, MergeOp},
                                                    {{"normalize", 2, 3, "?vecName?"}, NormalizeOp},
                                                    {{"offset", 2, 3, "?offset?"}, OffsetOp},
                                                    {{"populate", 4, 4, "vecName density"}, PopulateOp},
-                                                   {{"random", 2, 2, ""}, RandomOp},
+                                                   {{"random", 2, 0, "?-seed seed? ?-dist dist? ?param ...?"}, RandomOp},
                                                    {{"range", 4, 4, "first last"}, RangeOp},
                                                    {{"search", 3, 5, "?-value? value ?value?"}, SearchOp},
                                                    {{"seq", 4, 5, "start end ?step?"}, SeqOp},
                                                    {{"set", 3, 3, "list"}, SetOp},
                                                    {{"sort", 2, 0, "?-reverse? ?vecName?..."}, SortOp},
                                                    {{"split", 2, 0, "?vecName?..."}, SplitOp},
+                                                   {{"unique", 3, 4, "destName ?countsName?"}, UniqueOp},
                                                    {{"variable", 2, 3, "?varName?"}, VariableOp},
                                                    {{NULL, 0, 0, NULL}, NULL}};
 
@@ -161,6 +166,19 @@ int Rbc_VectorInstanceObjCmd(ClientData clientData, Tcl_Interp *interp, Tcl_Size
         return TCL_ERROR;
     }
 
+    /*
+     * Operations that understand compressed storage work on the
+     * chunks directly.  All others see the decoded values.
+     */
+    if (vPtr->chunksPtr != NULL) {
+        RbcVectorCmdOp *proc = vectorInstOpCmd[index].proc;
+
+        if ((proc != AppendOp) && (proc != LengthOp) && (proc != RangeOp) && (proc != SearchOp) &&
+            ((proc != IndexOp) || (objc != 3)) && (Rbc_VectorMaterialize(vPtr) != TCL_OK)) {
+            return TCL_ERROR;
+        }
+    }
+
     /*
      * Reset the selected region before each instance operation.
      */
@@ -196,9 +214,11 @@ int Rbc_VectorInstanceObjCmd(ClientData clientData, Tcl_Interp *interp, Tcl_Size
  */
 static int AppendOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]) {
     Tcl_Size i;
+    Tcl_Size oldLength;
     int result;
     VectorObject *v2Ptr;
 
+    oldLength = vPtr->length;
     for (i = 2; i < objc; i++) {
         v2Ptr = Rbc_VectorParseElement(NULL, vPtr->dataPtr, Tcl_GetString(objv[i]), NULL, NS_SEARCH_BOTH);
         if (v2Ptr != NULL) {
@@ -220,7 +240,7 @@ static int AppendOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_O
         if (vPtr->flush) {
             Rbc_VectorFlushCache(vPtr);
         }
-        Rbc_VectorUpdateClients(vPtr);
+        Rbc_VectorUpdateClientsFrom(vPtr, oldLength);
     }
     return TCL_OK;
 }
@@ -433,6 +453,161 @@ static Tcl_Size ParseAt(void *clientData, Tcl_Interp *interp, Tcl_Size objc, Tcl
     *(Tcl_Size *)dstPtr = first;
     return 1;
 }
+/*
+ * Binary values are converted by one loop per format and byte order.
+ * Values are loaded with memcpy, so the input needs no alignment, and
+ * each loop is simple enough for the compiler to vectorize.
+ */
+typedef void BinreadConvertProc(double *valueArr, const unsigned char *bytes, Tcl_Size length);
+
+static uint16_t SwapBytes16(uint16_t x) {
+#if defined(__GNUC__)
+    return __builtin_bswap16(x);
+#else
+    return (uint16_t)((x << 8) | (x >> 8));
+#endif
+}
+
+static uint32_t SwapBytes32(uint32_t x) {
+#if defined(__GNUC__)
+    return __builtin_bswap32(x);
+#else
+    return ((x & 0xFFu) << 24) | ((x & 0xFF00u) << 8) | ((x >> 8) & 0xFF00u) | (x >> 24);
+#endif
+}
+
+static uint64_t SwapBytes64(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_bswap64(x);
+#else
+    return ((uint64_t)SwapBytes32((uint32_t)x) << 32) | SwapBytes32((uint32_t)(x >> 32));
+#endif
+}
+
+/*
+ * Loads a value of size bytes in reversed byte order.  The size is a
+ * compile-time constant at every call, so the switch folds away.
+ */
+static void LoadSwapped(void *dstPtr, const unsigned char *bytes, size_t size) {
+    switch (size) {
+    case 2: {
+        uint16_t x;
+
+        memcpy(&x, bytes, 2);
+        x = SwapBytes16(x);
+        memcpy(dstPtr, &x, 2);
+        break;
+    }
+    case 4: {
+        uint32_t x;
+
+        memcpy(&x, bytes, 4);
+        x = SwapBytes32(x);
+        memcpy(dstPtr, &x, 4);
+        break;
+    }
+    case 8: {
+        uint64_t x;
+
+        memcpy(&x, bytes, 8);
+        x = SwapBytes64(x);
+        memcpy(dstPtr, &x, 8);
+        break;
+    }
+    default:
+        memcpy(dstPtr, bytes, size);
+        break;
+    }
+}
+
+#define DEFINE_BINREAD_CONVERTERS(name, type)                                                                          \
+    static void name(double *valueArr, const unsigned char *bytes, Tcl_Size length) {                                  \
+        Tcl_Size i;                                                                                                    \
+        for (i = 0; i < length; i++) {                                                                                 \
+            type value;                                                                                                \
+            memcpy(&value, bytes + (size_t)i * sizeof(type), sizeof(type));                                            \
+            valueArr[i] = (double)value;                                                                               \
+        }                                                                                                              \
+    }                                                                                                                  \
+    static void name##Swap(double *valueArr, const unsigned char *bytes, Tcl_Size length) {                            \
+        Tcl_Size i;                                                                                                    \
+        for (i = 0; i < length; i++) {                                                                                 \
+            type value;                                                                                                \
+            LoadSwapped(&value, bytes + (size_t)i * sizeof(type), sizeof(type));                                       \
+            valueArr[i] = (double)value;                                                                               \
+        }                                                                                                              \
+    }
+
+DEFINE_BINREAD_CONVERTERS(ConvertUChar, unsigned char)
+DEFINE_BINREAD_CONVERTERS(ConvertChar, signed char)
+DEFINE_BINREAD_CONVERTERS(ConvertUShort, unsigned short)
+DEFINE_BINREAD_CONVERTERS(ConvertShort, short)
+DEFINE_BINREAD_CONVERTERS(ConvertUInt, unsigned int)
+DEFINE_BINREAD_CONVERTERS(ConvertInt, int)
+DEFINE_BINREAD_CONVERTERS(ConvertULong, unsigned long)
+DEFINE_BINREAD_CONVERTERS(ConvertLong, long)
+DEFINE_BINREAD_CONVERTERS(ConvertULongLong, unsigned long long)
+DEFINE_BINREAD_CONVERTERS(ConvertLongLong, long long)
+DEFINE_BINREAD_CONVERTERS(ConvertFloat, float)
+DEFINE_BINREAD_CONVERTERS(ConvertDouble, double)
+
+#undef DEFINE_BINREAD_CONVERTERS
+
+/* Indexed by NativeFormats, then by the -swap flag. */
+static BinreadConvertProc *const binreadConverters[][2] = {
+    {ConvertUChar, ConvertUCharSwap},         {ConvertChar, ConvertCharSwap},
+    {ConvertUShort, ConvertUShortSwap},       {ConvertShort, ConvertShortSwap},
+    {ConvertUInt, ConvertUIntSwap},           {ConvertInt, ConvertIntSwap},
+    {ConvertULong, ConvertULongSwap},         {ConvertLong, ConvertLongSwap},
+    {ConvertULongLong, ConvertULongLongSwap}, {ConvertLongLong, ConvertLongLongSwap},
+    {ConvertFloat, ConvertFloatSwap},         {ConvertDouble, ConvertDoubleSwap}};
+
+/*
+ * Values are read in blocks of BINREAD_BLOCK_VALUES when no count is
+ * given, and converted BINREAD_STAGE_VALUES at a time.
+ */
+#define BINREAD_BLOCK_VALUES 65536
+#define BINREAD_STAGE_VALUES 2048
+
+/*
+ * -----------------------------------------------------------------------
+ *
+ * ConvertBinaryValues --
+ *
+ *      Converts raw binary values into doubles.  The raw values may
+ *      lie in the upper part of valueArr itself: raw value i never
+ *      starts below double i, so converting in ascending order never
+ *      overwrites raw values that are still needed.  Each stage is
+ *      copied out before it is converted, which keeps the conversion
+ *      loop free of aliasing.
+ *
+ * Parameters:
+ *      BinreadConvertProc *proc - Conversion loop for the format.
+ *      int size - Size of a raw value in bytes.
+ *      double *valueArr - Receives the converted values.
+ *      const unsigned char *bytes - Raw values.
+ *      Tcl_Size length - Number of values.
+ *
+ * Results:
+ *      None.
+ *
+ * -----------------------------------------------------------------------
+ */
+static void ConvertBinaryValues(BinreadConvertProc *proc, int size, double *valueArr, const unsigned char *bytes,
+                                Tcl_Size length) {
+    double stage[BINREAD_STAGE_VALUES];
+
+    while (length > 0) {
+        Tcl_Size n = (length < BINREAD_STAGE_VALUES) ? length : BINREAD_STAGE_VALUES;
+
+        memcpy(stage, bytes, (size_t)n * (size_t)size);
+        (*proc)(valueArr, (const unsigned char *)stage, n);
+        valueArr += n;
+        bytes += (size_t)n * (size_t)size;
+        length -= n;
+    }
+}
+
 /*
  * -----------------------------------------------------------------------
  *
@@ -470,7 +645,7 @@ static int BinreadOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_
     Tcl_Channel channel;
     const char *channelName;
     const char *string;
-    char *byteArr;
+    unsigned char *byteArr;
     enum NativeFormats fmt;
     struct NativeFmtValue nfmt;
     Tcl_DString translation;
@@ -480,12 +655,14 @@ static int BinreadOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_
     Tcl_Size total;
     Tcl_Size optionStart;
     Tcl_Size argc;
-    Tcl_Size bufferValues;
-    Tcl_Size bufferBytes;
+    Tcl_Size blockValues;
+    Tcl_Size blockBytes;
     Tcl_Size bytesRead;
     Tcl_Size length;
     Tcl_Size newTotal;
-    size_t bufferByteCount;
+    Tcl_Size last;
+    size_t blockByteCount;
+    BinreadConvertProc *proc;
     int mode;
     int size;
     int swap;
@@ -496,6 +673,7 @@ static int BinreadOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_
     savedErrorObj = NULL;
     count = 0;
     first = vPtr->length;
+    last = vPtr->length;
     total = 0;
     optionStart = 3;
     swap = FALSE;
@@ -567,32 +745,27 @@ static int BinreadOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_
         goto cleanup;
     }
 
+    proc = binreadConverters[fmt][swap ? 1 : 0];
+
     /*
-     * With no explicit count, read BUFFER_SIZE values per iteration.
-     * With a count, allocate enough space for that one requested read.
+     * With no explicit count, read BINREAD_BLOCK_VALUES values per
+     * iteration.  With a count, make that one requested read.
      */
-    bufferValues = (count == 0) ? (Tcl_Size)BUFFER_SIZE : count;
+    blockValues = (count == 0) ? (Tcl_Size)BINREAD_BLOCK_VALUES : count;
 
-    if (GetArrayByteCount(interp, bufferValues, (size_t)size, &bufferByteCount) != TCL_OK) {
+    if (GetArrayByteCount(interp, blockValues, sizeof(double), &blockByteCount) != TCL_OK) {
         goto cleanup;
     }
 
     /*
      * Tcl_Read() accepts its byte count as Tcl_Size.
      */
-    if (bufferByteCount > (size_t)TCL_SIZE_MAX) {
+    if (blockByteCount > (size_t)TCL_SIZE_MAX) {
         Tcl_SetObjResult(interp, Tcl_NewStringObj("binary read size is too large", -1));
         goto cleanup;
     }
 
-    bufferBytes = (Tcl_Size)bufferByteCount;
-
-    byteArr = Tcl_AttemptAlloc(bufferByteCount);
-
-    if ((byteArr == NULL) && (bufferByteCount > 0)) {
-        Tcl_SetObjResult(interp, Tcl_NewStringObj("can't allocate binary input buffer", -1));
-        goto cleanup;
-    }
+    blockBytes = blockValues * size;
 
     /*
      * Preserve the channel's original translation setting.
@@ -607,8 +780,47 @@ static int BinreadOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_
 
     translationChanged = TRUE;
 
+    /*
+     * The vector grows by a block before each read and is trimmed to
+     * the values actually read afterwards.  "last" starts at the
+     * original length, so errors before the first read trim nothing.
+     */
     for (;;) {
-        bytesRead = Tcl_Read(channel, byteArr, bufferBytes);
+        unsigned char *rawArr;
+        Tcl_Size end;
+
+        if (AddVectorSizes(interp, first, blockValues, &end) != TCL_OK) {
+            goto cleanup;
+        }
+
+        if ((end > vPtr->length) && (Rbc_VectorChangeLength(vPtr, end) != TCL_OK)) {
+            goto cleanup;
+        }
+
+        if (first >= last) {
+            /*
+             * Past the end of the existing values.  Read straight into
+             * the upper part of the new block and convert in place.
+             */
+            rawArr = (unsigned char *)(vPtr->valueArr + first) + (size_t)blockValues * (sizeof(double) - size);
+        } else {
+            /*
+             * Existing values are overwritten.  Read into a separate
+             * buffer, so a short read can't clobber values past the
+             * ones replaced.
+             */
+            if (byteArr == NULL) {
+                byteArr = Tcl_AttemptAlloc((size_t)blockBytes);
+
+                if ((byteArr == NULL) && (blockBytes > 0)) {
+                    Tcl_SetObjResult(interp, Tcl_NewStringObj("can't allocate binary input buffer", -1));
+                    goto cleanup;
+                }
+            }
+            rawArr = byteArr;
+        }
+
+        bytesRead = Tcl_Read(channel, (char *)rawArr, blockBytes);
 
         if (bytesRead < 0) {
             Tcl_SetObjResult(interp, Tcl_ObjPrintf("error reading channel: %s", Tcl_PosixError(interp)));
@@ -632,8 +844,8 @@ static int BinreadOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_
 
         length = bytesRead / size;
 
-        if (CopyValues(vPtr, byteArr, fmt, size, length, swap, &first) != TCL_OK) {
-            goto cleanup;
+        if ((fmt != FMT_DOUBLE) || swap || (rawArr != (unsigned char *)(vPtr->valueArr + first))) {
+            ConvertBinaryValues(proc, size, vPtr->valueArr + first, rawArr, length);
         }
 
         if (AddVectorSizes(interp, total, length, &newTotal) != TCL_OK) {
@@ -641,6 +853,11 @@ static int BinreadOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_
         }
 
         total = newTotal;
+        first += length;
+
+        if (first > last) {
+            last = first;
+        }
 
         /*
          * An explicit count requests at most one Tcl_Read(). This
@@ -687,6 +904,19 @@ cleanup:
         ckfree(byteArr);
     }
 
+    /*
+     * Drop the unused part of the last block.  The storage is kept, so
+     * this never copies the values.
+     */
+    if (vPtr->length > last) {
+        vPtr->length = last;
+        vPtr->last = last - 1;
+    }
+
+    if (total > 0) {
+        vPtr->notifyFlags |= UPDATE_RANGE;
+    }
+
     if (result != TCL_OK) {
         return TCL_ERROR;
     }
@@ -695,7 +925,7 @@ cleanup:
         Rbc_VectorFlushCache(vPtr);
     }
 
-    Rbc_VectorUpdateClients(vPtr);
+    Rbc_VectorUpdateClientsFrom(vPtr, first - total);
 
     Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt)total));
 
@@ -981,6 +1211,83 @@ static int IndexOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Ob
     return TCL_OK;
 }
 
+/*
+ * -----------------------------------------------------------------------
+ *
+ * IsinOp --
+ *
+ *      Tests each component of the vector for membership in another
+ *      vector.
+ *
+ *      vecName isin otherName maskName
+ *
+ *      The mask vector receives 1.0 for each component that also occurs
+ *      in the other vector and 0.0 otherwise.  The mask has the same
+ *      length as the vector and is created if it does not exist.
+ *
+ * Parameters:
+ *      VectorObject *vPtr
+ *      Tcl_Interp *interp
+ *      int objc
+ *      Tcl_Obj * const objv[]
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      The contents of the mask vector are replaced.
+ *
+ * -----------------------------------------------------------------------
+ */
+static int IsinOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]) {
+    Rbc_VectorValueSet set;
+    VectorObject *v2Ptr, *maskPtr;
+    double *maskArr;
+    size_t byteCount;
+    Tcl_Size i;
+    int isNew;
+    char *string;
+
+    (void)objc;
+    if (Rbc_VectorLookupName(vPtr->dataPtr, Tcl_GetString(objv[2]), &v2Ptr) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    if (GetArrayByteCount(interp, vPtr->length, sizeof(double), &byteCount) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    if (Rbc_VectorValueSetInit(interp, &set, FALSE) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    if (Rbc_VectorValueSetAdd(interp, &set, v2Ptr->valueArr, v2Ptr->length) != TCL_OK) {
+        Rbc_VectorValueSetFree(&set);
+        return TCL_ERROR;
+    }
+    maskArr = NULL;
+    if (byteCount > 0) {
+        maskArr = Tcl_AttemptAlloc(byteCount);
+        if (maskArr == NULL) {
+            Rbc_VectorValueSetFree(&set);
+            Tcl_SetObjResult(interp, Tcl_NewStringObj("can't allocate mask vector", -1));
+            return TCL_ERROR;
+        }
+    }
+    for (i = 0; i < vPtr->length; i++) {
+        maskArr[i] = (Rbc_VectorValueSetFind(&set, vPtr->valueArr[i]) >= 0) ? 1.0 : 0.0;
+    }
+    Rbc_VectorValueSetFree(&set);
+
+    string = Tcl_GetString(objv[3]);
+    maskPtr = Rbc_VectorCreate(vPtr->dataPtr, string, string, string, &isNew);
+    if (maskPtr == NULL) {
+        if (maskArr != NULL) {
+            ckfree(maskArr);
+        }
+        return TCL_ERROR;
+    }
+    maskPtr->notifyFlags |= UPDATE_RANGE;
+    return Rbc_VectorReset(maskPtr, maskArr, vPtr->length, vPtr->length, TCL_DYNAMIC);
+}
+
 /*
  * -----------------------------------------------------------------------
  *
@@ -1367,6 +1674,61 @@ static int PopulateOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl
     return TCL_OK;
 }
 
+/*
+ * Types and helper functions (for Tcl_ParseArgsObjv) for "random" vector
+ * instance command
+ */
+typedef enum { RANDOM_UNIFORM, RANDOM_NORMAL, RANDOM_EXPONENTIAL } RandomDistribution;
+
+static const char *const randomDistNames[] = {"uniform", "normal", "exponential", NULL};
+
+/*
+ * Values are generated in blocks of RANDOM_BLOCK_SIZE.  Each block draws
+ * from its own substream, obtained by jumping the seeded generator, so
+ * the contents of a block never depend on how many values precede it in
+ * the same stream.
+ */
+#define RANDOM_BLOCK_SIZE 65536
+
+struct RandomSeedValue {
+    int isSet;
+    uint64_t seed;
+};
+
+/* Parses "-seed" option */
+static Tcl_Size ParseSeed(void *clientData, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const *objv, void *dstPtr) {
+    struct RandomSeedValue *seedPtr = (struct RandomSeedValue *)dstPtr;
+    Tcl_WideInt seed;
+
+    (void)clientData;
+    if (objc < 1) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("option \"-seed\" requires an additional argument", -1));
+        return -1;
+    }
+    if (Tcl_GetWideIntFromObj(interp, objv[0], &seed) != TCL_OK) {
+        return -1;
+    }
+    seedPtr->isSet = TRUE;
+    seedPtr->seed = (uint64_t)seed;
+    return 1;
+}
+
+/* Parses "-dist" option */
+static Tcl_Size ParseDist(void *clientData, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const *objv, void *dstPtr) {
+    int index;
+
+    (void)clientData;
+    if (objc < 1) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("option \"-dist\" requires an additional argument", -1));
+        return -1;
+    }
+    if (Tcl_GetIndexFromObj(interp, objv[0], randomDistNames, "distribution", 0, &index) != TCL_OK) {
+        return -1;
+    }
+    *(RandomDistribution *)dstPtr = (RandomDistribution)index;
+    return 1;
+}
+
 /*
  * -----------------------------------------------------------------------
  *
@@ -1374,6 +1736,13 @@ static int PopulateOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl
  *
  *      Generates random values for the length of the vector.
  *
+ *      vecName random ?-seed seed? ?-dist uniform|normal|exponential? ?param ...?
+ *
+ *      The distribution parameters are "?min max?" for uniform (default
+ *      0 1), "?mean stddev?" for normal (default 0 1) and "?rate?" for
+ *      exponential (default 1).  Without -seed, the generator of the
+ *      current thread is used to seed the fill.
+ *
  * Parameters:
  *      VectorObject *vPtr
  *      Tcl_Interp *interp
@@ -1384,24 +1753,114 @@ static int PopulateOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl
  *      A standard Tcl result.
  *
  * Side effects:
- *      TODO: Side Effects
+ *      Every component of the vector is replaced by a new random value.
  *
  * -----------------------------------------------------------------------
  */
 static int RandomOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]) {
-    Tcl_Size i;
+    struct RandomSeedValue seed = {FALSE, 0};
+    RandomDistribution dist = RANDOM_UNIFORM;
+    Tcl_Obj **paramObjv = NULL;
+    Tcl_Size nParams, argc, i;
+    double params[2];
+    Rbc_Random stream;
+    int result = TCL_ERROR;
 
-    (void)interp;
-    (void)objc;
-    (void)objv;
-    for (i = 0; i < vPtr->length; i++) {
-        vPtr->valueArr[i] = Rbc_RandomDouble();
+    /*
+     * Tcl_ParseArgsObjv() treats its first argument as the command name,
+     * so the "random" word is passed in that position.  Arguments that
+     * are not options are returned as distribution parameters.
+     */
+    argc = objc - 1;
+    if (argc > 1) {
+        const Tcl_ArgvInfo randomOpts[] = {{TCL_ARGV_GENFUNC, "-seed", ParseSeed, &seed, NULL, NULL},
+                                           {TCL_ARGV_GENFUNC, "-dist", ParseDist, &dist, NULL, NULL},
+                                           TCL_ARGV_TABLE_END};
+
+        if (Tcl_ParseArgsObjv(interp, randomOpts, &argc, objv + 1, &paramObjv) != TCL_OK) {
+            return TCL_ERROR;
+        }
+    }
+    nParams = argc - 1;
+
+    switch (dist) {
+    case RANDOM_UNIFORM:
+    case RANDOM_NORMAL:
+        params[0] = 0.0;
+        params[1] = 1.0;
+        if ((nParams != 0) && (nParams != 2)) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("wrong # of parameters for %s distribution: should be \"%s\"",
+                                                   randomDistNames[dist],
+                                                   (dist == RANDOM_UNIFORM) ? "?min max?" : "?mean stddev?"));
+            goto cleanup;
+        }
+        break;
+    case RANDOM_EXPONENTIAL:
+        params[0] = 1.0;
+        if (nParams > 1) {
+            Tcl_SetObjResult(interp,
+                             Tcl_NewStringObj("wrong # of parameters for exponential distribution: should be \"?rate?\"", -1));
+            goto cleanup;
+        }
+        break;
+    }
+    for (i = 0; i < nParams; i++) {
+        if (Rbc_GetDouble(interp, paramObjv[i + 1], params + i) != TCL_OK) {
+            goto cleanup;
+        }
+        if (!FINITE(params[i])) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("distribution parameter \"%s\" must be finite",
+                                                   Tcl_GetString(paramObjv[i + 1])));
+            goto cleanup;
+        }
     }
+    if ((dist == RANDOM_UNIFORM) && (params[0] > params[1])) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("uniform minimum can't be greater than maximum", -1));
+        goto cleanup;
+    }
+    if ((dist == RANDOM_NORMAL) && (params[1] < 0.0)) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("normal standard deviation can't be negative", -1));
+        goto cleanup;
+    }
+    if ((dist == RANDOM_EXPONENTIAL) && (params[0] <= 0.0)) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("exponential rate must be positive", -1));
+        goto cleanup;
+    }
+
+    Rbc_RandomSeed(&stream, (seed.isSet) ? seed.seed : Rbc_RandomNext(Rbc_RandomThreadState()));
+    for (i = 0; i < vPtr->length; i += RANDOM_BLOCK_SIZE) {
+        Rbc_Random rng = stream;
+        Tcl_Size count;
+
+        count = vPtr->length - i;
+        if (count > RANDOM_BLOCK_SIZE) {
+            count = RANDOM_BLOCK_SIZE;
+        }
+        switch (dist) {
+        case RANDOM_UNIFORM:
+            Rbc_RandomUniform(&rng, vPtr->valueArr + i, count, params[0], params[1]);
+            break;
+        case RANDOM_NORMAL:
+            Rbc_RandomNormal(&rng, vPtr->valueArr + i, count, params[0], params[1]);
+            break;
+        case RANDOM_EXPONENTIAL:
+            Rbc_RandomExponential(&rng, vPtr->valueArr + i, count, params[0]);
+            break;
+        }
+        Rbc_RandomJump(&stream);
+    }
+    vPtr->notifyFlags |= UPDATE_RANGE;
     if (vPtr->flush) {
         Rbc_VectorFlushCache(vPtr);
     }
     Rbc_VectorUpdateClients(vPtr);
-    return TCL_OK;
+    result = TCL_OK;
+
+cleanup:
+    if (paramObjv != NULL) {
+        ckfree((char *)paramObjv);
+    }
+    return result;
 }
 
 /*
@@ -1430,7 +1889,8 @@ static int RandomOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_O
 static int RangeOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]) {
     Tcl_Obj *listObjPtr;
     Tcl_Size first, last;
-    Tcl_Size i;
+    Tcl_Size i, base;
+    double *valueArr, *decodedArr;
 
     if ((Rbc_VectorGetIndex(interp, vPtr, Tcl_GetString(objv[2]), &first, INDEX_CHECK, (Rbc_VectorIndexProc **)NULL) !=
          TCL_OK) ||
@@ -1438,16 +1898,42 @@ static int RangeOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Ob
          TCL_OK)) {
         return TCL_ERROR;
     }
+    valueArr = vPtr->valueArr;
+    decodedArr = NULL;
+    base = 0;
+    if (vPtr->chunksPtr != NULL) {
+        Tcl_Size count;
+        size_t byteCount;
+
+        /*
+         * Decode only the chunks holding the requested values.
+         */
+        base = (first < last) ? first : last;
+        count = ((first < last) ? last : first) - base + 1;
+        if (GetArrayByteCount(interp, count, sizeof(double), &byteCount) != TCL_OK) {
+            return TCL_ERROR;
+        }
+        decodedArr = Tcl_AttemptAlloc(byteCount);
+        if (decodedArr == NULL) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("can't allocate %" TCL_SIZE_MODIFIER "d elements", count));
+            return TCL_ERROR;
+        }
+        Rbc_VectorChunksDecode(vPtr->chunksPtr, base, count, decodedArr);
+        valueArr = decodedArr;
+    }
     listObjPtr = Tcl_NewListObj(0, NULL);
     if (first > last) {
         for (i = first; i >= last; i--) {
-            Tcl_ListObjAppendElement(interp, listObjPtr, Tcl_NewDoubleObj(vPtr->valueArr[i]));
+            Tcl_ListObjAppendElement(interp, listObjPtr, Tcl_NewDoubleObj(valueArr[i - base]));
         }
     } else {
         for (i = first; i <= last; i++) {
-            Tcl_ListObjAppendElement(interp, listObjPtr, Tcl_NewDoubleObj(vPtr->valueArr[i]));
+            Tcl_ListObjAppendElement(interp, listObjPtr, Tcl_NewDoubleObj(valueArr[i - base]));
         }
     }
+    if (decodedArr != NULL) {
+        ckfree(decodedArr);
+    }
     Tcl_SetObjResult(interp, listObjPtr);
     return TCL_OK;
 }
@@ -1478,8 +1964,7 @@ static int RangeOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Ob
  */
 static int SearchOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]) {
     double min, max;
-    Tcl_Size i;
-    int wantValue;
+    int wantValue, result;
     char *string;
     Tcl_Obj *listObjPtr;
 
@@ -1501,55 +1986,120 @@ static int SearchOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_O
     }
     listObjPtr = Tcl_NewListObj(0, NULL);
     Tcl_IncrRefCount(listObjPtr);
-    for (i = 0; i < vPtr->length; i++) {
-        if (InRange(vPtr->valueArr[i], min, max)) {
-            Tcl_Obj *objPtr;
+    if (vPtr->chunksPtr != NULL) {
+        Rbc_VectorChunks *storePtr = vPtr->chunksPtr;
+        double chunkArr[RBC_VECTOR_CHUNK_VALUES];
+        double slack;
+        int canSkip;
+        Tcl_Size i;
 
-            if (wantValue) {
-                objPtr = Tcl_NewDoubleObj(vPtr->valueArr[i]);
-            } else {
-                Tcl_Size index;
-                if ((vPtr->offset > 0) && (i > (TCL_SIZE_MAX - vPtr->offset))) {
-                    Tcl_DecrRefCount(listObjPtr);
-                    Tcl_SetObjResult(interp, Tcl_NewStringObj("vector index is too large", -1));
-                    return TCL_ERROR;
-                }
-                index = i + vPtr->offset;
-                objPtr = Tcl_NewWideIntObj((Tcl_WideInt)index);
+        /*
+         * InRange() accepts values slightly outside of [min, max].
+         * Widen the window by more than that tolerance, then skip
+         * the chunks whose values all lie outside of it.
+         */
+        slack = 4.0 * DBL_EPSILON * (FABS(max - min) + 1.0);
+        canSkip = FINITE(min) && FINITE(max) && FINITE(slack);
+        result = TCL_OK;
+        for (i = 0; (i < storePtr->nChunks) && (result == TCL_OK); i++) {
+            const Rbc_VectorChunk *chunkPtr = storePtr->chunkArr + i;
+
+            if (canSkip && ((chunkPtr->min > chunkPtr->max) || (chunkPtr->max < (min - slack)) ||
+                            (chunkPtr->min > (max + slack)))) {
+                continue;
             }
-            Tcl_ListObjAppendElement(interp, listObjPtr, objPtr);
+            Rbc_VectorChunksDecodeChunk(storePtr, i, chunkArr);
+            result = SearchValues(interp, vPtr, listObjPtr, chunkArr, i * RBC_VECTOR_CHUNK_VALUES,
+                                  RBC_VECTOR_CHUNK_VALUES, min, max, wantValue);
         }
+        if (result == TCL_OK) {
+            result = SearchValues(interp, vPtr, listObjPtr, storePtr->tailArr, i * RBC_VECTOR_CHUNK_VALUES,
+                                  storePtr->nTail, min, max, wantValue);
+        }
+    } else {
+        result = SearchValues(interp, vPtr, listObjPtr, vPtr->valueArr, 0, vPtr->length, min, max, wantValue);
+    }
+    if (result == TCL_OK) {
+        Tcl_SetObjResult(interp, listObjPtr);
     }
-    Tcl_SetObjResult(interp, listObjPtr);
     Tcl_DecrRefCount(listObjPtr);
-    return TCL_OK;
+    return result;
 }
 
 /*
  * -----------------------------------------------------------------------
  *
- * SeqOp --
+ * SearchValues --
  *
- *      Generates a sequence of values in the vector.
+ *      Appends the values in the range [min, max], or their indices,
+ *      to a list.  Used by SearchOp for the whole value array, or
+ *      for one chunk of a compressed vector at a time.
  *
  * Parameters:
- *      VectorObject *vPtr
  *      Tcl_Interp *interp
- *      int objc
- *      Tcl_Obj * const objv[]
+ *      VectorObject *vPtr
+ *      Tcl_Obj *listObjPtr - List to append to.
+ *      const double *valueArr - Values to search.
+ *      Tcl_Size base - Vector index of valueArr[0].
+ *      Tcl_Size length - Number of values to search.
+ *      double min, max - Range of values to search for.
+ *      int wantValue - If non-zero, append values instead of indices.
  *
  * Results:
  *      A standard Tcl result.
  *
- * Side effects:
- *      TODO: Side Effects
- *
  * -----------------------------------------------------------------------
  */
-static int SeqOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]) {
+static int SearchValues(Tcl_Interp *interp, VectorObject *vPtr, Tcl_Obj *listObjPtr, const double *valueArr,
+                        Tcl_Size base, Tcl_Size length, double min, double max, int wantValue) {
     Tcl_Size i;
-    Tcl_Size nSteps;
-    double start;
+
+    for (i = 0; i < length; i++) {
+        if (InRange(valueArr[i], min, max)) {
+            Tcl_Obj *objPtr;
+
+            if (wantValue) {
+                objPtr = Tcl_NewDoubleObj(valueArr[i]);
+            } else {
+                Tcl_Size index;
+                if ((vPtr->offset > 0) && ((base + i) > (TCL_SIZE_MAX - vPtr->offset))) {
+                    Tcl_SetObjResult(interp, Tcl_NewStringObj("vector index is too large", -1));
+                    return TCL_ERROR;
+                }
+                index = base + i + vPtr->offset;
+                objPtr = Tcl_NewWideIntObj((Tcl_WideInt)index);
+            }
+            Tcl_ListObjAppendElement(interp, listObjPtr, objPtr);
+        }
+    }
+    return TCL_OK;
+}
+
+/*
+ * -----------------------------------------------------------------------
+ *
+ * SeqOp --
+ *
+ *      Generates a sequence of values in the vector.
+ *
+ * Parameters:
+ *      VectorObject *vPtr
+ *      Tcl_Interp *interp
+ *      int objc
+ *      Tcl_Obj * const objv[]
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      TODO: Side Effects
+ *
+ * -----------------------------------------------------------------------
+ */
+static int SeqOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]) {
+    Tcl_Size i;
+    Tcl_Size nSteps;
+    double start;
     double finish;
     double step;
     double span;
@@ -1931,6 +2481,111 @@ error:
     return TCL_ERROR;
 }
 
+/*
+ * -----------------------------------------------------------------------
+ *
+ * UniqueOp --
+ *
+ *      Stores the distinct values of the vector into another vector.
+ *
+ *      vecName unique destName ?countsName?
+ *
+ *      Values are stored in order of their first occurrence.  If a
+ *      counts vector is given, it receives the number of occurrences of
+ *      each distinct value.  Both vectors are created if necessary.
+ *
+ * Parameters:
+ *      VectorObject *vPtr
+ *      Tcl_Interp *interp
+ *      int objc
+ *      Tcl_Obj * const objv[]
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      The contents of the destination vectors are replaced.
+ *
+ * -----------------------------------------------------------------------
+ */
+static int UniqueOp(VectorObject *vPtr, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]) {
+    Rbc_VectorValueSet set;
+    VectorObject *destPtr, *countsPtr;
+    double *countArr;
+    Tcl_Size i;
+    int isNew;
+    char *string;
+
+    if (Rbc_VectorValueSetInit(interp, &set, (objc > 3)) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    if (Rbc_VectorValueSetAdd(interp, &set, vPtr->valueArr, vPtr->length) != TCL_OK) {
+        goto error;
+    }
+    countArr = NULL;
+    if ((objc > 3) && (set.nValues > 0)) {
+        size_t byteCount;
+
+        if (GetArrayByteCount(interp, set.nValues, sizeof(double), &byteCount) != TCL_OK) {
+            goto error;
+        }
+        countArr = Tcl_AttemptAlloc(byteCount);
+        if (countArr == NULL) {
+            Tcl_SetObjResult(interp, Tcl_NewStringObj("can't allocate counts vector", -1));
+            goto error;
+        }
+        for (i = 0; i < set.nValues; i++) {
+            countArr[i] = (double)set.counts[i];
+        }
+    }
+
+    /*
+     * Both vectors are looked up only after the values have been
+     * collected, so the source vector may also be a destination.
+     */
+    string = Tcl_GetString(objv[2]);
+    destPtr = Rbc_VectorCreate(vPtr->dataPtr, string, string, string, &isNew);
+    countsPtr = NULL;
+    if ((destPtr != NULL) && (objc > 3)) {
+        string = Tcl_GetString(objv[3]);
+        countsPtr = Rbc_VectorCreate(vPtr->dataPtr, string, string, string, &isNew);
+        if (countsPtr == destPtr) {
+            Tcl_SetObjResult(interp, Tcl_NewStringObj("destination and counts vectors must differ", -1));
+            countsPtr = NULL;
+            destPtr = NULL;
+        }
+    }
+    if ((destPtr == NULL) || ((objc > 3) && (countsPtr == NULL))) {
+        if (countArr != NULL) {
+            ckfree(countArr);
+        }
+        goto error;
+    }
+    destPtr->notifyFlags |= UPDATE_RANGE;
+    if (Rbc_VectorReset(destPtr, set.values, set.nValues, set.capacity, TCL_DYNAMIC) != TCL_OK) {
+        if (countArr != NULL) {
+            ckfree(countArr);
+        }
+        goto error;
+    }
+    set.values = NULL; /* Now owned by the destination vector. */
+    if (countsPtr != NULL) {
+        countsPtr->notifyFlags |= UPDATE_RANGE;
+        if (Rbc_VectorReset(countsPtr, countArr, set.nValues, set.nValues, TCL_DYNAMIC) != TCL_OK) {
+            if (countArr != NULL) {
+                ckfree(countArr);
+            }
+            goto error;
+        }
+    }
+    Rbc_VectorValueSetFree(&set);
+    return TCL_OK;
+
+error:
+    Rbc_VectorValueSetFree(&set);
+    return TCL_ERROR;
+}
+
 /*
  * -----------------------------------------------------------------------
  *
@@ -2004,6 +2659,9 @@ static int AppendVector(VectorObject *destPtr, VectorObject *srcPtr) {
     if (GetArrayByteCount(destPtr->interp, sourceLength, sizeof(double), &byteCount) != TCL_OK) {
         return TCL_ERROR;
     }
+    if (destPtr->chunksPtr != NULL) {
+        return AppendChunks(destPtr, srcPtr->valueArr + sourceFirst, sourceLength);
+    }
     if (Rbc_VectorChangeLength(destPtr, newSize) != TCL_OK) {
         return TCL_ERROR;
     }
@@ -2044,6 +2702,25 @@ static int AppendList(VectorObject *vPtr, Tcl_Size objc, Tcl_Obj *const objv[])
     if (AddVectorSizes(vPtr->interp, oldSize, objc, &newSize) != TCL_OK) {
         return TCL_ERROR;
     }
+    if (vPtr->chunksPtr != NULL) {
+        double *valueArr;
+        size_t byteCount;
+        int result;
+
+        if (GetArrayByteCount(vPtr->interp, objc, sizeof(double), &byteCount) != TCL_OK) {
+            return TCL_ERROR;
+        }
+        valueArr = ckalloc(byteCount + sizeof(double));
+        for (i = 0; i < objc; i++) {
+            if (Rbc_GetDouble(vPtr->interp, objv[i], valueArr + i) != TCL_OK) {
+                ckfree(valueArr);
+                return TCL_ERROR;
+            }
+        }
+        result = AppendChunks(vPtr, valueArr, objc);
+        ckfree(valueArr);
+        return result;
+    }
     if (Rbc_VectorChangeLength(vPtr, newSize) != TCL_OK) {
         return TCL_ERROR;
     }
@@ -2059,151 +2736,38 @@ static int AppendList(VectorObject *vPtr, Tcl_Size objc, Tcl_Obj *const objv[])
 }
 
 /*
- *--------------------------------------------------------------
+ * -----------------------------------------------------------------------
  *
- * CopyValues --
+ * AppendChunks --
  *
- *      TODO: Description
+ *      Appends values to a vector whose values are compressed,
+ *      without decoding the chunks already stored.
  *
  * Parameters:
  *      VectorObject *vPtr
- *      char *byteArr
- *      enum NativeFormats fmt
- *      int size
- *      int length
- *      int swap
- *      int *indexPtr
+ *      const double *valueArr
+ *      Tcl_Size length
  *
  * Results:
- *      TODO: Results
+ *      A standard Tcl result.
  *
  * Side effects:
- *      TODO: Side Effects
+ *      The values are added to the tail of the compressed storage.
  *
- *--------------------------------------------------------------
+ * -----------------------------------------------------------------------
  */
-static int CopyValues(VectorObject *vPtr, char *byteArr, enum NativeFormats fmt, int size, Tcl_Size length, int swap,
-                      Tcl_Size *indexPtr) {
-    Tcl_Size i;
-    Tcl_Size n;
-    Tcl_Size newSize;
-
-    if ((length < 0) || (indexPtr == NULL) || (*indexPtr < 0) || (*indexPtr > vPtr->length)) {
-        Tcl_SetObjResult(vPtr->interp, Tcl_NewStringObj("invalid binary vector range", -1));
-        return TCL_ERROR;
-    }
-
-    if ((fmt == FMT_UNKNOWN) || (size <= 0)) {
-        Tcl_SetObjResult(vPtr->interp, Tcl_NewStringObj("invalid binary format", -1));
-        return TCL_ERROR;
-    }
-
-    if (AddVectorSizes(vPtr->interp, *indexPtr, length, &newSize) != TCL_OK) {
-        return TCL_ERROR;
-    }
-
-    if (swap && (size > 1)) {
-        size_t nBytes;
-        size_t byteOffset;
-        unsigned char *p;
-        unsigned char temp;
-        int left;
-        int right;
-
-        if (GetArrayByteCount(vPtr->interp, length, (size_t)size, &nBytes) != TCL_OK) {
-            return TCL_ERROR;
-        }
-
-        for (byteOffset = 0; byteOffset < nBytes; byteOffset += (size_t)size) {
-
-            p = (unsigned char *)byteArr + byteOffset;
-
-            for (left = 0, right = size - 1; left < right; left++, right--) {
-
-                temp = p[left];
-                p[left] = p[right];
-                p[right] = temp;
-            }
-        }
-    }
-
-    if (newSize > vPtr->length) {
-        if (Rbc_VectorChangeLength(vPtr, newSize) != TCL_OK) {
-            return TCL_ERROR;
-        }
-    }
-
-#define CopyArrayToVector(array)                                                                                       \
-    do {                                                                                                               \
-        for (i = 0, n = *indexPtr; i < length; i++, n++) {                                                             \
-            vPtr->valueArr[n] = (double)(array)[i];                                                                    \
-        }                                                                                                              \
-    } while (0)
-
-    switch (fmt) {
-    case FMT_CHAR:
-        CopyArrayToVector((char *)byteArr);
-        break;
-
-    case FMT_UCHAR:
-        CopyArrayToVector((unsigned char *)byteArr);
-        break;
-
-    case FMT_SHORT:
-        CopyArrayToVector((short *)byteArr);
-        break;
-
-    case FMT_USHORT:
-        CopyArrayToVector((unsigned short *)byteArr);
-        break;
-
-    case FMT_INT:
-        CopyArrayToVector((int *)byteArr);
-        break;
-
-    case FMT_UINT:
-        CopyArrayToVector((unsigned int *)byteArr);
-        break;
-
-    case FMT_LONG:
-        CopyArrayToVector((long *)byteArr);
-        break;
-
-    case FMT_ULONG:
-        CopyArrayToVector((unsigned long *)byteArr);
-        break;
-
-    case FMT_LONGLONG:
-        CopyArrayToVector((long long *)byteArr);
-        break;
-
-    case FMT_ULONGLONG:
-        CopyArrayToVector((unsigned long long *)byteArr);
-        break;
-
-    case FMT_FLOAT:
-        CopyArrayToVector((float *)byteArr);
-        break;
-
-    case FMT_DOUBLE:
-        CopyArrayToVector((double *)byteArr);
-        break;
-
-    case FMT_UNKNOWN:
-        /*
-         * Rejected above. Keep the case to satisfy exhaustive-switch
-         * diagnostics.
-         */
-        assert(0);
-        return TCL_ERROR;
-    }
-
-#undef CopyArrayToVector
+static int AppendChunks(VectorObject *vPtr, const double *valueArr, Tcl_Size length) {
+    Rbc_VectorChunks *storePtr = vPtr->chunksPtr;
+    int result;
 
-    *indexPtr = newSize;
+    result = Rbc_VectorChunksAppend(storePtr, valueArr, length);
+    vPtr->length = storePtr->nChunks * RBC_VECTOR_CHUNK_VALUES + storePtr->nTail;
+    vPtr->last = vPtr->length - 1;
     vPtr->notifyFlags |= UPDATE_RANGE;
-
-    return TCL_OK;
+    if (result != TCL_OK) {
+        Tcl_SetObjResult(vPtr->interp, Tcl_ObjPrintf("can't allocate compressed storage for vector \"%s\"", vPtr->name));
+    }
+    return result;
 }
 
 /*
@@ -2340,6 +2904,306 @@ Tcl_Size *Rbc_VectorSortIndex(VectorObject **vPtrPtr, Tcl_Size nVectors) {
     return indexArr;
 }
 
+/*
+ * Open-addressing hash table on normalized IEEE bit patterns, used by
+ * Rbc_VectorValueSet.  The table is kept at most half full.
+ */
+#define VALUE_SET_MIN_SLOTS 64
+#define VALUE_SET_NAN_BITS UINT64_C(0x7ff8000000000000)
+
+static uint64_t ValueSetKey(double value) {
+    uint64_t bits;
+
+    if (value == 0.0) {
+        return 0; /* -0.0 and 0.0 */
+    }
+    if (value != value) {
+        return VALUE_SET_NAN_BITS;
+    }
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static size_t ValueSetHash(uint64_t key) {
+    key ^= key >> 33;
+    key *= UINT64_C(0xff51afd7ed558ccd);
+    key ^= key >> 33;
+    key *= UINT64_C(0xc4ceb9fe1a85ec53);
+    key ^= key >> 33;
+    return (size_t)key;
+}
+
+static int ValueSetAllocSlots(Tcl_Interp *interp, Rbc_VectorValueSet *setPtr, size_t nSlots) {
+    Tcl_Size *slots;
+    size_t i;
+
+    if (nSlots > (SIZE_MAX / sizeof(Tcl_Size))) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("allocation size is too large", -1));
+        return TCL_ERROR;
+    }
+    slots = Tcl_AttemptAlloc(nSlots * sizeof(Tcl_Size));
+    if (slots == NULL) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("can't allocate value table", -1));
+        return TCL_ERROR;
+    }
+    for (i = 0; i < nSlots; i++) {
+        slots[i] = -1;
+    }
+    setPtr->slots = slots;
+    setPtr->mask = nSlots - 1;
+    return TCL_OK;
+}
+
+/*
+ * Doubles the number of slots and rehashes the stored values.
+ */
+static int ValueSetGrowSlots(Tcl_Interp *interp, Rbc_VectorValueSet *setPtr) {
+    Tcl_Size *oldSlots = setPtr->slots;
+    size_t oldMask = setPtr->mask;
+    Tcl_Size i;
+
+    if (oldMask >= (SIZE_MAX / 2)) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("allocation size is too large", -1));
+        return TCL_ERROR;
+    }
+    if (ValueSetAllocSlots(interp, setPtr, (oldMask + 1) * 2) != TCL_OK) {
+        setPtr->slots = oldSlots;
+        setPtr->mask = oldMask;
+        return TCL_ERROR;
+    }
+    ckfree(oldSlots);
+    for (i = 0; i < setPtr->nValues; i++) {
+        size_t j;
+
+        j = ValueSetHash(ValueSetKey(setPtr->values[i])) & setPtr->mask;
+        while (setPtr->slots[j] >= 0) {
+            j = (j + 1) & setPtr->mask;
+        }
+        setPtr->slots[j] = i;
+    }
+    return TCL_OK;
+}
+
+/*
+ * Doubles the capacity of the value and count arrays.
+ */
+static int ValueSetGrowValues(Tcl_Interp *interp, Rbc_VectorValueSet *setPtr) {
+    Tcl_Size capacity;
+    size_t byteCount;
+    double *values;
+
+    if (setPtr->capacity == 0) {
+        capacity = VALUE_SET_MIN_SLOTS / 2;
+    } else if (MultiplyVectorSizes(interp, setPtr->capacity, 2, &capacity) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    if (GetArrayByteCount(interp, capacity, sizeof(double), &byteCount) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    values = Tcl_AttemptRealloc(setPtr->values, byteCount);
+    if (values == NULL) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("can't allocate value table", -1));
+        return TCL_ERROR;
+    }
+    setPtr->values = values;
+    if (setPtr->counts != NULL) {
+        Tcl_Size *counts;
+
+        if (GetArrayByteCount(interp, capacity, sizeof(Tcl_Size), &byteCount) != TCL_OK) {
+            return TCL_ERROR;
+        }
+        counts = Tcl_AttemptRealloc(setPtr->counts, byteCount);
+        if (counts == NULL) {
+            Tcl_SetObjResult(interp, Tcl_NewStringObj("can't allocate value table", -1));
+            return TCL_ERROR;
+        }
+        setPtr->counts = counts;
+    }
+    setPtr->capacity = capacity;
+    return TCL_OK;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_VectorValueSetInit --
+ *
+ *      Initializes an empty value set.
+ *
+ * Parameters:
+ *      Tcl_Interp *interp - Interpreter for error reporting.
+ *      Rbc_VectorValueSet *setPtr - Set to initialize.
+ *      int keepCounts - If non-zero, count the occurrences of
+ *          each value.
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      Memory is allocated.  After a successful call, release it
+ *      with Rbc_VectorValueSetFree, even if later additions fail.
+ *
+ *--------------------------------------------------------------
+ */
+int Rbc_VectorValueSetInit(Tcl_Interp *interp, Rbc_VectorValueSet *setPtr, int keepCounts) {
+    setPtr->values = NULL;
+    setPtr->counts = NULL;
+    setPtr->nValues = 0;
+    setPtr->capacity = 0;
+    setPtr->slots = NULL;
+    setPtr->mask = 0;
+    if (keepCounts) {
+        /*
+         * A non-NULL counts array marks the set as counting.  It is
+         * resized together with the values array.
+         */
+        setPtr->counts = Tcl_AttemptAlloc(sizeof(Tcl_Size));
+        if (setPtr->counts == NULL) {
+            Tcl_SetObjResult(interp, Tcl_NewStringObj("can't allocate value table", -1));
+            return TCL_ERROR;
+        }
+    }
+    if (ValueSetAllocSlots(interp, setPtr, VALUE_SET_MIN_SLOTS) != TCL_OK) {
+        Rbc_VectorValueSetFree(setPtr);
+        return TCL_ERROR;
+    }
+    return TCL_OK;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_VectorValueSetAdd --
+ *
+ *      Adds an array of values to the set.  Each lookup probes the
+ *      table linearly from the slot of the value's hash.
+ *
+ * Parameters:
+ *      Tcl_Interp *interp - Interpreter for error reporting.
+ *      Rbc_VectorValueSet *setPtr - Set to update.
+ *      const double *valueArr - Values to add.
+ *      Tcl_Size length - Number of values.
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      New distinct values are appended to the set and counts are
+ *      updated.
+ *
+ *--------------------------------------------------------------
+ */
+int Rbc_VectorValueSetAdd(Tcl_Interp *interp, Rbc_VectorValueSet *setPtr, const double *valueArr, Tcl_Size length) {
+    Tcl_Size i;
+
+    for (i = 0; i < length; i++) {
+        uint64_t key;
+        Tcl_Size index;
+        size_t j;
+
+        if ((size_t)setPtr->nValues >= (setPtr->mask + 1) / 2) {
+            if (ValueSetGrowSlots(interp, setPtr) != TCL_OK) {
+                return TCL_ERROR;
+            }
+        }
+        key = ValueSetKey(valueArr[i]);
+        j = ValueSetHash(key) & setPtr->mask;
+        while ((index = setPtr->slots[j]) >= 0) {
+            if (ValueSetKey(setPtr->values[index]) == key) {
+                break;
+            }
+            j = (j + 1) & setPtr->mask;
+        }
+        if (index < 0) {
+            if (setPtr->nValues == setPtr->capacity) {
+                if (ValueSetGrowValues(interp, setPtr) != TCL_OK) {
+                    return TCL_ERROR;
+                }
+            }
+            index = setPtr->nValues++;
+            memcpy(setPtr->values + index, &key, sizeof(key));
+            if (setPtr->counts != NULL) {
+                setPtr->counts[index] = 0;
+            }
+            setPtr->slots[j] = index;
+        }
+        if (setPtr->counts != NULL) {
+            setPtr->counts[index]++;
+        }
+    }
+    return TCL_OK;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_VectorValueSetFind --
+ *
+ *      Looks up a value in the set.
+ *
+ * Parameters:
+ *      const Rbc_VectorValueSet *setPtr - Set to search.
+ *      double value - Value to look up.
+ *
+ * Results:
+ *      Returns the index of the value in setPtr->values, or -1 if
+ *      the value is not in the set.
+ *
+ * Side effects:
+ *      None.
+ *
+ *--------------------------------------------------------------
+ */
+Tcl_Size Rbc_VectorValueSetFind(const Rbc_VectorValueSet *setPtr, double value) {
+    uint64_t key;
+    Tcl_Size index;
+    size_t j;
+
+    key = ValueSetKey(value);
+    j = ValueSetHash(key) & setPtr->mask;
+    while ((index = setPtr->slots[j]) >= 0) {
+        if (ValueSetKey(setPtr->values[index]) == key) {
+            return index;
+        }
+        j = (j + 1) & setPtr->mask;
+    }
+    return -1;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_VectorValueSetFree --
+ *
+ *      Releases the memory used by a value set.
+ *
+ * Parameters:
+ *      Rbc_VectorValueSet *setPtr - Set to release.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Arrays still owned by the set are freed.  Callers may take
+ *      ownership of setPtr->values by setting it to NULL first.
+ *
+ *--------------------------------------------------------------
+ */
+void Rbc_VectorValueSetFree(Rbc_VectorValueSet *setPtr) {
+    if (setPtr->values != NULL) {
+        ckfree(setPtr->values);
+        setPtr->values = NULL;
+    }
+    if (setPtr->counts != NULL) {
+        ckfree(setPtr->counts);
+        setPtr->counts = NULL;
+    }
+    if (setPtr->slots != NULL) {
+        ckfree(setPtr->slots);
+        setPtr->slots = NULL;
+    }
+}
+
 /*
  *--------------------------------------------------------------
  *
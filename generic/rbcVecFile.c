@@ -0,0 +1,916 @@
+/*
+ * rbcVecFile.c --
+ *
+ *      This module implements the "vector save" and "vector load"
+ *      commands, which write and read snapshot files holding the
+ *      values of many vectors at once.
+ *
+ * Copyright (c) 2009 Samuel Green, Nicholas Hudson, Stanton Sievers, Jarrod Stormo
+ * All rights reserved.
+ *
+ * See "license.terms" for details.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "rbcVector.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SNAPSHOT_HAVE_MMAP 1
+#endif
+
+/*
+ * Snapshot file layout.  All integers are little-endian.
+ *
+ *      File header (SNAPSHOT_HEADER_SIZE bytes):
+ *          char[8]  magic ("RBCVSNAP")
+ *          uint32   version
+ *          uint32   number of vectors
+ *          uint64   size of the header, including all entries and the
+ *                   padding up to the first payload
+ *
+ *      One entry per vector (SNAPSHOT_ENTRY_SIZE bytes + name):
+ *          uint32   length of the name in bytes
+ *          uint8    data type (SNAPSHOT_FLOAT64)
+ *          uint8    encoding (SNAPSHOT_RAW or SNAPSHOT_ZLIB)
+ *          uint16   reserved, zero
+ *          uint64   number of values
+ *          uint64   file offset of the payload
+ *          uint64   size of the payload in bytes
+ *          char[]   fully qualified vector name (UTF-8, not terminated)
+ *
+ * Every payload starts at a multiple of SNAPSHOT_ALIGN bytes.  Raw
+ * payloads hold the values as little-endian IEEE doubles and can be
+ * mapped directly into memory.  Zlib payloads hold one compressed
+ * block per SNAPSHOT_BLOCK_VALUES values, each preceded by its uint32
+ * compressed size.
+ */
+#define SNAPSHOT_MAGIC "RBCVSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HEADER_SIZE 24
+#define SNAPSHOT_ENTRY_SIZE 32
+#define SNAPSHOT_ALIGN 64
+#define SNAPSHOT_BLOCK_VALUES 65536
+#define SNAPSHOT_IO_BYTES (1 << 24)
+#define SNAPSHOT_MAX_HEADER_SIZE (1 << 30)
+#define SNAPSHOT_ZLIB_LEVEL 6
+
+enum SnapshotDataTypes { SNAPSHOT_FLOAT64 = 1 };
+
+enum SnapshotEncodings { SNAPSHOT_RAW, SNAPSHOT_ZLIB };
+
+typedef struct {
+    const char *name;     /* Fully qualified vector name. */
+    uint32_t nameBytes;   /* Length of the name in bytes. */
+    int encoding;         /* Payload encoding. */
+    uint64_t length;      /* Number of values. */
+    uint64_t offset;      /* File offset of the payload. */
+    uint64_t storedBytes; /* Size of the payload in the file. */
+    VectorObject *vPtr;   /* Vector being saved, or loaded. */
+    int isNew;            /* Vector was created by "vector load". */
+    double *valueArr;     /* Values read by "vector load". */
+    Tcl_FreeProc *freeProc;
+} SnapshotEntry;
+
+static int IsLittleEndian(void) {
+    const uint16_t one = 1;
+
+    return *(const unsigned char *)&one;
+}
+
+static void PutUint32(unsigned char *p, uint32_t value) {
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static void PutUint64(unsigned char *p, uint64_t value) {
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint32_t GetUint32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t GetUint64(const unsigned char *p) {
+    return (uint64_t)GetUint32(p) | ((uint64_t)GetUint32(p + 4) << 32);
+}
+
+/*
+ * Reverses the byte order of an array of doubles.  Snapshot payloads
+ * are little-endian, so this is needed only on big-endian hosts.
+ */
+static void SwapDoubles(double *valueArr, Tcl_Size length) {
+    Tcl_Size i;
+
+    for (i = 0; i < length; i++) {
+        unsigned char *p = (unsigned char *)(valueArr + i);
+        int j;
+
+        for (j = 0; j < 4; j++) {
+            unsigned char c = p[j];
+
+            p[j] = p[7 - j];
+            p[7 - j] = c;
+        }
+    }
+}
+
+static uint64_t AlignOffset(uint64_t offset) {
+    return (offset + (SNAPSHOT_ALIGN - 1)) & ~(uint64_t)(SNAPSHOT_ALIGN - 1);
+}
+
+static int WriteBytes(Tcl_Interp *interp, Tcl_Channel channel, const char *bytes, uint64_t count) {
+    while (count > 0) {
+        Tcl_Size chunk = (count > SNAPSHOT_IO_BYTES) ? SNAPSHOT_IO_BYTES : (Tcl_Size)count;
+
+        if (Tcl_Write(channel, bytes, chunk) != chunk) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("error writing snapshot: %s", Tcl_PosixError(interp)));
+            return TCL_ERROR;
+        }
+        bytes += chunk;
+        count -= (uint64_t)chunk;
+    }
+    return TCL_OK;
+}
+
+static int ReadBytes(Tcl_Interp *interp, Tcl_Channel channel, char *bytes, uint64_t count) {
+    while (count > 0) {
+        Tcl_Size chunk = (count > SNAPSHOT_IO_BYTES) ? SNAPSHOT_IO_BYTES : (Tcl_Size)count;
+
+        if (Tcl_Read(channel, bytes, chunk) != chunk) {
+            Tcl_SetObjResult(interp, Tcl_NewStringObj("snapshot file is truncated", -1));
+            return TCL_ERROR;
+        }
+        bytes += chunk;
+        count -= (uint64_t)chunk;
+    }
+    return TCL_OK;
+}
+
+static int WritePadding(Tcl_Interp *interp, Tcl_Channel channel, uint64_t *offsetPtr) {
+    static const char zeros[SNAPSHOT_ALIGN] = {0};
+    uint64_t aligned;
+
+    aligned = AlignOffset(*offsetPtr);
+    if (WriteBytes(interp, channel, zeros, aligned - *offsetPtr) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    *offsetPtr = aligned;
+    return TCL_OK;
+}
+
+static int SeekTo(Tcl_Interp *interp, Tcl_Channel channel, uint64_t offset) {
+    if ((offset > (uint64_t)INT64_MAX) || (Tcl_Seek(channel, (Tcl_WideInt)offset, SEEK_SET) < 0)) {
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("error seeking in snapshot: %s", Tcl_PosixError(interp)));
+        return TCL_ERROR;
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WritePayload --
+ *
+ *      Writes the values of one vector at the current channel
+ *      position, either raw or as a series of zlib blocks.
+ *
+ * Parameters:
+ *      Tcl_Interp *interp - Interpreter for error reporting.
+ *      Tcl_Channel channel - Binary output channel.
+ *      SnapshotEntry *entryPtr - Entry of the vector to write.  Its
+ *          storedBytes field is set.
+ *      double *scratchArr - Buffer of SNAPSHOT_BLOCK_VALUES values.
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      Data is written to the channel.  The interpreter result is
+ *      reset after each compressed block.
+ *
+ *----------------------------------------------------------------------
+ */
+static int WritePayload(Tcl_Interp *interp, Tcl_Channel channel, SnapshotEntry *entryPtr, double *scratchArr) {
+    VectorObject *vPtr = entryPtr->vPtr;
+    int swap = !IsLittleEndian();
+    Tcl_Size i;
+
+    entryPtr->storedBytes = 0;
+    for (i = 0; i < vPtr->length; i += SNAPSHOT_BLOCK_VALUES) {
+        Tcl_Size count;
+        const double *blockArr;
+        size_t blockBytes;
+
+        count = vPtr->length - i;
+        if (count > SNAPSHOT_BLOCK_VALUES) {
+            count = SNAPSHOT_BLOCK_VALUES;
+        }
+        blockBytes = (size_t)count * sizeof(double);
+        blockArr = vPtr->valueArr + i;
+        if (swap) {
+            memcpy(scratchArr, blockArr, blockBytes);
+            SwapDoubles(scratchArr, count);
+            blockArr = scratchArr;
+        }
+        if (entryPtr->encoding == SNAPSHOT_ZLIB) {
+            Tcl_Obj *blockObjPtr;
+            unsigned char *bytes;
+            unsigned char prefix[4];
+            Tcl_Size nBytes;
+            int result;
+
+            blockObjPtr = Tcl_NewByteArrayObj((const unsigned char *)blockArr, (Tcl_Size)blockBytes);
+            Tcl_IncrRefCount(blockObjPtr);
+            result = Tcl_ZlibDeflate(interp, TCL_ZLIB_FORMAT_ZLIB, blockObjPtr, SNAPSHOT_ZLIB_LEVEL, NULL);
+            Tcl_DecrRefCount(blockObjPtr);
+            if (result != TCL_OK) {
+                return TCL_ERROR;
+            }
+            bytes = Tcl_GetByteArrayFromObj(Tcl_GetObjResult(interp), &nBytes);
+            PutUint32(prefix, (uint32_t)nBytes);
+            if ((WriteBytes(interp, channel, (const char *)prefix, 4) != TCL_OK) ||
+                (WriteBytes(interp, channel, (const char *)bytes, (uint64_t)nBytes) != TCL_OK)) {
+                return TCL_ERROR;
+            }
+            Tcl_ResetResult(interp);
+            entryPtr->storedBytes += 4 + (uint64_t)nBytes;
+        } else {
+            if (WriteBytes(interp, channel, (const char *)blockArr, blockBytes) != TCL_OK) {
+                return TCL_ERROR;
+            }
+            entryPtr->storedBytes += blockBytes;
+        }
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Rbc_VectorSaveObjCmd --
+ *
+ *      Implements the "vector save" command.
+ *
+ *      vector save fileName ?-compress? ?vecName ...?
+ *
+ *      The file is written in two passes.  A placeholder header is
+ *      written first, then the payloads, and finally the header is
+ *      rewritten with the payload offsets and sizes.
+ *
+ * Parameters:
+ *      ClientData clientData - Interpreter-specific data.
+ *      Tcl_Interp *interp
+ *      int objc
+ *      Tcl_Obj * const objv[]
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      The snapshot file is created or overwritten.
+ *
+ *----------------------------------------------------------------------
+ */
+int Rbc_VectorSaveObjCmd(ClientData clientData, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]) {
+    VectorInterpData *dataPtr = clientData;
+    SnapshotEntry *entryArr;
+    unsigned char *headerArr;
+    double *scratchArr;
+    Tcl_Channel channel;
+    Tcl_Size i, first, nEntries;
+    uint64_t headerBytes, offset;
+    int encoding, result;
+
+    encoding = SNAPSHOT_RAW;
+    for (first = 3; first < objc; first++) {
+        const char *string = Tcl_GetString(objv[first]);
+
+        if (string[0] != '-') {
+            break;
+        }
+        if (strcmp(string, "-compress") != 0) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("bad switch \"%s\": must be -compress", string));
+            return TCL_ERROR;
+        }
+        encoding = SNAPSHOT_ZLIB;
+    }
+    nEntries = objc - first;
+    if ((uint64_t)nEntries > (SNAPSHOT_MAX_HEADER_SIZE / SNAPSHOT_ENTRY_SIZE)) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("too many vectors for a snapshot", -1));
+        return TCL_ERROR;
+    }
+    entryArr = ckalloc(sizeof(SnapshotEntry) * (nEntries + 1));
+    headerBytes = SNAPSHOT_HEADER_SIZE;
+    for (i = 0; i < nEntries; i++) {
+        SnapshotEntry *entryPtr = entryArr + i;
+
+        if (Rbc_VectorLookupName(dataPtr, Tcl_GetString(objv[first + i]), &entryPtr->vPtr) != TCL_OK) {
+            ckfree(entryArr);
+            return TCL_ERROR;
+        }
+        entryPtr->name = entryPtr->vPtr->name;
+        entryPtr->nameBytes = (uint32_t)strlen(entryPtr->name);
+        entryPtr->encoding = encoding;
+        entryPtr->length = (uint64_t)entryPtr->vPtr->length;
+        entryPtr->offset = 0;
+        entryPtr->storedBytes = 0;
+        headerBytes += SNAPSHOT_ENTRY_SIZE + entryPtr->nameBytes;
+    }
+    if (headerBytes > SNAPSHOT_MAX_HEADER_SIZE) {
+        ckfree(entryArr);
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("snapshot header is too large", -1));
+        return TCL_ERROR;
+    }
+    headerBytes = AlignOffset(headerBytes);
+
+    channel = Tcl_OpenFileChannel(interp, Tcl_GetString(objv[2]), "w", 0666);
+    if (channel == NULL) {
+        ckfree(entryArr);
+        return TCL_ERROR;
+    }
+    result = TCL_ERROR;
+    headerArr = ckalloc((size_t)headerBytes);
+    memset(headerArr, 0, (size_t)headerBytes);
+    scratchArr = ckalloc(SNAPSHOT_BLOCK_VALUES * sizeof(double));
+    if (Tcl_SetChannelOption(interp, channel, "-translation", "binary") != TCL_OK) {
+        goto done;
+    }
+
+    /*
+     * Reserve the header, then write the 64-byte aligned payloads.
+     */
+    if (WriteBytes(interp, channel, (const char *)headerArr, headerBytes) != TCL_OK) {
+        goto done;
+    }
+    offset = headerBytes;
+    for (i = 0; i < nEntries; i++) {
+        entryArr[i].offset = offset;
+        if (WritePayload(interp, channel, entryArr + i, scratchArr) != TCL_OK) {
+            goto done;
+        }
+        offset += entryArr[i].storedBytes;
+        if (WritePadding(interp, channel, &offset) != TCL_OK) {
+            goto done;
+        }
+    }
+
+    /*
+     * Fill in and rewrite the header.
+     */
+    memcpy(headerArr, SNAPSHOT_MAGIC, 8);
+    PutUint32(headerArr + 8, SNAPSHOT_VERSION);
+    PutUint32(headerArr + 12, (uint32_t)nEntries);
+    PutUint64(headerArr + 16, headerBytes);
+    offset = SNAPSHOT_HEADER_SIZE;
+    for (i = 0; i < nEntries; i++) {
+        SnapshotEntry *entryPtr = entryArr + i;
+        unsigned char *p = headerArr + offset;
+
+        PutUint32(p, entryPtr->nameBytes);
+        p[4] = SNAPSHOT_FLOAT64;
+        p[5] = (unsigned char)entryPtr->encoding;
+        PutUint64(p + 8, entryPtr->length);
+        PutUint64(p + 16, entryPtr->offset);
+        PutUint64(p + 24, entryPtr->storedBytes);
+        memcpy(p + SNAPSHOT_ENTRY_SIZE, entryPtr->name, entryPtr->nameBytes);
+        offset += SNAPSHOT_ENTRY_SIZE + entryPtr->nameBytes;
+    }
+    if ((SeekTo(interp, channel, 0) != TCL_OK) ||
+        (WriteBytes(interp, channel, (const char *)headerArr, headerBytes) != TCL_OK)) {
+        goto done;
+    }
+    result = TCL_OK;
+
+done:
+    if (Tcl_Close(interp, channel) != TCL_OK) {
+        result = TCL_ERROR;
+    }
+    ckfree(scratchArr);
+    ckfree(headerArr);
+    ckfree(entryArr);
+    return result;
+}
+
+#ifdef SNAPSHOT_HAVE_MMAP
+/*
+ * Mapped payloads start inside a page, so the vector's array is not
+ * the address returned by mmap.  This table maps each array handed to
+ * a vector back to its mapping.
+ */
+typedef struct {
+    void *base;    /* Address returned by mmap. */
+    size_t length; /* Length of the mapping. */
+} SnapshotMapping;
+
+static Tcl_HashTable mappingTable;
+static int mappingTableInitialized = 0;
+TCL_DECLARE_MUTEX(mappingMutex)
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UnmapSnapshotValues --
+ *
+ *      Tcl_FreeProc for vectors whose values are mapped from a
+ *      snapshot file.
+ *
+ * Parameters:
+ *      void *valueArr - Array of values handed to the vector.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The file mapping is removed.
+ *
+ *----------------------------------------------------------------------
+ */
+static void UnmapSnapshotValues(void *valueArr) {
+    Tcl_HashEntry *hPtr;
+    SnapshotMapping *mapPtr = NULL;
+
+    Tcl_MutexLock(&mappingMutex);
+    hPtr = Tcl_FindHashEntry(&mappingTable, (char *)valueArr);
+    if (hPtr != NULL) {
+        mapPtr = Tcl_GetHashValue(hPtr);
+        Tcl_DeleteHashEntry(hPtr);
+    }
+    Tcl_MutexUnlock(&mappingMutex);
+    if (mapPtr != NULL) {
+        munmap(mapPtr->base, mapPtr->length);
+        ckfree(mapPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MapSnapshotValues --
+ *
+ *      Maps a raw payload copy-on-write into memory.  The vector may
+ *      modify its values without changing the file.
+ *
+ * Parameters:
+ *      Tcl_Interp *interp - Interpreter for error reporting.
+ *      int fd - Open descriptor of the snapshot file.
+ *      uint64_t fileSize - Size of the snapshot file.
+ *      SnapshotEntry *entryPtr - Entry to map.  Its valueArr and
+ *          freeProc fields are set.
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      A new mapping is registered.
+ *
+ *----------------------------------------------------------------------
+ */
+static int MapSnapshotValues(Tcl_Interp *interp, int fd, uint64_t fileSize, SnapshotEntry *entryPtr) {
+    SnapshotMapping *mapPtr;
+    Tcl_HashEntry *hPtr;
+    uint64_t pageSize, start;
+    void *base;
+    int isNew;
+
+    /*
+     * Touching a mapped page past the end of the file raises SIGBUS,
+     * so the payload must lie within the file.
+     */
+    if ((entryPtr->offset > fileSize) || (entryPtr->storedBytes > (fileSize - entryPtr->offset))) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("snapshot file is truncated", -1));
+        return TCL_ERROR;
+    }
+    pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+    start = entryPtr->offset - (entryPtr->offset % pageSize);
+    if ((entryPtr->offset - start + entryPtr->storedBytes) > (uint64_t)SIZE_MAX) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("snapshot payload is too large to map", -1));
+        return TCL_ERROR;
+    }
+    mapPtr = ckalloc(sizeof(SnapshotMapping));
+    mapPtr->length = (size_t)(entryPtr->offset - start + entryPtr->storedBytes);
+    base = mmap(NULL, mapPtr->length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)start);
+    if (base == MAP_FAILED) {
+        ckfree(mapPtr);
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("can't map snapshot payload: %s", Tcl_PosixError(interp)));
+        return TCL_ERROR;
+    }
+    mapPtr->base = base;
+    entryPtr->valueArr = (double *)((char *)base + (entryPtr->offset - start));
+    entryPtr->freeProc = UnmapSnapshotValues;
+
+    Tcl_MutexLock(&mappingMutex);
+    if (!mappingTableInitialized) {
+        Tcl_InitHashTable(&mappingTable, TCL_ONE_WORD_KEYS);
+        mappingTableInitialized = 1;
+    }
+    hPtr = Tcl_CreateHashEntry(&mappingTable, (char *)entryPtr->valueArr, &isNew);
+    Tcl_SetHashValue(hPtr, mapPtr);
+    Tcl_MutexUnlock(&mappingMutex);
+    return TCL_OK;
+}
+#endif /* SNAPSHOT_HAVE_MMAP */
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReadPayload --
+ *
+ *      Reads the values of one vector into a new array.  Raw payloads
+ *      are read straight into the array.  Zlib blocks are inflated
+ *      and copied into place.
+ *
+ * Parameters:
+ *      Tcl_Interp *interp - Interpreter for error reporting.
+ *      Tcl_Channel channel - Binary input channel.
+ *      SnapshotEntry *entryPtr - Entry to read.  Its valueArr and
+ *          freeProc fields are set.
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      Memory is allocated.  The interpreter result is reset after
+ *      each compressed block.
+ *
+ *----------------------------------------------------------------------
+ */
+static int ReadPayload(Tcl_Interp *interp, Tcl_Channel channel, SnapshotEntry *entryPtr) {
+    Tcl_Size length = (Tcl_Size)entryPtr->length;
+    size_t valueBytes = (size_t)entryPtr->length * sizeof(double);
+    double *valueArr;
+    Tcl_Size i;
+
+    if (SeekTo(interp, channel, entryPtr->offset) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    valueArr = Tcl_AttemptAlloc(valueBytes);
+    if (valueArr == NULL) {
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("can't allocate %" TCL_SIZE_MODIFIER "d elements for vector \"%s\"",
+                                               length, entryPtr->name));
+        return TCL_ERROR;
+    }
+    if (entryPtr->encoding == SNAPSHOT_RAW) {
+        if (entryPtr->storedBytes != valueBytes) {
+            ckfree(valueArr);
+            Tcl_SetObjResult(interp, Tcl_NewStringObj("bad snapshot payload size", -1));
+            return TCL_ERROR;
+        }
+        if (ReadBytes(interp, channel, (char *)valueArr, valueBytes) != TCL_OK) {
+            ckfree(valueArr);
+            return TCL_ERROR;
+        }
+    } else {
+        uint64_t remaining = entryPtr->storedBytes;
+
+        for (i = 0; i < length; i += SNAPSHOT_BLOCK_VALUES) {
+            Tcl_Obj *blockObjPtr;
+            unsigned char prefix[4], *bytes;
+            Tcl_Size count, nBytes;
+            uint32_t blockBytes;
+            int result;
+
+            count = length - i;
+            if (count > SNAPSHOT_BLOCK_VALUES) {
+                count = SNAPSHOT_BLOCK_VALUES;
+            }
+            if ((remaining < 4) || (ReadBytes(interp, channel, (char *)prefix, 4) != TCL_OK)) {
+                goto corrupt;
+            }
+            blockBytes = GetUint32(prefix);
+            remaining -= 4;
+            if (blockBytes > remaining) {
+                goto corrupt;
+            }
+            remaining -= blockBytes;
+            blockObjPtr = Tcl_NewObj();
+            Tcl_IncrRefCount(blockObjPtr);
+            bytes = Tcl_SetByteArrayLength(blockObjPtr, (Tcl_Size)blockBytes);
+            result = ReadBytes(interp, channel, (char *)bytes, blockBytes);
+            if (result == TCL_OK) {
+                result = Tcl_ZlibInflate(interp, TCL_ZLIB_FORMAT_ZLIB, blockObjPtr,
+                                         count * (Tcl_Size)sizeof(double), NULL);
+            }
+            Tcl_DecrRefCount(blockObjPtr);
+            if (result != TCL_OK) {
+                ckfree(valueArr);
+                return TCL_ERROR;
+            }
+            bytes = Tcl_GetByteArrayFromObj(Tcl_GetObjResult(interp), &nBytes);
+            if (nBytes != count * (Tcl_Size)sizeof(double)) {
+                goto corrupt;
+            }
+            memcpy(valueArr + i, bytes, (size_t)nBytes);
+            Tcl_ResetResult(interp);
+        }
+        if (remaining != 0) {
+            goto corrupt;
+        }
+    }
+    if (!IsLittleEndian()) {
+        SwapDoubles(valueArr, length);
+    }
+    entryPtr->valueArr = valueArr;
+    entryPtr->freeProc = TCL_DYNAMIC;
+    return TCL_OK;
+
+corrupt:
+    ckfree(valueArr);
+    Tcl_SetObjResult(interp, Tcl_ObjPrintf("corrupt compressed payload for vector \"%s\"", entryPtr->name));
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ParseSnapshotHeader --
+ *
+ *      Reads and validates the header of a snapshot file.
+ *
+ * Parameters:
+ *      Tcl_Interp *interp - Interpreter for error reporting.
+ *      Tcl_Channel channel - Binary input channel, at offset zero.
+ *      unsigned char **headerPtr - Returns the header bytes.  Entry
+ *          names point into this buffer.
+ *      SnapshotEntry **entryArrPtr - Returns the entries.
+ *      Tcl_Size *nEntriesPtr - Returns the number of entries.
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      On success the caller must free *headerPtr and *entryArrPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+static int ParseSnapshotHeader(Tcl_Interp *interp, Tcl_Channel channel, unsigned char **headerPtr,
+                               SnapshotEntry **entryArrPtr, Tcl_Size *nEntriesPtr) {
+    unsigned char fixed[SNAPSHOT_HEADER_SIZE], *headerArr;
+    SnapshotEntry *entryArr;
+    uint64_t headerBytes, offset;
+    uint32_t nEntries, i;
+
+    if (ReadBytes(interp, channel, (char *)fixed, SNAPSHOT_HEADER_SIZE) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    if (memcmp(fixed, SNAPSHOT_MAGIC, 8) != 0) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("not a vector snapshot file", -1));
+        return TCL_ERROR;
+    }
+    if (GetUint32(fixed + 8) != SNAPSHOT_VERSION) {
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("unsupported snapshot version %u", (unsigned)GetUint32(fixed + 8)));
+        return TCL_ERROR;
+    }
+    nEntries = GetUint32(fixed + 12);
+    headerBytes = GetUint64(fixed + 16);
+    if ((headerBytes < SNAPSHOT_HEADER_SIZE) || (headerBytes > SNAPSHOT_MAX_HEADER_SIZE) ||
+        (nEntries > (headerBytes - SNAPSHOT_HEADER_SIZE) / SNAPSHOT_ENTRY_SIZE)) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("bad snapshot header", -1));
+        return TCL_ERROR;
+    }
+    headerArr = ckalloc((size_t)headerBytes);
+    memcpy(headerArr, fixed, SNAPSHOT_HEADER_SIZE);
+    if (ReadBytes(interp, channel, (char *)headerArr + SNAPSHOT_HEADER_SIZE, headerBytes - SNAPSHOT_HEADER_SIZE) !=
+        TCL_OK) {
+        ckfree(headerArr);
+        return TCL_ERROR;
+    }
+    entryArr = ckalloc(sizeof(SnapshotEntry) * ((size_t)nEntries + 1));
+    offset = SNAPSHOT_HEADER_SIZE;
+    for (i = 0; i < nEntries; i++) {
+        SnapshotEntry *entryPtr = entryArr + i;
+        unsigned char *p = headerArr + offset;
+
+        if ((headerBytes - offset) < SNAPSHOT_ENTRY_SIZE) {
+            goto bad;
+        }
+        entryPtr->nameBytes = GetUint32(p);
+        entryPtr->encoding = p[5];
+        entryPtr->length = GetUint64(p + 8);
+        entryPtr->offset = GetUint64(p + 16);
+        entryPtr->storedBytes = GetUint64(p + 24);
+        entryPtr->vPtr = NULL;
+        entryPtr->isNew = FALSE;
+        entryPtr->valueArr = NULL;
+        entryPtr->freeProc = TCL_STATIC;
+        if ((p[4] != SNAPSHOT_FLOAT64) || (entryPtr->encoding > SNAPSHOT_ZLIB) || (entryPtr->nameBytes == 0) ||
+            (entryPtr->nameBytes > (headerBytes - offset - SNAPSHOT_ENTRY_SIZE)) ||
+            (entryPtr->length > (uint64_t)TCL_SIZE_MAX) || (entryPtr->length > (SIZE_MAX / sizeof(double))) ||
+            (entryPtr->offset % SNAPSHOT_ALIGN) != 0 || (entryPtr->offset < headerBytes)) {
+            goto bad;
+        }
+
+        /*
+         * Names are not terminated.  They are copied into a
+         * Tcl_DString before use.
+         */
+        entryPtr->name = (const char *)p + SNAPSHOT_ENTRY_SIZE;
+        offset += SNAPSHOT_ENTRY_SIZE + entryPtr->nameBytes;
+    }
+    *headerPtr = headerArr;
+    *entryArrPtr = entryArr;
+    *nEntriesPtr = (Tcl_Size)nEntries;
+    return TCL_OK;
+
+bad:
+    ckfree(entryArr);
+    ckfree(headerArr);
+    Tcl_SetObjResult(interp, Tcl_NewStringObj("bad snapshot header", -1));
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Rbc_VectorLoadObjCmd --
+ *
+ *      Implements the "vector load" command.
+ *
+ *      vector load fileName ?-mmap?
+ *
+ *      All payloads are read, and every vector is looked up or
+ *      created, before any vector is changed.  A damaged file or a
+ *      name that can't be used leaves every vector untouched.  The
+ *      values are then handed to the vectors with Rbc_VectorReset.
+ *      With -mmap, raw payloads are mapped instead of read where the
+ *      platform supports it and the file is on the native
+ *      filesystem.
+ *
+ * Parameters:
+ *      ClientData clientData - Interpreter-specific data.
+ *      Tcl_Interp *interp
+ *      int objc
+ *      Tcl_Obj * const objv[]
+ *
+ * Results:
+ *      A standard Tcl result.  The interpreter result holds the list
+ *      of loaded vector names.
+ *
+ * Side effects:
+ *      Vectors are created or their contents replaced.
+ *
+ *----------------------------------------------------------------------
+ */
+int Rbc_VectorLoadObjCmd(ClientData clientData, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]) {
+    VectorInterpData *dataPtr = clientData;
+    SnapshotEntry *entryArr;
+    unsigned char *headerArr;
+    Tcl_Channel channel;
+    Tcl_Obj *listObjPtr;
+    Tcl_DString ds;
+    Tcl_Size i, nEntries;
+    int useMap, result;
+#ifdef SNAPSHOT_HAVE_MMAP
+    struct stat st;
+    int fd = -1;
+#endif
+
+    useMap = FALSE;
+    if (objc == 4) {
+        if (strcmp(Tcl_GetString(objv[3]), "-mmap") != 0) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("bad switch \"%s\": must be -mmap", Tcl_GetString(objv[3])));
+            return TCL_ERROR;
+        }
+        useMap = TRUE;
+    }
+    channel = Tcl_OpenFileChannel(interp, Tcl_GetString(objv[2]), "r", 0);
+    if (channel == NULL) {
+        return TCL_ERROR;
+    }
+    if ((Tcl_SetChannelOption(interp, channel, "-translation", "binary") != TCL_OK) ||
+        (ParseSnapshotHeader(interp, channel, &headerArr, &entryArr, &nEntries) != TCL_OK)) {
+        Tcl_Close(NULL, channel);
+        return TCL_ERROR;
+    }
+    result = TCL_ERROR;
+
+#ifdef SNAPSHOT_HAVE_MMAP
+    /*
+     * Payloads can be mapped only when their byte order matches the
+     * host.
+     */
+    if (useMap && IsLittleEndian()) {
+        const char *nativePath;
+
+        /*
+         * Files of other filesystems, such as zipfs, have no native
+         * path.  Their payloads are read through the channel.
+         */
+        nativePath = (const char *)Tcl_FSGetNativePath(objv[2]);
+        if (nativePath != NULL) {
+            fd = open(nativePath, O_RDONLY);
+            if ((fd < 0) || (fstat(fd, &st) != 0)) {
+                Tcl_SetObjResult(interp, Tcl_ObjPrintf("can't map \"%s\": %s", Tcl_GetString(objv[2]),
+                                                       Tcl_PosixError(interp)));
+                goto done;
+            }
+        }
+    }
+#else
+    (void)useMap;
+#endif
+    for (i = 0; i < nEntries; i++) {
+        SnapshotEntry *entryPtr = entryArr + i;
+
+        if (entryPtr->length == 0) {
+            continue;
+        }
+#ifdef SNAPSHOT_HAVE_MMAP
+        if ((fd >= 0) && (entryPtr->encoding == SNAPSHOT_RAW)) {
+            if (entryPtr->storedBytes != entryPtr->length * sizeof(double)) {
+                Tcl_SetObjResult(interp, Tcl_NewStringObj("bad snapshot payload size", -1));
+                goto done;
+            }
+            if (MapSnapshotValues(interp, fd, (uint64_t)st.st_size, entryPtr) != TCL_OK) {
+                goto done;
+            }
+            continue;
+        }
+#endif
+        if (ReadPayload(interp, channel, entryPtr) != TCL_OK) {
+            goto done;
+        }
+    }
+
+    /*
+     * Every payload is in memory.  Look up or create every vector
+     * before changing any of them.  If a name can't be used, the
+     * vectors created so far are destroyed again.
+     */
+    Tcl_DStringInit(&ds);
+    for (i = 0; i < nEntries; i++) {
+        SnapshotEntry *entryPtr = entryArr + i;
+        const char *name;
+
+        Tcl_DStringSetLength(&ds, 0);
+        name = Tcl_DStringAppend(&ds, entryPtr->name, (Tcl_Size)entryPtr->nameBytes);
+        entryPtr->vPtr = Rbc_VectorCreate(dataPtr, name, name, name, &entryPtr->isNew);
+        if (entryPtr->vPtr == NULL) {
+            break;
+        }
+    }
+    Tcl_DStringFree(&ds);
+    if (i < nEntries) {
+        Tcl_InterpState state;
+
+        state = Tcl_SaveInterpState(interp, TCL_ERROR);
+        while (i-- > 0) {
+            if (entryArr[i].isNew) {
+                Rbc_VectorFree(entryArr[i].vPtr);
+            }
+        }
+        Tcl_RestoreInterpState(interp, state);
+        goto done;
+    }
+
+    /*
+     * Hand the arrays to the vectors.  Their lengths were checked
+     * with the header, so Rbc_VectorReset can't fail.
+     */
+    listObjPtr = Tcl_NewListObj(0, NULL);
+    for (i = 0; i < nEntries; i++) {
+        SnapshotEntry *entryPtr = entryArr + i;
+        VectorObject *vPtr = entryPtr->vPtr;
+
+        vPtr->notifyFlags |= UPDATE_RANGE;
+        Rbc_VectorReset(vPtr, entryPtr->valueArr, (Tcl_Size)entryPtr->length, (Tcl_Size)entryPtr->length,
+                        entryPtr->freeProc);
+        entryPtr->valueArr = NULL; /* Now owned by the vector. */
+        Tcl_ListObjAppendElement(interp, listObjPtr, Tcl_NewStringObj(vPtr->name, -1));
+    }
+    Tcl_SetObjResult(interp, listObjPtr);
+    result = TCL_OK;
+
+done:
+    for (i = 0; i < nEntries; i++) {
+        SnapshotEntry *entryPtr = entryArr + i;
+
+        if (entryPtr->valueArr != NULL) {
+            if (entryPtr->freeProc == TCL_DYNAMIC) {
+                ckfree(entryPtr->valueArr);
+            } else {
+                entryPtr->freeProc(entryPtr->valueArr);
+            }
+        }
+    }
+#ifdef SNAPSHOT_HAVE_MMAP
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+    Tcl_Close(NULL, channel);
+    ckfree(entryArr);
+    ckfree(headerArr);
+    return result;
+}
@@ -65,7 +65,6 @@ static int precTable[] = {
 static void InstallIndexProc(Tcl_HashTable *tablePtr, char *string, Rbc_VectorIndexProc *procPtr);
 static Tcl_Size First(VectorObject *vPtr);
 static Tcl_Size Next(VectorObject *vPtr, Tcl_Size current);
-static double Random(double value);
 static double Mean(Rbc_Vector *vecPtr);
 static double Sum(Rbc_Vector *vecPtr);
 static double Product(Rbc_Vector *vecPtr);
@@ -92,6 +91,7 @@ static double Fmod(double x, double y);
 static int ParseString(Tcl_Interp *interp, const char *string, Value *valuePtr);
 static int ParseMathFunction(Tcl_Interp *interp, char *start, ParseInfo *parsePtr, Value *valuePtr);
 static int ComponentFunc(ClientData clientData, Tcl_Interp *interp, VectorObject *vPtr);
+static int RandomFunc(ClientData clientData, Tcl_Interp *interp, VectorObject *vPtr);
 static int ScalarFunc(ClientData clientData, Tcl_Interp *interp, VectorObject *vPtr);
 static int VectorFunc(ClientData clientData, Tcl_Interp *interp, VectorObject *vPtr);
 static int ParseSubstitutionResult(Tcl_Interp *interp, Value *valuePtr);
@@ -123,7 +123,7 @@ static MathFunction mathFunctions[] = {
     {"q1", (GenericMathProc *)ScalarFunc, (ClientData)Q1},
     {"q3", (GenericMathProc *)ScalarFunc, (ClientData)Q3},
     {"prod", (GenericMathProc *)ScalarFunc, (ClientData)Product},
-    {"random", (GenericMathProc *)ComponentFunc, (ClientData)Random},
+    {"random", (GenericMathProc *)RandomFunc, (ClientData)NULL},
     {"round", (GenericMathProc *)ComponentFunc, (ClientData)Round},
     {"sdev", (GenericMathProc *)ScalarFunc, (ClientData)StdDeviation},
     {"sin", (GenericMathProc *)ComponentFunc, (ClientData)sin},
@@ -379,12 +379,6 @@ double Rbc_VecMin(Rbc_Vector *vecPtr) {
     return vPtr->min;
 }
 
-static double Random(double value) {
-    (void)value;
-
-    return Rbc_RandomDouble();
-}
-
 /*
  *----------------------------------------------------------------------
  *
@@ -2260,6 +2254,46 @@ static int ComponentFunc(ClientData clientData, Tcl_Interp *interp, VectorObject
     return TCL_OK;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * RandomFunc --
+ *
+ *      Implements the "random" math function.  Each finite component
+ *      in the designated interval is replaced by a pseudo-random value
+ *      in the range [0.0, 1.0).  Consecutive finite components are
+ *      filled as one block from the generator of the current thread.
+ *
+ * Parameters:
+ *      ClientData clientData - Not used.
+ *      Tcl_Interp *interp - Not used.
+ *      VectorObject *vPtr - Vector to fill.
+ *
+ * Results:
+ *      Always returns TCL_OK.
+ *
+ * Side effects:
+ *      The thread's generator is advanced.
+ *
+ *----------------------------------------------------------------------
+ */
+static int RandomFunc(ClientData clientData, Tcl_Interp *interp, VectorObject *vPtr) {
+    Rbc_Random *rngPtr = Rbc_RandomThreadState();
+    Tcl_Size i, runStart;
+
+    (void)clientData;
+    (void)interp;
+    for (i = First(vPtr); i >= 0; /* empty */) {
+        runStart = i;
+        while ((i <= vPtr->last) && (FINITE(vPtr->valueArr[i]))) {
+            i++;
+        }
+        Rbc_RandomUniform(rngPtr, vPtr->valueArr + runStart, i - runStart, 0.0, 1.0);
+        i = (i <= vPtr->last) ? Next(vPtr, i) : -1;
+    }
+    return TCL_OK;
+}
+
 /*
  *--------------------------------------------------------------
  *
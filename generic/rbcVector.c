@@ -23,6 +23,7 @@ static Tcl_ObjCmdProc2 VectorObjCmd;
 static Tcl_ObjCmdProc2 VectorCreateObjCmd;
 static Tcl_ObjCmdProc2 VectorDestroyObjCmd;
 static Tcl_ObjCmdProc2 VectorExprObjCmd;
+static Tcl_ObjCmdProc2 VectorIntersectObjCmd;
 static Tcl_ObjCmdProc2 VectorNamesObjCmd;
 
 static Tcl_CmdDeleteProc VectorInstDeleteProc;
@@ -30,6 +31,7 @@ static Tcl_CmdDeleteProc VectorInstDeleteProc;
 static Tcl_InterpDeleteProc VectorInterpDeleteProc;
 
 static void VectorNotifyClients(ClientData clientData);
+static void VectorCompressProc(ClientData clientData);
 static void VectorFlushCache(VectorObject *vPtr);
 static char *VectorVarTrace(ClientData clientData, Tcl_Interp *interp, char *part1, char *part2, int flags);
 static char *BuildQualifiedName(Tcl_Interp *interp, const char *name, Tcl_DString *fullName);
@@ -136,7 +138,10 @@ int Rbc_VectorInit(Tcl_Interp *interp) {
 static const VectorOpSpec vectorOpCmd[] = {{{"create", 2, 0, "?vecName? ?switches...?"}, VectorCreateObjCmd},
                                            {{"destroy", 2, 0, "?vecName?..."}, VectorDestroyObjCmd},
                                            {{"expr", 3, 3, "expression"}, VectorExprObjCmd},
+                                           {{"intersect", 5, 5, "vecName vecName destName"}, VectorIntersectObjCmd},
+                                           {{"load", 3, 4, "fileName ?-mmap?"}, Rbc_VectorLoadObjCmd},
                                            {{"names", 2, 3, "?pattern?..."}, VectorNamesObjCmd},
+                                           {{"save", 3, 0, "fileName ?-compress? ?vecName...?"}, Rbc_VectorSaveObjCmd},
                                            {{NULL, 0, 0, NULL}, NULL}};
 
 /*
@@ -254,12 +259,14 @@ static int VectorCreateObjCmd(ClientData clientData, Tcl_Interp *interp, Tcl_Siz
     char *cmdName, *varName;
     int freeOnUnset;
     int flush;
+    int compressed;
     Tcl_Size defLen;
     Tcl_Obj **objNameArray; /* holds all vector names specified */
     Tcl_Size count;
     Tcl_DString ds;
     Tcl_Size i;
     const Tcl_ArgvInfo argsTable[] = {{TCL_ARGV_STRING, "-command", NULL, &cmdName, NULL, NULL},
+                                      {TCL_ARGV_GENFUNC, "-compressed", ParseBool, &compressed, NULL, "-compressed"},
                                       {TCL_ARGV_GENFUNC, "-flush", ParseBool, &flush, NULL, "-flush"},
                                       {TCL_ARGV_GENFUNC, "-length", ParseVectorLength, &defLen, NULL, "-length"},
                                       {TCL_ARGV_STRING, "-variable", NULL, &varName, NULL, NULL},
@@ -275,6 +282,7 @@ static int VectorCreateObjCmd(ClientData clientData, Tcl_Interp *interp, Tcl_Siz
     freeOnUnset = 0; /* value of the user level '-watchunset' switch */
     defLen = 0;      /* default vector length */
     flush = FALSE;
+    compressed = FALSE;
 
     count = objc - 1; /* start at "create" */
     if (Tcl_ParseArgsObjv(interp, argsTable, &count, objv + 1, &objNameArray)) {
@@ -403,6 +411,10 @@ static int VectorCreateObjCmd(ClientData clientData, Tcl_Interp *interp, Tcl_Siz
         vPtr->freeOnUnset = freeOnUnset;
         vPtr->flush = flush;
         vPtr->offset = first;
+        vPtr->compressed = compressed;
+        if (compressed) {
+            Rbc_VectorCompressWhenIdle(vPtr);
+        }
         if (size > 0) {
             if (Rbc_VectorChangeLength(vPtr, size) != TCL_OK) {
                 goto error;
@@ -494,6 +506,87 @@ static int VectorExprObjCmd(ClientData clientData, Tcl_Interp *interp, Tcl_Size
     return Rbc_ExprVector(interp, Tcl_GetString(objv[2]), (Rbc_Vector *)NULL);
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * VectorIntersectObjCmd --
+ *
+ *      Stores the distinct values that occur in both of two vectors
+ *      into a destination vector.
+ *
+ *      vector intersect vecName vecName destName
+ *
+ *      Values are stored in order of their first occurrence in the
+ *      first vector.  The destination vector is created if necessary
+ *      and may be one of the source vectors.
+ *
+ * Parameters:
+ *      ClientData clientData - Interpreter-specific data.
+ *      Tcl_Interp *interp
+ *      int objc
+ *      Tcl_Obj * const objv[]
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      The contents of the destination vector are replaced.
+ *
+ *----------------------------------------------------------------------
+ */
+static int VectorIntersectObjCmd(ClientData clientData, Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[]) {
+    VectorInterpData *dataPtr = clientData;
+    VectorObject *v1Ptr, *v2Ptr, *destPtr;
+    Rbc_VectorValueSet set1, set2;
+    Tcl_Size i, count;
+    int isNew, result;
+    const char *string;
+
+    (void)objc;
+    if ((Rbc_VectorLookupName(dataPtr, Tcl_GetString(objv[2]), &v1Ptr) != TCL_OK) ||
+        (Rbc_VectorLookupName(dataPtr, Tcl_GetString(objv[3]), &v2Ptr) != TCL_OK)) {
+        return TCL_ERROR;
+    }
+    if (Rbc_VectorValueSetInit(interp, &set1, FALSE) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    if (Rbc_VectorValueSetInit(interp, &set2, FALSE) != TCL_OK) {
+        Rbc_VectorValueSetFree(&set1);
+        return TCL_ERROR;
+    }
+    result = TCL_ERROR;
+    if ((Rbc_VectorValueSetAdd(interp, &set1, v1Ptr->valueArr, v1Ptr->length) != TCL_OK) ||
+        (Rbc_VectorValueSetAdd(interp, &set2, v2Ptr->valueArr, v2Ptr->length) != TCL_OK)) {
+        goto done;
+    }
+
+    /*
+     * Compact the distinct values of the first vector in place.  The
+     * values array of set1 then becomes the destination's storage.
+     */
+    count = 0;
+    for (i = 0; i < set1.nValues; i++) {
+        if (Rbc_VectorValueSetFind(&set2, set1.values[i]) >= 0) {
+            set1.values[count++] = set1.values[i];
+        }
+    }
+    string = Tcl_GetString(objv[4]);
+    destPtr = Rbc_VectorCreate(dataPtr, string, string, string, &isNew);
+    if (destPtr == NULL) {
+        goto done;
+    }
+    destPtr->notifyFlags |= UPDATE_RANGE;
+    result = Rbc_VectorReset(destPtr, set1.values, count, set1.capacity, TCL_DYNAMIC);
+    if (result == TCL_OK) {
+        set1.values = NULL;
+    }
+
+done:
+    Rbc_VectorValueSetFree(&set1);
+    Rbc_VectorValueSetFree(&set2);
+    return result;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -735,7 +828,15 @@ VectorObject *Rbc_VectorCreate(VectorInterpData *dataPtr, const char *vecName, c
             }
         }
         qualVecName = (char *)vecName;
-        vPtr = Rbc_VectorParseElement(NULL, dataPtr, qualVecName, NULL, NS_SEARCH_CURRENT);
+        /*
+         * Look the vector up without decoding it: creating a vector
+         * that already exists doesn't touch its values.
+         */
+        vPtr = GetVectorObject(dataPtr, qualVecName, NS_SEARCH_CURRENT);
+        if (vPtr != NULL) {
+            vPtr->first = 0;
+            vPtr->last = vPtr->length - 1;
+        }
     }
 
     if (vPtr == NULL) {
@@ -900,6 +1001,12 @@ void Rbc_VectorFree(VectorObject *vPtr) {
         ckfree((char *)clientPtr);
     }
     Rbc_ChainDestroy(vPtr->chainPtr);
+    if (vPtr->notifyFlags & COMPRESS_PENDING) {
+        Tcl_CancelIdleCall(VectorCompressProc, vPtr);
+    }
+    if (vPtr->chunksPtr != NULL) {
+        Rbc_VectorChunksFree(vPtr->chunksPtr);
+    }
     if ((vPtr->valueArr != NULL) && (vPtr->freeProc != TCL_STATIC)) {
         if (vPtr->freeProc == TCL_DYNAMIC) {
             ckfree((char *)vPtr->valueArr);
@@ -1149,6 +1256,13 @@ int Rbc_VectorReset(VectorObject *vPtr, double *valueArr, Tcl_Size length, Tcl_S
         valueArr = newArr;
         freeProc = TCL_DYNAMIC;
     }
+    /*
+     * Compressed values are replaced as a whole.
+     */
+    if (vPtr->chunksPtr != NULL) {
+        Rbc_VectorChunksFree(vPtr->chunksPtr);
+        vPtr->chunksPtr = NULL;
+    }
     /*
      * Release the old array only when it is actually being replaced.
      */
@@ -1223,6 +1337,7 @@ static void VectorNotifyClients(ClientData clientData) {
             clientPtr->serverPtr = NULL;
         }
     }
+    vPtr->changedFirst = vPtr->length;
 }
 
 /*
@@ -1252,6 +1367,36 @@ int Rbc_VectorNotifyPending(Rbc_VectorId clientId) {
     return (clientPtr->serverPtr->notifyFlags & NOTIFY_PENDING);
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * Rbc_VectorChangedFirst --
+ *
+ *      Returns the lowest index of the vector changed since its
+ *      clients were last notified.  It's meant to be called from a
+ *      client's callback, where values before this index are known
+ *      to be the same as at the previous callback.  For example,
+ *      appending values only changes the indices past the old end
+ *      of the vector.
+ *
+ * Parameters:
+ *      Rbc_VectorId clientId - Client token identifying the vector
+ *
+ * Results:
+ *      The lowest changed index.  Zero is returned if the vector no
+ *      longer exists.
+ *
+ *--------------------------------------------------------------
+ */
+Tcl_Size Rbc_VectorChangedFirst(Rbc_VectorId clientId) {
+    VectorClient *clientPtr = (VectorClient *)clientId;
+
+    if ((clientPtr == NULL) || (clientPtr->magic != VECTOR_MAGIC) || (clientPtr->serverPtr == NULL)) {
+        return 0;
+    }
+    return clientPtr->serverPtr->changedFirst;
+}
+
 /*
  * ----------------------------------------------------------------------
  *
@@ -1344,6 +1489,9 @@ int Rbc_VectorChangeLength(VectorObject *vPtr, Tcl_Size length) {
         Tcl_SetObjResult(vPtr->interp, Tcl_ObjPrintf("bad vector size \"%" TCL_SIZE_MODIFIER "d\"", length));
         return TCL_ERROR;
     }
+    if (Rbc_VectorMaterialize(vPtr) != TCL_OK) {
+        return TCL_ERROR;
+    }
 
     newArr = NULL;
     newSize = 0;
@@ -1416,6 +1564,130 @@ int Rbc_VectorChangeLength(VectorObject *vPtr, Tcl_Size length) {
     return TCL_OK;
 }
 
+/*
+ * ----------------------------------------------------------------------
+ *
+ * Rbc_VectorMaterialize --
+ *
+ *      Decodes the compressed values of a vector back into its value
+ *      array.  Every path that hands out the value array of a vector
+ *      calls this first.  The values stay decoded until they change,
+ *      so that repeated reads don't decode and encode them each time.
+ *
+ * Parameters:
+ *      VectorObject *vPtr
+ *
+ * Results:
+ *      A standard Tcl result.  If memory for the values can't be
+ *      allocated, TCL_ERROR is returned and the interpreter result of
+ *      the vector holds an error message.
+ *
+ * Side effects:
+ *      The compressed storage of the vector is released.
+ *
+ * ----------------------------------------------------------------------
+ */
+int Rbc_VectorMaterialize(VectorObject *vPtr) {
+    Rbc_VectorChunks *storePtr = vPtr->chunksPtr;
+    double *valueArr;
+    size_t byteCount;
+
+    if (storePtr == NULL) {
+        return TCL_OK;
+    }
+    if (GetVectorByteCount(vPtr->interp, vPtr->length, &byteCount) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    valueArr = Tcl_AttemptAlloc(byteCount);
+    if (valueArr == NULL) {
+        Tcl_SetObjResult(vPtr->interp, Tcl_ObjPrintf("can't allocate %" TCL_SIZE_MODIFIER "d elements for vector \"%s\"",
+                                                     vPtr->length, vPtr->name));
+        return TCL_ERROR;
+    }
+    Rbc_VectorChunksDecode(storePtr, 0, vPtr->length, valueArr);
+    Rbc_VectorChunksFree(storePtr);
+    vPtr->chunksPtr = NULL;
+    vPtr->valueArr = valueArr;
+    vPtr->size = vPtr->length;
+    vPtr->freeProc = TCL_DYNAMIC;
+    return TCL_OK;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * Rbc_VectorCompressWhenIdle --
+ *
+ *      Arranges for the values of a compressed vector to be encoded
+ *      at the next idle point.
+ *
+ * Parameters:
+ *      VectorObject *vPtr
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      VectorCompressProc is scheduled.
+ *
+ * ----------------------------------------------------------------------
+ */
+void Rbc_VectorCompressWhenIdle(VectorObject *vPtr) {
+    if (vPtr->compressed && !(vPtr->notifyFlags & COMPRESS_PENDING)) {
+        vPtr->notifyFlags |= COMPRESS_PENDING;
+        Tcl_DoWhenIdle(VectorCompressProc, vPtr);
+    }
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * VectorCompressProc --
+ *
+ *      Encodes the values of a compressed vector into chunks and
+ *      releases its value array.  Vectors with clients are left
+ *      alone, since clients such as graph elements keep pointers
+ *      into the value array.  Vectors shorter than one chunk gain
+ *      nothing and are left alone as well.
+ *
+ * Parameters:
+ *      ClientData clientData - Vector object.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      On success, valueArr is NULL and chunksPtr holds the values.
+ *      If memory runs out, the vector simply stays uncompressed.
+ *
+ * ----------------------------------------------------------------------
+ */
+static void VectorCompressProc(ClientData clientData) {
+    VectorObject *vPtr = clientData;
+    Rbc_VectorChunks *storePtr;
+
+    vPtr->notifyFlags &= ~COMPRESS_PENDING;
+    if (!vPtr->compressed || (vPtr->chunksPtr != NULL) || (vPtr->length < RBC_VECTOR_CHUNK_VALUES) ||
+        (Rbc_ChainGetLength(vPtr->chainPtr) > 0)) {
+        return;
+    }
+    storePtr = Rbc_VectorChunksCreate(vPtr->valueArr, vPtr->length);
+    if (storePtr == NULL) {
+        return;
+    }
+    if (vPtr->freeProc != TCL_STATIC) {
+        if (vPtr->freeProc == TCL_DYNAMIC) {
+            ckfree(vPtr->valueArr);
+        } else {
+            vPtr->freeProc(vPtr->valueArr);
+        }
+    }
+    vPtr->chunksPtr = storePtr;
+    vPtr->valueArr = NULL;
+    vPtr->size = 0;
+    vPtr->freeProc = TCL_STATIC;
+}
+
 /*
  * ----------------------------------------------------------------------
  *
@@ -1837,6 +2109,14 @@ VectorObject *Rbc_VectorParseElement(Tcl_Interp *interp, VectorInterpData *dataP
         return NULL;
     }
     Tcl_DecrRefCount(nameObjPtr);
+    if (Rbc_VectorMaterialize(vPtr) != TCL_OK) {
+        if (interp == NULL) {
+            Tcl_ResetResult(vPtr->interp);
+        } else if (interp != vPtr->interp) {
+            Tcl_SetObjResult(interp, Tcl_GetObjResult(vPtr->interp));
+        }
+        return NULL;
+    }
     oldFirst = vPtr->first;
     oldLast = vPtr->last;
     /*
@@ -1915,8 +2195,38 @@ VectorObject *Rbc_VectorParseElement(Tcl_Interp *interp, VectorInterpData *dataP
  * ----------------------------------------------------------------------
  */
 void Rbc_VectorUpdateClients(VectorObject *vPtr) {
+    Rbc_VectorUpdateClientsFrom(vPtr, 0);
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * Rbc_VectorUpdateClientsFrom --
+ *
+ *      Like Rbc_VectorUpdateClients, but only the values from the
+ *      given index on have changed.  Clients can ask for this index
+ *      with Rbc_VectorChangedFirst to avoid rescanning the values
+ *      before it.
+ *
+ * Parameters:
+ *      VectorObject *vPtr - The vector to update clients for
+ *      Tcl_Size first - Lowest index changed
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The individual client callbacks are eventually invoked.
+ *
+ * ----------------------------------------------------------------------
+ */
+void Rbc_VectorUpdateClientsFrom(VectorObject *vPtr, Tcl_Size first) {
+    if (first < vPtr->changedFirst) {
+        vPtr->changedFirst = first;
+    }
     vPtr->dirty++;
     vPtr->max = vPtr->min = rbcNaN;
+    Rbc_VectorCompressWhenIdle(vPtr);
     if (vPtr->notifyFlags & NOTIFY_NEVER) {
         return;
     }
@@ -1976,6 +2286,16 @@ static char *VectorVarTrace(ClientData clientData, Tcl_Interp *interp, char *par
     }
     first = vPtr->first;
     last = vPtr->last;
+
+    /*
+     * Reads of single elements and ranges decode only the chunks they
+     * touch.  Everything else needs the value array.
+     */
+    if (((flags & TCL_TRACE_READS) == 0) || (first == SPECIAL_INDEX)) {
+        if (Rbc_VectorMaterialize(vPtr) != TCL_OK) {
+            goto error;
+        }
+    }
     varFlags = TCL_LEAVE_ERR_MSG | (flags & (TCL_GLOBAL_ONLY | TCL_NAMESPACE_ONLY));
     if (flags & TCL_TRACE_WRITES) {
         double value;
@@ -2021,7 +2341,9 @@ static char *VectorVarTrace(ClientData clientData, Tcl_Interp *interp, char *par
             return NULL;
         }
         if (first == last) {
-            if (first >= 0) {
+            if (vPtr->chunksPtr != NULL) {
+                Rbc_VectorChunksDecode(vPtr->chunksPtr, first, 1, &value);
+            } else if (first >= 0) {
                 value = vPtr->valueArr[first];
             } else {
                 vPtr->first = 0, vPtr->last = vPtr->length - 1;
@@ -2318,7 +2640,8 @@ static VectorObject *FindVectorInNamespace(VectorInterpData *dataPtr, Tcl_Namesp
  *
  * Rbc_GetValues --
  *
- *      Return a list containing the values of the vector
+ *      Return a list containing the values of the vector.  For a
+ *      compressed vector only the chunks in the range are decoded.
  *
  * Parameters:
  *      VectorObject *vPtr
@@ -2339,6 +2662,27 @@ Tcl_Obj *Rbc_GetValues(VectorObject *vPtr, Tcl_Size first, Tcl_Size last) {
     Tcl_Obj *listObjPtr;
 
     listObjPtr = Tcl_NewListObj(0, NULL);
+    if (vPtr->chunksPtr != NULL) {
+        double chunkArr[RBC_VECTOR_CHUNK_VALUES];
+
+        /*
+         * Decode one chunk at a time, and only the chunks in the range.
+         */
+        for (i = first; i <= last; /*empty*/) {
+            Tcl_Size j, n;
+
+            n = RBC_VECTOR_CHUNK_VALUES - (i % RBC_VECTOR_CHUNK_VALUES);
+            if (n > last - i + 1) {
+                n = last - i + 1;
+            }
+            Rbc_VectorChunksDecode(vPtr->chunksPtr, i, n, chunkArr);
+            for (j = 0; j < n; j++) {
+                Tcl_ListObjAppendElement(vPtr->interp, listObjPtr, Tcl_NewDoubleObj(chunkArr[j]));
+            }
+            i += n;
+        }
+        return listObjPtr;
+    }
     for (i = first; i <= last; i++) {
         Tcl_ListObjAppendElement(vPtr->interp, listObjPtr, Tcl_NewDoubleObj(vPtr->valueArr[i]));
     }
@@ -2551,6 +2895,12 @@ int Rbc_GetVectorById(Tcl_Interp *interp, Rbc_VectorId clientId, Rbc_Vector **ve
         Rbc_AppendResultStrings(interp, "vector no longer exists", (char *)NULL);
         return TCL_ERROR;
     }
+    if (Rbc_VectorMaterialize(clientPtr->serverPtr) != TCL_OK) {
+        if (interp != clientPtr->serverPtr->interp) {
+            Tcl_SetObjResult(interp, Tcl_GetObjResult(clientPtr->serverPtr->interp));
+        }
+        return TCL_ERROR;
+    }
     Rbc_VectorUpdateRange(clientPtr->serverPtr);
     *vecPtrPtr = (Rbc_Vector *)clientPtr->serverPtr;
     return TCL_OK;
@@ -61,6 +61,8 @@ typedef struct Rbc_Vector_s {
 #define NOTIFY_DESTROYED ((int)RBC_VECTOR_NOTIFY_DESTROY)
 /* The data of the vector has changed.  Update the min and max limits when they are needed */
 #define UPDATE_RANGE (1 << 9)
+/* A do-when-idle compression of the vector's values is pending. */
+#define COMPRESS_PENDING (1 << 10)
 
 #define UCHAR(c) ((unsigned char) (c))
 #define VECTOR_CHAR(c) ((isalnum(UCHAR(c))) || (c == '_') || (c == ':') || (c == '@') || (c == '.'))
@@ -80,6 +82,34 @@ typedef struct {
     unsigned int nextId;
 } VectorInterpData;
 
+/*
+ * Rbc_VectorChunks --
+ *
+ *      Compressed storage of the values of a vector (rbcVecChunk.c).
+ *      Values are kept in chunks of RBC_VECTOR_CHUNK_VALUES values,
+ *      each encoded on its own, followed by a tail of values that do
+ *      not fill a chunk yet.
+ */
+#define RBC_VECTOR_CHUNK_VALUES 1024
+
+typedef struct {
+    unsigned char *bytes; /* Encoded values (malloc-ed). */
+    size_t nBytes;        /* Size of the encoded values. */
+    int encoding;         /* Encoding used for the chunk. */
+    double min, max;      /* Range of the finite values in the chunk.
+                           * min > max if there are none. */
+} Rbc_VectorChunk;
+
+typedef struct {
+    Rbc_VectorChunk *chunkArr; /* Encoded chunks (malloc-ed). */
+    Tcl_Size nChunks;          /* Number of encoded chunks. */
+    Tcl_Size chunkCapacity;    /* Allocated length of chunkArr. */
+    double *tailArr;           /* Values after the last chunk
+                                * (malloc-ed, one chunk long). */
+    Tcl_Size nTail;            /* Number of values in tailArr. */
+    size_t nBytes;             /* Total size of the encoded chunks. */
+} Rbc_VectorChunks;
+
 /*
  *    A vector is an array of double precision values.  It can be
  *    accessed through a Tcl command, a Tcl array variable, or C
@@ -141,6 +171,14 @@ typedef struct {
     int flush;
     Tcl_Size first, last; /* Selected region of vector. This is used
                            * mostly for the math routines */
+    int compressed;       /* If non-zero, the values are compressed
+                           * into chunksPtr whenever the vector is
+                           * idle and has no clients. */
+    Rbc_VectorChunks *chunksPtr; /* If non-NULL, holds the values of the
+                                  * vector and valueArr is NULL. */
+    Tcl_Size changedFirst;       /* Lowest index changed since the
+                                  * clients were last notified.  Values
+                                  * before it are known to be the same. */
 } VectorObject;
 
 typedef struct Rbc_VectorIdStruct *Rbc_VectorId;
@@ -245,6 +283,7 @@ VectorObject *Rbc_VectorParseElement(Tcl_Interp *interp, VectorInterpData *dataP
                                      const char **endPtr, int flags);
 int Rbc_VectorChangeLength(VectorObject *vPtr, Tcl_Size length);
 void Rbc_VectorUpdateClients(VectorObject *vPtr);
+void Rbc_VectorUpdateClientsFrom(VectorObject *vPtr, Tcl_Size first);
 int Rbc_VectorMapVariable(Tcl_Interp *interp, VectorObject *vPtr, const char *name);
 VectorObject *Rbc_VectorCreate(VectorInterpData *dataPtr, const char *vecName, const char *cmdName, const char *varName,
                                int *newPtr);
@@ -263,6 +302,7 @@ void Rbc_VectorUpdateRange(VectorObject *vPtr);
 VectorObject *Rbc_VectorNew(VectorInterpData *dataPtr);
 VectorInterpData *Rbc_VectorGetInterpData(Tcl_Interp *interp);
 int Rbc_VectorNotifyPending(Rbc_VectorId clientId);
+Tcl_Size Rbc_VectorChangedFirst(Rbc_VectorId clientId);
 void Rbc_FreeVectorId(Rbc_VectorId clientId);
 int Rbc_GetVectorById(Tcl_Interp *interp, Rbc_VectorId clientId, Rbc_Vector **vecPtrPtr);
 int Rbc_VectorExists2(Tcl_Interp *interp, const char *vecName);
@@ -278,9 +318,23 @@ char *Rbc_NameOfVector(Rbc_Vector *vecPtr);
 
 int Rbc_ResetVector(Rbc_Vector *vecPtr, double *dataArr, Tcl_Size nValues, Tcl_Size arraySize, Tcl_FreeProc *freeProc);
 
+int Rbc_VectorMaterialize(VectorObject *vPtr);
+void Rbc_VectorCompressWhenIdle(VectorObject *vPtr);
+
 /* Instance Functions Definitions (rbcVecObjCmd.c) */
 Tcl_ObjCmdProc2 Rbc_VectorInstanceObjCmd;
 
+/* Snapshot Files (rbcVecFile.c) */
+Tcl_ObjCmdProc2 Rbc_VectorSaveObjCmd;
+Tcl_ObjCmdProc2 Rbc_VectorLoadObjCmd;
+
+/* Compressed Storage (rbcVecChunk.c) */
+Rbc_VectorChunks *Rbc_VectorChunksCreate(const double *valueArr, Tcl_Size length);
+int Rbc_VectorChunksAppend(Rbc_VectorChunks *storePtr, const double *valueArr, Tcl_Size length);
+void Rbc_VectorChunksDecode(const Rbc_VectorChunks *storePtr, Tcl_Size first, Tcl_Size count, double *valueArr);
+void Rbc_VectorChunksDecodeChunk(const Rbc_VectorChunks *storePtr, Tcl_Size index, double *valueArr);
+void Rbc_VectorChunksFree(Rbc_VectorChunks *storePtr);
+
 /* Vector Math Definitions (rbcVecMath.c) */
 typedef double(ComponentProc)(double value);
 typedef int(VectorProc)(VectorObject *vPtr);
@@ -293,6 +347,32 @@ void Rbc_VectorInstallMathFunctions(Tcl_HashTable *tablePtr);
 void Rbc_VectorInstallSpecialIndices(Tcl_HashTable *tablePtr);
 Tcl_Size *Rbc_VectorSortIndex(VectorObject **vPtrPtr, Tcl_Size nVectors);
 
+/*
+ * Rbc_VectorValueSet --
+ *
+ *      Set of distinct vector values, used by the "unique", "isin" and
+ *      "intersect" operations.  Values are hashed on their IEEE bit
+ *      patterns in an open-addressing table.  Signed zeros and all NaNs
+ *      are normalized, so -0.0 matches 0.0 and any NaN matches any
+ *      other NaN.
+ */
+typedef struct {
+    double *values;    /* Distinct values, in order of first
+                        * insertion. */
+    Tcl_Size *counts;  /* Number of insertions of each value, or
+                        * NULL if counts are not kept. */
+    Tcl_Size nValues;  /* Number of distinct values. */
+    Tcl_Size capacity; /* Allocated length of values and counts. */
+    Tcl_Size *slots;   /* Hash table of indices into values, -1
+                        * marks an empty slot. */
+    size_t mask;       /* Number of slots minus one. */
+} Rbc_VectorValueSet;
+
+int Rbc_VectorValueSetInit(Tcl_Interp *interp, Rbc_VectorValueSet *setPtr, int keepCounts);
+int Rbc_VectorValueSetAdd(Tcl_Interp *interp, Rbc_VectorValueSet *setPtr, const double *valueArr, Tcl_Size length);
+Tcl_Size Rbc_VectorValueSetFind(const Rbc_VectorValueSet *setPtr, double value);
+void Rbc_VectorValueSetFree(Rbc_VectorValueSet *setPtr);
+
 Tcl_Size Rbc_VectorLength(Rbc_Vector *v);
 Tcl_Size Rbc_VectorSize(Rbc_Vector *v);
 